@@ -4,17 +4,46 @@
 // Setup up ADC0 to convert up to 4 channels using SS2
 
 #include <stdint.h>
+#include "ES_PostList.h"
+
+// rate of the shared Timer0A ADC trigger
+#define ADC_SAMPLE_CLOCK_HZ 10000
+// layout of an ADC_MultiGetHalf buffer
+#define ADC_STEPS_PER_RUN 4
+#define ADC_RUNS_PER_HALF 8
+// the readings: PE0 and PE1 the wire sensors, PE2 the battery divider
+#define ADC_NUM_CHANNELS 3
+#define ADC_BATTERY_CHANNEL 2
+
+// called on every run of conversions, ADC_STEPS_PER_RUN 12-bit readings,
+// and may replace them with filtered values
+typedef void (*ADCRunFilter_t)(uint32_t Run[ADC_STEPS_PER_RUN]);
 
 // initialize the A/D converter to convert on 1-4 channels
 void ADC_MultiInit(uint8_t HowMany);
 
 //------------ADC_MultiRead------------
-// Triggers A/D conversion and waits for result
+// Returns the latest readings
 // Input: none
 // Output: up to 4 12-bit result of ADC conversions
-// software trigger, busy-wait sampling, takes about 18.6uS to execute
+// continuous build: the average of the last full half buffer, no waiting
+// otherwise: software trigger, busy-wait sampling, takes about 18.6uS to execute
+// with a run filter set, the filter's output for the latest run instead
 // data returned by reference
 // lowest numbered converted channel is in data[0]
 
 void ADC_MultiRead(uint32_t data[4]);
+// ADC_MultiRead without recording, for interrupt level control loops
+void ADC_MultiPeek(uint32_t data[4]);
+
+// start the shared ADC_SAMPLE_CLOCK_HZ trigger, once
+void ADC_SampleClockInit(void);
+
+// ADC_HALF_READY to PostFunc (0 for none) on every full half buffer
+void ADC_MultiSubscribe(pPostFunc PostFunc);
+// filter every run at the sample rate (0 for none)
+void ADC_MultiSetRunFilter(ADCRunFilter_t Filter);
+// the runs of half buffer 0 or 1
+const uint32_t *ADC_MultiGetHalf(uint8_t Half);
+void ADC_MultiHalfISR(void);
 #endif
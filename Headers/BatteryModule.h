@@ -0,0 +1,22 @@
+/****************************************************************************
+
+  Header file for the battery voltage and the duty cycle feed-forward
+ ****************************************************************************/
+
+#ifndef BatteryModule_H
+#define BatteryModule_H
+
+#include "ES_Types.h"
+
+// the 2S pack the gains were tuned on, and where BATTERY_LOW goes out
+#define BATTERY_NOMINAL_MV 7800
+#define BATTERY_LOW_MV 6600
+
+// Public Function Prototypes
+void InitBattery( void );
+bool Battery_Update( void );
+uint16_t Battery_GetMV( void );
+bool Battery_IsLow( void );
+void Battery_PrintStatus( void );
+
+#endif /* BatteryModule_H */
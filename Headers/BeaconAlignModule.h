@@ -0,0 +1,20 @@
+/****************************************************************************
+
+  Header file for the coarse-to-fine goal beacon sweep
+ ****************************************************************************/
+
+#ifndef BeaconAlignModule_H
+#define BeaconAlignModule_H
+
+#include "ES_Types.h"
+
+// how often the caller feeds Align_Step a fresh IR code
+#define ALIGN_SAMPLE_MS 10
+
+// Public Function Prototypes
+void Align_Start( uint8_t GoalCode, bool Clockwise );
+bool Align_Step( uint8_t Code );
+void Align_Stop( void );
+void Align_PrintStats( void );
+
+#endif /* BeaconAlignModule_H */
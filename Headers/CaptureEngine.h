@@ -0,0 +1,46 @@
+/****************************************************************************
+
+  Header file for the input capture frequency engine
+ ****************************************************************************/
+
+#ifndef CaptureEngine_H
+#define CaptureEngine_H
+
+#include "ES_Types.h"
+
+// one entry per capture channel, described in the Channels table in
+// CaptureEngine.c; numbered as the input recorder channels (REC_CH_)
+typedef enum { CAP_STAGING, CAP_FRONT_IR, CAP_BACK_IR,
+               NUM_CAP_CHANNELS } CaptureChannel_t;
+
+#define CAP_INVALID_CODE 0xff
+
+// wrap a capture ISR body to count its cycles in a CAPTURE_ISR_STATS build
+#if defined(CAPTURE_ISR_STATS)
+#include "ES_Port.h"
+#define CAP_ISR_BEGIN()       uint32_t CapIsrStart = _HW_GetCycleCount()
+#define CAP_ISR_END(Channel)  Capture_RecordIsr(Channel, _HW_GetCycleCount() - CapIsrStart)
+#else
+#define CAP_ISR_BEGIN()
+#define CAP_ISR_END(Channel)
+#endif
+
+// Public Function Prototypes
+void Capture_InitChannel( CaptureChannel_t Channel );
+void Capture_Enable( CaptureChannel_t Channel, bool Enable );
+uint32_t Capture_HandleEdge( CaptureChannel_t Channel );
+uint8_t Capture_HandleInterrupt( CaptureChannel_t Channel );
+uint8_t Capture_ClassifyPeriod( CaptureChannel_t Channel, uint32_t PeriodTicks );
+uint8_t Capture_GetCode( CaptureChannel_t Channel );
+uint8_t Capture_GetConfidence( CaptureChannel_t Channel );
+uint32_t Capture_GetPeriod( CaptureChannel_t Channel, uint8_t Age );
+uint32_t Capture_GetPeriodUS( CaptureChannel_t Channel, uint8_t Age );
+uint32_t Capture_GetLastEdge( CaptureChannel_t Channel );
+void Capture_Forget( CaptureChannel_t Channel );
+#if defined(CAPTURE_ISR_STATS)
+void Capture_RecordIsr( CaptureChannel_t Channel, uint32_t Cycles );
+void Capture_PrintIsrStats( void );
+void Capture_ToggleDMA( void );
+#endif
+
+#endif /* CaptureEngine_H */
@@ -0,0 +1,18 @@
+/****************************************************************************
+
+  Header file for the uDMA control table and ping-pong channel helpers
+ ****************************************************************************/
+
+#ifndef DMAModule_H
+#define DMAModule_H
+
+#include "ES_Types.h"
+
+// Public Function Prototypes
+void InitDMAModule( void );
+void DMA_StartPingPong( uint8_t Channel, uint8_t Encoding, uint32_t SourceAddress,
+                        uint32_t *pBuffer, uint16_t HalfSize, uint32_t ArbSize );
+void DMA_RearmPingPong( uint8_t Channel );
+uint16_t DMA_GetPingPongPosition( uint8_t Channel );
+
+#endif /* DMAModule_H */
@@ -0,0 +1,65 @@
+/****************************************************************************
+
+  Header file for the fixed-point two channel filter stages
+ ****************************************************************************/
+
+#ifndef DSPFilters_H
+#define DSPFilters_H
+
+#include <stdint.h>
+#include "DSP_Intrinsics.h"
+
+// Every stage filters two channels at once: a sample pair is one word with
+// channel 0 in the low and channel 1 in the high int16.
+#define FILTER_PAIR(Ch0, Ch1)  DSP_Pack((Ch0), (Ch1))
+#define FILTER_CH0(Pair)       DSP_LO(Pair)
+#define FILTER_CH1(Pair)       DSP_HI(Pair)
+
+// 12 bit ADC readings are filtered shifted up to 15 bits, so rounding in
+// the stages stays below an ADC count
+#define FILTER_ADC_SHIFT 3
+
+#define FILTER_MAX_MA_SHIFT 4          // up to 16 taps
+#define FILTER_MAX_MEDIAN 7
+
+// y = b0*x0 + b1*x1 + b2*x2 - a1*y1 - a2*y2, all Q14
+typedef struct
+{
+  int16_t b0, b1, b2;
+  int16_t a1, a2;
+} BiquadCoeffs_t;
+
+typedef struct
+{
+  int32_t B0;
+  uint32_t B12;                        // (b1, b2)
+  uint32_t A12;                        // (-a1, -a2)
+  uint32_t X[2];                       // per channel (x1, x2)
+  uint32_t Y[2];                       // per channel (y1, y2)
+  int32_t Error[2];                    // bits rounded off the last output
+} Biquad2_t;
+
+typedef struct
+{
+  uint32_t History[1 << FILTER_MAX_MA_SHIFT];
+  int32_t Sum[2];
+  uint8_t Shift;                       // 2^Shift taps
+  uint8_t Head;
+} MovingAverage2_t;
+
+typedef struct
+{
+  uint32_t History[FILTER_MAX_MEDIAN];
+  uint8_t Length;                      // odd
+  uint8_t Head;
+} Median2_t;
+
+// Public Function Prototypes
+void Biquad2_Init( Biquad2_t *pFilter, const BiquadCoeffs_t *pCoeffs );
+uint32_t Biquad2_Step( Biquad2_t *pFilter, uint32_t In );
+void MovingAverage2_Init( MovingAverage2_t *pFilter, uint8_t Shift );
+uint32_t MovingAverage2_Step( MovingAverage2_t *pFilter, uint32_t In );
+void Median2_Init( Median2_t *pFilter, uint8_t Length );
+uint32_t Median2_Step( Median2_t *pFilter, uint32_t In );
+
+#endif /* DSPFilters_H */
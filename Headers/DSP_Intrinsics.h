@@ -0,0 +1,94 @@
+/****************************************************************************
+
+  Fixed-point multiplies and the SIMD pair instructions of the Cortex-M4
+  DSP extension, with plain C versions for the Cortex-M3 QEMU build and
+  the host that give the same bits
+ ****************************************************************************/
+
+#ifndef DSP_Intrinsics_H
+#define DSP_Intrinsics_H
+
+#include <stdint.h>
+
+// the high word of a*b, for a Q31 (or Q30...) coefficient times a sample
+// or filter state: SMMUL
+#if defined(__CC_ARM)
+static __inline int32_t DSP_MulHigh( int32_t a, int32_t b )
+{
+  int32_t Result;
+  __asm { SMMUL Result, a, b }
+  return Result;
+}
+#elif defined(__GNUC__) && defined(__ARM_FEATURE_DSP)
+static inline int32_t DSP_MulHigh( int32_t a, int32_t b )
+{
+  int32_t Result;
+  __asm ("smmul %0, %1, %2" : "=r" (Result) : "r" (a), "r" (b));
+  return Result;
+}
+#else
+static inline int32_t DSP_MulHigh( int32_t a, int32_t b )
+{
+  return (int32_t)(((int64_t)a*b) >> 32);
+}
+#endif
+
+// Acc + a*b into 64 bits, which every compiler here makes one SMLAL of
+#if defined(__CC_ARM)
+static __inline int64_t DSP_MulAcc64( int64_t Acc, int32_t a, int32_t b )
+#else
+static inline int64_t DSP_MulAcc64( int64_t Acc, int32_t a, int32_t b )
+#endif
+{
+  return Acc + (int64_t)a*b;
+}
+
+// Two int16 halves of a word: the SIMD multiplies below take a pair of
+// samples, or of coefficients, packed this way.
+#define DSP_LO(Pair) ((int16_t)((Pair) & 0xffff))
+#define DSP_HI(Pair) ((int16_t)((uint32_t)(Pair) >> 16))
+
+#if defined(__CC_ARM)
+// (Lo, Hi) into one word: PKHBT
+#define DSP_Pack(Lo, Hi)        ((uint32_t)__pkhbt((Lo), (Hi), 16))
+// lo*lo + hi*hi + Acc, the dual 16 bit multiply accumulate: SMLAD
+#define DSP_Smlad(x, y, Acc)    __smlad((x), (y), (Acc))
+// a clamped to int16: SSAT #16
+#define DSP_Sat16(a)            __ssat((a), 16)
+#elif defined(__GNUC__) && defined(__ARM_FEATURE_DSP)
+static inline uint32_t DSP_Pack( int32_t Lo, int32_t Hi )
+{
+  uint32_t Result;
+  __asm ("pkhbt %0, %1, %2, lsl #16" : "=r" (Result) : "r" (Lo), "r" (Hi));
+  return Result;
+}
+static inline int32_t DSP_Smlad( uint32_t x, uint32_t y, int32_t Acc )
+{
+  int32_t Result;
+  __asm ("smlad %0, %1, %2, %3" : "=r" (Result) : "r" (x), "r" (y), "r" (Acc));
+  return Result;
+}
+static inline int32_t DSP_Sat16( int32_t a )
+{
+  int32_t Result;
+  __asm ("ssat %0, #16, %1" : "=r" (Result) : "r" (a));
+  return Result;
+}
+#else
+static inline uint32_t DSP_Pack( int32_t Lo, int32_t Hi )
+{
+  return ((uint32_t)Lo & 0xffff) | ((uint32_t)Hi << 16);
+}
+static inline int32_t DSP_Smlad( uint32_t x, uint32_t y, int32_t Acc )
+{
+  // wraps as the instruction does (it only sets the Q flag)
+  return (int32_t)((uint32_t)Acc + (uint32_t)(DSP_LO(x)*DSP_LO(y)) +
+                   (uint32_t)(DSP_HI(x)*DSP_HI(y)));
+}
+static inline int32_t DSP_Sat16( int32_t a )
+{
+  return (a > INT16_MAX) ? INT16_MAX : ((a < INT16_MIN) ? INT16_MIN : a);
+}
+#endif
+
+#endif /* DSP_Intrinsics_H */
@@ -301,8 +301,25 @@ typedef enum {  ES_NO_EVENT = 0,
 								GoalAligned,
 								BucketAligned,
 								ReloadingGoalAligned,
-								ShotComplete
+								ShotComplete,
+								/* Hall effect capture events */
+								STATION_LOST,
+								/* ADC0 half buffer of samples ready, param is the half */
+								ADC_HALF_READY,
+								/* wheel ramp done: stopped, or at speed when untimed */
+								MOTION_COMPLETE,
+								/* flywheel held at its target RPM, param is the RPM */
+								FLYWHEEL_AT_SPEED,
+								/* servo move finished, param is the pulse width in uS */
+								SERVO_MOVE_DONE,
+								/* IR pulse train sent, param is the number of pulses */
+								IR_PULSES_DONE,
+								/* filtered battery under BATTERY_LOW_MV, param is the mV */
+								BATTERY_LOW,
+								/* beacon sweep gave up, param is the degrees turned */
+								ALIGN_FAILED,
 								
+                NUM_ES_EVENTS /* must stay last: sizes the statechart tables */
                 } ES_EventTyp_t ;
 
 /****************************************************************************/
@@ -341,7 +358,7 @@ typedef enum {  ES_NO_EVENT = 0,
 
 /****************************************************************************/
 // This is the list of event checking functions 
-#define EVENT_CHECK_LIST Check4Keystroke
+#define EVENT_CHECK_LIST Check4Keystroke, Check4BatteryLow
 
 /****************************************************************************/
 // These are the definitions for the post functions to be executed when the
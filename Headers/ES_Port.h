@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include "inc/hw_types.h"
 #include "termio.h"
 #include "bitdefs.h"       /* generic bit defs (BIT0HI, BIT0LO,...) */
 #include "Bin_Const.h"     /* macros to specify binary constants in C */
@@ -65,6 +66,29 @@ void CPUsetPRIMASK(uint32_t newPRIMASK);
 #define EnterCritical()	{ _PRIMASK_temp = CPUgetPRIMASK_cpsid(); }
 #define ExitCritical() { CPUsetPRIMASK(_PRIMASK_temp); }
 
+// marks the places in the queue code where interrupts are enabled so the
+// ES_Queue.c stress harness (QUEUE_STRESS) can fire a simulated ISR there;
+// compiles to nothing otherwise
+#if defined(QUEUE_STRESS)
+void QueueStress_Preempt(void);
+#define ES_PREEMPTION_POINT() QueueStress_Preempt()
+#else
+#define ES_PREEMPTION_POINT()
+#endif
+
+// the DWT cycle counter of the Cortex-M4 counts CPU clocks, for timing short
+// stretches of code: Start = _HW_GetCycleCount(); ... ; _HW_GetCycleCount()-Start
+#define ES_DEMCR          0xE000EDFC   // debug exception & monitor control
+#define ES_DEMCR_TRCENA   0x01000000   // enables the DWT
+#define ES_DWT_CTRL       0xE0001000
+#define ES_DWT_CYCCNTENA  0x00000001
+#define ES_DWT_CYCCNT     0xE0001004
+
+#define _HW_CycleCounterInit() { HWREG(ES_DEMCR) |= ES_DEMCR_TRCENA; \
+                                 HWREG(ES_DWT_CYCCNT) = 0; \
+                                 HWREG(ES_DWT_CTRL) |= ES_DWT_CYCCNTENA; }
+#define _HW_GetCycleCount()    (HWREG(ES_DWT_CYCCNT))
+
 
 /* Rate constants for programming the SysTick Period to generate tick interrupts.
    These assume an 40MHz configuration, they are the values to be used to program
@@ -91,13 +115,25 @@ typedef enum {	ES_Timer_RATE_OFF  	=   (0),
 // map the generic functions for testing the serial port to actual functions 
 // for this platform. If the C compiler does not provide functions to test
 // and retrieve serial characters, you should write them in ES_Port.c
+// With RECORD_INPUTS/REPLAY_INPUTS the keystrokes go through InputRecorder
+#if defined(REPLAY_INPUTS)
+#include "InputRecorder.h"
+#define IsNewKeyReady()  InputRec_ReplayKeyReady()
+#define GetNewKey()      InputRec_ReplayKey()
+#elif defined(RECORD_INPUTS)
+#include "InputRecorder.h"
+#define IsNewKeyReady()  ( kbhit() != 0 )
+#define GetNewKey()      InputRec_RecordKey(getchar())
+#else
 #define IsNewKeyReady()  ( kbhit() != 0 )
 #define GetNewKey()      getchar()
+#endif
 
 // prototypes for the hardware specific routines
 void _HW_Timer_Init(TimerRate_t Rate);
 bool _HW_Process_Pending_Ints( void );
 uint16_t _HW_GetTickCount(void);
+uint32_t _HW_GetLongTickCount(void);
 void ConsoleInit(void);
 // and the one Framework function that we define here
 uint16_t ES_Timer_GetTime(void);
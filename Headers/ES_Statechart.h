@@ -0,0 +1,40 @@
+/****************************************************************************
+ Module
+     ES_Statechart.h
+ Description
+     Types shared by the table driven state machines that
+     Tools/StatechartGen.py emits. Each generated machine owns a
+     [NUM_<MACHINE>_STATES][NUM_ES_EVENTS] array of ES_SCTransition_t so that
+     finding the transition for (CurrentState, EventType) is one indexed load.
+ Notes
+     An all-zero entry means "no transition on this event in this state";
+     the generator writes out only the transitions, with designated
+     initializers, and leaves the rest zero.
+*****************************************************************************/
+
+#ifndef ES_STATECHART_H
+#define ES_STATECHART_H
+
+#include "ES_Types.h"
+#include "ES_Events.h"
+
+// bits for ES_SCTransition_t.Flags
+#define SC_TAKEN      0x01  /* this entry holds a transition */
+#define SC_INTERNAL   0x02  /* consume the event without exit/entry */
+#define SC_HISTORY    0x04  /* enter the target with ES_ENTRY_HISTORY */
+#define SC_PASS       0x08  /* do not consume, pass the event up a level */
+#define SC_GUARDED    0x10  /* EventParam must equal Param */
+
+typedef struct
+{
+  uint8_t  NextState;
+  uint8_t  Flags;
+  uint16_t Param;
+} ES_SCTransition_t;
+
+#define SC_NO_TRANSITION { 0, 0, 0 }
+
+// During functions are exported by the hand written module in state order
+typedef ES_Event (*ES_SCDuring_t)( ES_Event );
+
+#endif /* ES_STATECHART_H */
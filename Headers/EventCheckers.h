@@ -22,5 +22,6 @@
 // prototypes for event checkers
 bool Check4Keystroke(void);
 bool Check4Button( void );
+bool Check4BatteryLow( void );
 
 #endif /* EventCheckers_H */
@@ -0,0 +1,28 @@
+/****************************************************************************
+
+  Header file for the flywheel tachometer and speed loop
+ ****************************************************************************/
+
+#ifndef FlywheelModule_H
+#define FlywheelModule_H
+
+#include "ES_Types.h"
+
+#define FLY_RATE_HZ 100
+
+// Public Function Prototypes
+void InitFlywheel( void );
+void Fly_SetTargetRPM( uint16_t RPM );
+void Fly_LimitForSupply( uint16_t SupplyMV );
+uint16_t Fly_TargetRPMForStage( uint8_t StagingArea );
+uint16_t Fly_GetRPM( void );
+bool Fly_IsAtSpeed( void );
+void Fly_MarkShot( void );
+void FlywheelTachISR( void );
+void FlywheelControlISR( void );
+void Fly_PrintStats( void );
+#if defined(REPLAY_INPUTS)
+void Fly_ReplayAtSpeed( void );
+#endif
+
+#endif /* FlywheelModule_H */
@@ -18,5 +18,9 @@ void StagingAreaISR( void );
 // uint16_t GetStagingAreaCode( void );
 uint8_t GetStagingAreaCodeSingle( uint16_t thePeriod );
 uint8_t GetStagingAreaCodeArray(void);
+uint8_t GetStagingAreaConfidence(void);
+void StagingAreaLostISR( void );
+void MarkStagingAreaStop( void );
+void PrintStagingAreaLatency( void );
 
 #endif /* HallEffectModule_H */
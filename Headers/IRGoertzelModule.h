@@ -0,0 +1,26 @@
+/****************************************************************************
+
+  Header file for the Goertzel IR beacon detector
+ ****************************************************************************/
+
+#ifndef IRGoertzelModule_H
+#define IRGoertzelModule_H
+
+#include "ES_Types.h"
+
+// beacons are numbered as the IR codes, 1250Hz (0) to 2200Hz (4)
+#define NUM_IR_BEACONS 5
+#define IR_GOERTZEL_NONE 0xff
+
+// Public Function Prototypes
+void InitIRGoertzel( void );
+void EnableIRGoertzel( bool Enable );
+bool IRGoertzel_IsEnabled( void );
+void IRGoertzelSampleISR( void );
+uint16_t IRGoertzel_GetAmplitude( uint8_t Beacon );
+uint8_t IRGoertzel_GetDetected( void );
+uint8_t IRGoertzel_GetStrongest( void );
+uint16_t IRGoertzel_GetFrameNumber( void );
+void IRGoertzel_PrintFrame( void );
+
+#endif /* IRGoertzelModule_H */
@@ -0,0 +1,78 @@
+/****************************************************************************
+
+  Header file for the input recorder
+
+  Build with RECORD_INPUTS defined to log every nondeterministic input into
+  a RAM buffer ('r' on the console dumps it). Build the host replay harness
+  (Host/ReplayMain.c) with REPLAY_INPUTS defined to feed a dumped log back
+  through the same code with virtual time. With neither defined the REC_
+  macros reduce to the plain hardware reads.
+ ****************************************************************************/
+
+#ifndef InputRecorder_H
+#define InputRecorder_H
+
+#include "ES_Types.h"
+
+// input capture channels that are logged
+#define REC_CH_STAGING   0
+#define REC_CH_FRONT_IR  1
+#define REC_CH_BACK_IR   2
+#define REC_NUM_CHANNELS 3
+
+// interrupts that carry no data but have to fire at the same point on replay;
+// the ones that post from a periodic ISR the host never runs are replayed as
+// the post (Host/ReplayMain.c has the table)
+#define REC_IRQ_SSI_EOT     0
+#define REC_IRQ_GAME_TIMER  1
+#define REC_IRQ_GET_AWAY    2
+#define REC_IRQ_STATION_LOST 3
+#define REC_IRQ_FLY_AT_SPEED 4
+#define REC_IRQ_SERVO_DONE  5
+#define REC_IRQ_IR_PULSES_DONE 6
+#define REC_NUM_IRQS        7
+
+// REC_QEI takes both wheel encoder positions, as read in one OdometryISR
+// tick, and on replay overwrites them with the recorded ones
+#if defined(REPLAY_INPUTS)
+#define REC_CAPTURE(Channel, HwValue) InputRec_ReplayCapture(Channel)
+#define REC_SSI_BYTE(HwValue)         InputRec_ReplaySSIByte()
+#define REC_IRQ(Source)
+#define REC_QEI(Counts)               InputRec_ReplayQEI(Counts)
+#elif defined(RECORD_INPUTS)
+#define REC_CAPTURE(Channel, HwValue) InputRec_RecordCapture(Channel, HwValue)
+#define REC_SSI_BYTE(HwValue)         InputRec_RecordSSIByte(HwValue)
+#define REC_IRQ(Source)               InputRec_RecordIRQ(Source)
+#define REC_QEI(Counts)               InputRec_RecordQEI(Counts)
+#else
+#define REC_CAPTURE(Channel, HwValue) (HwValue)
+#define REC_SSI_BYTE(HwValue)         (HwValue)
+#define REC_IRQ(Source)
+#define REC_QEI(Counts)
+#endif
+
+// Public Function Prototypes
+#if defined(RECORD_INPUTS)
+uint32_t InputRec_RecordCapture( uint8_t Channel, uint32_t Value );
+uint8_t InputRec_RecordSSIByte( uint8_t Value );
+void InputRec_RecordIRQ( uint8_t Source );
+void InputRec_RecordQEI( const int32_t Counts[2] );
+void InputRec_RecordADC( const uint32_t Data[], uint8_t HowMany );
+int InputRec_RecordKey( int Key );
+void InputRec_RecordTick( void );
+void InputRec_Dump( void );
+#endif
+
+#if defined(REPLAY_INPUTS)
+bool InputRec_LoadLog( const uint8_t *pLog, uint32_t Length );
+bool InputRec_ReplayTick( void );
+uint32_t InputRec_ReplayCapture( uint8_t Channel );
+uint8_t InputRec_ReplaySSIByte( void );
+void InputRec_ReplayQEI( int32_t Counts[2] );
+void InputRec_ReplayADC( uint32_t Data[], uint8_t HowMany );
+bool InputRec_ReplayKeyReady( void );
+int InputRec_ReplayKey( void );
+uint32_t InputRec_ReplayedTicks( void );
+#endif
+
+#endif /* InputRecorder_H */
@@ -13,6 +13,7 @@
 #include "ES_Types.h"     /* gets bool type for returns */
 
 // Public Function Prototypes
+void InitLEDs(void);
 void TurnOnOffYellowLEDs(bool ONorOFF, bool TeamColor);
 void TurnOnOffBlueLEDs(bool ONorOFF, bool TeamColor);
 void TurnOnOFFTeamColorLEDs(bool ONorOFF, bool TeamColor);
@@ -12,10 +12,26 @@
 #include "ES_Configure.h" /* gets us event definitions */
 #include "ES_Types.h"     /* gets bool type for returns */
 #include "ES_Events.h" 
+#include "PWMmodule.h"   /* DriveMode_t */
+
+#define MOTOR_PROFILE_RATE_HZ 1000
+// how long brakeStop() brakes before coasting when stopping from speed
+#define MOTOR_STOP_BRAKE_MS 80
 
 // Public Function Prototypes
+void InitMotorActions(void);
+void SetMotorProfile(uint16_t AccelPercentPerS, uint16_t DecelPercentPerS);
 void start2rotate(bool rotationDirection, uint8_t DutyCycle);
+void rotateInPlace(bool rotationDirection, uint8_t DutyCycle, uint16_t TimeMS);
+void driveStraight(uint8_t DutyCycle, bool direction, uint16_t TimeMS);
+void driveArc(uint8_t LeftDutyCycle, uint8_t RightDutyCycle, bool direction, uint16_t TimeMS);
 void stop(void);
+void brakeStop(uint16_t BrakeMS);
 void driveSeperate(uint8_t LeftDutyCycle, uint8_t RightDutyCycle, bool direction);
+void driveDecay(uint8_t LeftDutyCycle, uint8_t RightDutyCycle, bool direction, DriveMode_t Mode);
+void driveSpeed(int16_t LeftMMPerS, int16_t RightMMPerS);
+void MotorActions_SpeedTick(int16_t LeftMMPerS, int16_t RightMMPerS);
+void MotorProfileISR(void);
+void MotorActions_PrintStats(void);
 
 #endif /* MotorActionsModule_H */
@@ -0,0 +1,36 @@
+/****************************************************************************
+
+  Header file for the wheel encoders and dead reckoning
+ ****************************************************************************/
+
+#ifndef OdometryModule_H
+#define OdometryModule_H
+
+#include "ES_Types.h"
+
+#define ODO_RATE_HZ 100
+// between the wheels' contact patches, configuration not yet measured on
+// the robot
+#define ODO_TRACK_MM 230.0f
+
+// where the robot is from where Odo_ResetPose was called: mm along its
+// heading then, mm to its left, and radians turned counterclockwise
+typedef struct
+{
+  float X;
+  float Y;
+  float Heading;
+} Pose_t;
+
+// Public Function Prototypes
+void InitOdometry( void );
+int32_t Odo_GetCount( bool wheelSide );
+int32_t Odo_GetDistanceMM( bool wheelSide );
+int16_t Odo_GetSpeed( bool wheelSide );
+void Odo_GetPose( Pose_t *pPose );
+void Odo_ResetPose( void );
+void Odo_MarkStop( bool Braking );
+void OdometryISR( void );
+void Odo_PrintStatus( void );
+
+#endif /* OdometryModule_H */
@@ -12,13 +12,31 @@
 #include "ES_Configure.h" /* gets us event definitions */
 #include "ES_Types.h"     /* gets bool type for returns */
 
+// what the H-bridge does between the pulses of a drive wheel
+typedef enum
+{
+	DRIVE_FAST_DECAY,   // coasts, 0% is a coast stop
+	DRIVE_SLOW_DECAY,   // brakes, 0% is a brake
+	DRIVE_BRAKE         // both inputs high, whatever the duty cycle
+} DriveMode_t;
+
 // Public Function Prototypes
 void InitializePWM(void);
 void InitializeAltPWM(void);
-void SetPWMDutyCycle(uint8_t DutyCycle, bool direction, bool wheelSide);
+void SetDriveDutyCycles(uint8_t LeftDutyCycle, bool LeftDirection,
+                        uint8_t RightDutyCycle, bool RightDirection, DriveMode_t Mode);
+void StageDriveDutyCycles(uint8_t LeftDutyCycle, bool LeftDirection,
+                          uint8_t RightDutyCycle, bool RightDirection, DriveMode_t Mode);
+void DrivePeriodISR( void );
 void SetPWMPeriodUS(uint16_t Period);
 void EmitIR( bool OnOrOff );
-void SetServoDuty(uint16_t DutyCycle);
+void EmitIRPulses( uint8_t Count, uint16_t FrequencyHz, uint8_t DutyCycle );
+bool IRPulsesBusy( void );
+void IRPulseISR( void );
+#if defined(REPLAY_INPUTS)
+void ReplayIRPulsesDone( void );
+#endif
 void SetFlyDuty(uint16_t DutyCycle);
+void SetPWMSupplyScale(uint16_t Scale);
 
 #endif /* PWMmodule_H */
@@ -14,7 +14,8 @@
 
 // typedefs for the states
 // State definitions for use with the query function
-typedef enum { REQUESTING_BALL, WAITING4BALL } ReloadingState_t;
+// (generated from Tools/Statecharts/ReloadingSubSM.yaml)
+#include "ReloadingSubSM_States.h"
 
 // Public Function Prototypes
 
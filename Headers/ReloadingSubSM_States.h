@@ -0,0 +1,14 @@
+/****************************************************************************
+ ReloadingSubSM_States.h
+ GENERATED by Tools/StatechartGen.py from ReloadingSubSM.yaml -- do not edit
+ ****************************************************************************/
+
+#ifndef ReloadingSubSM_States_H
+#define ReloadingSubSM_States_H
+
+// State definitions for use with the query function
+typedef enum { REQUESTING_BALL, WAITING4BALL } ReloadingState_t;
+
+#define NUM_RELOADING_STATES 2
+
+#endif /* ReloadingSubSM_States_H */
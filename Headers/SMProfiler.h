@@ -0,0 +1,24 @@
+/****************************************************************************
+
+  Header file for the state machine profiler
+ ****************************************************************************/
+
+#ifndef SMProfiler_H
+#define SMProfiler_H
+
+#include "ES_Configure.h" /* gets us event definitions */
+#include "ES_Types.h"
+
+// one entry per profiled machine; sub-machines name their parent state
+// in the ParentState table in SMProfiler.c
+typedef enum { PROF_ROBOT_TOP, PROF_CHECKING_IN, PROF_SHOOTING, PROF_RELOADING,
+               NUM_PROF_MACHINES } ProfMachine_t;
+
+// Public Function Prototypes
+void SMProf_Enter( ProfMachine_t Machine, uint8_t State );
+void SMProf_Transition( ProfMachine_t Machine, uint8_t From, uint8_t To,
+                        ES_EventTyp_t Event );
+void SMProf_Dump( void );
+void SMProf_Reset( void );
+
+#endif /* SMProfiler_H */
@@ -20,6 +20,7 @@ bool InitSPIService ( uint8_t );
 ES_Event RunSPIService( ES_Event );
 bool PostSPIService( ES_Event );
 uint16_t getCommand(void);
+void SPI_InterruptResponse( void );
 
 
 #endif /* SPIService_H */
@@ -0,0 +1,42 @@
+/****************************************************************************
+
+  Header file for the ball separator servo
+ ****************************************************************************/
+
+#ifndef ServoModule_H
+#define ServoModule_H
+
+#include "ES_Types.h"
+
+#define SERVO_RATE_HZ 50
+#define SERVO_MAX_SEGMENTS 4
+
+// separator gate widths. The separator is a positional servo, a width is a
+// gate angle: it is held at SEPARATOR_CLOSED_US from start up and between
+// feeds, so every move eases from a known width. The two angles are
+// placeholders to be tuned on the robot.
+#define SEPARATOR_CLOSED_US 1500
+#define SEPARATOR_OPEN_US 1000
+
+// one leg of a move: get to PulseUS in TimeMS, a hold if it is already there
+typedef struct
+{
+  uint16_t PulseUS;
+  uint16_t TimeMS;
+} ServoSegment_t;
+
+// Public Function Prototypes
+void InitServo( void );
+void Servo_SetEndpoints( uint16_t MinUS, uint16_t MaxUS );
+void Servo_SetPulseUS( uint16_t PulseUS );
+void Servo_Off( void );
+void Servo_MoveTo( uint16_t PulseUS, uint16_t TimeMS );
+void Servo_Run( const ServoSegment_t *pSegments, uint8_t NumSegments );
+bool Servo_IsMoving( void );
+uint16_t Servo_GetPulseUS( void );
+void ServoPeriodISR( void );
+#if defined(REPLAY_INPUTS)
+void Servo_ReplayMoveDone( void );
+#endif
+
+#endif /* ServoModule_H */
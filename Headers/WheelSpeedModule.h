@@ -0,0 +1,43 @@
+/****************************************************************************
+
+  Header file for the fixed-point PI wheel speed controller
+ ****************************************************************************/
+
+#ifndef WheelSpeedModule_H
+#define WheelSpeedModule_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// steps a second the gains are for, the odometry tick
+#define WHEEL_SPEED_RATE_HZ 100
+
+// commands are Q15 fractions of 100% duty, negative backward
+#define WHEEL_FULL_DUTY 32768
+
+// gain in Q16, Q15 duty per mm/s, from duty percent per mm/s
+#define WHEEL_GAIN(PercentPerMMPerS) \
+  ((int32_t)((PercentPerMMPerS)*WHEEL_FULL_DUTY/100.0*(1 << 16)))
+
+typedef struct
+{
+  int32_t Kff;                         // feed forward, duty per mm/s of target
+  int32_t Kp;                          // duty per mm/s of error
+  int32_t Ki;                          // duty per mm/s of error, every step
+  int32_t IntegralLimit;               // Q15 duty
+} WheelGains_t;
+
+typedef struct
+{
+  const WheelGains_t *pGains;
+  int32_t Integral;                    // Q15 duty
+} WheelPI_t;
+
+// the robot's gains, tuned on the wheel model of the TEST build
+extern const WheelGains_t WheelDefaultGains;
+
+// Public Function Prototypes
+void WheelPI_Init( WheelPI_t *pPI, const WheelGains_t *pGains );
+int32_t WheelPI_Step( WheelPI_t *pPI, int32_t TargetMMPerS, int32_t MeasuredMMPerS );
+
+#endif /* WheelSpeedModule_H */
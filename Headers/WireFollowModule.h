@@ -0,0 +1,20 @@
+/****************************************************************************
+
+  Header file for the 1kHz wire following control loop
+ ****************************************************************************/
+
+#ifndef WireFollowModule_H
+#define WireFollowModule_H
+
+#include "ES_Types.h"
+
+#define WIRE_FOLLOW_RATE_HZ 1000
+
+// Public Function Prototypes
+void InitWireFollow( void );
+void EnableWireFollow( bool Enable );
+void SetWireFollowSpeed( uint8_t DutyCycle );
+void WireFollowControlISR( void );
+void WireFollow_PrintStats( void );
+
+#endif /* WireFollowModule_H */
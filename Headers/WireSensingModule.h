@@ -13,5 +13,6 @@
 // Public Function Prototypes
 void InitRLCSensor( void );
 void ReadRLCSensor(int RLCReading[2]);
+void PeekRLCSensor(int RLCReading[2]);
 
 #endif 
@@ -0,0 +1,91 @@
+/****************************************************************************
+HostShim
+	Just enough of the TM4C123 and TivaWare driverlib for the firmware to run
+	as a host program (see Host/ReplayMain.c).
+
+	HWREG() is redirected here by Host/inc/hw_types.h. Every register address
+	gets a 32 bit cell the first time it is touched, so read-modify-write
+	sequences behave; the peripheral-ready (SYSCTL PRxxx) block reads back as
+	all ones so the "wait for the clock" loops fall straight through, and
+	the shift register's SSI1 status reads as an empty transmit FIFO.
+	The driverlib calls the firmware makes are no-ops.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "inc/hw_types.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define NumRegisters 4096           // power of 2, open addressing
+#define PRBlockStart 0x400FEA00
+#define PRBlockEnd   0x400FEAFF
+// SSI1 SR: TFE and TNF
+#define SSI1Status   0x4000900C
+#define SSIReady     0x00000003
+
+/*---------------------------- Module Variables ---------------------------*/
+static uint32_t RegAddress[NumRegisters];
+static volatile uint32_t RegValue[NumRegisters];
+static bool RegUsed[NumRegisters];
+
+/*------------------------------ Module Code ------------------------------*/
+volatile uint32_t *HostReg(uint32_t Address)
+{
+  uint32_t Slot = (Address >> 2) * 2654435761u;
+  uint32_t Probe;
+
+  for (Probe = 0; Probe < NumRegisters; Probe++)
+  {
+    uint32_t i = (Slot + Probe) & (NumRegisters - 1);
+    if (!RegUsed[i])
+    {
+      RegUsed[i] = true;
+      RegAddress[i] = Address;
+      RegValue[i] = ((Address >= PRBlockStart) && (Address <= PRBlockEnd)) ? 0xffffffff :
+                    ((Address == SSI1Status) ? SSIReady : 0);
+      return &RegValue[i];
+    }
+    if (RegAddress[i] == Address)
+    {
+      return &RegValue[i];
+    }
+  }
+  fprintf(stderr, "HostShim: register file full at 0x%08lx\n", (unsigned long)Address);
+  exit(2);
+}
+
+// interrupt masking, nothing preempts on the host (_PRIMASK_temp itself
+// lives in ES_Queue.c)
+uint32_t CPUgetPRIMASK_cpsid(void) { return 0; }
+void CPUsetPRIMASK(uint32_t newPRIMASK) { (void)newPRIMASK; }
+void __enable_irq(void) { }
+void __disable_irq(void) { }
+
+// driverlib entry points used by the firmware
+void SysCtlClockSet(uint32_t ui32Config) { (void)ui32Config; }
+void SysCtlPeripheralEnable(uint32_t ui32Peripheral) { (void)ui32Peripheral; }
+void GPIOPinConfigure(uint32_t ui32PinConfig) { (void)ui32PinConfig; }
+void GPIOPinTypeUART(uint32_t ui32Port, uint8_t ui8Pins) { (void)ui32Port; (void)ui8Pins; }
+void GPIOPinTypeGPIOOutput(uint32_t ui32Port, uint8_t ui8Pins) { (void)ui32Port; (void)ui8Pins; }
+void GPIOPinWrite(uint32_t ui32Port, uint8_t ui8Pins, uint8_t ui8Val)
+{ (void)ui32Port; (void)ui8Pins; (void)ui8Val; }
+void IntEnable(uint32_t ui32Interrupt) { (void)ui32Interrupt; }
+bool IntMasterEnable(void) { return false; }
+void SysTickPeriodSet(uint32_t ui32Period) { (void)ui32Period; }
+void SysTickIntEnable(void) { }
+void SysTickEnable(void) { }
+void TimerConfigure(uint32_t ui32Base, uint32_t ui32Config) { (void)ui32Base; (void)ui32Config; }
+void TimerEnable(uint32_t ui32Base, uint32_t ui32Timer) { (void)ui32Base; (void)ui32Timer; }
+void TimerIntClear(uint32_t ui32Base, uint32_t ui32IntFlags) { (void)ui32Base; (void)ui32IntFlags; }
+void TimerIntEnable(uint32_t ui32Base, uint32_t ui32IntFlags) { (void)ui32Base; (void)ui32IntFlags; }
+void TimerLoadSet(uint32_t ui32Base, uint32_t ui32Timer, uint32_t ui32Value)
+{ (void)ui32Base; (void)ui32Timer; (void)ui32Value; }
+void TimerPrescaleSet(uint32_t ui32Base, uint32_t ui32Timer, uint32_t ui32Value)
+{ (void)ui32Base; (void)ui32Timer; (void)ui32Value; }
+void UARTClockSourceSet(uint32_t ui32Base, uint32_t ui32Source) { (void)ui32Base; (void)ui32Source; }
+void UARTStdioConfig(uint32_t ui32PortNum, uint32_t ui32Baud, uint32_t ui32SrcClock)
+{ (void)ui32PortNum; (void)ui32Baud; (void)ui32SrcClock; }
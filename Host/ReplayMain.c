@@ -0,0 +1,150 @@
+/****************************************************************************
+ReplayMain
+	Host harness that replays an input log captured with a RECORD_INPUTS
+	build ('r' on the console) through the application with virtual time.
+	The firmware's console output goes to stdout, so two replays of the same
+	log can be diffed to check a change for regressions.
+
+ Build (from the repo root, TIVAWARE pointing at TivaWare_C_Series-2.1.0.12573)
+	gcc -std=c99 -O2 -DREPLAY_INPUTS -DPART_TM4C123GH6PM \
+	    -IHost -IHeaders -I$TIVAWARE -o replay \
+	    Host/HostShim.c Host/ReplayMain.c \
+	    $(ls Source/[A-Z]*.c | grep -v Template) -lm
+	(the lower case sources, main.c and the UART console, stay out)
+ Run
+	./replay console_capture.txt
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "InputRecorder.h"
+#include "HallEffectModule.h"
+#include "SPIService.h"
+#include "RobotTopSM.h"
+#include "FlywheelModule.h"
+#include "ServoModule.h"
+#include "PWMmodule.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define MaxLogSize (1024*1024)
+
+/*---------------------------- Module Functions ---------------------------*/
+static long ReadHexLog( FILE *pFile, uint8_t *pLog, long MaxSize );
+
+/*---------------------------- Module Variables ---------------------------*/
+// what each REC_IRQ_ source runs on replay: the ISR itself, or for a post
+// from a periodic ISR that never runs here, the module's stand-in for it
+typedef void ReplayISR_t( void );
+static ReplayISR_t * const IRQs[REC_NUM_IRQS] =
+  { SPI_InterruptResponse, GameTimerISR, GetAwayISR, StagingAreaLostISR,
+    Fly_ReplayAtSpeed, Servo_ReplayMoveDone, ReplayIRPulsesDone };
+
+static uint8_t Log[MaxLogSize];
+static clock_t StartTime;
+
+/*------------------------------ Module Code ------------------------------*/
+int main(int argc, char *argv[])
+{
+  FILE *pFile;
+  long Length;
+
+  if (argc != 2)
+  {
+    fprintf(stderr, "usage: %s capture.txt\n", argv[0]);
+    return 2;
+  }
+  pFile = fopen(argv[1], "r");
+  if (pFile == NULL)
+  {
+    perror(argv[1]);
+    return 2;
+  }
+  Length = ReadHexLog(pFile, Log, MaxLogSize);
+  fclose(pFile);
+  if ((Length <= 0) || !InputRec_LoadLog(Log, (uint32_t)Length))
+  {
+    fprintf(stderr, "%s: no REC BEGIN/REC END block with a valid log\n", argv[1]);
+    return 2;
+  }
+
+  StartTime = clock();
+  if (ES_Initialize(ES_Timer_RATE_1mS) == Success)
+  {
+    ES_Run();
+  }
+  fprintf(stderr, "framework failed to start\n");
+  return 2;
+}
+
+/****************************************************************************
+ Function
+    ReplayIRQ
+
+ Description
+    Called by InputRecorder for every IRQ record, where the interrupt landed
+    on the target
+****************************************************************************/
+void ReplayIRQ( uint8_t Source )
+{
+  IRQs[Source]();
+}
+
+/****************************************************************************
+ Function
+    ReplayFinished
+
+ Description
+    Called by InputRecorder when the log is used up or the code stops reading
+    the inputs in the recorded order
+****************************************************************************/
+void ReplayFinished( bool DidDiverge )
+{
+  double WallSeconds = (double)(clock() - StartTime) / CLOCKS_PER_SEC;
+  double VirtualSeconds = InputRec_ReplayedTicks() / 1000.0;
+
+  fflush(stdout);
+  fprintf(stderr, "\nreplay %s: %.3f s of robot time in %.3f s (%.0fx)\n",
+          DidDiverge ? "DIVERGED" : "complete", VirtualSeconds, WallSeconds,
+          (WallSeconds > 0) ? VirtualSeconds / WallSeconds : 0.0);
+  exit(DidDiverge ? 1 : 0);
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+static long ReadHexLog( FILE *pFile, uint8_t *pLog, long MaxSize )
+{
+  char Line[256];
+  long Length = 0;
+  bool InLog = false;
+  char *p;
+
+  while (fgets(Line, sizeof(Line), pFile) != NULL)
+  {
+    if (!InLog)
+    {
+      InLog = (strncmp(Line, "REC BEGIN", 9) == 0);
+      continue;
+    }
+    if (strncmp(Line, "REC END", 7) == 0)
+    {
+      return Length;
+    }
+    for (p = Line; (p[0] != '\0') && (p[1] != '\0'); p += 2)
+    {
+      unsigned int Byte;
+      if ((sscanf(p, "%2x", &Byte) != 1) || (Length >= MaxSize))
+      {
+        break;
+      }
+      pLog[Length++] = (uint8_t)Byte;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,55 @@
+/****************************************************************************
+LOCScript
+	What the scripted LOC in QemuShim.c answers. Each command (matched on
+	its first byte under Mask) walks its own list of replies; a reply is used
+	for Repeat frames and the entry with Repeat 0 is used from then on.
+	Reply bytes are as clocked back during the 5 byte frame, so bytes 2..4
+	carry the response (see SPIService.c).
+
+	The default run: the game starts after a few status polls, the first
+	query after a report comes back not ready, then ACK on every query.
+	Edit the tables to script other matches.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stdint.h>
+
+#include "QemuShim.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define StatusMask    0xC0    // 11xx xxxx  ROBOT_STATUS
+#define StatusMatch   0xC0
+#define FreqMask      0xC0    // 10xx xxxx  frequency report
+#define FreqMatch     0x80
+#define QueryMask     0xF0    // 0111 xxxx  query new response
+#define QueryMatch    0x70
+
+#define ResponseReady 0xAA
+#define GameStarted   0x80    // game status bit of SB3
+
+/*---------------------------- Module Variables ---------------------------*/
+static const LOCReply_t StatusReplies[] =
+{
+  { 5, { 0, 0, 0x00, 0x00, 0x00 } },                // waiting for the start
+  { 0, { 0, 0, 0x00, 0x01, GameStarted | 0x01 } }   // playing, staging area 1
+};
+
+static const LOCReply_t FreqReplies[] =
+{
+  { 0, { 0, 0, 0x00, 0x00, 0x00 } }
+};
+
+static const LOCReply_t QueryReplies[] =
+{
+  { 1, { 0, 0, 0x00, 0x00, 0x00 } },                // response not ready
+  { 0, { 0, 0, ResponseReady, 0x00, 0x00 } }        // ready, ACK
+};
+
+const LOCCommand_t LOCScript[] =
+{
+  { StatusMask, StatusMatch, StatusReplies },
+  { FreqMask, FreqMatch, FreqReplies },
+  { QueryMask, QueryMatch, QueryReplies }
+};
+
+const uint8_t NumLOCCommands = sizeof(LOCScript) / sizeof(LOCScript[0]);
@@ -0,0 +1,423 @@
+/****************************************************************************
+QemuShim
+	Just enough of a TM4C123 on top of QEMU's lm3s6965evb machine (a
+	Cortex-M3 with a similar memory map) for the firmware to boot and run
+	its state machines. Build and run with Qemu/Makefile.
+
+	HWREG() is redirected here by Qemu/inc/hw_types.h, and the _R register
+	macros by the copy of tm4c123gh6pm.h the Makefile generates.
+	- The core peripherals (SysTick, NVIC, SCB), UART0 and the clock
+	  configuration registers go straight to the emulated part.
+	- SSI0 is a scripted stand-in for the LOC. Every byte written to the
+	  data register clocks the matching byte of the scripted reply
+	  (LOCScript.c) into the receive FIFO. The last byte of a 5 byte frame
+	  pends the SSI0 interrupt through the NVIC if TXIM is enabled, as the
+	  end of transmission would.
+	- SSI1, the LED shift register, sends instantly: its status always
+	  reads as an empty transmit FIFO.
+	- ES_DWT_CYCCNT (QEMU has no DWT) reads as instructions executed,
+	  worked out from the SysTick count and the -icount shift.
+	- Everything else lands in a shadow register file as in HostShim.c:
+	  writes stick, the peripheral present/ready blocks read as all ones and
+	  nothing changes on its own.
+
+ Notes
+	QemuReg() only hands back a pointer, so it can not tell a read from a
+	write. Registers where that matters (the SSI0 data register and bit-band
+	aliases of shadowed registers) get a cell preloaded with what a read
+	would return, tagged in the upper byte. The next QemuReg() call from
+	thread level, or QemuShim_Poll() from the ES_Run loop, finds the tag
+	gone if the firmware wrote the cell and applies the write. Those
+	registers are only used from thread level in this firmware.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "inc/hw_ints.h"
+#include "inc/hw_nvic.h"
+#include "inc/hw_ssi.h"
+#include "inc/hw_sysctl.h"
+
+#include "ES_Port.h"
+#include "QemuShim.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define NumRegisters 1024           // power of 2, open addressing
+#define PeriphSize   0x1000
+#define SCSStart     0xE000E000     // SysTick, NVIC and SCB
+#define SCSEnd       0xE000EFFF
+#define BitBandStart 0x42000000
+#define BitBandEnd   0x43FFFFFF
+#define PPBlockStart 0x400FE300
+#define PPBlockEnd   0x400FE3FF
+#define PRBlockStart 0x400FEA00
+#define PRBlockEnd   0x400FEAFF
+
+#define PendingTag   0xA5000000     // marks a preloaded cell that was not written
+#define TagMask      0xFF000000
+#define RxFifoSize   8
+#define MaxLOCCommands 8
+
+// the firmware runs the PLL at 40MHz, QEMU's system clock follows RCC/RCC2
+#define SysClockNs   25
+#ifndef QEMU_ICOUNT_SHIFT
+#define QEMU_ICOUNT_SHIFT 5
+#endif
+
+/*---------------------------- Module Types -------------------------------*/
+typedef enum { NoCellPending, DataCellPending, BitCellPending } PendingCell_t;
+
+/*---------------------------- Module Functions ---------------------------*/
+static bool IsPassThrough( uint32_t Address );
+static volatile uint32_t *ShadowReg( uint32_t Address );
+static volatile uint32_t *SSIReg( uint32_t Address );
+static volatile uint32_t *BitBandReg( uint32_t Address );
+static void SettlePendingCell( void );
+static void LOCByteWritten( uint8_t Byte );
+static const LOCReply_t *CurrentReply( uint8_t Command, uint8_t *pWhich );
+static uint32_t InstructionCount( void );
+static bool InHandler( void );
+
+// SysTick count of the thread that reads it, weak so that builds without
+// ES_Port.c (the queue benchmark) still link
+uint32_t _HW_GetLongTickCount( void ) __attribute__((weak));
+
+/*---------------------------- Module Variables ---------------------------*/
+static uint32_t RegAddress[NumRegisters];
+static volatile uint32_t RegValue[NumRegisters];
+static bool RegUsed[NumRegisters];
+
+static volatile uint32_t PendingCell;
+static PendingCell_t PendingKind = NoCellPending;
+static uint32_t PendingAddress;     // target register of a bit-band cell
+static uint8_t PendingBit;
+static volatile uint32_t ComputedCell;
+
+static uint8_t RxFifo[RxFifoSize];
+static uint8_t RxHead;
+static uint8_t RxCount;
+static uint8_t FrameByte;
+static uint8_t FrameCommand;
+static const LOCReply_t *pFrameReply;
+static uint8_t ReplyIndex[MaxLOCCommands];
+static uint16_t ReplyUses[MaxLOCCommands];
+
+static uint32_t FreeRunWraps;
+
+/*------------------------------ Module Code ------------------------------*/
+volatile uint32_t *QemuReg(uint32_t Address)
+{
+  if (IsPassThrough(Address))
+  {
+    return (volatile uint32_t *)Address;
+  }
+  if (!InHandler())
+  {
+    SettlePendingCell();
+  }
+  if ((Address >= BitBandStart) && (Address <= BitBandEnd))
+  {
+    return BitBandReg(Address);
+  }
+  if ((Address & ~(PeriphSize - 1)) == SSI0_BASE)
+  {
+    return SSIReg(Address);
+  }
+  if (Address == SSI1_BASE + SSI_O_SR)
+  {
+    ComputedCell = SSI_SR_TFE | SSI_SR_TNF;
+    return &ComputedCell;
+  }
+  if (Address == ES_DWT_CYCCNT)
+  {
+    ComputedCell = InstructionCount();
+    return &ComputedCell;
+  }
+  return ShadowReg(Address);
+}
+
+/****************************************************************************
+ Function
+    QemuShim_Poll
+
+ Description
+    Called from _HW_Process_Pending_Ints so a write to the LOC data register
+    takes effect even when nothing else touches a shadowed register
+****************************************************************************/
+void QemuShim_Poll( void )
+{
+  SettlePendingCell();
+}
+
+/****************************************************************************
+ Function
+    QemuShim_Exit
+
+ Description
+    Ends the QEMU session with Code as its exit status (semihosting SYS_EXIT,
+    QEMU has to be started with -semihosting), for unattended runs
+****************************************************************************/
+void QemuShim_Exit( int Code )
+{
+  register uint32_t Operation __asm("r0") = 0x18;                   // SYS_EXIT
+  register uint32_t Reason __asm("r1") = (Code == 0) ? 0x20026 : 0x20023;
+
+  __asm volatile ("bkpt 0xab" : : "r" (Operation), "r" (Reason) : "memory");
+  while (1)
+    ;
+}
+
+// the armcc intrinsics the firmware uses
+void __enable_irq( void )
+{
+  __asm volatile ("cpsie i" : : : "memory");
+}
+
+void __disable_irq( void )
+{
+  __asm volatile ("cpsid i" : : : "memory");
+}
+
+// for builds that leave ES_Port.c out; ES_Port.c has the same for gcc
+__attribute__((weak)) uint32_t CPUgetPRIMASK_cpsid( void )
+{
+  uint32_t WasMasked;
+
+  __asm volatile ("mrs %0, PRIMASK\n"
+                  "cpsid i" : "=r" (WasMasked) : : "memory");
+  return WasMasked;
+}
+
+__attribute__((weak)) void CPUsetPRIMASK( uint32_t newPRIMASK )
+{
+  __asm volatile ("msr PRIMASK, %0" : : "r" (newPRIMASK) : "memory");
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+static bool IsPassThrough( uint32_t Address )
+{
+  return ((Address >= SCSStart) && (Address <= SCSEnd)) ||
+         ((Address >= UART0_BASE) && (Address < (UART0_BASE + PeriphSize))) ||
+         (Address == SYSCTL_RIS) || (Address == SYSCTL_RCC) ||
+         (Address == SYSCTL_RCC2);
+}
+
+static volatile uint32_t *ShadowReg( uint32_t Address )
+{
+  uint32_t Slot = (Address >> 2) * 2654435761u;
+  uint32_t Probe;
+
+  for (Probe = 0; Probe < NumRegisters; Probe++)
+  {
+    uint32_t i = (Slot + Probe) & (NumRegisters - 1);
+    if (!RegUsed[i])
+    {
+      RegUsed[i] = true;
+      RegAddress[i] = Address;
+      if (((Address >= PPBlockStart) && (Address <= PPBlockEnd)) ||
+          ((Address >= PRBlockStart) && (Address <= PRBlockEnd)))
+      {
+        RegValue[i] = 0xffffffff;
+      }
+      else
+      {
+        RegValue[i] = 0;
+      }
+      return &RegValue[i];
+    }
+    if (RegAddress[i] == Address)
+    {
+      return &RegValue[i];
+    }
+  }
+  // out of cells: stop where a debugger attached to QEMU can see why
+  while (1)
+    ;
+}
+
+static volatile uint32_t *SSIReg( uint32_t Address )
+{
+  switch (Address - SSI0_BASE)
+  {
+    case SSI_O_DR :
+      // a read pops the receive FIFO, a write clocks out a byte
+      PendingCell = PendingTag | ((RxCount != 0) ? RxFifo[RxHead] : 0);
+      PendingKind = DataCellPending;
+      return &PendingCell;
+
+    case SSI_O_SR :
+      // the shim transmits instantly, so never busy and never full
+      ComputedCell = SSI_SR_TFE | SSI_SR_TNF | ((RxCount != 0) ? SSI_SR_RNE : 0);
+      return &ComputedCell;
+
+    case SSI_O_RIS :
+      ComputedCell = SSI_RIS_TXRIS;
+      return &ComputedCell;
+
+    case SSI_O_MIS :
+      ComputedCell = SSI_RIS_TXRIS & *ShadowReg(SSI0_BASE + SSI_O_IM);
+      return &ComputedCell;
+
+    default :
+      return ShadowReg(Address);
+  }
+}
+
+static volatile uint32_t *BitBandReg( uint32_t Address )
+{
+  uint32_t Target = 0x40000000 + ((Address - BitBandStart) >> 5);
+  uint8_t Bit = (Address >> 2) & 0x1f;
+
+  if (IsPassThrough(Target))
+  {
+    return (volatile uint32_t *)Address;   // QEMU does bit-banding itself
+  }
+  PendingAddress = Target;
+  PendingBit = Bit;
+  PendingCell = PendingTag | ((*QemuReg(Target) >> Bit) & 1);
+  PendingKind = BitCellPending;
+  return &PendingCell;
+}
+
+static void SettlePendingCell( void )
+{
+  uint32_t Value = PendingCell;
+  PendingCell_t Kind = PendingKind;
+
+  PendingKind = NoCellPending;
+  if (Kind == DataCellPending)
+  {
+    if ((Value & TagMask) != PendingTag)
+    {
+      LOCByteWritten((uint8_t)Value);
+    }
+    else if (RxCount != 0)
+    {
+      RxHead = (RxHead + 1) % RxFifoSize;
+      RxCount--;
+    }
+  }
+  else if ((Kind == BitCellPending) && ((Value & TagMask) != PendingTag))
+  {
+    volatile uint32_t *pTarget = QemuReg(PendingAddress);
+    if (Value & 1)
+    {
+      *pTarget |= (1u << PendingBit);
+    }
+    else
+    {
+      *pTarget &= ~(1u << PendingBit);
+    }
+  }
+}
+
+static void LOCByteWritten( uint8_t Byte )
+{
+  static uint8_t Which;
+
+  if (FrameByte == 0)
+  {
+    FrameCommand = Byte;
+    pFrameReply = CurrentReply(FrameCommand, &Which);
+  }
+  if (RxCount < RxFifoSize)
+  {
+    RxFifo[(RxHead + RxCount) % RxFifoSize] =
+        (pFrameReply != NULL) ? pFrameReply->Reply[FrameByte] : 0;
+    RxCount++;
+  }
+  if (++FrameByte < LOC_FRAME_BYTES)
+  {
+    return;
+  }
+
+  // end of the frame: move the script on and raise the EOT interrupt
+  FrameByte = 0;
+  if ((pFrameReply != NULL) && (pFrameReply->Repeat != 0) &&
+      (++ReplyUses[Which] >= pFrameReply->Repeat))
+  {
+    ReplyIndex[Which]++;
+    ReplyUses[Which] = 0;
+  }
+  if (*ShadowReg(SSI0_BASE + SSI_O_IM) & SSI_IM_TXIM)
+  {
+    HWREG(NVIC_PEND0) = 1u << (INT_SSI0 - 16);
+  }
+}
+
+static const LOCReply_t *CurrentReply( uint8_t Command, uint8_t *pWhich )
+{
+  uint8_t i;
+
+  for (i = 0; (i < NumLOCCommands) && (i < MaxLOCCommands); i++)
+  {
+    if ((Command & LOCScript[i].Mask) == LOCScript[i].Match)
+    {
+      *pWhich = i;
+      return &LOCScript[i].pReplies[ReplyIndex[i]];
+    }
+  }
+  return NULL;
+}
+
+/* Instructions executed so far. Under -icount every instruction advances
+   QEMU's virtual clock by 2^shift ns and SysTick counts system clocks of
+   SysClockNs each, so clocks * SysClockNs >> shift is an instruction count.
+   With the ES tick running, whole ticks come from the ES tick count; if
+   nobody started SysTick (the queue benchmark) it is started here free
+   running, and its wraps are counted from COUNTFLAG.
+*/
+static uint32_t InstructionCount( void )
+{
+  uint64_t Clocks;
+  uint32_t Control = HWREG(NVIC_ST_CTRL);
+  uint32_t Reload;
+  uint32_t Current;
+
+  if ((Control & NVIC_ST_CTRL_ENABLE) == 0)
+  {
+    HWREG(NVIC_ST_RELOAD) = 0x00ffffff;
+    HWREG(NVIC_ST_CURRENT) = 0;
+    HWREG(NVIC_ST_CTRL) = NVIC_ST_CTRL_CLK_SRC | NVIC_ST_CTRL_ENABLE;
+    FreeRunWraps = 0;
+    Control = HWREG(NVIC_ST_CTRL);
+  }
+  Reload = HWREG(NVIC_ST_RELOAD);
+  Current = HWREG(NVIC_ST_CURRENT);
+
+  if ((Control & NVIC_ST_CTRL_INTEN) && (_HW_GetLongTickCount != NULL))
+  {
+    uint32_t Ticks;
+    do
+    {
+      Ticks = _HW_GetLongTickCount();
+      Current = HWREG(NVIC_ST_CURRENT);
+    } while (Ticks != _HW_GetLongTickCount());
+    Clocks = (uint64_t)Ticks * (Reload + 1);
+  }
+  else
+  {
+    if (Control & NVIC_ST_CTRL_COUNT)
+    {
+      FreeRunWraps++;
+    }
+    Clocks = (uint64_t)FreeRunWraps * (Reload + 1);
+  }
+  Clocks += Reload - Current;
+  return (uint32_t)((Clocks * SysClockNs) >> QEMU_ICOUNT_SHIFT);
+}
+
+static bool InHandler( void )
+{
+  uint32_t IPSR;
+
+  __asm volatile ("mrs %0, IPSR" : "=r" (IPSR));
+  return (IPSR & 0x1ff) != 0;
+}
@@ -0,0 +1,43 @@
+/****************************************************************************
+
+  Header file for the QEMU peripheral shim
+
+  The Makefile force-includes this into every file of the QEMU build, so it
+  also supplies the armcc intrinsics the firmware calls without a prototype.
+ ****************************************************************************/
+
+#ifndef QemuShim_H
+#define QemuShim_H
+
+#include <stdint.h>
+
+// one SSI transaction with the LOC: command byte plus four zeros
+#define LOC_FRAME_BYTES 5
+
+// a scripted LOC reply, used for Repeat frames (0: from here on)
+typedef struct
+{
+  uint16_t Repeat;
+  uint8_t Reply[LOC_FRAME_BYTES];
+} LOCReply_t;
+
+// the replies for the commands whose first byte matches under Mask
+typedef struct
+{
+  uint8_t Mask;
+  uint8_t Match;
+  const LOCReply_t *pReplies;
+} LOCCommand_t;
+
+// defined in LOCScript.c
+extern const LOCCommand_t LOCScript[];
+extern const uint8_t NumLOCCommands;
+
+// Public Function Prototypes
+volatile uint32_t *QemuReg( uint32_t Address );
+void QemuShim_Poll( void );
+void QemuShim_Exit( int Code );
+void __enable_irq( void );
+void __disable_irq( void );
+
+#endif /* QemuShim_H */
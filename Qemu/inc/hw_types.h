@@ -0,0 +1,38 @@
+//*****************************************************************************
+//
+// hw_types.h - QEMU build stand-in for the TivaWare header of the same name
+//
+// Qemu/ is put ahead of the TivaWare root on the include path, so every
+// HWREG() in the firmware and in driverlib goes through QemuReg() in
+// QemuShim.c, which decides whether the emulated lm3s6965 or the shim
+// answers for that address.
+//
+//*****************************************************************************
+
+#ifndef __HW_TYPES_H__
+#define __HW_TYPES_H__
+
+#include <stdint.h>
+
+volatile uint32_t *QemuReg(uint32_t Address);
+
+#define HWREG(x)        (*QemuReg((uint32_t)(x)))
+#define HWREGH(x)       (*(volatile uint16_t *)QemuReg((uint32_t)(x)))
+#define HWREGB(x)       (*(volatile uint8_t *)QemuReg((uint32_t)(x)))
+#define HWREGBITW(x, b) HWREG(((uint32_t)(x) & 0xF0000000) | 0x02000000 |     \
+                              (((uint32_t)(x) & 0x000FFFFF) << 5) | ((b) << 2))
+#define HWREGBITH(x, b) HWREGH(((uint32_t)(x) & 0xF0000000) | 0x02000000 |    \
+                               (((uint32_t)(x) & 0x000FFFFF) << 5) | ((b) << 2))
+#define HWREGBITB(x, b) HWREGB(((uint32_t)(x) & 0xF0000000) | 0x02000000 |    \
+                               (((uint32_t)(x) & 0x000FFFFF) << 5) | ((b) << 2))
+
+// the firmware is built for a TM4C123 whatever it runs on
+#define CLASS_IS_TM4C123  1
+#define CLASS_IS_TM4C129  0
+#define REVISION_IS_A0    0
+#define REVISION_IS_A1    0
+#define REVISION_IS_A2    0
+#define REVISION_IS_B0    0
+#define REVISION_IS_B1    0
+
+#endif // __HW_TYPES_H__
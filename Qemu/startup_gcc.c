@@ -0,0 +1,286 @@
+//*****************************************************************************
+//
+// startup_gcc.c - Startup code for the QEMU (arm-none-eabi-gcc) build.
+//
+// The vector table follows StartUp/startup_rvmdk.S entry for entry as far
+// as the last handler the firmware installs. QEMU's lm3s6965 NVIC has 64
+// interrupt lines, so the wide timer vectors are there for the layout only;
+// those timers are shadowed by QemuShim.c and never interrupt.
+//
+//*****************************************************************************
+
+#include <stdint.h>
+
+//*****************************************************************************
+//
+// Forward declaration of the default fault handlers.
+//
+//*****************************************************************************
+void ResetISR(void);
+static void NmiSR(void);
+static void FaultISR(void);
+static void IntDefaultHandler(void);
+
+//*****************************************************************************
+//
+// The interrupt handlers used by the application, weak so that builds with
+// only part of it (the queue benchmark) still link.
+//
+//*****************************************************************************
+void SysTickIntHandler(void) __attribute__((weak, alias("IntDefaultHandler")));
+void SPI_InterruptResponse(void) __attribute__((weak, alias("IntDefaultHandler")));
+void ShortTimerAHandler(void) __attribute__((weak, alias("IntDefaultHandler")));
+void ShortTimerBHandler(void) __attribute__((weak, alias("IntDefaultHandler")));
+void StagingAreaISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void StagingAreaLostISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void InputCaptureForFrontIRDetection(void) __attribute__((weak, alias("IntDefaultHandler")));
+void GameTimerISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void InputCaptureForBackIRDetection(void) __attribute__((weak, alias("IntDefaultHandler")));
+void GetAwayISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void IRGoertzelSampleISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void ADC_MultiHalfISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void WireFollowControlISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void MotorProfileISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void OdometryISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void FlywheelControlISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void FlywheelTachISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void ServoPeriodISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void DrivePeriodISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+void IRPulseISR(void) __attribute__((weak, alias("IntDefaultHandler")));
+
+//*****************************************************************************
+//
+// The entry point for the application.
+//
+//*****************************************************************************
+extern int main(void);
+
+//*****************************************************************************
+//
+// Symbols from the linker script.
+//
+//*****************************************************************************
+extern uint32_t _ldata;
+extern uint32_t _data;
+extern uint32_t _edata;
+extern uint32_t _bss;
+extern uint32_t _ebss;
+extern uint32_t _estack;
+
+//*****************************************************************************
+//
+// The vector table.
+//
+//*****************************************************************************
+__attribute__ ((section(".isr_vector")))
+void (* const g_pfnVectors[])(void) =
+{
+    (void (*)(void))&_estack,               // The initial stack pointer
+    ResetISR,                               // The reset handler
+    NmiSR,                                  // The NMI handler
+    FaultISR,                               // The hard fault handler
+    IntDefaultHandler,                      // The MPU fault handler
+    IntDefaultHandler,                      // The bus fault handler
+    IntDefaultHandler,                      // The usage fault handler
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    IntDefaultHandler,                      // SVCall handler
+    IntDefaultHandler,                      // Debug monitor handler
+    0,                                      // Reserved
+    IntDefaultHandler,                      // The PendSV handler
+    SysTickIntHandler,                      // The SysTick handler
+    IntDefaultHandler,                      // GPIO Port A
+    IntDefaultHandler,                      // GPIO Port B
+    IntDefaultHandler,                      // GPIO Port C
+    IntDefaultHandler,                      // GPIO Port D
+    IntDefaultHandler,                      // GPIO Port E
+    IntDefaultHandler,                      // UART0 Rx and Tx
+    IntDefaultHandler,                      // UART1 Rx and Tx
+    SPI_InterruptResponse,                  // SSI0 Rx and Tx
+    IntDefaultHandler,                      // I2C0 Master and Slave
+    IntDefaultHandler,                      // PWM Fault
+    DrivePeriodISR,                         // PWM Generator 0
+    IntDefaultHandler,                      // PWM Generator 1
+    ServoPeriodISR,                         // PWM Generator 2
+    OdometryISR,                            // Quadrature Encoder 0
+    IntDefaultHandler,                      // ADC Sequence 0
+    IntDefaultHandler,                      // ADC Sequence 1
+    ADC_MultiHalfISR,                       // ADC Sequence 2
+    IntDefaultHandler,                      // ADC Sequence 3
+    IntDefaultHandler,                      // Watchdog timer
+    IntDefaultHandler,                      // Timer 0 subtimer A
+    IntDefaultHandler,                      // Timer 0 subtimer B
+    MotorProfileISR,                        // Timer 1 subtimer A
+    IntDefaultHandler,                      // Timer 1 subtimer B
+    WireFollowControlISR,                   // Timer 2 subtimer A
+    IntDefaultHandler,                      // Timer 2 subtimer B
+    IntDefaultHandler,                      // Analog Comparator 0
+    IntDefaultHandler,                      // Analog Comparator 1
+    IntDefaultHandler,                      // Analog Comparator 2
+    IntDefaultHandler,                      // System Control (PLL, OSC, BO)
+    IntDefaultHandler,                      // FLASH Control
+    IntDefaultHandler,                      // GPIO Port F
+    IntDefaultHandler,                      // GPIO Port G
+    IntDefaultHandler,                      // GPIO Port H
+    IntDefaultHandler,                      // UART2 Rx and Tx
+    IntDefaultHandler,                      // SSI1 Rx and Tx
+    FlywheelControlISR,                     // Timer 3 subtimer A
+    FlywheelTachISR,                        // Timer 3 subtimer B
+    IntDefaultHandler,                      // I2C1 Master and Slave
+    IntDefaultHandler,                      // Quadrature Encoder 1
+    IntDefaultHandler,                      // CAN0
+    IntDefaultHandler,                      // CAN1
+    0,                                      // Reserved
+    0,                                      // Reserved
+    IntDefaultHandler,                      // Hibernate
+    IntDefaultHandler,                      // USB0
+    IntDefaultHandler,                      // PWM Generator 3
+    IntDefaultHandler,                      // uDMA Software Transfer
+    IntDefaultHandler,                      // uDMA Error
+    IntDefaultHandler,                      // ADC1 Sequence 0
+    IntDefaultHandler,                      // ADC1 Sequence 1
+    IntDefaultHandler,                      // ADC1 Sequence 2
+    IRGoertzelSampleISR,                    // ADC1 Sequence 3
+    0,                                      // Reserved
+    0,                                      // Reserved
+    IntDefaultHandler,                      // GPIO Port J
+    IntDefaultHandler,                      // GPIO Port K
+    IntDefaultHandler,                      // GPIO Port L
+    IntDefaultHandler,                      // SSI2 Rx and Tx
+    IntDefaultHandler,                      // SSI3 Rx and Tx
+    IntDefaultHandler,                      // UART3 Rx and Tx
+    IntDefaultHandler,                      // UART4 Rx and Tx
+    IntDefaultHandler,                      // UART5 Rx and Tx
+    IntDefaultHandler,                      // UART6 Rx and Tx
+    IntDefaultHandler,                      // UART7 Rx and Tx
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    IntDefaultHandler,                      // I2C2 Master and Slave
+    IntDefaultHandler,                      // I2C3 Master and Slave
+    IntDefaultHandler,                      // Timer 4 subtimer A
+    IntDefaultHandler,                      // Timer 4 subtimer B
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    0,                                      // Reserved
+    ShortTimerAHandler,                     // Timer 5 subtimer A
+    ShortTimerBHandler,                     // Timer 5 subtimer B
+    StagingAreaISR,                         // Wide Timer 0 subtimer A
+    StagingAreaLostISR,                     // Wide Timer 0 subtimer B
+    GameTimerISR,                           // Wide Timer 1 subtimer A
+    InputCaptureForFrontIRDetection,        // Wide Timer 1 subtimer B
+    IntDefaultHandler,                      // Wide Timer 2 subtimer A
+    IntDefaultHandler,                      // Wide Timer 2 subtimer B
+    InputCaptureForBackIRDetection,         // Wide Timer 3 subtimer A
+    GetAwayISR,                             // Wide Timer 3 subtimer B
+    IntDefaultHandler,                      // Wide Timer 4 subtimer A
+    IntDefaultHandler,                      // Wide Timer 4 subtimer B
+    IntDefaultHandler,                      // Wide Timer 5 subtimer A
+    IntDefaultHandler,                      // Wide Timer 5 subtimer B
+    IntDefaultHandler,                      // FPU
+    0,                                      // Reserved
+    0,                                      // Reserved
+    IntDefaultHandler,                      // I2C4 Master and Slave
+    IntDefaultHandler,                      // I2C5 Master and Slave
+    IntDefaultHandler,                      // GPIO Port M
+    IntDefaultHandler,                      // GPIO Port N
+    IntDefaultHandler,                      // Quadrature Encoder 2
+    0,                                      // Reserved
+    0,                                      // Reserved
+    IntDefaultHandler,                      // GPIO Port P (Summary or P0)
+    IntDefaultHandler,                      // GPIO Port P1
+    IntDefaultHandler,                      // GPIO Port P2
+    IntDefaultHandler,                      // GPIO Port P3
+    IntDefaultHandler,                      // GPIO Port P4
+    IntDefaultHandler,                      // GPIO Port P5
+    IntDefaultHandler,                      // GPIO Port P6
+    IntDefaultHandler,                      // GPIO Port P7
+    IntDefaultHandler,                      // GPIO Port Q (Summary or Q0)
+    IntDefaultHandler,                      // GPIO Port Q1
+    IntDefaultHandler,                      // GPIO Port Q2
+    IntDefaultHandler,                      // GPIO Port Q3
+    IntDefaultHandler,                      // GPIO Port Q4
+    IntDefaultHandler,                      // GPIO Port Q5
+    IntDefaultHandler,                      // GPIO Port Q6
+    IntDefaultHandler,                      // GPIO Port Q7
+    IntDefaultHandler,                      // GPIO Port R
+    IntDefaultHandler,                      // GPIO Port S
+    IntDefaultHandler,                      // PWM 1 Generator 0
+    IntDefaultHandler,                      // PWM 1 Generator 1
+    IRPulseISR                              // PWM 1 Generator 2
+};
+
+//*****************************************************************************
+//
+// Copies the initialized data from flash, zeroes .bss and calls main().
+//
+//*****************************************************************************
+void
+ResetISR(void)
+{
+    uint32_t *pui32Src, *pui32Dest;
+
+    pui32Src = &_ldata;
+    for(pui32Dest = &_data; pui32Dest < &_edata; )
+    {
+        *pui32Dest++ = *pui32Src++;
+    }
+    for(pui32Dest = &_bss; pui32Dest < &_ebss; )
+    {
+        *pui32Dest++ = 0;
+    }
+
+    main();
+    while(1)
+    {
+    }
+}
+
+//*****************************************************************************
+//
+// Unexpected exceptions stop here; attach gdb to QEMU (-s -S) to see where.
+//
+//*****************************************************************************
+static void
+NmiSR(void)
+{
+    while(1)
+    {
+    }
+}
+
+static void
+FaultISR(void)
+{
+    while(1)
+    {
+    }
+}
+
+static void
+IntDefaultHandler(void)
+{
+    while(1)
+    {
+    }
+}
@@ -1,15 +1,46 @@
 // ADMulti.c
 // Setup up ADC0 to convert up to 4 channels using SS2
+// SS2 runs continuously off the 10kHz ADC sample clock (Timer0A's ADC
+// trigger) with 16x hardware averaging, and the uDMA moves every run into a
+// ping-pong buffer. Each full half (8 runs, 0.8ms) interrupts once to
+// average its runs into the latest readings, so ADC_MultiRead just copies
+// those out. A run filter, if set, sees every run instead and its output
+// for the last run of the half is the latest reading. QEMU has no uDMA and the replay build reads the log, so there
+// ADC_MultiRead still triggers SS2 by software and waits.
+// On the TM4C123 the IE bit of SS2's last step is what requests uDMA
+// channel 16, and the channel's done interrupt comes in on the SS2 vector
+// (16) with the sequence's own interrupt left masked; the ISR tells the
+// two apart by the channel's bit in the uDMA DMACHIS.
 
 
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "inc/hw_gpio.h"
 #include "inc/hw_types.h"
 #include "inc/hw_memmap.h"
 #include "inc/tm4c123gh6pm.h"
 
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+
 #include "ADMulti.h"
+#include "DMAModule.h"
+#include "InputRecorder.h"
+
+#if !defined(QEMU) && !defined(REPLAY_INPUTS)
+#define ADC_CONTINUOUS
+#endif
+
+#define TicksPerSecond 40000000
+// SS2 always converts all 4 steps so each run is one 4 word uDMA burst
+#define StepsPerRun ADC_STEPS_PER_RUN
+#define RunsPerHalf ADC_RUNS_PER_HALF
+#define ADC0SS2DMAChannel 16
+#define ADC0SS2DMABit (1UL << ADC0SS2DMAChannel)
+#define ADC0SS2Encoding 0
+// ADC0 sequence 2 is interrupt 16
+#define ADC0SS2IntBit 0x00010000
 
 static const uint32_t HowMany2Mask[4] = {0x01,0x03,0x07,0x0F};
 // this mapping puts PE0 as resuult 0, PE1 as result 1...
@@ -18,9 +49,20 @@ static const uint32_t HowMany2CTL[4] = {ADC_SSCTL2_END0|ADC_SSCTL2_IE0,
                                         ADC_SSCTL2_END1|ADC_SSCTL2_IE1,
                                         ADC_SSCTL2_END2|ADC_SSCTL2_IE2,
                                         ADC_SSCTL2_END3|ADC_SSCTL2_IE3};
+// same order, the unused steps convert the last channel again
+static const uint32_t HowMany2RunMux[4] = {0x3333,0x2223,0x1123,0x0123};
 
 static uint8_t NumChannelsConverting;
 
+// filled by the uDMA in the continuous build
+static uint32_t Samples[2*RunsPerHalf*StepsPerRun];
+static volatile uint32_t Latest[4];
+static uint8_t FullHalf;
+static pPostFunc HalfSubscriber;
+static ADCRunFilter_t RunFilter;
+
+static void ReadLatest(uint32_t data[4]);
+
 // initialize the A/D converter to convert on 1-4 channels
 void ADC_MultiInit(uint8_t HowMany){ 
   volatile uint32_t delay;
@@ -31,6 +73,9 @@ void ADC_MultiInit(uint8_t HowMany){
     return;
   
   NumChannelsConverting = HowMany;
+#if defined(REPLAY_INPUTS)
+  return;                         // samples come from the recorded log
+#endif
   
   SYSCTL_RCGCADC_R |= 0x00000001; // 1) activate ADC0
   SYSCTL_RCGCGPIO_R |= SYSCTL_RCGCGPIO_R4; // 1) activate clock for Port E
@@ -41,6 +86,25 @@ void ADC_MultiInit(uint8_t HowMany){
   GPIO_PORTE_DEN_R &= ~HowMany2Mask[index];      // 5) disable digital I/O on PE0 - PE3
   GPIO_PORTE_AMSEL_R |= HowMany2Mask[index];     // 6) enable analog functionality on PE4 PE5
   
+#if defined(ADC_CONTINUOUS)
+  ADC0_PC_R &= ~0xF;              // 8) clear max sample rate field
+  ADC0_PC_R |= ADC_PC_SR_1M;      //    1M samples/sec: 4 steps x 16 = 64uS of each 100uS tick
+  ADC0_SSPRI_R = 0x3210;          // 9) Sequencer 3 is lowest priority
+  ADC0_ACTSS_R &= ~ADC_ACTSS_ASEN2; // 10) disable sample sequencer 2
+  ADC0_EMUX_R = (ADC0_EMUX_R & ~ADC_EMUX_EM2_M) | ADC_EMUX_EM2_TIMER; // 11) seq2 is timer trigger
+  ADC0_SAC_R = ADC_SAC_AVG_16X;   //     every step is the average of 16 conversions
+  ADC0_SSMUX2_R = HowMany2RunMux[index];      // 12) set channels for SS2
+  ADC0_SSCTL2_R = ADC_SSCTL2_END3|ADC_SSCTL2_IE3; // 13) all 4 steps, IE asks for the uDMA
+  DMA_StartPingPong(ADC0SS2DMAChannel, ADC0SS2Encoding, (uint32_t)&ADC0_SSFIFO2_R,
+                    Samples, RunsPerHalf*StepsPerRun, UDMA_CHCTL_ARBSIZE_4);
+  FullHalf = 0;
+  ADC0_IM_R &= ~ADC_IM_MASK2;     // 14) no interrupt per run, the uDMA done still gets through
+  ADC0_ISC_R = ADC_ISC_IN2;
+  UDMA_CHIS_R = ADC0SS2DMABit;
+  NVIC_EN0_R |= ADC0SS2IntBit;
+  ADC0_ACTSS_R |= ADC_ACTSS_ASEN2; // 15) enable sample sequencer 2
+  ADC_SampleClockInit();
+#else
   ADC0_PC_R &= ~0xF;              // 8) clear max sample rate field
   ADC0_PC_R |= 0x1;               //    configure for 125K samples/sec
   ADC0_SSPRI_R = 0x3210;          // 9) Sequencer 3 is lowest priority
@@ -50,18 +114,58 @@ void ADC_MultiInit(uint8_t HowMany){
   ADC0_SSCTL2_R = HowMany2CTL[index];         // 13) set which sample is last
   ADC0_IM_R &= ~0x0004;           // 14) disable SS2 interrupts
   ADC0_ACTSS_R |= 0x0004;         // 15) enable sample sequencer 2
+#endif
 }
 
 //------------ADC_MultiRead------------
-// Triggers A/D conversion and waits for result
+// Returns the latest readings
 // Input: none
 // Output: up to 4 12-bit result of ADC conversions
-// software trigger, busy-wait sampling, takes about 18.6uS to execute
+// continuous build: the average of the last full half buffer, no waiting
+// otherwise: software trigger, busy-wait sampling, takes about 18.6uS to execute
+// with a run filter set, the filter's output for the latest run instead
+// (without the continuous build the filter runs here, at the read rate)
 // data returned by reference
 // lowest numbered converted channel is in data[0]
 void ADC_MultiRead(uint32_t data[4]){ 
+#if defined(REPLAY_INPUTS)
+  InputRec_ReplayADC(data, NumChannelsConverting);
+  return;
+#endif
+  ReadLatest(data);
+#if defined(RECORD_INPUTS)
+  InputRec_RecordADC(data, NumChannelsConverting);
+#endif
+}
+
+//------------ADC_MultiPeek------------
+// ADC_MultiRead for control loops in interrupts: the same readings, but
+// never recorded, as what a control loop does with them is no input to
+// the state machines (and at 1kHz would fill the log in seconds). The
+// replay build has no samples to give it, so zeros.
+void ADC_MultiPeek(uint32_t data[4]){
+#if defined(REPLAY_INPUTS)
   uint8_t i;
-  
+
+  for (i=0; i< NumChannelsConverting; i++){
+    data[i] = 0;
+  }
+#else
+  ReadLatest(data);
+#endif
+}
+
+// the latest readings, or a fresh conversion without the continuous build
+static void ReadLatest(uint32_t data[4]){
+  uint8_t i;
+
+#if defined(ADC_CONTINUOUS)
+  EnterCritical();                    // one half's readings, not a mix of two
+  for (i=0; i< NumChannelsConverting; i++){
+    data[i] = Latest[i];
+  }
+  ExitCritical();
+#else
   ADC0_PSSI_R = 0x0004;               // 1) initiate SS2
   while((ADC0_RIS_R&0x04)==0)
   {};                                 // 2) wait for conversion(s) to complete
@@ -69,4 +173,106 @@ void ADC_MultiRead(uint32_t data[4]){
     data[i] = ADC0_SSFIFO2_R&0xFFF;   // 3) read result, one at a time
   }
   ADC0_ISC_R = 0x0004;                // 4) acknowledge completion, clear int
+  if (RunFilter != 0){
+    RunFilter(data);
+  }
+#endif
+}
+
+//------------ADC_SampleClockInit------------
+// Starts Timer0A as the ADC_SAMPLE_CLOCK_HZ ADC trigger, once
+// On the TM4C123 every timer's ADC trigger goes to every timer triggered
+// sequencer on both ADCs, so all of them share this one clock
+void ADC_SampleClockInit(void){
+  static bool Running = false;
+
+  if (Running)
+    return;
+  SYSCTL_RCGCTIMER_R |= SYSCTL_RCGCTIMER_R0;  // activate Timer0
+  while((SYSCTL_PRTIMER_R & SYSCTL_PRTIMER_R0) == 0)
+  {};
+  TIMER0_CTL_R &= ~TIMER_CTL_TAEN;            // disable while configuring
+  TIMER0_CFG_R = TIMER_CFG_32_BIT_TIMER;
+  TIMER0_TAMR_R = (TIMER0_TAMR_R & ~TIMER_TAMR_TAMR_M) | TIMER_TAMR_TAMR_PERIOD;
+  TIMER0_TAILR_R = TicksPerSecond/ADC_SAMPLE_CLOCK_HZ - 1;
+  TIMER0_CTL_R |= (TIMER_CTL_TAOTE | TIMER_CTL_TAEN | TIMER_CTL_TASTALL); // ADC trigger on, go
+  Running = true;
+}
+
+//------------ADC_MultiSubscribe------------
+// Have ADC_HALF_READY posted to PostFunc every time a half buffer fills
+// (every 0.8mS); the EventParam is the half for ADC_MultiGetHalf. Pass
+// 0 to stop. Only the continuous build ever posts it.
+void ADC_MultiSubscribe(pPostFunc PostFunc){
+  HalfSubscriber = PostFunc;
+}
+
+//------------ADC_MultiSetRunFilter------------
+// Have Filter called on every run from the half buffer ISR, 10000 times a
+// second, so it can run digital filters at the sample rate; ADC_MultiRead
+// then returns what it leaves in the last run. Pass 0 to go back to the
+// plain average.
+void ADC_MultiSetRunFilter(ADCRunFilter_t Filter){
+  EnterCritical();
+  RunFilter = Filter;
+  ExitCritical();
+}
+
+//------------ADC_MultiGetHalf------------
+// The runs of a full half buffer: ADC_RUNS_PER_HALF runs of
+// ADC_STEPS_PER_RUN words, channel i of a run in word i. The uDMA writes
+// over it again 0.8mS after ADC_HALF_READY.
+const uint32_t *ADC_MultiGetHalf(uint8_t Half){
+  return &Samples[(Half & 1)*RunsPerHalf*StepsPerRun];
+}
+
+//------------ADC_MultiHalfISR------------
+// ADC0 SS2 uDMA done: a half buffer is full, hand it back to the uDMA and
+// average or filter it into the latest readings
+void ADC_MultiHalfISR(void){
+  const uint32_t *pRun = &Samples[FullHalf*RunsPerHalf*StepsPerRun];
+  uint32_t Sums[4] = {0,0,0,0};
+  uint32_t Filtered[StepsPerRun];
+  uint8_t Run;
+  uint8_t i;
+  ES_Event ReadyEvent;
+
+  // clear the source of the interrupt, the uDMA done and the raw status the
+  // runs leave behind; anything but a done has no half to hand back
+  ADC0_ISC_R = ADC_ISC_IN2;
+  if ((UDMA_CHIS_R & ADC0SS2DMABit) == 0)
+    return;
+  UDMA_CHIS_R = ADC0SS2DMABit;
+  DMA_RearmPingPong(ADC0SS2DMAChannel);
+
+  if (RunFilter != 0){
+    // filter a copy, the half stays raw for ADC_MultiGetHalf
+    for (Run=0; Run< RunsPerHalf; Run++){
+      for (i=0; i< StepsPerRun; i++){
+        Filtered[i] = pRun[i]&0xFFF;
+      }
+      RunFilter(Filtered);
+      pRun += StepsPerRun;
+    }
+    for (i=0; i< NumChannelsConverting; i++){
+      Latest[i] = Filtered[i];
+    }
+  }else{
+    for (Run=0; Run< RunsPerHalf; Run++){
+      for (i=0; i< NumChannelsConverting; i++){
+        Sums[i] += pRun[i]&0xFFF;
+      }
+      pRun += StepsPerRun;
+    }
+    for (i=0; i< NumChannelsConverting; i++){
+      Latest[i] = Sums[i]/RunsPerHalf;
+    }
+  }
+
+  if (HalfSubscriber != 0){
+    ReadyEvent.EventType = ADC_HALF_READY;
+    ReadyEvent.EventParam = FullHalf;
+    HalfSubscriber(ReadyEvent);
+  }
+  FullHalf ^= 1;
 }
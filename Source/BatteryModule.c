@@ -0,0 +1,211 @@
+/****************************************************************************
+BatteryModule
+	Battery voltage on E2 (AIN1, the third ADMulti channel) through a
+	divider, filtered, and the feed-forward that goes with it: PWMmodule
+	scales every motor duty cycle by BATTERY_NOMINAL_MV over the battery,
+	so a duty cycle gets the same motor voltage on a tired pack as on the
+	pack the wheel, flywheel and wire follow gains were tuned on.
+	BATTERY_LOW goes to RobotTopSM when the filtered voltage drops under
+	BATTERY_LOW_MV, once until it is back over it by LowHysteresisMV.
+
+ Notes
+	Check4BatteryLow calls Battery_Update from the event checkers; it
+	samples every SampleMS through ADC_MultiRead, so the input recorder
+	logs the readings and a replay scales the motors the same way.
+	The filter's time constant is a couple of seconds, for the state of
+	the pack, not the sag of every motor start.
+	A reading under NoBatteryMV is the board on USB (or QEMU): the motors
+	get no compensation and there is no BATTERY_LOW.
+	Only a reading a 2S pack can give (MinPackMV to MaxPackMV) scales the
+	motors; anything else is a wrong divider or a bad sample, and the duty
+	cycles go through as they are until the reading is back in range.
+	Battery_PrintStatus ('v' on the console) prints the voltage and scale.
+	Unverified configuration: MVPerCountQ8 assumes a 3:1 divider that
+	hasn't been measured on the robot. Check 'v' against a meter on the
+	pack and correct it.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "ADMulti.h"
+
+#include "BatteryModule.h"
+#include "PWMmodule.h"
+#include "RobotTopSM.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define SampleMS 100
+// mV per ADC count, Q8: 3.3V full scale behind a 3:1 divider.
+// Unverified configuration, the divider is not measured yet
+#define MVPerCountQ8 619
+// what a 2S pack reads, flat to full; the motors are only scaled in here
+#define MinPackMV 6000
+#define MaxPackMV 9000
+// first order filter, 1/16 a sample: about 1.6s at 10 samples a second
+#define FilterShift 4
+#define NoBatteryMV 4000
+#define LowHysteresisMV 300
+
+// PWMmodule's duty cycle scale, Q12, kept within half to one and a half
+#define ScaleShift 12
+#define ScaleOne (1 << ScaleShift)
+#define MinScale (ScaleOne/2)
+#define MaxScale (3*ScaleOne/2)
+
+/*---------------------------- Module Functions ---------------------------*/
+static uint16_t ReadMV( void );
+static void SetScale( void );
+
+/*---------------------------- Module Variables ---------------------------*/
+// filtered voltage, mV << FilterShift
+static uint32_t Filtered;
+static uint16_t LastSample;
+static uint16_t Scale = ScaleOne;
+static bool LowPosted;
+static bool InRange;
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+    InitBattery
+
+ Description
+    Starts the filter at the battery now, so the first scale is right.
+    Call after InitRLCSensor, which starts the ADC.
+****************************************************************************/
+void InitBattery( void )
+{
+  Filtered = (uint32_t)ReadMV() << FilterShift;
+  LowPosted = false;
+  SetScale();
+}
+
+/****************************************************************************
+ Function
+    Battery_Update
+
+ Returns
+    bool : true if BATTERY_LOW was posted
+
+ Description
+    A sample every SampleMS, through the filter into PWMmodule's scale
+****************************************************************************/
+bool Battery_Update( void )
+{
+  static uint16_t LastTime;
+  uint16_t Now = ES_Timer_GetTime();
+  uint16_t MV;
+  ES_Event ThisEvent;
+
+  if ((uint16_t)(Now - LastTime) < SampleMS)
+  {
+    return false;
+  }
+  LastTime = Now;
+
+  Filtered += ((int32_t)((uint32_t)ReadMV() << FilterShift) - (int32_t)Filtered) >> FilterShift;
+  SetScale();
+
+  MV = Battery_GetMV();
+  if (MV < NoBatteryMV)
+  {
+    return false;
+  }
+  if (MV > BATTERY_LOW_MV + LowHysteresisMV)
+  {
+    LowPosted = false;
+  }
+  else if ((MV < BATTERY_LOW_MV) && !LowPosted)
+  {
+    LowPosted = true;
+    ThisEvent.EventType = BATTERY_LOW;
+    ThisEvent.EventParam = MV;
+    PostRobotTopSM(ThisEvent);
+    return true;
+  }
+  return false;
+}
+
+/****************************************************************************
+ Function
+    Battery_GetMV
+
+ Description
+    The filtered battery voltage
+****************************************************************************/
+uint16_t Battery_GetMV( void )
+{
+  return (uint16_t)(Filtered >> FilterShift);
+}
+
+/****************************************************************************
+ Function
+    Battery_IsLow
+
+ Description
+    Whether BATTERY_LOW has gone out and the battery hasn't come back since
+****************************************************************************/
+bool Battery_IsLow( void )
+{
+  return LowPosted;
+}
+
+/****************************************************************************
+ Function
+    Battery_PrintStatus
+
+ Description
+    Console dump of the battery and the duty cycle scale
+****************************************************************************/
+void Battery_PrintStatus( void )
+{
+  printf("\r\nBattery %u mV (last sample %u mV), duty x%u/%u%s%s\r\n",
+         (unsigned)Battery_GetMV(), (unsigned)LastSample, (unsigned)Scale,
+         (unsigned)ScaleOne, LowPosted ? ", low" : "",
+         InRange ? "" : ", not a 2S pack so not scaled");
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+static uint16_t ReadMV( void )
+{
+  uint32_t Readings[4];
+
+  ADC_MultiRead(Readings);
+  LastSample = (uint16_t)((Readings[ADC_BATTERY_CHANNEL]*MVPerCountQ8) >> 8);
+  return LastSample;
+}
+
+/***************************************************************************
+  SetScale
+    BATTERY_NOMINAL_MV over the battery to PWMmodule, or no scaling with
+    no pack reading to go by
+ ***************************************************************************/
+static void SetScale( void )
+{
+  uint16_t MV = Battery_GetMV();
+  uint32_t NewScale;
+
+  InRange = ((MV >= MinPackMV) && (MV <= MaxPackMV));
+  if (!InRange)
+  {
+    NewScale = ScaleOne;
+  }
+  else
+  {
+    NewScale = ((uint32_t)BATTERY_NOMINAL_MV << ScaleShift)/MV;
+    if (NewScale < MinScale)
+    {
+      NewScale = MinScale;
+    }
+    else if (NewScale > MaxScale)
+    {
+      NewScale = MaxScale;
+    }
+  }
+  Scale = (uint16_t)NewScale;
+  SetPWMSupplyScale(Scale);
+}
@@ -0,0 +1,552 @@
+/****************************************************************************
+BeaconAlignModule
+	Turns the robot onto a beacon, coarse then fine. The sweep turns in
+	place fast and logs, every ALIGN_SAMPLE_MS, whether the front IR code
+	is the goal's against the odometry heading. The goal is seen over a
+	window of headings; from the window's leading and trailing edges the
+	beacon is at their middle, and the robot turns back there on a
+	decelerating profile and brakes on it.
+	ShootingSubSM's aim region calls Align_Start on entry and Align_Step
+	with each IR code until it returns true. If the goal's window hasn't
+	closed after SweepLimitRad of sweep, or the robot isn't on the beacon
+	AlignLimitMS after the start, the alignment gives up, brakes and posts
+	ALIGN_FAILED to RobotTopSM instead.
+
+ Notes
+	Both turns run on the wheel speed loop (driveSpeed), so the sweep rate
+	doesn't change with the battery. The way back slows as the square root
+	of the arc left, the speed that stops the wheels at ReturnDecelMMPerS2
+	right on the centre, down to ReturnMinMMPerS to creep the last degree.
+	An edge takes EdgeSamples in a row, so one bad code neither opens nor
+	closes the window. A sweep that starts inside the window has no leading
+	edge to go by, so the window only counts once the goal has been out of
+	sight.
+	Align_PrintStats ('b' on the console) prints the last window and the
+	mean and worst time to align over the alignments so far.
+	Build with TEST defined for the host model of the turn in the test
+	harness at the end of the file.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+#include <math.h>
+#include "ES_Configure.h"
+#if !defined(TEST)
+#include "ES_Framework.h"
+#endif
+
+#include "BeaconAlignModule.h"
+#include "OdometryModule.h"
+#include "MotorActionsModule.h"
+#include "RobotTopSM.h"
+
+#if defined(TEST)
+// the model's stand-in, with driveSpeed, brakeStop and Odo_GetPose
+uint16_t ES_Timer_GetTime( void );
+#endif
+
+/*----------------------------- Module Defines ----------------------------*/
+#define Pi 3.14159265f
+#define RadiansToDegrees10 (1800.0f/Pi)
+
+// wheel speeds of the turns, mm/s
+#define SweepMMPerS 300.0f
+#define ReturnMinMMPerS 40.0f
+#define ReturnDecelMMPerS2 1500.0f
+
+// consecutive samples that make an edge
+#define EdgeSamples 2
+// close enough to the centre to brake, 1.5 degrees
+#define AlignToleranceRad (1.5f*Pi/180.0f)
+// give up: no window after a full turn and 30 degrees, or not aligned in
+// 6s (a full turn of sweep takes about 2.4s)
+#define SweepLimitRad (2.0f*Pi + 30.0f*Pi/180.0f)
+#define AlignLimitMS 6000
+
+typedef enum { AlignIdle, AlignSweeping, AlignReturning } AlignPhase_t;
+
+/*---------------------------- Module Functions ---------------------------*/
+static float Heading( void );
+static float Wrap( float Angle );
+static void SweepStep( bool Valid, float Now );
+static bool ReturnStep( float Now );
+static void GiveUp( void );
+static int32_t Degrees10( float Angle );
+
+/*---------------------------- Module Variables ---------------------------*/
+static AlignPhase_t Phase = AlignIdle;
+static uint8_t Goal;
+
+// window of the sweep in progress
+static bool SeenInvalid;
+static bool InWindow;
+static uint8_t Run;
+static float FirstValid;
+static float LastValid;
+static float Lead;
+static float Trail;
+static float Centre;
+// sweep turned so far
+static float LastHeading;
+static float Turned;
+
+// time to align
+static uint16_t StartTime;
+static uint16_t Aligned;
+static uint32_t SumMS;
+static uint16_t WorstMS;
+static uint16_t LastMS;
+static uint16_t Failed;
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+    Align_Start
+
+ Parameters
+    uint8_t : the IR code of the goal's beacon
+    bool : true to sweep clockwise
+
+ Description
+    Starts the sweep from where the robot is facing now
+****************************************************************************/
+void Align_Start( uint8_t GoalCode, bool Clockwise )
+{
+  Goal = GoalCode;
+  SeenInvalid = false;
+  InWindow = false;
+  Run = 0;
+  LastHeading = Heading();
+  Turned = 0.0f;
+  StartTime = ES_Timer_GetTime();
+  Phase = AlignSweeping;
+
+  // clockwise turns the heading down: left wheel forward, right back
+  if (Clockwise)
+  {
+    driveSpeed((int16_t)SweepMMPerS, -(int16_t)SweepMMPerS);
+  }
+  else
+  {
+    driveSpeed(-(int16_t)SweepMMPerS, (int16_t)SweepMMPerS);
+  }
+}
+
+/****************************************************************************
+ Function
+    Align_Step
+
+ Parameters
+    uint8_t : the front IR code now
+
+ Returns
+    bool : true once the robot is on the beacon's centre and braking,
+    false also after giving up with ALIGN_FAILED
+****************************************************************************/
+bool Align_Step( uint8_t Code )
+{
+  float Now = Heading();
+
+  if (Phase == AlignIdle)
+  {
+    return false;
+  }
+  if ((uint16_t)(ES_Timer_GetTime() - StartTime) > AlignLimitMS)
+  {
+    GiveUp();
+    return false;
+  }
+
+  if (Phase == AlignSweeping)
+  {
+    Turned += fabsf(Wrap(Now - LastHeading));
+    LastHeading = Now;
+    if (Turned > SweepLimitRad)
+    {
+      GiveUp();
+      return false;
+    }
+    SweepStep(Code == Goal, Now);
+    return false;
+  }
+  if (Phase == AlignReturning)
+  {
+    return ReturnStep(Now);
+  }
+  return false;
+}
+
+/****************************************************************************
+ Function
+    Align_Stop
+
+ Description
+    Gives up an alignment in progress and brakes
+****************************************************************************/
+void Align_Stop( void )
+{
+  if (Phase != AlignIdle)
+  {
+    Phase = AlignIdle;
+    brakeStop(MOTOR_STOP_BRAKE_MS);
+  }
+}
+
+/****************************************************************************
+ Function
+    Align_PrintStats
+
+ Description
+    Console dump of the last window and the times to align so far
+****************************************************************************/
+void Align_PrintStats( void )
+{
+  printf("\r\nBeacon window %ld to %ld (0.1 deg), centre %ld\r\n",
+         (long)Degrees10(Lead), (long)Degrees10(Trail), (long)Degrees10(Centre));
+  printf("%u alignments, last %u ms, mean %lu ms, worst %u ms, %u given up\r\n",
+         (unsigned)Aligned, (unsigned)LastMS,
+         (unsigned long)((Aligned != 0) ? (SumMS/Aligned) : 0), (unsigned)WorstMS,
+         (unsigned)Failed);
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+/***************************************************************************
+  SweepStep
+    One sample of the sweep: finds the edges of the goal's window and
+    starts the way back when the trailing one is seen
+ ***************************************************************************/
+static void SweepStep( bool Valid, float Now )
+{
+  if (!SeenInvalid)
+  {
+    SeenInvalid = !Valid;
+    return;
+  }
+
+  if (!InWindow)
+  {
+    if (!Valid)
+    {
+      Run = 0;
+      return;
+    }
+    if (Run++ == 0)
+    {
+      FirstValid = Now;
+    }
+    if (Run >= EdgeSamples)
+    {
+      InWindow = true;
+      Lead = FirstValid;
+      LastValid = Now;
+      Run = 0;
+    }
+    return;
+  }
+
+  if (Valid)
+  {
+    LastValid = Now;
+    Run = 0;
+    return;
+  }
+  if (++Run >= EdgeSamples)
+  {
+    Trail = LastValid;
+    Centre = Wrap(Lead + Wrap(Trail - Lead)/2.0f);
+    Phase = AlignReturning;
+  }
+}
+
+/***************************************************************************
+  ReturnStep
+    One step of the way back to the centre, true when braking on it
+ ***************************************************************************/
+static bool ReturnStep( float Now )
+{
+  float Error = Wrap(Centre - Now);
+  float Speed;
+  uint16_t MS;
+
+  if (fabsf(Error) <= AlignToleranceRad)
+  {
+    brakeStop(MOTOR_STOP_BRAKE_MS);
+    Phase = AlignIdle;
+
+    MS = ES_Timer_GetTime() - StartTime;
+    LastMS = MS;
+    SumMS += MS;
+    if (MS > WorstMS)
+    {
+      WorstMS = MS;
+    }
+    Aligned++;
+    return true;
+  }
+
+  // the speed that stops the wheels on the centre, from the arc left
+  Speed = sqrtf(2.0f*ReturnDecelMMPerS2*fabsf(Error)*(ODO_TRACK_MM/2.0f));
+  if (Speed > SweepMMPerS)
+  {
+    Speed = SweepMMPerS;
+  }
+  else if (Speed < ReturnMinMMPerS)
+  {
+    Speed = ReturnMinMMPerS;
+  }
+  // counterclockwise, the heading going up, is the right wheel forward
+  if (Error < 0.0f)
+  {
+    Speed = -Speed;
+  }
+  driveSpeed(-(int16_t)Speed, (int16_t)Speed);
+  return false;
+}
+
+/***************************************************************************
+  GiveUp
+    Brakes and tells RobotTopSM the goal wasn't found
+ ***************************************************************************/
+static void GiveUp( void )
+{
+  ES_Event ThisEvent;
+
+  brakeStop(MOTOR_STOP_BRAKE_MS);
+  Phase = AlignIdle;
+  Failed++;
+
+  ThisEvent.EventType = ALIGN_FAILED;
+  ThisEvent.EventParam = (uint16_t)(Degrees10(Turned)/10);
+  PostRobotTopSM(ThisEvent);
+}
+
+static float Heading( void )
+{
+  Pose_t Pose;
+
+  Odo_GetPose(&Pose);
+  return Pose.Heading;
+}
+
+static float Wrap( float Angle )
+{
+  if (Angle > Pi)
+  {
+    return Angle - 2.0f*Pi;
+  }
+  if (Angle < -Pi)
+  {
+    return Angle + 2.0f*Pi;
+  }
+  return Angle;
+}
+
+static int32_t Degrees10( float Angle )
+{
+  return (int32_t)(Angle*RadiansToDegrees10);
+}
+
+#ifdef TEST
+/* Test harness: the sweep and the way back against a model of the robot
+   turning in place.
+
+   Host (from the repo root):
+      gcc -std=gnu99 -O2 -DTEST -IHeaders -o beaconalign Source/BeaconAlignModule.c -lm
+      ./beaconalign
+   The model runs at 1kHz. Each wheel follows its driveSpeed command with
+   a first order lag of WheelLagS, for the speed loop, and brakeStop takes
+   it to stopped with BrakeLagS. The heading is what the wheels' encoder
+   counts turn it by over ODO_TRACK_MM, as the odometry sees it at
+   ODO_RATE_HZ. The goal's code reads within WindowDeg of the beacon,
+   IRLagS after the robot gets there (the capture's run of periods), and
+   Align_Step gets a code every ALIGN_SAMPLE_MS as from ShootingSubSM.
+   For every beacon bearing and sweep direction it prints the time to
+   align and how far off the beacon the robot comes to rest; a rest more
+   than MaxErrorDeg off, or no alignment in time, fails. With no beacon
+   the alignment has to give up with ALIGN_FAILED within AlignLimitMS.
+   The program exits 1 on a failure. The lags are guesses for this robot,
+   not measurements.
+*/
+#include <stdlib.h>
+#include "CaptureEngine.h"
+
+#define ModelRateHz 1000
+#define WheelLagS 0.05
+#define BrakeLagS 0.02
+#define IRLagS 0.003
+#define WindowDeg 8.0
+#define MaxErrorDeg 2.0
+// time after the brake for the robot to come to rest
+#define SettleMS 300
+#define ModelMMPerCount (3.14159265*70.0/(4*12*30))
+#define NoBeacon 1000.0
+
+static uint32_t ModelMS;
+static double Command[2];
+static double Position[2];
+static double Speed[2];
+static double LagS = WheelLagS;
+static float OdoHeading;
+static bool Posted;
+static uint16_t PostedParam;
+
+uint16_t ES_Timer_GetTime( void )
+{
+  return (uint16_t)ModelMS;
+}
+
+void driveSpeed( int16_t LeftMMPerS, int16_t RightMMPerS )
+{
+  Command[0] = LeftMMPerS;
+  Command[1] = RightMMPerS;
+  LagS = WheelLagS;
+}
+
+void brakeStop( uint16_t BrakeMS )
+{
+  (void)BrakeMS;
+  Command[0] = Command[1] = 0.0;
+  LagS = BrakeLagS;
+}
+
+void Odo_GetPose( Pose_t *pPose )
+{
+  pPose->X = pPose->Y = 0.0f;
+  pPose->Heading = OdoHeading;
+}
+
+bool PostRobotTopSM( ES_Event ThisEvent )
+{
+  if (ThisEvent.EventType == ALIGN_FAILED)
+  {
+    Posted = true;
+    PostedParam = ThisEvent.EventParam;
+  }
+  return true;
+}
+
+// the true heading, from the wheels
+static double TrueHeading( void )
+{
+  return (Position[1] - Position[0])/ODO_TRACK_MM;
+}
+
+static double WrapDeg( double Degrees )
+{
+  return Degrees - 360.0*floor((Degrees + 180.0)/360.0);
+}
+
+static void ModelStep( void )
+{
+  uint8_t Side;
+
+  for (Side = 0; Side < 2; Side++)
+  {
+    Speed[Side] += (Command[Side] - Speed[Side])/(LagS*ModelRateHz);
+    Position[Side] += Speed[Side]/ModelRateHz;
+  }
+  ModelMS++;
+  if ((ModelMS % (1000/ODO_RATE_HZ)) == 0)
+  {
+    double Counts = floor(Position[1]/ModelMMPerCount) - floor(Position[0]/ModelMMPerCount);
+
+    OdoHeading = (float)(WrapDeg(Counts*ModelMMPerCount/ODO_TRACK_MM*180.0/3.14159265)*
+                         3.14159265/180.0);
+  }
+}
+
+typedef struct
+{
+  bool Done;
+  uint32_t TimeMS;
+  double ErrorDeg;
+} Result_t;
+
+static Result_t RunAlign( double BeaconDeg, bool Clockwise )
+{
+  static double HeadingLog[ModelRateHz];
+  Result_t Result = { false, 0, 0.0 };
+  uint32_t Lag = (uint32_t)(IRLagS*ModelRateHz);
+  uint32_t n;
+  double Seen;
+  uint8_t Code;
+
+  ModelMS = 1;
+  Position[0] = Position[1] = 0.0;
+  Speed[0] = Speed[1] = 0.0;
+  Command[0] = Command[1] = 0.0;
+  OdoHeading = 0.0f;
+  Posted = false;
+  for (n = 0; n < ModelRateHz; n++)
+  {
+    HeadingLog[n] = 0.0;
+  }
+
+  Align_Start(1, Clockwise);
+  for (n = 0; n < (uint32_t)(AlignLimitMS + 1000); n++)
+  {
+    ModelStep();
+    HeadingLog[ModelMS % ModelRateHz] = TrueHeading()*180.0/3.14159265;
+    if ((ModelMS % ALIGN_SAMPLE_MS) != 0)
+    {
+      continue;
+    }
+    Seen = HeadingLog[(ModelMS - Lag) % ModelRateHz];
+    Code = ((BeaconDeg != NoBeacon) && (fabs(WrapDeg(Seen - BeaconDeg)) < WindowDeg)) ?
+           1 : CAP_INVALID_CODE;
+    if (Align_Step(Code))
+    {
+      Result.Done = true;
+      Result.TimeMS = ModelMS - 1;
+      break;
+    }
+    if (Posted)
+    {
+      Result.TimeMS = ModelMS - 1;
+      return Result;
+    }
+  }
+  for (n = 0; n < SettleMS; n++)
+  {
+    ModelStep();
+  }
+  Result.ErrorDeg = WrapDeg(TrueHeading()*180.0/3.14159265 - BeaconDeg);
+  return Result;
+}
+
+int main( void )
+{
+  static const double Bearings[] = { 0.0, 20.0, 90.0, 180.0, 270.0, 340.0 };
+  unsigned i, Dir;
+  int Failures = 0;
+  Result_t Result;
+  bool Pass;
+
+  printf("%8s %4s | %7s %9s\n", "bearing", "turn", "aligned", "rest off");
+  for (Dir = 0; Dir < 2; Dir++)
+  {
+    for (i = 0; i < sizeof(Bearings)/sizeof(Bearings[0]); i++)
+    {
+      // clockwise is the heading going down, so the beacon is at -bearing
+      double BeaconDeg = Dir ? -Bearings[i] : Bearings[i];
+
+      Result = RunAlign(BeaconDeg, Dir != 0);
+      Pass = Result.Done && (fabs(Result.ErrorDeg) <= MaxErrorDeg);
+      printf("%8.0f %4s | %5lums %7.2fdeg%s\n", Bearings[i], Dir ? "cw" : "ccw",
+             (unsigned long)Result.TimeMS, Result.ErrorDeg, Pass ? "" : "  FAIL");
+      Failures += !Pass;
+    }
+  }
+
+  Result = RunAlign(NoBeacon, true);
+  Pass = !Result.Done && Posted && (Result.TimeMS <= AlignLimitMS + ALIGN_SAMPLE_MS);
+  printf("%8s %4s | gave up after %lums and %u deg%s\n", "none", "cw",
+         (unsigned long)Result.TimeMS, (unsigned)PostedParam, Pass ? "" : "  FAIL");
+  Failures += !Pass;
+
+  printf("%s\n", Failures ? "FAILED" : "passed");
+  return Failures ? 1 : 0;
+}
+#endif /* TEST */
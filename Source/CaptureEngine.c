@@ -0,0 +1,819 @@
+/****************************************************************************
+CaptureEngine
+	Frequency measurement for every sensor that is read by timing the
+	period between rising edges on a wide timer capture pin: the staging
+	area hall effect sensor and the front and back IR beacon receivers.
+
+	Each channel is one entry in the Channels table: the wide timer, which
+	of its subtimers and pin,
+	how many periods in a row have to agree, and a list of bands (period and
+	tolerance in us). A period inside band i classifies as code i. Adding a
+	sensor takes a band list, a Channels entry and a name in CaptureEngine.h;
+	its ISR calls Capture_HandleEdge.
+
+ Notes
+	Periods are kept in timer ticks (25 ns). The ISR only stores the raw
+	tick delta in the channel's ring of the last CaptureRingSize periods
+	and counts it. Capture_GetCode and Capture_GetConfidence classify the
+	periods that came in since they were last called and extend or restart
+	the cached run of periods with one code, so polling with no new edges
+	costs a compare. If more than a ring's worth came in between reads the
+	run restarts from the oldest period still in the ring, which is still
+	more than any SampleWindow. A period in us is converted by whoever asks.
+	Band edges are in ticks at compile time, and a lookup table built from
+	them at init (carved from a shared pool) maps a period to its code in one
+	step.
+	On a per edge channel only its ISR writes the ring and EdgeCount moves
+	after the slot it passes is written, so thread level readers of periods
+	need no critical section as long as they read fewer than CaptureRingSize
+	entries back. The run is updated in a critical section, since the
+	staging area ISR reads its own code.
+	The IR channels don't interrupt per edge: each capture event triggers a
+	uDMA transfer of the capture register into a ping-pong buffer of raw
+	edge times, and the timer interrupts only when a half of it is full
+	(DMAHalfSize edges). That ISR and any reader turn the edges that came
+	in since into periods in the ring (CatchUp), so a code is never older
+	than the last edge. The staging area stays on per edge interrupts since
+	it has to restart the field lost timeout and post STATION_REACHED on the
+	edge that confirms a station. The record and replay builds and QEMU,
+	which has no uDMA, take every edge as an interrupt so a replay sees the
+	edges one by one as they were recorded.
+	Build with CAPTURE_ISR_STATS defined to time the capture ISRs with the
+	DWT cycle counter ('c' on the console prints interrupts, edges, cycles
+	and the share of the CPU they took). 'C' switches the uDMA channels to
+	per edge interrupts and back, so the two can be compared on the same
+	beacons.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "inc/hw_gpio.h"
+#include "inc/hw_sysctl.h"
+#include "inc/hw_timer.h"
+#include "inc/hw_nvic.h"
+#include "inc/hw_udma.h"
+
+#include "ES_Port.h"
+
+#include "CaptureEngine.h"
+#include "DMAModule.h"
+#include "InputRecorder.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define TicksPerUS 40
+#define BitsPerNibble 4
+// alternate function number of WTnCCP0 and WTnCCP1 on all of the capture pins
+#define CCPFunction 7
+// periods kept per channel, must be a power of 2
+#define CaptureRingSize 16
+// classifier bins for all channels, 992 are in use
+#define ClassifierPoolSize 1024
+// DMAChannel of a channel that interrupts on every edge
+#define NoDMA 0xff
+// edges per ping-pong half, at least the largest DMAHalfSize in Channels
+#define MaxDMAHalfSize 8
+// uDMA channel encoding of the wide timers
+#define WideTimerEncoding 3
+// a channel's Run: code of the latest period in the low byte, how many
+// periods in a row had it in the high byte
+#define RunCode(Run) ((uint8_t)(Run))
+#define RunCount(Run) ((uint8_t)((Run) >> 8))
+#define MaxRunCount 0xff
+
+#if !defined(RECORD_INPUTS) && !defined(REPLAY_INPUTS) && !defined(QEMU)
+#define CAPTURE_DMA
+#endif
+
+/*---------------------------- Module Types -------------------------------*/
+// a period strictly between LowTicks and HighTicks is in the band
+typedef struct
+{
+  uint32_t LowTicks;
+  uint32_t HighTicks;
+} CaptureBand_t;
+
+// band of periods within +/- ToleranceUS of PeriodUS
+#define CAP_BAND(PeriodUS, ToleranceUS) \
+  { ((PeriodUS) - (ToleranceUS))*TicksPerUS, ((PeriodUS) + (ToleranceUS))*TicksPerUS }
+
+typedef enum { SubtimerA, SubtimerB } Subtimer_t;
+
+// the registers and bits of one subtimer of a wide timer
+typedef struct
+{
+  uint32_t ModeOffset;     // TnMR
+  uint32_t LoadOffset;     // TnILR
+  uint32_t CaptureOffset;  // TnR, the time of the latest capture
+  uint32_t ModeClear;      // TnMR bits cleared for edge time capture
+  uint32_t ModeSet;        // and set
+  uint32_t Enable;         // CTL TnEN
+  uint32_t Stall;          // CTL TnSTALL
+  uint32_t EventMask;      // CTL TnEVENT, 0 for rising edges
+  uint32_t CaptureInt;     // IMR/ICR capture event bit
+  uint32_t DMAInt;         // IMR/ICR uDMA done bit
+} SubtimerRegs_t;
+
+typedef struct
+{
+  uint32_t TimerBase;      // wide timer
+  Subtimer_t Subtimer;     // the half the capture runs on
+  uint32_t TimerClock;     // its SYSCTL_RCGCWTIMER bit
+  uint32_t PortBase;       // port of the WTnCCP0/1 pin
+  uint32_t PortClock;      // its SYSCTL_RCGCGPIO bit
+  uint8_t Pin;
+  uint8_t IntNumber;       // NVIC interrupt number of the subtimer
+  uint8_t SampleWindow;    // periods in a row with one code before it counts
+  uint8_t BinShift;        // classifier bins are 2^BinShift ticks wide
+  uint8_t NumBands;
+  const CaptureBand_t *pBands;
+  uint8_t DMAChannel;      // uDMA channel of the subtimer, NoDMA for per edge interrupts
+  uint8_t DMAHalfSize;     // edges per interrupt when on uDMA
+} ChannelDesc_t;
+
+typedef struct
+{
+  uint32_t LastEdge;
+  uint32_t Periods[CaptureRingSize];
+  volatile uint32_t EdgeCount;  // periods stored, the next goes in slot EdgeCount % CaptureRingSize
+  uint32_t Classified;     // EdgeCount as of the last UpdateRun
+  uint16_t Run;            // see RunCode/RunCount, as of Classified
+  uint8_t *pTable;
+  uint16_t NumBins;
+  uint32_t TableStart;     // period in ticks at the start of bin 0
+  bool OnDMA;
+  uint16_t EdgesRead;      // next edge in Edges to turn into a period
+  uint32_t Edges[2*MaxDMAHalfSize];  // written by the uDMA
+} ChannelState_t;
+
+// the channel number is also the input recorder channel of its edges
+typedef char CaptureChannelsMatchRecorder[(NUM_CAP_CHANNELS == REC_NUM_CHANNELS) ? 1 : -1];
+
+#if defined(CAPTURE_ISR_STATS)
+typedef struct
+{
+  uint32_t Count;
+  uint32_t Edges;
+  uint32_t TotalCycles;
+  uint32_t MinCycles;
+  uint32_t MaxCycles;
+} IsrStats_t;
+#endif
+
+/*---------------------------- Module Functions ---------------------------*/
+static void BuildClassifier( CaptureChannel_t Channel );
+static uint32_t PeriodAt( const ChannelState_t *pState, uint8_t Age );
+static void AddEdge( CaptureChannel_t Channel, uint32_t Edge );
+static uint8_t CatchUp( CaptureChannel_t Channel );
+static uint16_t UpdateRun( CaptureChannel_t Channel );
+
+/*---------------------------- Module Variables ---------------------------*/
+// staging area periods, the code is the 4 bit staging area frequency code
+static const CaptureBand_t StagingBands[] =
+{
+  CAP_BAND(1333, 10), CAP_BAND(1277, 10), CAP_BAND(1222, 10), CAP_BAND(1166, 10),
+  CAP_BAND(1111, 10), CAP_BAND(1055, 10), CAP_BAND(1000, 10), CAP_BAND( 944, 10),
+  CAP_BAND( 889, 10), CAP_BAND( 833, 10), CAP_BAND( 778, 10), CAP_BAND( 722, 10),
+  CAP_BAND( 667, 10), CAP_BAND( 611, 10), CAP_BAND( 556, 10), CAP_BAND( 500, 10)
+};
+
+// IR beacon periods: 1250Hz green supply depot, 1450Hz bucket nav beacon,
+// 1700Hz red nav beacon, 1950Hz red supply depot, 2200Hz green nav beacon
+static const CaptureBand_t BeaconBands[] =
+{
+  CAP_BAND(800, 10), CAP_BAND(690, 10), CAP_BAND(588, 10), CAP_BAND(513, 10), CAP_BAND(455, 10)
+};
+
+static const SubtimerRegs_t Subtimers[2] =
+{
+  { TIMER_O_TAMR, TIMER_O_TAILR, TIMER_O_TAR, TIMER_TAMR_TAAMS,
+    TIMER_TAMR_TACDIR | TIMER_TAMR_TACMR | TIMER_TAMR_TAMR_CAP,
+    TIMER_CTL_TAEN, TIMER_CTL_TASTALL, TIMER_CTL_TAEVENT_M, TIMER_IMR_CAEIM, TIMER_IMR_DMAAIM },
+  { TIMER_O_TBMR, TIMER_O_TBILR, TIMER_O_TBR, TIMER_TBMR_TBAMS,
+    TIMER_TBMR_TBCDIR | TIMER_TBMR_TBCMR | TIMER_TBMR_TBMR_CAP,
+    TIMER_CTL_TBEN, TIMER_CTL_TBSTALL, TIMER_CTL_TBEVENT_M, TIMER_IMR_CBEIM, TIMER_IMR_DMABIM }
+};
+
+static const ChannelDesc_t Channels[NUM_CAP_CHANNELS] =
+{
+  // CAP_STAGING: hall effect sensor on C4, WT0CCP0, interrupt 94
+  { WTIMER0_BASE, SubtimerA, SYSCTL_RCGCWTIMER_R0, GPIO_PORTC_BASE, SYSCTL_RCGCGPIO_R2, 4, 94,
+    10, 6, sizeof(StagingBands)/sizeof(StagingBands[0]), StagingBands, NoDMA, 1 },
+  // CAP_FRONT_IR: IR receiver on the ball intake side on C7, WT1CCP1, interrupt 97, uDMA 13
+  // (C6 went to the right wheel's encoder and D4 is USB0DM, so the wire
+  // moves from C6: see the pin map in README.md); the game timer has WT1's
+  // A half
+  { WTIMER1_BASE, SubtimerB, SYSCTL_RCGCWTIMER_R1, GPIO_PORTC_BASE, SYSCTL_RCGCGPIO_R2, 7, 97,
+    4, 6, sizeof(BeaconBands)/sizeof(BeaconBands[0]), BeaconBands, 13, 8 },
+  // CAP_BACK_IR: IR receiver on the shooter side on D2, WT3CCP0, interrupt 100, uDMA 24
+  { WTIMER3_BASE, SubtimerA, SYSCTL_RCGCWTIMER_R3, GPIO_PORTD_BASE, SYSCTL_RCGCGPIO_R3, 2, 100,
+    4, 6, sizeof(BeaconBands)/sizeof(BeaconBands[0]), BeaconBands, 24, 8 }
+};
+
+static ChannelState_t State[NUM_CAP_CHANNELS];
+static uint8_t ClassifierPool[ClassifierPoolSize];
+static uint16_t PoolUsed;
+#if defined(CAPTURE_ISR_STATS)
+static IsrStats_t IsrStats[NUM_CAP_CHANNELS];
+#endif
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+    Capture_InitChannel
+
+ Parameters
+    CaptureChannel_t : the channel to set up
+
+ Description
+    Builds the channel's classifier and sets its wide timer half up for
+    rising edge capture, counting up over the full 32 bits, with either the
+    capture interrupt or (on uDMA) the uDMA done interrupt enabled. The
+    timer is left stopped, see Capture_Enable.
+****************************************************************************/
+void Capture_InitChannel( CaptureChannel_t Channel )
+{
+  const ChannelDesc_t *pDesc = &Channels[Channel];
+  const SubtimerRegs_t *pSub = &Subtimers[pDesc->Subtimer];
+
+  BuildClassifier(Channel);
+  State[Channel].Run = CAP_INVALID_CODE;
+#if defined(CAPTURE_ISR_STATS)
+  _HW_CycleCounterInit();
+#endif
+
+  // enable the clock to the wide timer and to the port
+  HWREG(SYSCTL_RCGCWTIMER) |= pDesc->TimerClock;
+  HWREG(SYSCTL_RCGCGPIO) |= pDesc->PortClock;
+
+  // make sure the subtimer is disabled before configuring
+  HWREG(pDesc->TimerBase + TIMER_O_CTL) &= ~pSub->Enable;
+
+  // set up the timer in 32bit wide mode (non-concatenated), both halves
+  // apart, which is also what a timer sharing the other half sets
+  HWREG(pDesc->TimerBase + TIMER_O_CFG) = TIMER_CFG_16_BIT;
+
+  // use the full 32 bit count
+  HWREG(pDesc->TimerBase + pSub->LoadOffset) = 0xffffffff;
+
+  // capture mode (TnMR=3, TnAMS=0), edge time (TnCMR=1), up-counting (TnCDIR=1)
+  HWREG(pDesc->TimerBase + pSub->ModeOffset) =
+    (HWREG(pDesc->TimerBase + pSub->ModeOffset) & ~pSub->ModeClear) | pSub->ModeSet;
+
+  // capture on rising edges (TnEVENT = 00)
+  HWREG(pDesc->TimerBase + TIMER_O_CTL) &= ~pSub->EventMask;
+
+  // route the pin to WTnCCP0/1 as a digital input
+  HWREG(pDesc->PortBase + GPIO_O_AFSEL) |= (1 << pDesc->Pin);
+  HWREG(pDesc->PortBase + GPIO_O_PCTL) =
+    (HWREG(pDesc->PortBase + GPIO_O_PCTL) & ~(0xf << (BitsPerNibble*pDesc->Pin))) +
+    (CCPFunction << (BitsPerNibble*pDesc->Pin));
+  HWREG(pDesc->PortBase + GPIO_O_DEN) |= (1 << pDesc->Pin);
+  HWREG(pDesc->PortBase + GPIO_O_DIR) &= ~(1 << pDesc->Pin);
+
+#if defined(CAPTURE_DMA)
+  if (pDesc->DMAChannel != NoDMA)
+  {
+    // every capture event is a uDMA request whether or not it is unmasked,
+    // so only the done interrupt (a full half) reaches the NVIC
+    State[Channel].OnDMA = true;
+    State[Channel].EdgesRead = 0;
+    DMA_StartPingPong(pDesc->DMAChannel, WideTimerEncoding, pDesc->TimerBase + pSub->CaptureOffset,
+                      State[Channel].Edges, pDesc->DMAHalfSize, UDMA_CHCTL_ARBSIZE_1);
+    HWREG(pDesc->TimerBase + TIMER_O_IMR) =
+      (HWREG(pDesc->TimerBase + TIMER_O_IMR) & ~pSub->CaptureInt) | pSub->DMAInt;
+  }
+  else
+#endif
+  {
+    // enable the local capture interrupt
+    HWREG(pDesc->TimerBase + TIMER_O_IMR) |= pSub->CaptureInt;
+  }
+  // and the subtimer's interrupt in the NVIC
+  HWREG(NVIC_EN0 + ((pDesc->IntNumber >> 5) << 2)) |= (1 << (pDesc->IntNumber & 0x1f));
+
+  // make sure interrupts are enabled globally
+  __enable_irq();
+}
+
+/****************************************************************************
+ Function
+    Capture_Enable
+
+ Description
+    Starts (with stall in the debugger) or stops the channel's capture timer
+****************************************************************************/
+void Capture_Enable( CaptureChannel_t Channel, bool Enable )
+{
+  const SubtimerRegs_t *pSub = &Subtimers[Channels[Channel].Subtimer];
+
+  if (Enable)
+  {
+    HWREG(Channels[Channel].TimerBase + TIMER_O_CTL) |= (pSub->Enable | pSub->Stall);
+  }
+  else
+  {
+    HWREG(Channels[Channel].TimerBase + TIMER_O_CTL) &= ~pSub->Enable;
+  }
+}
+
+/****************************************************************************
+ Function
+    Capture_HandleEdge
+
+ Returns
+    uint32_t, the period that just ended in ticks
+
+ Description
+    The body of the channel's capture ISR: clears the interrupt and stores
+    the period in the ring, nothing more.
+****************************************************************************/
+uint32_t Capture_HandleEdge( CaptureChannel_t Channel )
+{
+  ChannelState_t *pState = &State[Channel];
+  const SubtimerRegs_t *pSub = &Subtimers[Channels[Channel].Subtimer];
+  uint32_t TimerBase = Channels[Channel].TimerBase;
+  uint32_t Edge;
+  uint32_t Period;
+
+  // clear the source of the interrupt
+  HWREG(TimerBase + TIMER_O_ICR) = pSub->CaptureInt;
+
+  // grab the captured value and store the period in ticks
+  Edge = REC_CAPTURE(Channel, HWREG(TimerBase + pSub->CaptureOffset));
+  Period = Edge - pState->LastEdge;
+  AddEdge(Channel, Edge);
+#if defined(CAPTURE_ISR_STATS)
+  IsrStats[Channel].Edges++;
+#endif
+
+  return Period;
+}
+
+/****************************************************************************
+ Function
+    Capture_HandleInterrupt
+
+ Returns
+    uint8_t, how many periods went into the ring
+
+ Description
+    The body of a capture ISR for a channel that may be on uDMA: takes the
+    half the uDMA just filled (and whatever it has written since), or a
+    single edge when the channel interrupts per edge.
+****************************************************************************/
+uint8_t Capture_HandleInterrupt( CaptureChannel_t Channel )
+{
+  const ChannelDesc_t *pDesc = &Channels[Channel];
+  const SubtimerRegs_t *pSub = &Subtimers[pDesc->Subtimer];
+  uint8_t NewPeriods;
+
+  if (!State[Channel].OnDMA)
+  {
+    Capture_HandleEdge(Channel);
+    return 1;
+  }
+
+  // clear the done interrupt and the capture flags that requested the
+  // transfers, then give the full half back to the uDMA
+  HWREG(pDesc->TimerBase + TIMER_O_ICR) = (pSub->DMAInt | pSub->CaptureInt);
+  DMA_RearmPingPong(pDesc->DMAChannel);
+
+  NewPeriods = CatchUp(Channel);
+#if defined(CAPTURE_ISR_STATS)
+  IsrStats[Channel].Edges += NewPeriods;
+#endif
+  return NewPeriods;
+}
+
+/****************************************************************************
+ Function
+    Capture_ClassifyPeriod
+
+ Returns
+    uint8_t, the code of the band the period (in ticks) falls in,
+    CAP_INVALID_CODE if none
+****************************************************************************/
+uint8_t Capture_ClassifyPeriod( CaptureChannel_t Channel, uint32_t PeriodTicks )
+{
+  const ChannelState_t *pState = &State[Channel];
+  uint32_t Bin;
+
+  if ((pState->pTable == NULL) || (PeriodTicks < pState->TableStart))
+  {
+    return CAP_INVALID_CODE;
+  }
+  Bin = (PeriodTicks - pState->TableStart) >> Channels[Channel].BinShift;
+  if (Bin >= pState->NumBins)
+  {
+    return CAP_INVALID_CODE;
+  }
+  return pState->pTable[Bin];
+}
+
+/****************************************************************************
+ Function
+    Capture_GetCode
+
+ Returns
+    uint8_t, the channel's code once the last SampleWindow periods all had
+    it, CAP_INVALID_CODE otherwise
+****************************************************************************/
+uint8_t Capture_GetCode( CaptureChannel_t Channel )
+{
+  uint16_t Run = UpdateRun(Channel);
+
+  if (RunCount(Run) < Channels[Channel].SampleWindow)
+  {
+    return CAP_INVALID_CODE;
+  }
+  return RunCode(Run);
+}
+
+/****************************************************************************
+ Function
+    Capture_GetConfidence
+
+ Returns
+    uint8_t, how many periods in a row, up to the latest, have had its
+    code (saturating at 255); 0 if the latest one was in no band
+****************************************************************************/
+uint8_t Capture_GetConfidence( CaptureChannel_t Channel )
+{
+  return RunCount(UpdateRun(Channel));
+}
+
+/****************************************************************************
+ Function
+    Capture_GetPeriod
+
+ Returns
+    uint32_t, the period in ticks that ended Age edges ago (0 is the latest),
+    0 if Age is past the ring
+****************************************************************************/
+uint32_t Capture_GetPeriod( CaptureChannel_t Channel, uint8_t Age )
+{
+  if (Age >= CaptureRingSize)
+  {
+    return 0;
+  }
+  CatchUp(Channel);
+  return PeriodAt(&State[Channel], Age);
+}
+
+/****************************************************************************
+ Function
+    Capture_GetPeriodUS
+
+ Returns
+    uint32_t, as Capture_GetPeriod but in us
+****************************************************************************/
+uint32_t Capture_GetPeriodUS( CaptureChannel_t Channel, uint8_t Age )
+{
+  return Capture_GetPeriod(Channel, Age)/TicksPerUS;
+}
+
+/****************************************************************************
+ Function
+    Capture_GetLastEdge
+
+ Returns
+    uint32_t, the capture timer value of the latest edge
+****************************************************************************/
+uint32_t Capture_GetLastEdge( CaptureChannel_t Channel )
+{
+  CatchUp(Channel);
+  return State[Channel].LastEdge;
+}
+
+/****************************************************************************
+ Function
+    Capture_Forget
+
+ Description
+    Clears the ring and the run, for when the signal is known to be gone.
+    Call it from the channel's ISR or one at the same priority.
+****************************************************************************/
+void Capture_Forget( CaptureChannel_t Channel )
+{
+  uint8_t i;
+
+  for (i = 0; i < CaptureRingSize; i++)
+  {
+    State[Channel].Periods[i] = 0;
+  }
+  State[Channel].Classified = State[Channel].EdgeCount;
+  State[Channel].Run = CAP_INVALID_CODE;
+}
+
+#if defined(CAPTURE_ISR_STATS)
+/****************************************************************************
+ Function
+    Capture_RecordIsr
+
+ Description
+    Adds one ISR run to the channel's stats, see CAP_ISR_END
+****************************************************************************/
+void Capture_RecordIsr( CaptureChannel_t Channel, uint32_t Cycles )
+{
+  IsrStats_t *pStats = &IsrStats[Channel];
+
+  if ((pStats->Count == 0) || (Cycles < pStats->MinCycles))
+  {
+    pStats->MinCycles = Cycles;
+  }
+  if (Cycles > pStats->MaxCycles)
+  {
+    pStats->MaxCycles = Cycles;
+  }
+  pStats->TotalCycles += Cycles;
+  pStats->Count++;
+}
+
+/****************************************************************************
+ Function
+    Capture_PrintIsrStats
+
+ Description
+    Console dump of the capture ISR counts since the last dump, then starts
+    them over. Per channel: interrupts and edges per second, cycles per
+    interrupt and the load in hundredths of a percent of the CPU.
+****************************************************************************/
+void Capture_PrintIsrStats( void )
+{
+  static const char * const ChannelNames[NUM_CAP_CHANNELS] =
+    { "Staging", "FrontIR", "BackIR" };
+  static uint32_t LastPrintMS;
+  uint32_t NowMS = _HW_GetLongTickCount();
+  uint32_t ElapsedMS = NowMS - LastPrintMS;
+  IsrStats_t Stats;
+  uint8_t Channel;
+
+  LastPrintMS = NowMS;
+  if (ElapsedMS == 0)
+  {
+    ElapsedMS = 1;
+  }
+
+  printf("\r\n%-8s %-5s %7s %7s %6s %6s %6s %6s\r\n", "Capture", "Mode", "Int/s", "Edges/s",
+         "Min", "Avg", "Max", "Load");
+  for (Channel = 0; Channel < NUM_CAP_CHANNELS; Channel++)
+  {
+    EnterCritical();
+    Stats = IsrStats[Channel];
+    IsrStats[Channel].Count = 0;
+    IsrStats[Channel].Edges = 0;
+    IsrStats[Channel].TotalCycles = 0;
+    IsrStats[Channel].MaxCycles = 0;
+    ExitCritical();
+
+    // load: cycles spent over cycles elapsed (TicksPerUS*1000 a ms), in 0.01%
+    printf("%-8s %-5s %7lu %7lu %6lu %6lu %6lu %3lu.%02lu%%\r\n", ChannelNames[Channel],
+           State[Channel].OnDMA ? "uDMA" : "edge",
+           (unsigned long)((uint64_t)Stats.Count*1000/ElapsedMS),
+           (unsigned long)((uint64_t)Stats.Edges*1000/ElapsedMS),
+           (unsigned long)Stats.MinCycles,
+           (unsigned long)(Stats.Count ? Stats.TotalCycles/Stats.Count : 0),
+           (unsigned long)Stats.MaxCycles,
+           (unsigned long)((uint64_t)Stats.TotalCycles*10000/((uint64_t)ElapsedMS*TicksPerUS*1000)/100),
+           (unsigned long)((uint64_t)Stats.TotalCycles*10000/((uint64_t)ElapsedMS*TicksPerUS*1000)%100));
+  }
+}
+
+/****************************************************************************
+ Function
+    Capture_ToggleDMA
+
+ Description
+    Moves every channel that can be on uDMA to per edge interrupts, or back
+    to uDMA, for a before and after of Capture_PrintIsrStats. Without
+    CAPTURE_DMA all channels are per edge and this does nothing.
+****************************************************************************/
+void Capture_ToggleDMA( void )
+{
+#if defined(CAPTURE_DMA)
+  const ChannelDesc_t *pDesc;
+  const SubtimerRegs_t *pSub;
+  ChannelState_t *pState;
+  uint8_t Channel;
+
+  for (Channel = 0; Channel < NUM_CAP_CHANNELS; Channel++)
+  {
+    pDesc = &Channels[Channel];
+    pSub = &Subtimers[pDesc->Subtimer];
+    pState = &State[Channel];
+    if (pDesc->DMAChannel == NoDMA)
+    {
+      continue;
+    }
+
+    if (pState->OnDMA)
+    {
+      // stop the transfers, take the edges already in the buffer, then
+      // interrupt on every capture
+      HWREG(UDMA_ENACLR) = (1 << pDesc->DMAChannel);
+      CatchUp(Channel);
+      EnterCritical();
+      pState->OnDMA = false;
+      HWREG(pDesc->TimerBase + TIMER_O_ICR) = (pSub->DMAInt | pSub->CaptureInt);
+      HWREG(pDesc->TimerBase + TIMER_O_IMR) =
+        (HWREG(pDesc->TimerBase + TIMER_O_IMR) & ~pSub->DMAInt) | pSub->CaptureInt;
+      ExitCritical();
+    }
+    else
+    {
+      EnterCritical();
+      pState->OnDMA = true;
+      pState->EdgesRead = 0;
+      DMA_StartPingPong(pDesc->DMAChannel, WideTimerEncoding, pDesc->TimerBase + pSub->CaptureOffset,
+                        pState->Edges, pDesc->DMAHalfSize, UDMA_CHCTL_ARBSIZE_1);
+      HWREG(pDesc->TimerBase + TIMER_O_IMR) =
+        (HWREG(pDesc->TimerBase + TIMER_O_IMR) & ~pSub->CaptureInt) | pSub->DMAInt;
+      ExitCritical();
+    }
+  }
+#endif
+  printf("\r\n IR capture now on %s, 'c' twice for a fresh count\r\n",
+         State[CAP_FRONT_IR].OnDMA ? "uDMA" : "per edge interrupts");
+}
+#endif
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+/***************************************************************************
+  BuildClassifier
+    Takes the channel's table from the pool and fills it from its bands.
+    The table spans the shortest band to the longest, tolerances included.
+    A bin gets a code only if all of it is strictly within tolerance of
+    that band, so a bin on the edge of a band reads as invalid.
+ ***************************************************************************/
+static void BuildClassifier( CaptureChannel_t Channel )
+{
+  const ChannelDesc_t *pDesc = &Channels[Channel];
+  ChannelState_t *pState = &State[Channel];
+  uint32_t Low = 0xffffffff;
+  uint32_t High = 0;
+  uint32_t BinStart;
+  uint32_t BinEnd;
+  uint16_t NumBins;
+  uint16_t Bin;
+  uint8_t i;
+
+  if (pState->pTable != NULL)
+  {
+    return; // built on an earlier init
+  }
+
+  for (i = 0; i < pDesc->NumBands; i++)
+  {
+    if (pDesc->pBands[i].LowTicks < Low)
+    {
+      Low = pDesc->pBands[i].LowTicks;
+    }
+    if (pDesc->pBands[i].HighTicks > High)
+    {
+      High = pDesc->pBands[i].HighTicks;
+    }
+  }
+
+  NumBins = ((High - Low) >> pDesc->BinShift) + 1;
+  if (PoolUsed + NumBins > ClassifierPoolSize)
+  {
+    printf("\r\n Capture channel %u needs %u classifier bins, raise ClassifierPoolSize\r\n",
+           Channel, NumBins);
+    return;
+  }
+  pState->pTable = &ClassifierPool[PoolUsed];
+  pState->NumBins = NumBins;
+  pState->TableStart = Low;
+  PoolUsed += NumBins;
+
+  for (Bin = 0; Bin < NumBins; Bin++)
+  {
+    BinStart = Low + ((uint32_t)Bin << pDesc->BinShift);
+    BinEnd = BinStart + (1 << pDesc->BinShift) - 1;
+    pState->pTable[Bin] = CAP_INVALID_CODE;
+
+    for (i = 0; i < pDesc->NumBands; i++)
+    {
+      if ((BinStart > pDesc->pBands[i].LowTicks) && (BinEnd < pDesc->pBands[i].HighTicks))
+      {
+        pState->pTable[Bin] = i;
+        break;
+      }
+    }
+  }
+}
+
+/***************************************************************************
+  PeriodAt
+    The period that ended Age edges ago, Age below CaptureRingSize
+ ***************************************************************************/
+static uint32_t PeriodAt( const ChannelState_t *pState, uint8_t Age )
+{
+  return pState->Periods[(pState->EdgeCount - 1 - Age) & (CaptureRingSize - 1)];
+}
+
+/***************************************************************************
+  AddEdge
+    Stores the period that ended at Edge in the ring, nothing more; the
+    readers classify it (UpdateRun)
+ ***************************************************************************/
+static void AddEdge( CaptureChannel_t Channel, uint32_t Edge )
+{
+  ChannelState_t *pState = &State[Channel];
+
+  // write the slot before counting it in
+  pState->Periods[pState->EdgeCount & (CaptureRingSize - 1)] = Edge - pState->LastEdge;
+  pState->LastEdge = Edge;
+  pState->EdgeCount++;
+}
+
+/***************************************************************************
+  UpdateRun
+    Classifies the periods stored since the last call and extends or
+    restarts the run with each, then returns the run. With no new periods
+    it is a compare. If the ring has been lapped, the run starts over from
+    the oldest period still in it.
+ ***************************************************************************/
+static uint16_t UpdateRun( CaptureChannel_t Channel )
+{
+  ChannelState_t *pState = &State[Channel];
+  uint32_t EdgeCount;
+  uint16_t Run;
+  uint8_t Code;
+  uint8_t Count;
+
+  // CatchUp has its own critical section, and they don't nest
+  CatchUp(Channel);
+
+  EnterCritical();
+  EdgeCount = pState->EdgeCount;
+  if ((EdgeCount - pState->Classified) > CaptureRingSize)
+  {
+    pState->Classified = EdgeCount - CaptureRingSize;
+    pState->Run = CAP_INVALID_CODE;
+  }
+  Run = pState->Run;
+  while (pState->Classified != EdgeCount)
+  {
+    Code = Capture_ClassifyPeriod(Channel,
+                                  pState->Periods[pState->Classified & (CaptureRingSize - 1)]);
+    Count = RunCount(Run);
+    if (Code == CAP_INVALID_CODE)
+    {
+      Count = 0;
+    }
+    else if (Code != RunCode(Run))
+    {
+      Count = 1;
+    }
+    else if (Count < MaxRunCount)
+    {
+      Count++;
+    }
+    Run = ((uint16_t)Count << 8) | Code;
+    pState->Classified++;
+  }
+  pState->Run = Run;
+  ExitCritical();
+
+  return Run;
+}
+
+/***************************************************************************
+  CatchUp
+    For a channel on uDMA, turns the edges the uDMA has written since the
+    last call into periods; returns how many. Both the done ISR and thread
+    level readers call it, so it runs as a critical section. A per edge
+    channel is always caught up.
+ ***************************************************************************/
+static uint8_t CatchUp( CaptureChannel_t Channel )
+{
+  ChannelState_t *pState = &State[Channel];
+  uint16_t BufferSize;
+  uint16_t Next;
+  uint8_t NewPeriods = 0;
+
+  if (!pState->OnDMA)
+  {
+    return 0;
+  }
+  BufferSize = 2*Channels[Channel].DMAHalfSize;
+
+  EnterCritical();
+  Next = DMA_GetPingPongPosition(Channels[Channel].DMAChannel);
+  while (pState->EdgesRead != Next)
+  {
+    AddEdge(Channel, pState->Edges[pState->EdgesRead]);
+    pState->EdgesRead = (pState->EdgesRead + 1) % BufferSize;
+    NewPeriods++;
+  }
+  ExitCritical();
+
+  return NewPeriods;
+}
@@ -19,6 +19,7 @@
 #include "LEDModule.h"
 #include "CheckingInSubSM.h"
 #include "HallEffectModule.h"
+#include "SMProfiler.h"
 
 /*----------------------------- Module Defines ----------------------------*/
 // define constants for the states for this machine
@@ -60,6 +61,8 @@
 #define RESPONSE_READY 0xAA00
 #define RESPONSE_NOT_READY 0x0000
 #define RESPONSE_READY_MASK 0xff00
+// staging area we checked in at, 1 to 3
+#define LOCATION_MASK 0x000f
 
 /*---------------------------- Module Functions ---------------------------*/
 /* prototypes for private functions for this machine, things like during
@@ -177,6 +180,7 @@ ES_Event RunCheckingInSM( ES_Event CurrentEvent )
     if (MakeTransition == true)
     {
 			 printf("\r\n-------------State Transition from %u to %u-----------\r\n",CurrentState,NextState);
+       SMProf_Transition(PROF_CHECKING_IN, CurrentState, NextState, CurrentEvent.EventType);
        //   Execute exit function for current state
        CurrentEvent.EventType = ES_EXIT;
        RunCheckingInSM(CurrentEvent);
@@ -216,6 +220,7 @@ void StartCheckingInSM ( ES_Event CurrentEvent )
    {
         CurrentState = FirstReportDone;
    }
+   SMProf_Enter(PROF_CHECKING_IN, CurrentState);
    // call the entry function (if any) for the ENTRY_STATE
    RunCheckingInSM(CurrentEvent);
 }
@@ -375,6 +380,7 @@ static ES_Event DuringSecondReportDone( ES_Event Event)
 							// Post CHECK_IN_SUCCESS event and get out of SubSM
 							printf("\r\n CHECK_IN_SUCCESS event posted by SubSM to SPI\r\n");
 	            Event2Post.EventType = CHECK_IN_SUCCESS;
+	            Event2Post.EventParam = Event.EventParam & LOCATION_MASK;
 		          PostRobotTopSM(Event2Post);
 					}
 					else
@@ -0,0 +1,170 @@
+/****************************************************************************
+DMAModule
+	Owns the uDMA controller and its control table, and runs peripheral
+	channels in ping-pong mode: every request moves 32 bit words (one or a
+	power of 2 burst) from a fixed peripheral register, such as a capture
+	register or an ADC FIFO, into a RAM buffer split in two halves. When a
+	half fills the controller goes on into the other one and the done
+	interrupt comes in on the peripheral's own vector, where its ISR calls
+	DMA_RearmPingPong to hand the full half back.
+
+ Notes
+	The control table holds the primary and alternate descriptors of all 32
+	channels and must sit on a 1024 byte boundary.
+	The controller counts XFERSIZE down in the table as it goes, which is
+	how DMA_GetPingPongPosition finds the next word without an interrupt.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "inc/hw_sysctl.h"
+#include "inc/hw_udma.h"
+
+#include "DMAModule.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define NumDMAChannels 32
+// words per descriptor, and where the alternate descriptors start
+#define WordsPerDescriptor 4
+#define AlternateOffset (NumDMAChannels*WordsPerDescriptor)
+#define BitsPerNibble 4
+#define ChannelsPerMap 8
+
+// word to word, fixed source, incrementing destination
+#define PingPongControl (UDMA_CHCTL_DSTINC_32 | UDMA_CHCTL_DSTSIZE_32 | \
+                         UDMA_CHCTL_SRCINC_NONE | UDMA_CHCTL_SRCSIZE_32 | \
+                         UDMA_CHCTL_XFERMODE_PINGPONG)
+
+/*---------------------------- Module Variables ---------------------------*/
+static uint32_t ControlTable[2*NumDMAChannels*WordsPerDescriptor] __attribute__((aligned(1024)));
+// control word a half is rearmed with
+static uint32_t HalfControls[NumDMAChannels];
+static bool Initialized = false;
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+    InitDMAModule
+
+ Description
+    Clocks and enables the uDMA controller and points it at the control
+    table. Safe to call from every module that uses a channel.
+****************************************************************************/
+void InitDMAModule( void )
+{
+  if (Initialized)
+  {
+    return;
+  }
+
+  // enable the clock to the uDMA controller and wait for it to be ready
+  HWREG(SYSCTL_RCGCDMA) |= SYSCTL_RCGCDMA_R0;
+  while ((HWREG(SYSCTL_PRDMA) & SYSCTL_PRDMA_R0) != SYSCTL_PRDMA_R0)
+    ;
+
+  HWREG(UDMA_CFG) = UDMA_CFG_MASTEN;
+  HWREG(UDMA_CTLBASE) = (uint32_t)ControlTable;
+  Initialized = true;
+}
+
+/****************************************************************************
+ Function
+    DMA_StartPingPong
+
+ Parameters
+    uint8_t : uDMA channel
+    uint8_t : channel encoding that selects the peripheral (DMACHMAPn)
+    uint32_t : address of the peripheral register to read
+    uint32_t * : buffer of 2*HalfSize words
+    uint16_t : words per half, up to 1024
+    uint32_t : UDMA_CHCTL_ARBSIZE_ value, words moved per request
+
+ Description
+    Sets the channel up to fill pBuffer[0..HalfSize-1] from the primary
+    descriptor, then pBuffer[HalfSize..2*HalfSize-1] from the alternate one,
+    and enables it. The peripheral's DMA request has to be set up by the
+    caller.
+****************************************************************************/
+void DMA_StartPingPong( uint8_t Channel, uint8_t Encoding, uint32_t SourceAddress,
+                        uint32_t *pBuffer, uint16_t HalfSize, uint32_t ArbSize )
+{
+  uint32_t *pPrimary = &ControlTable[Channel*WordsPerDescriptor];
+  uint32_t *pAlternate = &ControlTable[AlternateOffset + Channel*WordsPerDescriptor];
+  uint32_t MapRegister = UDMA_CHMAP0 + (Channel/ChannelsPerMap)*sizeof(uint32_t);
+  uint8_t MapShift = BitsPerNibble*(Channel % ChannelsPerMap);
+
+  InitDMAModule();
+  HWREG(UDMA_ENACLR) = (1 << Channel);
+
+  // pick the peripheral, default priority, single and burst requests,
+  // primary descriptor first
+  HWREG(MapRegister) = (HWREG(MapRegister) & ~(0xf << MapShift)) | ((uint32_t)Encoding << MapShift);
+  HWREG(UDMA_PRIOCLR) = (1 << Channel);
+  HWREG(UDMA_USEBURSTCLR) = (1 << Channel);
+  HWREG(UDMA_REQMASKCLR) = (1 << Channel);
+  HWREG(UDMA_ALTCLR) = (1 << Channel);
+
+  // the controller wants end pointers, the last word each half gets
+  // XFERSIZE is the word count less one
+  HalfControls[Channel] = PingPongControl | ArbSize |
+                          ((uint32_t)(HalfSize - 1) << UDMA_CHCTL_XFERSIZE_S);
+  pPrimary[0] = SourceAddress;
+  pPrimary[1] = (uint32_t)&pBuffer[HalfSize - 1];
+  pPrimary[2] = HalfControls[Channel];
+  pAlternate[0] = SourceAddress;
+  pAlternate[1] = (uint32_t)&pBuffer[2*HalfSize - 1];
+  pAlternate[2] = HalfControls[Channel];
+
+  HWREG(UDMA_ENASET) = (1 << Channel);
+}
+
+/****************************************************************************
+ Function
+    DMA_RearmPingPong
+
+ Description
+    Call from the peripheral's ISR on the done interrupt. Hands whichever
+    half the controller finished (its descriptor is in stop mode) back for
+    the next lap; the other half is being filled.
+****************************************************************************/
+void DMA_RearmPingPong( uint8_t Channel )
+{
+  uint32_t *pPrimary = &ControlTable[Channel*WordsPerDescriptor];
+  uint32_t *pAlternate = &ControlTable[AlternateOffset + Channel*WordsPerDescriptor];
+
+  if ((pPrimary[2] & UDMA_CHCTL_XFERMODE_M) == UDMA_CHCTL_XFERMODE_STOP)
+  {
+    pPrimary[2] = HalfControls[Channel];
+  }
+  if ((pAlternate[2] & UDMA_CHCTL_XFERMODE_M) == UDMA_CHCTL_XFERMODE_STOP)
+  {
+    pAlternate[2] = HalfControls[Channel];
+  }
+}
+
+/****************************************************************************
+ Function
+    DMA_GetPingPongPosition
+
+ Returns
+    uint16_t, index in the buffer the next word will go to, 0 to
+    2*HalfSize-1
+****************************************************************************/
+uint16_t DMA_GetPingPongPosition( uint8_t Channel )
+{
+  bool InAlternate = ((HWREG(UDMA_ALTSET) & (1 << Channel)) != 0);
+  uint32_t Control = ControlTable[(InAlternate ? AlternateOffset : 0) +
+                                  Channel*WordsPerDescriptor + 2];
+  uint16_t HalfSize = ((HalfControls[Channel] & UDMA_CHCTL_XFERSIZE_M) >> UDMA_CHCTL_XFERSIZE_S) + 1;
+  uint16_t Left = 0;
+
+  // a half in stop mode is full, the controller just hasn't switched yet
+  if ((Control & UDMA_CHCTL_XFERMODE_M) != UDMA_CHCTL_XFERMODE_STOP)
+  {
+    Left = ((Control & UDMA_CHCTL_XFERSIZE_M) >> UDMA_CHCTL_XFERSIZE_S) + 1;
+  }
+  return ((InAlternate ? 2*HalfSize : HalfSize) - Left) % (2*HalfSize);
+}
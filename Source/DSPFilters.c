@@ -0,0 +1,467 @@
+//#define TEST
+/****************************************************************************
+DSPFilters
+	Fixed-point filter stages that work on two channels at once, for the
+	left and right RLC wire sensors: a biquad IIR section, a moving average
+	of up to 16 taps and a median of up to 7. A sample pair is one word,
+	channel 0 in the low and channel 1 in the high int16 (FILTER_PAIR), so
+	the biquad's taps go through SMLAD two at a time.
+
+ Notes
+	Samples are Q15 sized: the 12 bit ADC readings are shifted up by
+	FILTER_ADC_SHIFT first.
+	The biquad is direct form I with Q14 coefficients and error feedback:
+	the bits rounded off each output are added into the next one, so a low
+	cutoff section has no DC offset or dead band from the rounding.
+	The accumulator can't wrap for coefficients of a stable section and
+	Q15 samples, so the saturation only catches a wild input.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include "DSPFilters.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define CoeffShift 14
+#define RoundingMask ((1 << CoeffShift) - 1)
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+    Biquad2_Init
+
+ Description
+    Loads the Q14 coefficients, packed for SMLAD, and clears the history
+    of both channels.
+****************************************************************************/
+void Biquad2_Init( Biquad2_t *pFilter, const BiquadCoeffs_t *pCoeffs )
+{
+  uint8_t Channel;
+
+  pFilter->B0 = pCoeffs->b0;
+  pFilter->B12 = DSP_Pack(pCoeffs->b1, pCoeffs->b2);
+  pFilter->A12 = DSP_Pack(-pCoeffs->a1, -pCoeffs->a2);
+  for (Channel = 0; Channel < 2; Channel++)
+  {
+    pFilter->X[Channel] = 0;
+    pFilter->Y[Channel] = 0;
+    pFilter->Error[Channel] = 0;
+  }
+}
+
+/****************************************************************************
+ Function
+    Biquad2_Step
+
+ Parameters
+    uint32_t : the next input pair
+
+ Returns
+    uint32_t, the output pair
+****************************************************************************/
+uint32_t Biquad2_Step( Biquad2_t *pFilter, uint32_t In )
+{
+  int32_t Out[2];
+  int32_t Acc;
+  uint8_t Channel;
+
+  for (Channel = 0; Channel < 2; Channel++)
+  {
+    int16_t x0 = (Channel == 0) ? DSP_LO(In) : DSP_HI(In);
+
+    // b0*x0 + b1*x1 + b2*x2 - a1*y1 - a2*y2 + what was rounded off last time
+    Acc = pFilter->Error[Channel] + pFilter->B0*x0;
+    Acc = DSP_Smlad(pFilter->B12, pFilter->X[Channel], Acc);
+    Acc = DSP_Smlad(pFilter->A12, pFilter->Y[Channel], Acc);
+    Out[Channel] = DSP_Sat16(Acc >> CoeffShift);
+    pFilter->Error[Channel] = Acc & RoundingMask;
+
+    // shift the history along: (x0, x1), (y0, y1)
+    pFilter->X[Channel] = DSP_Pack(x0, DSP_LO(pFilter->X[Channel]));
+    pFilter->Y[Channel] = DSP_Pack(Out[Channel], DSP_LO(pFilter->Y[Channel]));
+  }
+  return DSP_Pack(Out[0], Out[1]);
+}
+
+/****************************************************************************
+ Function
+    MovingAverage2_Init
+
+ Parameters
+    uint8_t : the average is over 2^Shift samples, Shift up to
+              FILTER_MAX_MA_SHIFT
+
+ Description
+    Starts the average from zero, the output ramps up over the first
+    2^Shift samples.
+****************************************************************************/
+void MovingAverage2_Init( MovingAverage2_t *pFilter, uint8_t Shift )
+{
+  uint8_t i;
+
+  if (Shift > FILTER_MAX_MA_SHIFT)
+  {
+    Shift = FILTER_MAX_MA_SHIFT;
+  }
+  pFilter->Shift = Shift;
+  pFilter->Head = 0;
+  pFilter->Sum[0] = 0;
+  pFilter->Sum[1] = 0;
+  for (i = 0; i < (1 << FILTER_MAX_MA_SHIFT); i++)
+  {
+    pFilter->History[i] = 0;
+  }
+}
+
+/****************************************************************************
+ Function
+    MovingAverage2_Step
+
+ Returns
+    uint32_t, the rounded average pair of the last 2^Shift inputs
+****************************************************************************/
+uint32_t MovingAverage2_Step( MovingAverage2_t *pFilter, uint32_t In )
+{
+  uint32_t Oldest = pFilter->History[pFilter->Head];
+  int32_t Half = (1 << pFilter->Shift) >> 1;
+
+  // running sums, the sample leaving the window comes off
+  pFilter->Sum[0] += DSP_LO(In) - DSP_LO(Oldest);
+  pFilter->Sum[1] += DSP_HI(In) - DSP_HI(Oldest);
+  pFilter->History[pFilter->Head] = In;
+  pFilter->Head = (pFilter->Head + 1) & ((1 << pFilter->Shift) - 1);
+
+  return DSP_Pack((pFilter->Sum[0] + Half) >> pFilter->Shift,
+                  (pFilter->Sum[1] + Half) >> pFilter->Shift);
+}
+
+/****************************************************************************
+ Function
+    Median2_Init
+
+ Parameters
+    uint8_t : window length, odd, up to FILTER_MAX_MEDIAN
+****************************************************************************/
+void Median2_Init( Median2_t *pFilter, uint8_t Length )
+{
+  uint8_t i;
+
+  if (Length > FILTER_MAX_MEDIAN)
+  {
+    Length = FILTER_MAX_MEDIAN;
+  }
+  pFilter->Length = Length | 1;
+  pFilter->Head = 0;
+  for (i = 0; i < FILTER_MAX_MEDIAN; i++)
+  {
+    pFilter->History[i] = 0;
+  }
+}
+
+/****************************************************************************
+ Function
+    Median2_Step
+
+ Returns
+    uint32_t, the median pair of the last Length inputs, each channel on
+    its own
+****************************************************************************/
+uint32_t Median2_Step( Median2_t *pFilter, uint32_t In )
+{
+  int16_t Sorted[2][FILTER_MAX_MEDIAN];
+  uint8_t Length = pFilter->Length;
+  uint8_t i, j;
+
+  pFilter->History[pFilter->Head] = In;
+  if (++pFilter->Head >= Length)
+  {
+    pFilter->Head = 0;
+  }
+
+  // insertion sort both channels, the window is only a few samples
+  for (i = 0; i < Length; i++)
+  {
+    int16_t Lo = DSP_LO(pFilter->History[i]);
+    int16_t Hi = DSP_HI(pFilter->History[i]);
+
+    for (j = i; (j > 0) && (Sorted[0][j - 1] > Lo); j--)
+    {
+      Sorted[0][j] = Sorted[0][j - 1];
+    }
+    Sorted[0][j] = Lo;
+    for (j = i; (j > 0) && (Sorted[1][j - 1] > Hi); j--)
+    {
+      Sorted[1][j] = Sorted[1][j - 1];
+    }
+    Sorted[1][j] = Hi;
+  }
+  return DSP_Pack(Sorted[0][Length/2], Sorted[1][Length/2]);
+}
+
+#ifdef TEST
+/* Test harness for the filter stages.
+
+   Host (from the repo root):
+      gcc -std=gnu99 -O2 -DTEST -IHeaders -o dspfilters Source/DSPFilters.c -lm
+      ./dspfilters
+   Runs a two channel test signal (steps, a sine, noise and spikes) through
+   the wire sensor chain, median of 3, average of 8 and the 200Hz lowpass,
+   and checks every output bit for bit against a plain int64 model of the
+   same arithmetic, then against a double precision version of the chain
+   with the same quantized coefficients. The first mismatch, or an error
+   over FloatTolerance ADC counts, is printed and the program exits 1.
+   The plain C intrinsics are the ones checked here; the target build runs
+   the same harness on the DSP instructions.
+
+   Target (add termio.c, uartstdio.c and the startup file, or make
+   filterbench in Qemu/): also prints the average CPU cycles per two channel
+   step of each stage and of the chain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__arm__)
+#include "inc/hw_memmap.h"
+#include "inc/hw_types.h"
+#include "driverlib/sysctl.h"
+#include "ES_Port.h"
+#include "termio.h"
+#if defined(QEMU)
+#include "QemuShim.h"
+#endif
+#else
+#include <time.h>
+#endif
+
+#define NumTestSamples 20000
+#define MedianLength 3
+#define AverageShift 3
+// ADC counts the chain may be off from double precision
+#define FloatTolerance 1.0
+
+// Butterworth lowpass, 200Hz at the 10kHz ADC sample rate
+static const BiquadCoeffs_t TestLowpass = { 59, 119, 59, -29863, 13716 };
+
+static uint32_t RandomState = 0x2218B;
+
+static uint32_t NextRandom( void )
+{  // LCG, the same signal every run
+  RandomState = RandomState*1664525u + 1013904223u;
+  return RandomState >> 8;
+}
+
+// 12 bit reading for sample n of a channel, wire strength steps, the
+// 2kHz-ish ripple of a detuned tank, noise and the odd spike
+static int16_t TestReading( uint32_t n, uint8_t Channel )
+{
+  int32_t Level = ((n / 2500) & 1) ? 3000 : 900;
+  int32_t Reading;
+
+  Level += (Channel == 0) ? 0 : -300;
+  Reading = Level + (int32_t)(200.0*sin(n*(Channel ? 1.3 : 0.9)))
+            + (int32_t)(NextRandom() % 61) - 30;
+  if ((NextRandom() % 97) == 0)
+  {
+    Reading = (NextRandom() & 1) ? 4095 : 0;
+  }
+  return (Reading < 0) ? 0 : ((Reading > 4095) ? 4095 : Reading);
+}
+
+// int64 model of the chain, one channel
+typedef struct
+{
+  int32_t MedianWindow[MedianLength];
+  int32_t AverageWindow[1 << AverageShift];
+  int64_t x1, x2, y1, y2, Error;
+  uint32_t n;
+} RefChannel_t;
+
+static int32_t RefStep( RefChannel_t *pRef, int32_t In )
+{
+  int32_t Sorted[MedianLength];
+  int32_t Median, Average;
+  int64_t Acc, Sum = 0;
+  int32_t Out;
+  uint8_t i, j;
+
+  pRef->MedianWindow[pRef->n % MedianLength] = In;
+  for (i = 0; i < MedianLength; i++)
+  {
+    for (j = i; (j > 0) && (Sorted[j - 1] > pRef->MedianWindow[i]); j--)
+      Sorted[j] = Sorted[j - 1];
+    Sorted[j] = pRef->MedianWindow[i];
+  }
+  Median = Sorted[MedianLength/2];
+
+  pRef->AverageWindow[pRef->n % (1 << AverageShift)] = Median;
+  for (i = 0; i < (1 << AverageShift); i++)
+    Sum += pRef->AverageWindow[i];
+  Average = (int32_t)((Sum + (1 << (AverageShift - 1))) >> AverageShift);
+
+  Acc = pRef->Error + (int64_t)TestLowpass.b0*Average + (int64_t)TestLowpass.b1*pRef->x1
+        + (int64_t)TestLowpass.b2*pRef->x2 - (int64_t)TestLowpass.a1*pRef->y1
+        - (int64_t)TestLowpass.a2*pRef->y2;
+  Out = (int32_t)(Acc >> 14);
+  Out = (Out > INT16_MAX) ? INT16_MAX : ((Out < INT16_MIN) ? INT16_MIN : Out);
+  pRef->Error = Acc & ((1 << 14) - 1);
+  pRef->x2 = pRef->x1;
+  pRef->x1 = Average;
+  pRef->y2 = pRef->y1;
+  pRef->y1 = Out;
+  pRef->n++;
+  return Out;
+}
+
+// the same chain in double precision, ADC counts in and out
+typedef struct
+{
+  double MedianWindow[MedianLength];
+  double AverageWindow[1 << AverageShift];
+  double x1, x2, y1, y2;
+  uint32_t n;
+} FloatChannel_t;
+
+static double FloatStep( FloatChannel_t *pRef, double In )
+{
+  double Sorted[MedianLength];
+  double Median, Sum = 0, Out;
+  uint8_t i, j;
+
+  pRef->MedianWindow[pRef->n % MedianLength] = In;
+  for (i = 0; i < MedianLength; i++)
+  {
+    for (j = i; (j > 0) && (Sorted[j - 1] > pRef->MedianWindow[i]); j--)
+      Sorted[j] = Sorted[j - 1];
+    Sorted[j] = pRef->MedianWindow[i];
+  }
+  Median = Sorted[MedianLength/2];
+
+  pRef->AverageWindow[pRef->n % (1 << AverageShift)] = Median;
+  for (i = 0; i < (1 << AverageShift); i++)
+    Sum += pRef->AverageWindow[i];
+  Sum /= (1 << AverageShift);
+
+  Out = (TestLowpass.b0*Sum + TestLowpass.b1*pRef->x1 + TestLowpass.b2*pRef->x2
+         - TestLowpass.a1*pRef->y1 - TestLowpass.a2*pRef->y2) / 16384.0;
+  pRef->x2 = pRef->x1;
+  pRef->x1 = Sum;
+  pRef->y2 = pRef->y1;
+  pRef->y1 = Out;
+  pRef->n++;
+  return Out;
+}
+
+static Median2_t TestMedian;
+static MovingAverage2_t TestAverage;
+static Biquad2_t TestBiquad;
+static uint32_t Inputs[NumTestSamples];
+
+#if defined(__arm__)
+#define BenchStart()    _HW_GetCycleCount()
+#define BenchUnits      "cycles"
+#define BenchScale      1
+#else
+#define BenchStart()    ((uint32_t)clock())
+#define BenchUnits      "ns"
+#define BenchScale      (1000000000/CLOCKS_PER_SEC)
+#endif
+
+// newlib nano has no %f, so tenths by hand
+static void PrintBench( const char *pName, uint32_t Elapsed )
+{
+  uint32_t Tenths = (uint32_t)((10ull*BenchScale*Elapsed + NumTestSamples/2)/NumTestSamples);
+
+  printf("%-14s %6lu.%lu %s per step\r\n", pName, (unsigned long)(Tenths/10),
+         (unsigned long)(Tenths % 10), BenchUnits);
+}
+
+int main(void)
+{
+  static RefChannel_t Ref[2];
+  static FloatChannel_t FloatRef[2];
+  volatile uint32_t Sink = 0;
+  double MaxError = 0;
+  uint32_t Start, Pair;
+  uint32_t n;
+  uint8_t Channel;
+
+#if defined(__arm__)
+  SysCtlClockSet(SYSCTL_SYSDIV_5 | SYSCTL_USE_PLL | SYSCTL_OSC_MAIN
+                 | SYSCTL_XTAL_16MHZ);
+  TERMIO_Init();
+  _HW_CycleCounterInit();
+#endif
+
+  for (n = 0; n < NumTestSamples; n++)
+  {
+    int16_t Left = TestReading(n, 0);
+    int16_t Right = TestReading(n, 1);
+    Inputs[n] = FILTER_PAIR(Left << FILTER_ADC_SHIFT, Right << FILTER_ADC_SHIFT);
+  }
+
+  Median2_Init(&TestMedian, MedianLength);
+  MovingAverage2_Init(&TestAverage, AverageShift);
+  Biquad2_Init(&TestBiquad, &TestLowpass);
+  for (n = 0; n < NumTestSamples; n++)
+  {
+    Pair = Biquad2_Step(&TestBiquad,
+                        MovingAverage2_Step(&TestAverage, Median2_Step(&TestMedian, Inputs[n])));
+    for (Channel = 0; Channel < 2; Channel++)
+    {
+      int16_t In = (Channel == 0) ? FILTER_CH0(Inputs[n]) : FILTER_CH1(Inputs[n]);
+      int16_t Out = (Channel == 0) ? FILTER_CH0(Pair) : FILTER_CH1(Pair);
+      int32_t Expected = RefStep(&Ref[Channel], In);
+      double Error = fabs(Out - FloatStep(&FloatRef[Channel], In)) / (1 << FILTER_ADC_SHIFT);
+
+      if (Out != Expected)
+      {
+        printf("FAIL sample %lu channel %u: %d, expected %ld\r\n",
+               (unsigned long)n, Channel, Out, (long)Expected);
+        exit(1);
+      }
+      if (Error > MaxError)
+      {
+        MaxError = Error;
+      }
+    }
+  }
+  printf("bit exact over %u samples, max error %lu/1000 ADC counts from double\r\n",
+         NumTestSamples, (unsigned long)(MaxError*1000));
+  if (MaxError > FloatTolerance)
+  {
+    printf("FAIL error over %u counts\r\n", (unsigned)FloatTolerance);
+    exit(1);
+  }
+
+  Start = BenchStart();
+  for (n = 0; n < NumTestSamples; n++)
+    Sink += Median2_Step(&TestMedian, Inputs[n]);
+  PrintBench("median of 3", BenchStart() - Start);
+  Start = BenchStart();
+  for (n = 0; n < NumTestSamples; n++)
+    Sink += MovingAverage2_Step(&TestAverage, Inputs[n]);
+  PrintBench("average of 8", BenchStart() - Start);
+  Start = BenchStart();
+  for (n = 0; n < NumTestSamples; n++)
+    Sink += Biquad2_Step(&TestBiquad, Inputs[n]);
+  PrintBench("biquad", BenchStart() - Start);
+  Start = BenchStart();
+  for (n = 0; n < NumTestSamples; n++)
+    Sink += Biquad2_Step(&TestBiquad,
+                         MovingAverage2_Step(&TestAverage, Median2_Step(&TestMedian, Inputs[n])));
+  PrintBench("chain", BenchStart() - Start);
+  printf("PASS\r\n");
+
+#if defined(__arm__)
+#if defined(QEMU)
+  QemuShim_Exit(0);
+#endif
+  while(1)
+    ;
+#else
+  return 0;
+#endif
+}
+#endif /* TEST */
+/*------------------------------- Footnotes -------------------------------*/
+/*------------------------------ End of file ------------------------------*/
@@ -34,6 +34,10 @@
 #include "ES_Port.h"
 #include "ES_Types.h"
 #include "ES_Timers.h"
+#include "InputRecorder.h"
+#if defined(QEMU)
+#include "QemuShim.h"
+#endif
 
 #define UART_PORT 		0
 #define UART_BAUD		115200UL
@@ -54,6 +58,10 @@ static volatile uint8_t TickCount;
 // 8 and 16 bit processors
 static volatile uint16_t SysTickCounter = 0;
 
+// the same count kept 32 bits wide for measurements that can run longer
+// than the 65 second wrap of SysTickCounter (match length profiling)
+static volatile uint32_t LongTickCounter = 0;
+
 /****************************************************************************
  Function
      _HW_Timer_Init
@@ -102,6 +110,7 @@ void SysTickIntHandler(void)
 	/* Interrupt automatically cleared by hardware */
   ++TickCount;          /* flag that it occurred and needs a response */
 	++SysTickCounter;     // keep the free running time going
+	++LongTickCounter;
 #ifdef LED_DEBUG
 	BlinkLED();
 #endif
@@ -127,6 +136,22 @@ uint16_t _HW_GetTickCount(void)
    return (SysTickCounter);
 }
 
+/****************************************************************************
+ Function
+    _HW_GetLongTickCount()
+ Parameters
+    none
+ Returns
+    uint32_t   count of number of system ticks that have occurred.
+ Description
+    32 bit version of _HW_GetTickCount, wraps after ~49 days at 1mS
+ Notes
+****************************************************************************/
+uint32_t _HW_GetLongTickCount(void)
+{
+   return (LongTickCounter);
+}
+
 /****************************************************************************
  Function
      _HW_Process_Pending_Ints
@@ -150,8 +175,22 @@ uint16_t _HW_GetTickCount(void)
 ****************************************************************************/
 bool _HW_Process_Pending_Ints( void )
 {
+#if defined(REPLAY_INPUTS)
+   // virtual time: the recorded log decides when the next tick happens
+   if (InputRec_ReplayTick())
+   {
+      SysTickIntHandler();
+   }
+#endif
+#if defined(QEMU)
+   // lets the scripted LOC see the last byte written to it
+   QemuShim_Poll();
+#endif
    while (TickCount > 0)
    {
+#if defined(RECORD_INPUTS)
+      InputRec_RecordTick();
+#endif
       /* call the framework tick response to actually run the timers */
       ES_Timer_Tick_Resp();  
       TickCount--;
@@ -273,3 +312,20 @@ inline void CPUsetFAULTMASK(uint32_t newFAULTMASK)
   }
 }
 #endif
+
+#if defined(gcc)
+uint32_t CPUgetPRIMASK_cpsid(void)
+{
+  uint32_t r0;
+  __asm volatile ("    mrs     %0, PRIMASK\n"   // Store PRIMASK in r0
+                  "    cpsid   i\n"             // Disable interrupts
+                  : "=r" (r0) : : "memory");
+  return r0;
+}
+
+void CPUsetPRIMASK(uint32_t newPRIMASK)
+{
+  __asm volatile ("    msr     PRIMASK, %0\n"   // Store newPRIMASK in PRIMASK
+                  : : "r" (newPRIMASK) : "memory");
+}
+#endif
@@ -85,21 +85,24 @@ uint8_t ES_InitQueue( ES_Event * pBlock, uint8_t BlockSize )
 bool ES_EnQueueFIFO( ES_Event * pBlock, ES_Event Event2Add )
 {
    pQueue_t pThisQueue;
+   bool WasAdded = false;
    pThisQueue = (pQueue_t)pBlock;
+   ES_PREEMPTION_POINT();
+   // the space test has to be inside the critical region, an ISR posting
+   // between the test and the write would otherwise overfill the queue
+   EnterCritical();   // save interrupt state, turn ints off
    // index will go from 0 to QueueSize-1 so use '<' to test if there is space
    if ( pThisQueue->NumEntries < pThisQueue->QueueSize)
    {  // save the new event, use % to create circular buffer in block
       // 1+ to step past the Queue struct at the beginning of the
       // block
-      EnterCritical();   // save interrupt state, turn ints off
       pBlock[ 1 + ((pThisQueue->CurrentIndex + pThisQueue->NumEntries)
                % pThisQueue->QueueSize)] = Event2Add;
       pThisQueue->NumEntries++;          // inc number of entries
-      ExitCritical();  // restore saved interrupt state
-      
-      return(true);
-   }else
-      return(false);
+      WasAdded = true;
+   }
+   ExitCritical();  // restore saved interrupt state
+   return(WasAdded);
 }
 
 /****************************************************************************
@@ -122,10 +125,12 @@ bool ES_EnQueueFIFO( ES_Event * pBlock, ES_Event Event2Add )
 bool ES_EnQueueLIFO( ES_Event * pBlock, ES_Event Event2Add )
 {
    pQueue_t pThisQueue;
+   bool WasAdded = false;
    pThisQueue = (pQueue_t)pBlock;
+   ES_PREEMPTION_POINT();
+   EnterCritical();   // save interrupt state, turn ints off
    // index will go from 0 to QueueSize-1 so use '<' to test if there is space
     if ( pThisQueue->NumEntries < pThisQueue->QueueSize){
-      EnterCritical();   // save interrupt state, turn ints off
     // OK, there is space note that the queue now has 1 more entry
       pThisQueue->NumEntries++;
     // Check to see if we need to wrap around as we back up index
@@ -136,10 +141,10 @@ bool ES_EnQueueLIFO( ES_Event * pBlock, ES_Event Event2Add )
         pThisQueue->CurrentIndex--;
       }  
       pBlock[ 1 + pThisQueue->CurrentIndex ] = Event2Add;
-      ExitCritical();  // restore saved interrupt state      
-      return(true);
-    }else // in case no room on the queue
-      return(false);
+      WasAdded = true;
+    } // else no room on the queue
+   ExitCritical();  // restore saved interrupt state
+   return(WasAdded);
 }
 
 
@@ -165,9 +170,10 @@ uint8_t ES_DeQueue( ES_Event * pBlock, ES_Event * pReturnEvent )
    uint8_t NumLeft;
 
    pThisQueue = (pQueue_t)pBlock;
+   ES_PREEMPTION_POINT();
+   EnterCritical();   // save interrupt state, turn ints off
    if ( pThisQueue->NumEntries > 0)
    {
-      EnterCritical();   // save interrupt state, turn ints off
       *pReturnEvent = pBlock[ 1 + pThisQueue->CurrentIndex ];
       // inc the index
       pThisQueue->CurrentIndex++;
@@ -176,12 +182,12 @@ uint8_t ES_DeQueue( ES_Event * pBlock, ES_Event * pReturnEvent )
          pThisQueue->CurrentIndex = (uint8_t)(pThisQueue->CurrentIndex % pThisQueue->QueueSize);
       //dec number of elements since we took 1 out
       NumLeft = --pThisQueue->NumEntries; 
-      ExitCritical();  // restore saved interrupt state
    }else { // no items left in the queue
       (*pReturnEvent).EventType = ES_NO_EVENT;
       (*pReturnEvent).EventParam = 0;
       NumLeft = 0;
    }
+   ExitCritical();  // restore saved interrupt state
    return NumLeft;
 }
 
@@ -239,72 +245,435 @@ void QueueFlushQueue( uint8_t * pBlock )
  private functions
  ***************************************************************************/
 #ifdef TEST
-
+/* Test harness for the queue and ES_RecallEvents.
+   Link ES_Queue.c (TEST defined) with ES_DeferRecall.c but not ES_Framework.c;
+   the harness supplies the ES_PostToServiceLIFO that ES_RecallEvents calls
+   and points it at TestQueue.
+
+   Host, QUEUE_STRESS also defined (from the repo root):
+      gcc -std=c99 -O2 -DTEST -DQUEUE_STRESS -IHeaders -I$TIVAWARE \
+          -o queuestress Source/ES_Queue.c Source/ES_DeferRecall.c
+      ./queuestress [seed]
+   Every operation is checked against a reference model of the queue while a
+   simulated ISR posts FIFO at random ES_PREEMPTION_POINTs. The first
+   mismatch is printed with the seed and step and the program exits 1.
+
+   Target (add termio.c, uartstdio.c and the startup file): prints the
+   average and worst case CPU cycles per operation for each queue size.
+*/
 #include <stdio.h>
 #include "ES_General.h"
+#include "ES_DeferRecall.h"
+
+#define MaxTestSize 32
+
+// event types used by the harness, the EventParam carries a sequence number
+#define ISR_EVENT  1   // posted FIFO from the simulated ISR
+#define FIFO_EVENT 2   // posted FIFO from the foreground
+#define LIFO_EVENT 3   // posted LIFO from the foreground
+
+static const uint8_t TestSizes[] = { 1, 2, 3, 4, 8, 15, 20, MaxTestSize };
+static ES_Event TestQueue[MaxTestSize+1];
+static ES_Event DeferQueue[MaxTestSize+1];
+
+#ifdef QUEUE_STRESS
+
+#include <stdlib.h>
+
+#define StepsPerRun 200000
+
+// reference model of a queue, a plain ring that is only touched from the
+// places where the real operation is known to have taken effect
+typedef struct {  ES_Event Entry[MaxTestSize];
+                  uint8_t Size;
+                  uint8_t Head;
+                  uint8_t Count;
+} Model_t;
+
+static Model_t ServiceModel;
+static Model_t DeferModel;
+static uint32_t RandomState;
+static uint32_t Seed;
+static uint32_t Step;
+static uint8_t PreemptOdds;
+static bool InCritical;
+static bool InISR;
+static uint16_t NextSequence;
+static uint32_t ISRPosts, ISRDrops, Recalled, RecallDrops;
+
+static void Fail( const char *pWhat )
+{
+   printf("FAIL seed %lu size %u odds 1/%u step %lu: %s\n", (unsigned long)Seed,
+          ServiceModel.Size, PreemptOdds, (unsigned long)Step, pWhat);
+   exit(1);
+}
+
+static uint32_t NextRandom( void )
+{  // xorshift32, good enough to pick operations
+   RandomState ^= RandomState << 13;
+   RandomState ^= RandomState >> 17;
+   RandomState ^= RandomState << 5;
+   return RandomState;
+}
+
+static void ModelInit( Model_t *pModel, uint8_t Size )
+{
+   pModel->Size = Size;
+   pModel->Head = 0;
+   pModel->Count = 0;
+}
+
+static bool ModelPushBack( Model_t *pModel, ES_Event Event )
+{
+   if (pModel->Count == pModel->Size)
+      return false;
+   pModel->Entry[(pModel->Head + pModel->Count) % pModel->Size] = Event;
+   pModel->Count++;
+   return true;
+}
+
+static bool ModelPushFront( Model_t *pModel, ES_Event Event )
+{
+   if (pModel->Count == pModel->Size)
+      return false;
+   pModel->Head = (pModel->Head + pModel->Size - 1) % pModel->Size;
+   pModel->Entry[pModel->Head] = Event;
+   pModel->Count++;
+   return true;
+}
+
+static ES_Event ModelPop( Model_t *pModel )
+{
+   ES_Event Event = { ES_NO_EVENT, 0 };
+   if (pModel->Count > 0)
+   {
+      Event = pModel->Entry[pModel->Head];
+      pModel->Head = (pModel->Head + 1) % pModel->Size;
+      pModel->Count--;
+   }
+   return Event;
+}
+
+static bool SameEvent( ES_Event A, ES_Event B )
+{
+   return (A.EventType == B.EventType) && (A.EventParam == B.EventParam);
+}
+
+// walks the real queue and compares size, count and every entry in order
+static void CheckQueue( ES_Event *pBlock, const Model_t *pModel, const char *pName )
+{
+   pQueue_t pThisQueue = (pQueue_t)pBlock;
+   uint8_t i;
+   static char Message[80];
+
+   if (pThisQueue->QueueSize != pModel->Size)
+   {
+      sprintf(Message, "%s QueueSize %u, expected %u", pName,
+              pThisQueue->QueueSize, pModel->Size);
+      Fail(Message);
+   }
+   if (pThisQueue->NumEntries != pModel->Count)
+   {
+      sprintf(Message, "%s NumEntries %u, expected %u", pName,
+              pThisQueue->NumEntries, pModel->Count);
+      Fail(Message);
+   }
+   if (pThisQueue->CurrentIndex >= pThisQueue->QueueSize)
+   {
+      sprintf(Message, "%s CurrentIndex %u out of range", pName,
+              pThisQueue->CurrentIndex);
+      Fail(Message);
+   }
+   for (i = 0; i < pModel->Count; i++)
+   {
+      ES_Event Actual = pBlock[1 + ((pThisQueue->CurrentIndex + i) % pThisQueue->QueueSize)];
+      ES_Event Expected = pModel->Entry[(pModel->Head + i) % pModel->Size];
+      if (!SameEvent(Actual, Expected))
+      {
+         sprintf(Message, "%s entry %u is %u:%u, expected %u:%u", pName, i,
+                 Actual.EventType, Actual.EventParam,
+                 Expected.EventType, Expected.EventParam);
+         Fail(Message);
+      }
+   }
+}
+
+// host versions of the PRIMASK access used by EnterCritical/ExitCritical
+uint32_t CPUgetPRIMASK_cpsid(void)
+{
+   uint32_t WasMasked = InCritical;
+   InCritical = true;
+   return WasMasked;
+}
+
+void CPUsetPRIMASK(uint32_t newPRIMASK)
+{
+   InCritical = (newPRIMASK != 0);
+}
+
+/* Called at every ES_PREEMPTION_POINT, i.e. wherever interrupts are enabled
+   on entry to a queue operation. One time in PreemptOdds it plays an ISR
+   posting an event FIFO to the service queue. The points sit before the
+   foreground operation takes effect, so the model is updated here and the
+   foreground updates it after its own call returns.
+*/
+void QueueStress_Preempt( void )
+{
+   ES_Event ISREvent;
+   bool ModelAdded;
+
+   if (InCritical)
+      Fail("preemption point inside a critical region");
+   if (InISR || ((NextRandom() % PreemptOdds) != 0))
+      return;
+   InISR = true;
+   ISREvent.EventType = ISR_EVENT;
+   ISREvent.EventParam = NextSequence++;
+   ModelAdded = ModelPushBack(&ServiceModel, ISREvent);
+   if (ES_EnQueueFIFO(TestQueue, ISREvent) != ModelAdded)
+      Fail("ISR post result does not match free space");
+   if (ModelAdded)
+      ISRPosts++;
+   else
+      ISRDrops++;
+   InISR = false;
+}
+
+// the service post that ES_RecallEvents uses, one at a time so the model
+// follows the recall event by event
+bool ES_PostToServiceLIFO( uint8_t WhichService, ES_Event TheEvent )
+{
+   ES_Event Expected = ModelPop(&DeferModel);
+   bool WasAdded;
+
+   if (WhichService != 0)
+      Fail("recall posted to the wrong service");
+   if (!SameEvent(TheEvent, Expected))
+      Fail("recall out of order");
+   WasAdded = ES_EnQueueLIFO(TestQueue, TheEvent);
+   if (WasAdded != ModelPushFront(&ServiceModel, TheEvent))
+      Fail("recall post result does not match free space");
+   if (WasAdded)
+      Recalled++;
+   else
+      RecallDrops++;
+   return WasAdded;
+}
+
+static void RunOne( uint8_t Size, uint8_t Odds )
+{
+   ES_Event Event;
+   ES_Event Expected;
+   uint8_t NumLeft;
+   bool WasAdded;
+
+   ES_InitQueue(TestQueue, Size + 1);
+   ES_InitQueue(DeferQueue, Size + 1);
+   ModelInit(&ServiceModel, Size);
+   ModelInit(&DeferModel, Size);
+   PreemptOdds = Odds;
+   ISRPosts = ISRDrops = Recalled = RecallDrops = 0;
+
+   for (Step = 0; Step < StepsPerRun; Step++)
+   {
+      switch (NextRandom() % 8)
+      {
+         case 0 :
+         case 1 :
+            Event.EventType = FIFO_EVENT;
+            Event.EventParam = NextSequence++;
+            WasAdded = ES_EnQueueFIFO(TestQueue, Event);
+            if (WasAdded != ModelPushBack(&ServiceModel, Event))
+               Fail("EnQueueFIFO result does not match free space");
+            break;
+         case 2 :
+            Event.EventType = LIFO_EVENT;
+            Event.EventParam = NextSequence++;
+            WasAdded = ES_EnQueueLIFO(TestQueue, Event);
+            if (WasAdded != ModelPushFront(&ServiceModel, Event))
+               Fail("EnQueueLIFO result does not match free space");
+            break;
+         case 3 :
+         case 4 :
+         case 5 :
+            NumLeft = ES_DeQueue(TestQueue, &Event);
+            Expected = ModelPop(&ServiceModel);
+            if (!SameEvent(Event, Expected))
+               Fail("DeQueue returned the wrong event");
+            if (NumLeft != ServiceModel.Count)
+               Fail("DeQueue returned the wrong count");
+            break;
+         case 6 :   // defer whatever is at the head of the service queue
+            ES_DeQueue(TestQueue, &Event);
+            Expected = ModelPop(&ServiceModel);
+            if (!SameEvent(Event, Expected))
+               Fail("DeQueue for defer returned the wrong event");
+            if (Event.EventType != ES_NO_EVENT)
+            {
+               WasAdded = ES_EnQueueFIFO(DeferQueue, Event);
+               if (WasAdded != ModelPushBack(&DeferModel, Event))
+                  Fail("defer result does not match free space");
+            }
+            break;
+         case 7 :
+            if ((NextRandom() % 4) == 0)   // let some deferred events pile up
+            {
+               ES_RecallEvents(0, DeferQueue);
+               if (DeferModel.Count != 0)
+                  Fail("recall left events on the defer queue");
+            }
+            break;
+      }
+      if (InCritical)
+         Fail("operation returned with interrupts masked");
+      CheckQueue(TestQueue, &ServiceModel, "service");
+      CheckQueue(DeferQueue, &DeferModel, "defer");
+   }
+   printf("size %2u  ISR 1/%-2u  ISR posts %6lu  full %6lu  recalled %6lu  lost on recall %5lu\n",
+          Size, Odds, (unsigned long)ISRPosts, (unsigned long)ISRDrops,
+          (unsigned long)Recalled, (unsigned long)RecallDrops);
+}
+
+int main(int argc, char *argv[])
+{
+   static const uint8_t Odds[] = { 2, 5, 17 };
+   uint8_t i, j;
+
+   Seed = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 0x2218B;
+   RandomState = (Seed != 0) ? Seed : 1;
+   for (i = 0; i < ARRAY_SIZE(TestSizes); i++)
+      for (j = 0; j < ARRAY_SIZE(Odds); j++)
+         RunOne(TestSizes[i], Odds[j]);
+   printf("PASS seed %lu\n", (unsigned long)Seed);
+   return 0;
+}
+
+#else /* target benchmark */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "inc/hw_memmap.h"
+#include "driverlib/sysctl.h"
+#include "termio.h"
+
+#define BenchPasses 64
+
+typedef struct {  uint32_t Total;
+                  uint32_t Max;
+                  uint32_t Count;
+} BenchStat_t;
+
+static BenchStat_t FIFOStat, LIFOStat, DeQueueStat, RecallStat;
+static uint32_t Overhead;
+
+static void Accumulate( BenchStat_t *pStat, uint32_t Cycles )
+{
+   Cycles -= Overhead;
+   pStat->Total += Cycles;
+   if (Cycles > pStat->Max)
+      pStat->Max = Cycles;
+   pStat->Count++;
+}
+
+static void ClearStat( BenchStat_t *pStat )
+{
+   pStat->Total = 0;
+   pStat->Max = 0;
+   pStat->Count = 0;
+}
+
+static void PrintStat( const BenchStat_t *pStat )
+{
+   printf(" %5lu/%-5lu", (unsigned long)(pStat->Total / pStat->Count),
+          (unsigned long)pStat->Max);
+}
+
+// ES_RecallEvents posts back to TestQueue, as a service's own queue
+bool ES_PostToServiceLIFO( uint8_t WhichService, ES_Event TheEvent )
+{
+   return ES_EnQueueLIFO(TestQueue, TheEvent);
+}
+
+int main(void)
+{
+   ES_Event Event = { FIFO_EVENT, 0 };
+   uint32_t Start;
+   uint8_t i, Pass, n;
+
+   SysCtlClockSet(SYSCTL_SYSDIV_5 | SYSCTL_USE_PLL | SYSCTL_OSC_MAIN
+         | SYSCTL_XTAL_16MHZ);
+   TERMIO_Init();
+   _HW_CycleCounterInit();
+
+   // cost of the measurement itself, taken off every sample
+   Start = _HW_GetCycleCount();
+   Overhead = _HW_GetCycleCount() - Start;
+
+   printf("\r\nES_Queue cycles per operation, avg/max over %u passes\r\n", BenchPasses);
+   printf("size  EnQueueFIFO EnQueueLIFO DeQueue     Recall/event\r\n");
+   for (i = 0; i < ARRAY_SIZE(TestSizes); i++)
+   {
+      uint8_t Size = TestSizes[i];
+
+      ES_InitQueue(TestQueue, Size + 1);
+      ES_InitQueue(DeferQueue, Size + 1);
+      ClearStat(&FIFOStat);
+      ClearStat(&LIFOStat);
+      ClearStat(&DeQueueStat);
+      ClearStat(&RecallStat);
+      for (Pass = 0; Pass < BenchPasses; Pass++)
+      {  // every op is timed at every fill level and read/write position
+         for (n = 0; n < Size; n++)
+         {
+            Start = _HW_GetCycleCount();
+            ES_EnQueueFIFO(TestQueue, Event);
+            Accumulate(&FIFOStat, _HW_GetCycleCount() - Start);
+         }
+         for (n = 0; n < Size; n++)
+         {
+            Start = _HW_GetCycleCount();
+            ES_DeQueue(TestQueue, &Event);
+            Accumulate(&DeQueueStat, _HW_GetCycleCount() - Start);
+         }
+         for (n = 0; n < Size; n++)
+         {
+            Start = _HW_GetCycleCount();
+            ES_EnQueueLIFO(TestQueue, Event);
+            Accumulate(&LIFOStat, _HW_GetCycleCount() - Start);
+         }
+         while (ES_DeQueue(TestQueue, &Event) != 0)
+            ;
+         Event.EventType = FIFO_EVENT;
+         for (n = 0; n < Size; n++)
+            ES_EnQueueFIFO(DeferQueue, Event);
+         Start = _HW_GetCycleCount();
+         ES_RecallEvents(0, DeferQueue);
+         Start = _HW_GetCycleCount() - Start;
+         RecallStat.Total += Start - Overhead;
+         RecallStat.Count += Size;
+         if (((Start - Overhead) / Size) > RecallStat.Max)
+            RecallStat.Max = (Start - Overhead) / Size;
+         while (ES_DeQueue(TestQueue, &Event) != 0)
+            ;
+         Event.EventType = FIFO_EVENT;
+      }
+      printf("%4u ", Size);
+      PrintStat(&FIFOStat);
+      PrintStat(&LIFOStat);
+      PrintStat(&DeQueueStat);
+      PrintStat(&RecallStat);
+      printf("\r\n");
+   }
+#if defined(QEMU)
+   QemuShim_Exit(0);
+#endif
 
-static ES_Event TestQueue[3+1];
-volatile  uint8_t NumLeft; // for debugging visibility
-
-void main(void){
-  ES_Event MyEvent;
-  bool bReturn;
-  
-  ES_InitQueue( TestQueue, ARRAY_SIZE(TestQueue) );
-  MyEvent.EventType = 0;
-  MyEvent.EventParam = 1;
-  bReturn = ES_EnQueueFIFO( TestQueue, MyEvent );
-  bReturn +=1; // keep that sily optimizer away
-  
-    // Try stuffing one on using the LIFO rule
-  MyEvent.EventType = 10;
-  MyEvent.EventParam = 11;
-  bReturn = ES_EnQueueLIFO( TestQueue, MyEvent );
-  bReturn +=1; // keep that sily optimizer away
-  
-  // at this point, the events in the queue should be 11,0
-  // so pull off the 11, leaving 1 entry
-  NumLeft = ES_DeQueue( TestQueue, &MyEvent);
-  if ( NumLeft != 1)
-    bReturn = 0;  
-
-  MyEvent.EventType = 2;
-  MyEvent.EventParam = 3;
-  bReturn = ES_EnQueueFIFO( TestQueue, MyEvent );
-  bReturn +=1; // keep that sily optimizer away
-  
-  MyEvent.EventType = 4;
-  MyEvent.EventParam = 5;
-  bReturn = ES_EnQueueFIFO( TestQueue, MyEvent );
-  bReturn +=1; // keep that sily optimizer away
-  
-  // queue is now full so this one should fail
-  MyEvent.EventType = 6;
-  MyEvent.EventParam = 7;
-  bReturn = ES_EnQueueFIFO( TestQueue, MyEvent );
-  bReturn +=1; // keep that sily optimizer away
-  
-  // at this point, the events in the queue should be 0,2,4
-  // so pull off the 0, leaving 2 entries
-  NumLeft = ES_DeQueue( TestQueue, &MyEvent);
-  if ( NumLeft != 2)
-    bReturn = 0;  
-  // Try stuffing one on using the LIFO rule
-  MyEvent.EventType = 8;
-  MyEvent.EventParam = 9;
-  bReturn = ES_EnQueueLIFO( TestQueue, MyEvent );
-  bReturn +=1; // keep that sily optimizer away
-  
-  // at this point, the events in the queue should be 8,2,4
-  // so pull off the 8, leaving 2 entries
-  NumLeft = ES_DeQueue( TestQueue, &MyEvent);
-  NumLeft += 3; //to keep the compiler from optimizing away the last save
-  
   while(1)
     ;
 }
 
-#endif
+#endif /* QUEUE_STRESS */
+#endif /* TEST */
 /*------------------------------- Footnotes -------------------------------*/
 /*------------------------------ End of file ------------------------------*/
 
@@ -39,9 +39,20 @@
 #include "EventCheckers.h"
 
 #include "MotorActionsModule.h"
+#include "OdometryModule.h"
+#include "FlywheelModule.h"
+#include "ServoModule.h"
+#include "BatteryModule.h"
+#include "BeaconAlignModule.h"
 
 #include "RobotTopSM.h"
 #include "PWMmodule.h"
+#include "SMProfiler.h"
+#include "HallEffectModule.h"
+#include "CaptureEngine.h"
+#include "IRGoertzelModule.h"
+#include "WireFollowModule.h"
+#include "InputRecorder.h"
 
 // This is the event checking function sample. It is not intended to be 
 // included in the module. It is only here as a sample to guide you in writing
@@ -99,13 +110,76 @@ bool Check4Keystroke(void)
 			PostSPIService(CommandEvent);
 		}
 		else if (ThisEvent.EventParam == 'x') {
-			//stop();
-			SetServoDuty(70); 
+			// open the ball separator, 'X' closes it again
+			Servo_MoveTo(SEPARATOR_OPEN_US, 500);
+		} else if (ThisEvent.EventParam == 'X') {
+			Servo_MoveTo(SEPARATOR_CLOSED_US, 500);
 		} else if (ThisEvent.EventParam == 'd') {
 			CommandEvent.EventType = ES_TIMEOUT;
 			CommandEvent.EventParam = Waiting4Shot_TIMER;
 			PostRobotTopSM(CommandEvent);
 		}
+		else if (ThisEvent.EventParam == 'p') {
+			// state residency and transition counts since reset
+			SMProf_Dump();
+		}
+		else if (ThisEvent.EventParam == 'P') {
+			SMProf_Reset();
+		}
+		else if (ThisEvent.EventParam == 'l') {
+			// staging area detect to stop latency
+			PrintStagingAreaLatency();
+		}
+		else if (ThisEvent.EventParam == 'f') {
+			// Goertzel detector on, then its last frame and off again
+			if (IRGoertzel_IsEnabled()) {
+				IRGoertzel_PrintFrame();
+				EnableIRGoertzel(false);
+			} else {
+				EnableIRGoertzel(true);
+				printf("\r\n Goertzel on, 'f' again for a frame\r\n");
+			}
+		}
+		else if (ThisEvent.EventParam == 'w') {
+			// wire follow loop timing since the last 'w'
+			WireFollow_PrintStats();
+		}
+		else if (ThisEvent.EventParam == 'm') {
+			// wheel writes made and skipped since the last 'm'
+			MotorActions_PrintStats();
+		}
+		else if (ThisEvent.EventParam == 'o') {
+			// wheel speeds, pose and the last coast and brake stops
+			Odo_PrintStatus();
+		}
+		else if (ThisEvent.EventParam == 'F') {
+			// flywheel RPM, last spin up and the RPM of the shots so far
+			Fly_PrintStats();
+		}
+		else if (ThisEvent.EventParam == 'b') {
+			// last beacon window and the times to align so far
+			Align_PrintStats();
+		}
+		else if (ThisEvent.EventParam == 'v') {
+			// battery voltage and the duty cycle scale
+			Battery_PrintStatus();
+		}
+#if defined(CAPTURE_ISR_STATS)
+		else if (ThisEvent.EventParam == 'c') {
+			// capture ISR cycle counts since the last 'c'
+			Capture_PrintIsrStats();
+		}
+		else if (ThisEvent.EventParam == 'C') {
+			// IR capture between uDMA and per edge interrupts
+			Capture_ToggleDMA();
+		}
+#endif
+#if defined(RECORD_INPUTS)
+		else if (ThisEvent.EventParam == 'r') {
+			// hex dump of the input log for Host/ReplayMain.c
+			InputRec_Dump();
+		}
+#endif
 		else{   // otherwise post to Service 0 for processing
    
     }
@@ -113,3 +187,17 @@ bool Check4Keystroke(void)
   }
   return false;
 }
+
+/****************************************************************************
+ Function
+   Check4BatteryLow
+ Returns
+   bool: true if BATTERY_LOW was posted
+ Description
+   samples the battery every so often for the duty cycle feed-forward,
+   BatteryModule posts BATTERY_LOW to RobotTopSM when it runs down
+****************************************************************************/
+bool Check4BatteryLow( void )
+{
+  return Battery_Update();
+}
@@ -0,0 +1,488 @@
+/****************************************************************************
+FlywheelModule
+	Holds the flywheel at a target RPM. A tachometer on B3 (T3CCP1) times
+	every flywheel pulse on Timer3B, and Timer3A ticks at FLY_RATE_HZ to
+	turn the pulses since the last tick into RPM and run a PI on it
+	(WheelSpeedModule's controller, with the flywheel's gains) that sets
+	the flywheel duty. FLYWHEEL_AT_SPEED goes to RobotTopSM once the RPM has
+	stayed within AtSpeedPercent of the target for AtSpeedTicks, so a shot
+	goes as soon as the wheel is ready instead of after a worst case wait.
+
+ Notes
+	Timer3B captures in 24 bits (the prescaler is the top 8), so a period
+	up to 0.42S (143 RPM at one pulse a rev) reads right; a wheel that
+	gives no pulse for StaleTicks reads 0 RPM and the next pulse only
+	restarts the timing. Pulses closer than MaxRPM allows are glitches and
+	are dropped.
+	The RPM over a tick is from the mean period of its pulses; a tick with
+	no pulse keeps the last RPM.
+	From stopped the error pins the command at 100%, so the wheel spins up
+	at full duty and the loop backs it off on the way in. Only the loop
+	writes the flywheel duty while a target is set, and only when the duty
+	changes.
+	The wheel's top speed drops with the battery, and below a point the
+	scaled duty can't make up for it: Fly_LimitForSupply brings the targets
+	down to what the pack can hold with SupplyHeadroomPercent to spare, so
+	FLYWHEEL_AT_SPEED still comes on a low battery.
+	Fly_MarkShot() notes the RPM a ball goes out at. Fly_PrintStats ('F' on
+	the console) prints the spin up time of the last shot and the spread of
+	the release RPM over the shots so far, the numbers to tune the gains
+	and the targets by.
+	Unverified configuration: TachPulsesPerRev, FlyTopRPM, the StageRPM
+	targets and the FlyGains are placeholders that haven't been measured
+	or tuned on the robot. A wrong TachPulsesPerRev scales every RPM
+	reading, and so the targets and FLYWHEEL_AT_SPEED, by the same factor.
+	An input log records FLYWHEEL_AT_SPEED going out rather than the tach
+	pulses; the host replay doesn't run the loop, so Fly_ReplayAtSpeed
+	posts it where it went out on the target, and the RPM stays at 0.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "inc/hw_sysctl.h"
+#include "inc/hw_gpio.h"
+#include "inc/hw_timer.h"
+#include "inc/hw_nvic.h"
+
+#include "ES_Port.h"
+#include "BITDEFS.H"
+
+#include "FlywheelModule.h"
+#include "WheelSpeedModule.h"
+#include "PWMmodule.h"
+#include "RobotTopSM.h"
+#include "BatteryModule.h"
+#include "InputRecorder.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define TicksPerSecond 40000000
+// Timer3A's periodic count runs at 40MHz/10
+#define TickPrescale 10
+#define TicksPerFlyTick (TicksPerSecond/TickPrescale/FLY_RATE_HZ)
+// Timer 3A is interrupt 35, Timer 3B interrupt 36
+#define Timer3AIntBit BIT3HI
+#define Timer3BIntBit BIT4HI
+#define CaptureMask 0x00ffffff
+#define CCP1Function 7
+#define BitsPerNibble 4
+#define TachPin BIT3HI                         // B3
+#define TachPinNumber 3
+
+// tach pulses a flywheel rev, unverified configuration
+#define TachPulsesPerRev 1
+#define TicksPerMinute ((uint32_t)TicksPerSecond*60)
+#define MaxRPM 12000
+#define MinPeriodTicks (TicksPerMinute/(MaxRPM*TachPulsesPerRev))
+// no pulse for this many ticks reads as stopped
+#define StaleTicks 20
+
+// at speed: within AtSpeedPercent of the target for AtSpeedTicks in a row
+#define AtSpeedPercent 3
+#define AtSpeedTicks 5
+
+// flywheel speed at 100% on a nominal battery, unverified configuration
+#define FlyTopRPM 6000
+// of the top speed on a low battery a target may use
+#define SupplyHeadroomPercent 90
+#define PERCENT_Q15(Percent) ((int32_t)(Percent)*WHEEL_FULL_DUTY/100)
+
+/*---------------------------- Module Functions ---------------------------*/
+static void UpdateRPM( void );
+static void CheckAtSpeed( void );
+static uint8_t Q15ToPercent( int32_t Command );
+
+/*---------------------------- Module Variables ---------------------------*/
+// gains in duty per RPM, untuned starting points to tune with 'F'
+static const WheelGains_t FlyGains =
+{
+  WHEEL_GAIN(100.0/FlyTopRPM), WHEEL_GAIN(0.02), WHEEL_GAIN(0.2/FLY_RATE_HZ), PERCENT_Q15(30)
+};
+
+// target by staging area, 1 to 3, and 0 when it isn't known; placeholders
+// until the shots are measured
+static const uint16_t StageRPM[] = { 4800, 4400, 4800, 5200 };
+
+// tach, from Timer3B
+static uint32_t LastEdge;
+static bool Timing;
+static uint32_t PeriodSum;
+static uint16_t PeriodCount;
+
+// loop, from Timer3A
+static volatile uint16_t RPM;
+static uint16_t TicksSincePulse;
+static volatile uint16_t TargetRPM;
+static uint16_t LimitRPM;              // 0 for none
+static WheelPI_t FlyPI;
+static uint8_t AppliedDuty;
+static uint8_t InBandTicks;
+static volatile bool AtSpeed;
+static volatile uint32_t Ticks;
+static uint32_t StartTick;
+
+// shots
+static uint32_t LastSpinUpMS;
+static uint16_t Shots;
+static uint16_t ShotMinRPM;
+static uint16_t ShotMaxRPM;
+static uint32_t ShotRPMSum;
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+    InitFlywheel
+
+ Description
+    Sets Timer3B up capturing the tach's rising edges on B3 and starts
+    Timer3A as the FLY_RATE_HZ tick. Call after InitializePWM, the flywheel
+    stays off until a target is set.
+****************************************************************************/
+void InitFlywheel( void )
+{
+  // enable the clocks to Timer3 and port B
+  HWREG(SYSCTL_RCGCTIMER) |= SYSCTL_RCGCTIMER_R3;
+  HWREG(SYSCTL_RCGCGPIO) |= SYSCTL_RCGCGPIO_R1;
+  while ((HWREG(SYSCTL_PRTIMER) & SYSCTL_PRTIMER_R3) != SYSCTL_PRTIMER_R3)
+    ;
+
+  // make sure both halves are disabled before configuring, split 16 bit
+  HWREG(TIMER3_BASE + TIMER_O_CTL) &= ~(TIMER_CTL_TAEN | TIMER_CTL_TBEN);
+  HWREG(TIMER3_BASE + TIMER_O_CFG) = TIMER_CFG_16_BIT;
+
+  // A: periodic, counting down through the prescaler
+  HWREG(TIMER3_BASE + TIMER_O_TAMR) =
+    (HWREG(TIMER3_BASE + TIMER_O_TAMR) & ~TIMER_TAMR_TAMR_M) | TIMER_TAMR_TAMR_PERIOD;
+  HWREG(TIMER3_BASE + TIMER_O_TAPR) = TickPrescale - 1;
+  HWREG(TIMER3_BASE + TIMER_O_TAILR) = TicksPerFlyTick - 1;
+  HWREG(TIMER3_BASE + TIMER_O_IMR) |= TIMER_IMR_TATOIM;
+
+  // B: rising edge times, counting up through all 24 bits
+  HWREG(TIMER3_BASE + TIMER_O_TBMR) =
+    (HWREG(TIMER3_BASE + TIMER_O_TBMR) & ~TIMER_TBMR_TBAMS) |
+    (TIMER_TBMR_TBCDIR | TIMER_TBMR_TBCMR | TIMER_TBMR_TBMR_CAP);
+  HWREG(TIMER3_BASE + TIMER_O_TBILR) = 0xffff;
+  HWREG(TIMER3_BASE + TIMER_O_TBPR) = 0xff;
+  HWREG(TIMER3_BASE + TIMER_O_CTL) &= ~TIMER_CTL_TBEVENT_M;
+  HWREG(TIMER3_BASE + TIMER_O_IMR) |= TIMER_IMR_CBEIM;
+
+  // route B3 to T3CCP1 as a digital input
+  HWREG(GPIO_PORTB_BASE + GPIO_O_AFSEL) |= TachPin;
+  HWREG(GPIO_PORTB_BASE + GPIO_O_PCTL) =
+    (HWREG(GPIO_PORTB_BASE + GPIO_O_PCTL) & ~(0xf << (BitsPerNibble*TachPinNumber))) +
+    (CCP1Function << (BitsPerNibble*TachPinNumber));
+  HWREG(GPIO_PORTB_BASE + GPIO_O_DEN) |= TachPin;
+  HWREG(GPIO_PORTB_BASE + GPIO_O_DIR) &= ~TachPin;
+
+  TargetRPM = 0;
+  RPM = 0;
+  Timing = false;
+  TicksSincePulse = StaleTicks;
+
+  HWREG(NVIC_EN1) |= (Timer3AIntBit | Timer3BIntBit);
+
+  // make sure interrupts are enabled globally
+  __enable_irq();
+
+  // start both, with stall in the debugger
+  HWREG(TIMER3_BASE + TIMER_O_CTL) |= (TIMER_CTL_TAEN | TIMER_CTL_TASTALL |
+                                       TIMER_CTL_TBEN | TIMER_CTL_TBSTALL);
+}
+
+/****************************************************************************
+ Function
+    Fly_SetTargetRPM
+
+ Parameters
+    uint16_t : RPM to hold, 0 turns the flywheel off
+
+ Description
+    A new target starts over the spin up timing and the wait for
+    FLYWHEEL_AT_SPEED
+****************************************************************************/
+void Fly_SetTargetRPM( uint16_t NewRPM )
+{
+  if ((LimitRPM != 0) && (NewRPM > LimitRPM))
+  {
+    NewRPM = LimitRPM;
+  }
+  EnterCritical();
+  if (TargetRPM == 0)
+  {
+    WheelPI_Init(&FlyPI, &FlyGains);
+  }
+  TargetRPM = NewRPM;
+  AtSpeed = false;
+  InBandTicks = 0;
+  StartTick = Ticks;
+  if (NewRPM == 0)
+  {
+    AppliedDuty = 0;
+    SetFlyDuty(0);
+  }
+  ExitCritical();
+}
+
+/****************************************************************************
+ Function
+    Fly_LimitForSupply
+
+ Parameters
+    uint16_t : the battery in mV, 0 to lift the limit
+
+ Description
+    Caps every target from now on, the one running included, at what the
+    flywheel can hold on the battery
+****************************************************************************/
+void Fly_LimitForSupply( uint16_t SupplyMV )
+{
+  if (SupplyMV == 0)
+  {
+    LimitRPM = 0;
+    return;
+  }
+  LimitRPM = (uint16_t)((uint32_t)FlyTopRPM*SupplyMV*SupplyHeadroomPercent/
+                        (100UL*BATTERY_NOMINAL_MV));
+  if (TargetRPM > LimitRPM)
+  {
+    Fly_SetTargetRPM(LimitRPM);
+  }
+}
+
+/****************************************************************************
+ Function
+    Fly_TargetRPMForStage
+
+ Parameters
+    uint8_t : staging area, 1 to 3, 0 if not known
+
+ Returns
+    uint16_t : the target RPM to shoot from it
+****************************************************************************/
+uint16_t Fly_TargetRPMForStage( uint8_t StagingArea )
+{
+  if (StagingArea >= sizeof(StageRPM)/sizeof(StageRPM[0]))
+  {
+    StagingArea = 0;
+  }
+  return StageRPM[StagingArea];
+}
+
+/****************************************************************************
+ Function
+    Fly_GetRPM, Fly_IsAtSpeed
+
+ Description
+    The flywheel RPM as of the last tick, and whether FLYWHEEL_AT_SPEED has
+    gone out for the target now
+****************************************************************************/
+uint16_t Fly_GetRPM( void )
+{
+  return RPM;
+}
+
+bool Fly_IsAtSpeed( void )
+{
+  return AtSpeed;
+}
+
+#if defined(REPLAY_INPUTS)
+/****************************************************************************
+ Function
+    Fly_ReplayAtSpeed
+
+ Description
+    Stands in for CheckAtSpeed's post on a host replay, with the target as
+    the RPM
+****************************************************************************/
+void Fly_ReplayAtSpeed( void )
+{
+  ES_Event ThisEvent;
+
+  AtSpeed = true;
+  ThisEvent.EventType = FLYWHEEL_AT_SPEED;
+  ThisEvent.EventParam = TargetRPM;
+  PostRobotTopSM(ThisEvent);
+}
+#endif
+
+/****************************************************************************
+ Function
+    Fly_MarkShot
+
+ Description
+    A ball is going out now: keeps the RPM for the shot statistics
+****************************************************************************/
+void Fly_MarkShot( void )
+{
+  uint16_t Now = RPM;
+
+  if ((Shots == 0) || (Now < ShotMinRPM))
+  {
+    ShotMinRPM = Now;
+  }
+  if ((Shots == 0) || (Now > ShotMaxRPM))
+  {
+    ShotMaxRPM = Now;
+  }
+  ShotRPMSum += Now;
+  Shots++;
+}
+
+/****************************************************************************
+ Function
+    FlywheelTachISR
+
+ Description
+    Timer3B capture: adds the period since the last tach pulse to the tick
+****************************************************************************/
+void FlywheelTachISR( void )
+{
+  uint32_t Edge, Period;
+
+  // clear the source of the interrupt
+  HWREG(TIMER3_BASE + TIMER_O_ICR) = TIMER_ICR_CBECINT;
+  Edge = HWREG(TIMER3_BASE + TIMER_O_TBR) & CaptureMask;
+
+  if (!Timing)
+  {
+    // the first pulse from stopped only starts the timing
+    Timing = true;
+    LastEdge = Edge;
+    return;
+  }
+  Period = (Edge - LastEdge) & CaptureMask;
+  if (Period < MinPeriodTicks)
+  {
+    // a glitch, the next real pulse is still timed from the last one
+    return;
+  }
+  LastEdge = Edge;
+  PeriodSum += Period;
+  PeriodCount++;
+}
+
+/****************************************************************************
+ Function
+    FlywheelControlISR
+
+ Description
+    Timer3A timeout: the RPM over the tick, a step of the speed loop and
+    the check for FLYWHEEL_AT_SPEED
+****************************************************************************/
+void FlywheelControlISR( void )
+{
+  int32_t Command;
+  uint8_t Duty;
+
+  // clear the source of the interrupt
+  HWREG(TIMER3_BASE + TIMER_O_ICR) = TIMER_ICR_TATOCINT;
+  Ticks++;
+
+  UpdateRPM();
+  if (TargetRPM == 0)
+  {
+    return;
+  }
+
+  Command = WheelPI_Step(&FlyPI, TargetRPM, RPM);
+  Duty = Q15ToPercent(Command);
+  if (Duty != AppliedDuty)
+  {
+    AppliedDuty = Duty;
+    SetFlyDuty(Duty);
+  }
+  CheckAtSpeed();
+}
+
+/****************************************************************************
+ Function
+    Fly_PrintStats
+
+ Description
+    Console dump of the flywheel now, the last spin up and the RPM the
+    shots so far went out at
+****************************************************************************/
+void Fly_PrintStats( void )
+{
+  printf("\r\nFlywheel %u RPM, target %u, duty %u%%%s\r\n",
+         (unsigned)RPM, (unsigned)TargetRPM, (unsigned)AppliedDuty, AtSpeed ? ", at speed" : "");
+  printf("Last spin up %lu ms; %u shots at %u to %u RPM, mean %lu\r\n",
+         (unsigned long)LastSpinUpMS, (unsigned)Shots, (unsigned)ShotMinRPM, (unsigned)ShotMaxRPM,
+         (unsigned long)((Shots != 0) ? (ShotRPMSum/Shots) : 0));
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+/***************************************************************************
+  UpdateRPM
+    RPM from the mean period of the tick's pulses, held through a tick
+    without one and 0 after StaleTicks of them
+ ***************************************************************************/
+static void UpdateRPM( void )
+{
+  if (PeriodCount != 0)
+  {
+    RPM = (uint16_t)(TicksPerMinute/((PeriodSum/PeriodCount)*TachPulsesPerRev));
+    PeriodSum = 0;
+    PeriodCount = 0;
+    TicksSincePulse = 0;
+  }
+  else if (TicksSincePulse < StaleTicks)
+  {
+    if (++TicksSincePulse == StaleTicks)
+    {
+      RPM = 0;
+      Timing = false;
+    }
+  }
+}
+
+/***************************************************************************
+  CheckAtSpeed
+    Posts FLYWHEEL_AT_SPEED, once a target, after AtSpeedTicks in the band
+ ***************************************************************************/
+static void CheckAtSpeed( void )
+{
+  ES_Event ThisEvent;
+  int32_t Error = (int32_t)RPM - TargetRPM;
+
+  if (AtSpeed)
+  {
+    return;
+  }
+  if ((Error*100 > (int32_t)TargetRPM*AtSpeedPercent) ||
+      (Error*100 < -(int32_t)TargetRPM*AtSpeedPercent))
+  {
+    InBandTicks = 0;
+    return;
+  }
+  if (++InBandTicks < AtSpeedTicks)
+  {
+    return;
+  }
+  AtSpeed = true;
+  LastSpinUpMS = (Ticks - StartTick)*1000/FLY_RATE_HZ;
+  REC_IRQ(REC_IRQ_FLY_AT_SPEED);
+  ThisEvent.EventType = FLYWHEEL_AT_SPEED;
+  ThisEvent.EventParam = RPM;
+  PostRobotTopSM(ThisEvent);
+}
+
+/***************************************************************************
+  Q15ToPercent
+    The loop's command as a flywheel duty, rounded; it never drives the
+    flywheel backward
+ ***************************************************************************/
+static uint8_t Q15ToPercent( int32_t Command )
+{
+  if (Command <= 0)
+  {
+    return 0;
+  }
+  return (uint8_t)((Command*100 + (WHEEL_FULL_DUTY >> 1)) >> 15);
+}
@@ -24,10 +24,14 @@ Events to post:
 
 #include "MotorActionsModule.h"
 #include "HallEffectModule.h"
+#include "RobotTopSM.h"
+#include "InputRecorder.h"
+#include "CaptureEngine.h"
 
 
 /*----------------------------- Module Defines ----------------------------*/
 #define BitsPerNibble 4
+#define TicksPerUS 40
 #define TicksPerMS 40000
 
 // staging area frequency codes
@@ -47,24 +51,27 @@ Events to post:
 #define code611us (BIT3HI|BIT2HI|BIT0HI) //1101;
 #define code556us (BIT3HI|BIT2HI|BIT1HI) //1110;
 #define code500us (BIT3HI|BIT2HI|BIT1HI|BIT0HI) //1111;
-#define codeInvalidStagingArea 0xff
+#define codeInvalidStagingArea CAP_INVALID_CODE
+
+// a station is dropped once StationLoseVotes more periods missed its code
+// than matched it, or no edge came in for StationLostMS
+#define StationLoseVotes 20
+#define StationLostMS 10
 
 /*---------------------------- Module Variables ---------------------------*/
-// For Staging Area Frequency Capture
-static uint16_t StagingAreaCode;
-static uint16_t StagingAreaPeriod_Tolerance = 10;
-static uint32_t LastEdge;
-static uint32_t CurrentEdge;
-static uint32_t MeasuredStagingAreaPeriod;
-static uint8_t counter = 0;
-// static int StagingAreaPeriod = 0; // Can use this to make period calculation more robust
-// static int StagingAreaPeriodAddition = 0; // Can use this to make period calculation more robust
-static uint16_t PeriodBuffer[10];
-static int SampleSize = 10;
-static uint8_t CaptureIndex = 0;
-static uint16_t StagingAreaPeriods[16] = {1333, 1277, 1222, 1166, 1111, 1055, 1000, 944, 889, 833, 778, 722, 667, 611, 556, 500};
+// station the robot is on as posted to RobotTopSM, and the votes against it
+static uint8_t StationCode = codeInvalidStagingArea;
+static uint8_t StationMisses;
+// capture time of the edge that confirmed the station and detect to stop
+// latency in us, see MarkStagingAreaStop
+static uint32_t StationDetectTime;
+static uint32_t LastStopLatencyUS;
+static uint32_t MaxStopLatencyUS;
+static uint16_t NumStops;
 
 /*---------------------------- Module Functions ---------------------------*/
+static void UpdateStation( uint32_t PeriodTicks );
+static void DropStation( void );
 
 /*------------------------------ Module Code ------------------------------*/
 
@@ -87,47 +94,22 @@ static uint16_t StagingAreaPeriods[16] = {1333, 1277, 1222, 1166, 1111, 1055, 10
 ****************************************************************************/
 void InitStagingAreaISR ( void )
 {	
-	// enable Wide Timer 0 
-	HWREG(SYSCTL_RCGCWTIMER) |= SYSCTL_RCGCWTIMER_R0;
-	
-	//enable clock to port C
-	HWREG(SYSCTL_RCGCGPIO) |=SYSCTL_RCGCGPIO_R2;
-		
-	// make sure timer A is disabled before configuring
-	HWREG(WTIMER0_BASE+TIMER_O_CTL) &= ~TIMER_CTL_TAEN;
-	
-	// set up time in 32bit wide mode (non-concatinated mode)
-	HWREG(WTIMER0_BASE+TIMER_O_CFG) = TIMER_CFG_16_BIT;
-	
-	// use full 32 bit count by initializing the Interval Load Register to all ones 
-	HWREG(WTIMER0_BASE+TIMER_O_TAILR) = 0xffffffff;
-	
-	// set up timer A in capture mode (TAMR=3,TAAMS=0), for edge time (TACMR=1), 
-	// and upcounting (TACDIR = 1);
-	HWREG(WTIMER0_BASE+TIMER_O_TAMR) = (HWREG(WTIMER0_BASE+TIMER_O_TAMR) & ~TIMER_TAMR_TAAMS)|
-	(TIMER_TAMR_TACDIR | TIMER_TAMR_TACMR | TIMER_TAMR_TAMR_CAP);
+	// C4 (WT0CCP0) edge capture on wide timer 0 A
+	Capture_InitChannel(CAP_STAGING);
 	
-	// set event to rising edge by modifying TAEVENT bits in GPTMCTL to 00 (clear bits)
-	HWREG(WTIMER0_BASE+TIMER_O_CTL) &= ~TIMER_CTL_TAEVENT_M;
+	// make sure timer B is disabled before configuring
+	HWREG(WTIMER0_BASE+TIMER_O_CTL) &= ~TIMER_CTL_TBEN;
 	
-	// set up port to do capture by setting alt function for C4
-	HWREG(GPIO_PORTC_BASE+GPIO_O_AFSEL) |= BIT4HI;
+	// timer B is a 1-shot that StagingAreaISR restarts on every edge, so it
+	// only times out once the sensor has left the staging area field
+	HWREG(WTIMER0_BASE+TIMER_O_TBMR) = (HWREG(WTIMER0_BASE+TIMER_O_TBMR) & ~TIMER_TBMR_TBMR_M) | TIMER_TBMR_TBMR_1_SHOT;
+	HWREG(WTIMER0_BASE+TIMER_O_TBILR) = TicksPerMS*StationLostMS;
 	
-	// map bit 4's alt function to WT0CCP0 (7), by clearing nibble then
-	// shifting 7 to fourth nibble 
-	HWREG(GPIO_PORTC_BASE+GPIO_O_PCTL) = (HWREG(GPIO_PORTC_BASE+GPIO_O_PCTL) & 0xfff0ffff) + (7<<(4*BitsPerNibble));
+	// enable local timeout interrupt
+	HWREG(WTIMER0_BASE+TIMER_O_IMR) |= TIMER_IMR_TBTOIM;
 	
-	// set pin C4 to digital
-	HWREG(GPIO_PORTC_BASE+GPIO_O_DEN) |= BIT4HI;
-	
-	// set pin C4 to input
-	HWREG(GPIO_PORTC_BASE+GPIO_O_DIR) &= BIT4LO;
-	
-	// enable local capture interrupt
-	HWREG(WTIMER0_BASE+TIMER_O_IMR) |= TIMER_IMR_CAEIM;
-	
-	// enable Timer A in Wide Timer 0 interrupt in the NVIC (94--> EN2, bit 30)
-	HWREG(NVIC_EN2) |= BIT30HI;
+	// enable Timer B in Wide Timer 0 interrupt in the NVIC (95--> EN2, bit 31)
+	HWREG(NVIC_EN2) |= BIT31HI;
 	
 	// ensure interrupts are enabled globally
 	__enable_irq();
@@ -158,12 +140,13 @@ void EnableStagingAreaISR( bool isEnabled )
 {
 	if(isEnabled == 1){
 		// enable timer and enable timer to stall when program stopped by the debugger
-		HWREG(WTIMER0_BASE+TIMER_O_CTL) |= (TIMER_CTL_TAEN | TIMER_CTL_TASTALL);
+		Capture_Enable(CAP_STAGING, true);
 		
 	} else {
 		
-		// disable interrupt
-		HWREG(WTIMER0_BASE+TIMER_O_CTL) &= ~TIMER_CTL_TAEN;
+		// disable interrupt, and the field lost timeout with it
+		Capture_Enable(CAP_STAGING, false);
+		HWREG(WTIMER0_BASE+TIMER_O_CTL) &= ~TIMER_CTL_TBEN;
 	}
 }
 
@@ -186,294 +169,169 @@ void EnableStagingAreaISR( bool isEnabled )
 ****************************************************************************/
 void StagingAreaISR( void )
 {
-	// clear the source of the interrupt 
-	HWREG(WTIMER0_BASE+TIMER_O_ICR) = TIMER_ICR_CAECINT;
+	CAP_ISR_BEGIN();
+	uint32_t Period = Capture_HandleEdge(CAP_STAGING);
 	
-	// grab captured value and calc period 
-	CurrentEdge = HWREG(WTIMER0_BASE+TIMER_O_TAR);
-	MeasuredStagingAreaPeriod = CurrentEdge - LastEdge;
-	MeasuredStagingAreaPeriod = 1000*MeasuredStagingAreaPeriod/TicksPerMS; // Unit: us
+	// restart the field lost timeout
+	HWREG(WTIMER0_BASE+TIMER_O_TBV) = TicksPerMS*StationLostMS;
+	HWREG(WTIMER0_BASE+TIMER_O_CTL) |= (TIMER_CTL_TBEN | TIMER_CTL_TBSTALL);
 	
-	//Write this captured period into the array
-	PeriodBuffer[counter] = MeasuredStagingAreaPeriod;
-	
-	//Move to the next element the next time
-	counter++;
-		
-	// Update the module level variable StagingAreaPeriod to be the average of the past ten catches
-	// Update it every 10 interrupts
-	if(counter >= SampleSize){
-		counter = 0;
-  }
-	
-	// update LastCapture to prepare for the next edge
-	LastEdge = CurrentEdge;
-	
-	// Update the module level variable StagingAreaPeriod to be the average of the past ten catches
-	// Update it every 10 interrupts
-//	if(counter >= SampleSize){
-//		StagingAreaPeriod = StagingAreaPeriodAddition/SampleSize;
-
-//		StagingAreaPeriodAddition = 0;
-//		counter = 0;
-//  }
-	
-	// SEE ME
-	// Running average calculation. Can use this to make calculation more robust
-	// StagingAreaPeriodAddition  = (90*StagingAreaPeriodAddition + 10*MeasuredStagingAreaPeriod)/100;
-	// StagingAreaPeriod = StagingAreaPeriodAddition;
-
+	// post STATION_REACHED/STATION_LOST straight from here
+	UpdateStation(Period);
+	CAP_ISR_END(CAP_STAGING);
 }
 
 /****************************************************************************
  Function
-    GetStagingAreaCode
+    GetStagingAreaCodeSingle
 
  Parameters
-   ES_Event : the event to process
+   uint16_t : period in us
 
  Returns
-   ES_Event, ES_NO_EVENT if no error ES_ERROR otherwise
+   uint8_t, the staging area code for that period, codeInvalidStagingArea
+   if it is not within tolerance of any of them
 
  Description
-   add your description here
- Notes
-   uses nested switch/case to implement the machine.
- Author
-   J. Edward Carryer, 01/15/12, 15:23
+   one lookup in the staging area table of the capture engine
 ****************************************************************************/
-//uint16_t GetStagingAreaCode( void )
-//{
-//	uint16_t thePeriod = StagingAreaPeriod;
-//	printf("\r\n stag per %i",thePeriod);
-//	if( (thePeriod < (StagingAreaPeriods[0] + StagingAreaPeriod_Tolerance)) && (thePeriod > (StagingAreaPeriods[15] - StagingAreaPeriod_Tolerance)) ){
-//		if ( (thePeriod > (StagingAreaPeriods[0] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[0] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code1333us;
-//			printf("\r\n code1333 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[1] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[1] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code1277us;
-//			printf("\r\n code1277 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[2] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[2] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code1222us;
-//			printf("\r\n code1222 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[3] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[3] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code1166us;
-//			printf("\r\n code1166 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[4] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[4] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code1111us;
-//			printf("\r\n code1111 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[5] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[5] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code1055us;
-//			printf("\r\n code1055 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[6] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[6] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code1000us;
-//			printf("\r\n code1000 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[7] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[7] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code944us;
-//			printf("\r\n code944 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[8] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[8] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code889us;
-//			printf("\r\n code889 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[9] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[9] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code833us;
-//			printf("\r\n code833 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[10] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[10] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code778us;
-//			printf("\r\n code778 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[11] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[11] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code722us;
-//			printf("\r\n code722 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[12] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[12] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code667us;
-//			printf("\r\n code667 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[13] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[13] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code611us;
-//			printf("\r\n code611 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[14] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[14] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code556us;
-//			printf("\r\n code566 %x",StagingAreaCode);
-//		}
-
-//		else if ( (thePeriod > (StagingAreaPeriods[15] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[15] + StagingAreaPeriod_Tolerance)) ){
-//			StagingAreaCode = code500us;
-//			printf("\r\n code500 %x",StagingAreaCode);
-//		}
-//	}
-//	else{
-//		StagingAreaCode = codeInvalidStagingArea;
-//		printf("\r\n code70 %x",StagingAreaCode);
-//	}
-//	
-//	//printf("\r\n code %x",StagingAreaCode);
-//	return StagingAreaCode;
-//}
+uint8_t GetStagingAreaCodeSingle( uint16_t thePeriod )
+{
+	return Capture_ClassifyPeriod(CAP_STAGING, (uint32_t)thePeriod*TicksPerUS);
+}
 
 /****************************************************************************
  Function
-    GetStagingAreaCodeSingle
+    GetStagingAreaCodeArray
 
  Parameters
-   ES_Event : the event to process
+   None
 
  Returns
-   ES_Event, ES_NO_EVENT if no error ES_ERROR otherwise
+   uint8_t, the staging area code once the last 10 periods all had
+   it, codeInvalidStagingArea otherwise
 
  Description
-   add your description here
- Notes
-   uses nested switch/case to implement the machine.
- Author
-   J. Edward Carryer, 01/15/12, 15:23
+   reads the run kept by StagingAreaISR, no rescan of past periods
 ****************************************************************************/
-
-uint8_t GetStagingAreaCodeSingle( uint16_t thePeriod )
-{
-		if( (thePeriod < (StagingAreaPeriods[0] + StagingAreaPeriod_Tolerance)) && (thePeriod > (StagingAreaPeriods[15] - StagingAreaPeriod_Tolerance)) ){
-			if ( (thePeriod > (StagingAreaPeriods[0] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[0] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code1333us;
-				//printf("\r\n code1333 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[1] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[1] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code1277us;
-				//printf("\r\n code1277 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[2] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[2] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code1222us;
-				//printf("\r\n code1222 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[3] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[3] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code1166us;
-				//printf("\r\n code1166 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[4] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[4] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code1111us;
-				//printf("\r\n code1111 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[5] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[5] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code1055us;
-				//printf("\r\n code1055 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[6] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[6] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code1000us;
-				//printf("\r\n code1000 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[7] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[7] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code944us;
-				//printf("\r\n code944 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[8] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[8] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code889us;
-				//printf("\r\n code889 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[9] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[9] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code833us;
-				//printf("\r\n code833 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[10] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[10] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code778us;
-				//printf("\r\n code778 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[11] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[11] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code722us;
-				//printf("\r\n code722 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[12] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[12] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code667us;
-				//printf("\r\n code667 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[13] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[13] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code611us;
-				//printf("\r\n code611 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[14] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[14] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code556us;
-				//printf("\r\n code566 %x",StagingAreaCode);
-			}
-
-			else if ( (thePeriod > (StagingAreaPeriods[15] - StagingAreaPeriod_Tolerance)) && (thePeriod < (StagingAreaPeriods[15] + StagingAreaPeriod_Tolerance)) ){
-				StagingAreaCode = code500us;
-				//printf("\r\n code500 %x",StagingAreaCode);
-			}
-		}
-		else{
-			StagingAreaCode = codeInvalidStagingArea;
-			//printf("\r\n code70 %x",StagingAreaCode);
-		}	
-
-	//printf("\r\n code %x",StagingAreaCode);
-	return StagingAreaCode;
+uint8_t GetStagingAreaCodeArray(void){
+	return Capture_GetCode(CAP_STAGING);
 }
 
 /****************************************************************************
  Function
-    GetStagingAreaCodeArray
+    GetStagingAreaConfidence
 
  Parameters
-   ES_Event : the event to process
+   None
 
  Returns
-   ES_Event, ES_NO_EVENT if no error ES_ERROR otherwise
+   uint8_t, how many periods in a row (up to 255) have had the code of
+   the latest one, 0 if the latest one did not match any staging area
+****************************************************************************/
+uint8_t GetStagingAreaConfidence(void){
+	return Capture_GetConfidence(CAP_STAGING);
+}
+
+/****************************************************************************
+ Function
+    StagingAreaLostISR
 
  Description
-   add your description here
- Notes
-   uses nested switch/case to implement the machine.
- Author
-   J. Edward Carryer, 01/15/12, 15:23
+   Wide Timer 0 B timeout, no staging area edge for StationLostMS. Forgets
+   the code and posts STATION_LOST if a station was held.
 ****************************************************************************/
+void StagingAreaLostISR( void )
+{
+	REC_IRQ(REC_IRQ_STATION_LOST);
+	
+	// clear the source of the interrupt
+	HWREG(WTIMER0_BASE+TIMER_O_ICR) = TIMER_ICR_TBTOCINT;
+	
+	Capture_Forget(CAP_STAGING);
+	if(StationCode != codeInvalidStagingArea){
+		DropStation();
+	}
+}
 
-uint8_t GetStagingAreaCodeArray(void){
-	uint8_t i = 0;
-	uint8_t returnCode = GetStagingAreaCodeSingle(PeriodBuffer[0]);
-	//printf("\r\n staging area code %u \r\n",returnCode);
+/****************************************************************************
+ Function
+    MarkStagingAreaStop
+
+ Description
+   Called by RobotTopSM as it stops on STATION_REACHED. Takes the time from
+   the edge that confirmed the station to now off the capture timer, for
+   PrintStagingAreaLatency; nothing goes to the console from here.
+****************************************************************************/
+void MarkStagingAreaStop( void )
+{
+	uint32_t Now = HWREG(WTIMER0_BASE+TIMER_O_TAV);
+	
+	LastStopLatencyUS = (Now - StationDetectTime)/TicksPerUS;
+	if(LastStopLatencyUS > MaxStopLatencyUS){
+		MaxStopLatencyUS = LastStopLatencyUS;
+	}
+	NumStops++;
+}
+
+/****************************************************************************
+ Function
+    PrintStagingAreaLatency
+
+ Description
+   Console report of the station detect to stop latency
+****************************************************************************/
+void PrintStagingAreaLatency( void )
+{
+	printf("\r\nStation detect to stop: last %lu us, max %lu us over %u stops\r\n",
+		(unsigned long)LastStopLatencyUS, (unsigned long)MaxStopLatencyUS, NumStops);
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+/***************************************************************************
+  UpdateStation
+		Hysteresis on the staging area code, run from StagingAreaISR. A code is
+		taken once the capture engine believes it; after that a match takes
+		a vote off StationMisses and anything else adds one, so a few noisy
+		periods do not drop the station. Only the newest period is classified
+		while a station is held.
+ ***************************************************************************/
+static void UpdateStation( uint32_t PeriodTicks ){
+	ES_Event ThisEvent;
+	uint8_t StableCode;
 	
-	for(i = 1; i < SampleSize; i++){
-		if(GetStagingAreaCodeSingle(PeriodBuffer[i]) != returnCode){
-			return codeInvalidStagingArea;
+	if(StationCode == codeInvalidStagingArea){
+		StableCode = Capture_GetCode(CAP_STAGING);
+		if(StableCode != codeInvalidStagingArea){
+			StationCode = StableCode;
+			StationMisses = 0;
+			StationDetectTime = Capture_GetLastEdge(CAP_STAGING);
+			
+			ThisEvent.EventType = STATION_REACHED;
+			ThisEvent.EventParam = StableCode;
+			PostRobotTopSM(ThisEvent);
+		}
+	} else if(Capture_ClassifyPeriod(CAP_STAGING, PeriodTicks) == StationCode){
+		if(StationMisses > 0){
+			StationMisses--;
 		}
+	} else if(++StationMisses >= StationLoseVotes){
+		DropStation();
 	}
+}
+
+/***************************************************************************
+  DropStation
+		Forget the station and tell RobotTopSM which one was lost
+ ***************************************************************************/
+static void DropStation( void ){
+	ES_Event ThisEvent;
 	
-	return returnCode;
+	ThisEvent.EventType = STATION_LOST;
+	ThisEvent.EventParam = StationCode;
+	StationCode = codeInvalidStagingArea;
+	StationMisses = 0;
+	PostRobotTopSM(ThisEvent);
 }
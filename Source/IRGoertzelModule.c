@@ -0,0 +1,598 @@
+//#define TEST
+/****************************************************************************
+IRGoertzelModule
+	Beacon detection from the analog output of the front IR phototransistor
+	(PE3, AIN0) instead of its edges. ADC1 samples it at 10 kHz, and every
+	sample feeds five Goertzel filters, one per beacon frequency. At the end
+	of each 200 sample (20 ms) frame each filter gives the amplitude of its
+	beacon. So two beacons in view at once both show up, each with its
+	strength, where the capture engine sees edges from neither.
+
+ Notes
+	With N = 200 at 10 kHz the bins are 50 Hz apart and every beacon sits
+	exactly on one (k = 25, 29, 34, 39, 44), so the mid scale offset and
+	the other beacons fall in the nulls of a rectangular window.
+	The filter coefficients 2cos(2*pi*k/N) are Q30. The state update is one
+	SMMUL (DSP_MulHigh) per filter and the end of frame power one SMLAL
+	chain, see DSP_Intrinsics.h. States stay below 2^19 for a full scale
+	tone, so the state goes into the SMMUL shifted up by 2 (below 2^21) and
+	the high word is the Q30 product itself, down to the count below.
+	Shifting the high word up by 2 instead would throw away the product's
+	two lowest bits every sample.
+	The samples are timed by the 10 kHz ADC sample clock in ADMulti.c, which
+	ADC0 shares: on the TM4C123 a timer's ADC trigger reaches every timer
+	triggered sequencer on both ADCs.
+	CPU budget, per 20 ms frame at 40 MHz: 200 sample ISRs at about 70
+	cycles each (entry and exit, the FIFO read, 5 filter updates) plus one
+	end of frame of about 1500 cycles (5 powers and square roots), some
+	15500 cycles or 2% of the CPU. The cycles actually spent in the last
+	frame are kept and printed by IRGoertzel_PrintFrame.
+	Nothing in the state machines reads the detector yet, so it is off
+	unless asked for: 'f' on the console turns it on, and the next 'f'
+	prints the last frame and turns it off again. Its interrupt is at the
+	lowest priority, under the capture, wire follow and speed loop ISRs.
+	The samples don't go through the input recorder, so nothing the state
+	machines replay may depend on this module yet; under REPLAY_INPUTS it
+	stays off.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+#include "ES_Configure.h"
+#if !defined(TEST)
+#include "ES_Framework.h"
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "inc/hw_gpio.h"
+#include "inc/hw_sysctl.h"
+#include "inc/hw_adc.h"
+#include "inc/hw_nvic.h"
+
+#include "ES_Port.h"
+#include "BITDEFS.H"
+#endif
+
+#include "IRGoertzelModule.h"
+#include "ADMulti.h"
+#include "DSP_Intrinsics.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define SampleRateHz ADC_SAMPLE_CLOCK_HZ
+#define TicksPerSecond 40000000
+#define FrameSize 200
+#define AdcMidScale 2048
+// tone amplitude in ADC counts for a beacon to count as seen
+#define DetectAmplitude 40
+#define AIN0Pin BIT3HI
+// ADC1 sequence 3 is interrupt 51, priority field D of NVIC_PRI12
+#define ADC1SS3IntBit BIT19HI
+#define TimerTrigger 0x5
+
+/*---------------------------- Module Functions ---------------------------*/
+static void FilterSample( int32_t Sample );
+static void FinishFrame( void );
+static uint32_t SquareRoot( uint64_t Value );
+
+/*---------------------------- Module Variables ---------------------------*/
+// 2cos(2*pi*k/N) in Q30 for 1250, 1450, 1700, 1950 and 2200 Hz
+static const int32_t Coefficients[NUM_IR_BEACONS] =
+{
+  1518500250, 1316207875, 1034558137, 727434145, 402398309
+};
+
+static int32_t S1[NUM_IR_BEACONS];
+static int32_t S2[NUM_IR_BEACONS];
+static uint8_t SampleCount;
+static uint32_t FrameCycles;
+static uint32_t LastFrameCycles;
+static volatile uint16_t Amplitudes[NUM_IR_BEACONS];
+static volatile uint16_t FrameNumber;
+static bool Enabled;
+
+/*------------------------------ Module Code ------------------------------*/
+#if !defined(TEST)
+/****************************************************************************
+ Function
+    InitIRGoertzel
+
+ Description
+    Sets ADC1 sequence 3 up to convert AIN0 on every sample clock tick with
+    its interrupt enabled, and starts the sample clock. The sequence is
+    left off, see EnableIRGoertzel.
+****************************************************************************/
+void InitIRGoertzel( void )
+{
+#if defined(REPLAY_INPUTS)
+  return;
+#endif
+  _HW_CycleCounterInit();
+
+  // enable the clock to ADC1 and Port E
+  HWREG(SYSCTL_RCGCADC) |= SYSCTL_RCGCADC_R1;
+  HWREG(SYSCTL_RCGCGPIO) |= SYSCTL_RCGCGPIO_R4;
+  while ((HWREG(SYSCTL_PRGPIO) & SYSCTL_PRGPIO_R4) != SYSCTL_PRGPIO_R4)
+    ;
+
+  // PE3 as an analog input
+  HWREG(GPIO_PORTE_BASE + GPIO_O_DIR) &= ~AIN0Pin;
+  HWREG(GPIO_PORTE_BASE + GPIO_O_AFSEL) |= AIN0Pin;
+  HWREG(GPIO_PORTE_BASE + GPIO_O_DEN) &= ~AIN0Pin;
+  HWREG(GPIO_PORTE_BASE + GPIO_O_AMSEL) |= AIN0Pin;
+
+  // sequence 3 off while configuring: AIN0, one step, interrupt at its end,
+  // started by the timer
+  while ((HWREG(SYSCTL_PRADC) & SYSCTL_PRADC_R1) != SYSCTL_PRADC_R1)
+    ;
+  HWREG(ADC1_BASE + ADC_O_PC) = ADC_PC_SR_250K;
+  HWREG(ADC1_BASE + ADC_O_ACTSS) &= ~ADC_ACTSS_ASEN3;
+  HWREG(ADC1_BASE + ADC_O_EMUX) =
+    (HWREG(ADC1_BASE + ADC_O_EMUX) & ~ADC_EMUX_EM3_M) | (TimerTrigger << ADC_EMUX_EM3_S);
+  HWREG(ADC1_BASE + ADC_O_SSMUX3) = 0;
+  HWREG(ADC1_BASE + ADC_O_SSCTL3) = (ADC_SSCTL3_END0 | ADC_SSCTL3_IE0);
+  HWREG(ADC1_BASE + ADC_O_IM) |= ADC_IM_MASK3;
+
+  // enable ADC1 sequence 3's interrupt in the NVIC, at the lowest priority
+  HWREG(NVIC_PRI12) |= NVIC_PRI12_INTD_M;
+  HWREG(NVIC_EN1) |= ADC1SS3IntBit;
+
+  ADC_SampleClockInit();
+
+  // make sure interrupts are enabled globally
+  __enable_irq();
+}
+
+/****************************************************************************
+ Function
+    EnableIRGoertzel
+
+ Description
+    Turns ADC1 sequence 3 on or off; turning it on begins a fresh frame
+****************************************************************************/
+void EnableIRGoertzel( bool Enable )
+{
+  uint8_t Beacon;
+
+  if (Enable)
+  {
+    HWREG(ADC1_BASE + ADC_O_ACTSS) &= ~ADC_ACTSS_ASEN3;
+    for (Beacon = 0; Beacon < NUM_IR_BEACONS; Beacon++)
+    {
+      S1[Beacon] = 0;
+      S2[Beacon] = 0;
+    }
+    SampleCount = 0;
+    FrameCycles = 0;
+    HWREG(ADC1_BASE + ADC_O_ISC) = ADC_ISC_IN3;
+    HWREG(ADC1_BASE + ADC_O_ACTSS) |= ADC_ACTSS_ASEN3;
+  }
+  else
+  {
+    HWREG(ADC1_BASE + ADC_O_ACTSS) &= ~ADC_ACTSS_ASEN3;
+  }
+  Enabled = Enable;
+}
+
+/****************************************************************************
+ Function
+    IRGoertzel_IsEnabled
+
+ Returns
+    bool, true while ADC1 sequence 3 is sampling for the detector
+****************************************************************************/
+bool IRGoertzel_IsEnabled( void )
+{
+  return Enabled;
+}
+
+/****************************************************************************
+ Function
+    IRGoertzelSampleISR
+
+ Description
+    ADC1 sequence 3 done: runs the sample through the five filters, and
+    closes the frame every FrameSize samples
+****************************************************************************/
+void IRGoertzelSampleISR( void )
+{
+  uint32_t Start = _HW_GetCycleCount();
+
+  // clear the source of the interrupt and take the sample
+  HWREG(ADC1_BASE + ADC_O_ISC) = ADC_ISC_IN3;
+  FilterSample((int32_t)(HWREG(ADC1_BASE + ADC_O_SSFIFO3) & ADC_SSFIFO3_DATA_M) - AdcMidScale);
+  FrameCycles += _HW_GetCycleCount() - Start;
+}
+#endif
+
+/****************************************************************************
+ Function
+    IRGoertzel_GetAmplitude
+
+ Returns
+    uint16_t, the amplitude in ADC counts of the beacon (a beacon code, as
+    from Front_GetIRCode) over the last frame
+****************************************************************************/
+uint16_t IRGoertzel_GetAmplitude( uint8_t Beacon )
+{
+  if (Beacon >= NUM_IR_BEACONS)
+  {
+    return 0;
+  }
+  return Amplitudes[Beacon];
+}
+
+/****************************************************************************
+ Function
+    IRGoertzel_GetDetected
+
+ Returns
+    uint8_t, bit i set if beacon code i was above DetectAmplitude in the
+    last frame
+****************************************************************************/
+uint8_t IRGoertzel_GetDetected( void )
+{
+  uint8_t Detected = 0;
+  uint8_t Beacon;
+
+  for (Beacon = 0; Beacon < NUM_IR_BEACONS; Beacon++)
+  {
+    if (Amplitudes[Beacon] > DetectAmplitude)
+    {
+      Detected |= (1 << Beacon);
+    }
+  }
+  return Detected;
+}
+
+/****************************************************************************
+ Function
+    IRGoertzel_GetStrongest
+
+ Returns
+    uint8_t, code of the strongest beacon in the last frame if it was above
+    DetectAmplitude, IR_GOERTZEL_NONE otherwise
+****************************************************************************/
+uint8_t IRGoertzel_GetStrongest( void )
+{
+  uint8_t Strongest = IR_GOERTZEL_NONE;
+  uint16_t Largest = DetectAmplitude;
+  uint8_t Beacon;
+
+  for (Beacon = 0; Beacon < NUM_IR_BEACONS; Beacon++)
+  {
+    if (Amplitudes[Beacon] > Largest)
+    {
+      Largest = Amplitudes[Beacon];
+      Strongest = Beacon;
+    }
+  }
+  return Strongest;
+}
+
+/****************************************************************************
+ Function
+    IRGoertzel_GetFrameNumber
+
+ Returns
+    uint16_t, count of finished frames, to tell a new frame from an old one
+****************************************************************************/
+uint16_t IRGoertzel_GetFrameNumber( void )
+{
+  return FrameNumber;
+}
+
+/****************************************************************************
+ Function
+    IRGoertzel_PrintFrame
+
+ Description
+    Console dump of the last frame's amplitudes and the cycles it took
+****************************************************************************/
+void IRGoertzel_PrintFrame( void )
+{
+  static const uint16_t BeaconHz[NUM_IR_BEACONS] = { 1250, 1450, 1700, 1950, 2200 };
+  uint8_t Beacon;
+
+  printf("\r\n Goertzel frame %u:", FrameNumber);
+  for (Beacon = 0; Beacon < NUM_IR_BEACONS; Beacon++)
+  {
+    printf(" %uHz %u", BeaconHz[Beacon], Amplitudes[Beacon]);
+  }
+  printf("\r\n %lu cycles (%lu.%02lu%% of the CPU)\r\n", (unsigned long)LastFrameCycles,
+         (unsigned long)(LastFrameCycles*SampleRateHz/FrameSize/(TicksPerSecond/100)),
+         (unsigned long)(LastFrameCycles*SampleRateHz/FrameSize/(TicksPerSecond/10000) % 100));
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+/***************************************************************************
+  FilterSample
+    One sample, less mid scale, through the five filters; closes the frame
+    every FrameSize samples
+ ***************************************************************************/
+static void FilterSample( int32_t Sample )
+{
+  int32_t S0;
+  uint8_t Beacon;
+
+  // s[n] = x[n] + 2cos(w)s[n-1] - s[n-2], with s[n-1] in Q2 the high word
+  // of the Q30 product is in counts
+  for (Beacon = 0; Beacon < NUM_IR_BEACONS; Beacon++)
+  {
+    S0 = Sample + DSP_MulHigh(Coefficients[Beacon], S1[Beacon] << 2) - S2[Beacon];
+    S2[Beacon] = S1[Beacon];
+    S1[Beacon] = S0;
+  }
+
+  if (++SampleCount == FrameSize)
+  {
+    FinishFrame();
+  }
+}
+
+/***************************************************************************
+  FinishFrame
+    Power of each bin, s1^2 + s2^2 - 2cos(w)s1s2, scaled to the tone's
+    amplitude 2*sqrt(power)/N; then restarts the filters
+ ***************************************************************************/
+static void FinishFrame( void )
+{
+  int64_t Power;
+  int32_t Product;
+  uint8_t Beacon;
+
+  for (Beacon = 0; Beacon < NUM_IR_BEACONS; Beacon++)
+  {
+    Product = DSP_MulHigh(Coefficients[Beacon], S1[Beacon] << 2);
+    Power = DSP_MulAcc64(0, S1[Beacon], S1[Beacon]);
+    Power = DSP_MulAcc64(Power, S2[Beacon], S2[Beacon]);
+    Power = DSP_MulAcc64(Power, -Product, S2[Beacon]);
+    if (Power < 0)
+    {
+      Power = 0; // rounding on a silent bin
+    }
+    Amplitudes[Beacon] = (uint16_t)(2*SquareRoot((uint64_t)Power)/FrameSize);
+    S1[Beacon] = 0;
+    S2[Beacon] = 0;
+  }
+  SampleCount = 0;
+  FrameNumber++;
+  LastFrameCycles = FrameCycles;
+  FrameCycles = 0;
+}
+
+/***************************************************************************
+  SquareRoot
+    Integer square root, one result bit per pass
+ ***************************************************************************/
+static uint32_t SquareRoot( uint64_t Value )
+{
+  uint64_t Root = 0;
+  uint64_t Bit = (uint64_t)1 << 62;
+
+  while (Bit > Value)
+  {
+    Bit >>= 2;
+  }
+  while (Bit != 0)
+  {
+    if (Value >= Root + Bit)
+    {
+      Value -= Root + Bit;
+      Root = (Root >> 1) + Bit;
+    }
+    else
+    {
+      Root >>= 1;
+    }
+    Bit >>= 2;
+  }
+  return (uint32_t)Root;
+}
+
+#ifdef TEST
+/* Test harness for the filters.
+
+   Host (from the repo root):
+      gcc -std=gnu99 -O2 -DTEST -IHeaders -o goertzel Source/IRGoertzelModule.c -lm
+      ./goertzel
+   Synthesizes frames of N = FrameSize 12 bit samples at SampleRateHz: each
+   beacon alone at a few amplitudes and phases, two beacons at once, a tone
+   between two beacons and silence, all with a couple of counts of noise,
+   and runs them through FilterSample as the sample ISR would. Every bin's
+   amplitude is checked against a double precision Goertzel of the same
+   samples (to within MaxCountError), an on-bin beacon against the
+   amplitude it was made with, and the other bins against leakage. The
+   first failure is printed and the program exits 1. The error of the old
+   update, the high word shifted up instead of the state, is printed for
+   comparison, as is the time per sample.
+*/
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#define PI 3.14159265358979
+// ADC counts a bin may be off from double precision
+#define MaxCountError 1
+// off from the amplitude made, in percent, plus a count
+#define AmplitudeTolerance 2
+// the most an on-bin tone may show in another beacon's bin
+#define MaxLeakage 3
+#define NoiseCounts 2
+#define NumBenchFrames 5000
+
+static const double BeaconHz[NUM_IR_BEACONS] = { 1250, 1450, 1700, 1950, 2200 };
+static uint32_t RandomState = 0x2218B;
+static int16_t Frame[FrameSize];
+static double LegacyMaxError;
+
+static uint32_t NextRandom( void )
+{  // LCG, the same signal every run
+  RandomState = RandomState*1664525u + 1013904223u;
+  return RandomState >> 8;
+}
+
+// a frame of up to two tones (amplitude 0 for none) around mid scale
+static void MakeFrame( double Hz1, double Amplitude1, double Hz2, double Amplitude2,
+                       double Phase )
+{
+  double Value;
+  int32_t Reading;
+  uint16_t n;
+
+  for (n = 0; n < FrameSize; n++)
+  {
+    Value = AdcMidScale + Amplitude1*sin(2*PI*Hz1*n/SampleRateHz + Phase)
+            + Amplitude2*sin(2*PI*Hz2*n/SampleRateHz + 2*Phase);
+    Reading = (int32_t)floor(Value + 0.5) + (int32_t)(NextRandom() % (2*NoiseCounts + 1)) - NoiseCounts;
+    Frame[n] = (Reading < 0) ? 0 : ((Reading > 4095) ? 4095 : Reading);
+  }
+}
+
+// the same filter in double precision, with the coefficient it really uses
+static double FloatAmplitude( uint8_t Beacon )
+{
+  double Coefficient = Coefficients[Beacon]/1073741824.0;
+  double s0, s1 = 0, s2 = 0;
+  uint16_t n;
+
+  for (n = 0; n < FrameSize; n++)
+  {
+    s0 = (Frame[n] - AdcMidScale) + Coefficient*s1 - s2;
+    s2 = s1;
+    s1 = s0;
+  }
+  return 2*sqrt(fmax(s1*s1 + s2*s2 - Coefficient*s1*s2, 0))/FrameSize;
+}
+
+// the update before: the Q30 product's high word shifted up by 2
+static double LegacyAmplitude( uint8_t Beacon )
+{
+  int32_t s0, s1 = 0, s2 = 0;
+  int64_t Power;
+  uint16_t n;
+
+  for (n = 0; n < FrameSize; n++)
+  {
+    s0 = (Frame[n] - AdcMidScale) + (DSP_MulHigh(Coefficients[Beacon], s1) << 2) - s2;
+    s2 = s1;
+    s1 = s0;
+  }
+  Power = (int64_t)s1*s1 + (int64_t)s2*s2 - (int64_t)(DSP_MulHigh(Coefficients[Beacon], s1) << 2)*s2;
+  return 2*sqrt((double)((Power < 0) ? 0 : Power))/FrameSize;
+}
+
+// runs Frame through the module and checks every bin; Expected is the
+// amplitude made on bin OnBin, or for no single on-bin tone OnBin is
+// IR_GOERTZEL_NONE
+static void CheckFrame( const char *pName, uint8_t OnBin, double Expected )
+{
+  double Reference, Legacy;
+  uint16_t Amplitude;
+  uint16_t n;
+  uint8_t Beacon;
+
+  for (n = 0; n < FrameSize; n++)
+  {
+    FilterSample(Frame[n] - AdcMidScale);
+  }
+  for (Beacon = 0; Beacon < NUM_IR_BEACONS; Beacon++)
+  {
+    Amplitude = IRGoertzel_GetAmplitude(Beacon);
+    Reference = FloatAmplitude(Beacon);
+    Legacy = fabs(LegacyAmplitude(Beacon) - Reference);
+    if (Legacy > LegacyMaxError)
+    {
+      LegacyMaxError = Legacy;
+    }
+    if (fabs(Amplitude - Reference) > MaxCountError + 0.5)
+    {
+      printf("FAIL %s, %.0fHz: %u, double precision %.2f\n", pName, BeaconHz[Beacon],
+             Amplitude, Reference);
+      exit(1);
+    }
+    if ((Beacon == OnBin) &&
+        (fabs(Amplitude - Expected) > Expected*AmplitudeTolerance/100 + 1))
+    {
+      printf("FAIL %s, %.0fHz: %u, made with %.0f\n", pName, BeaconHz[Beacon],
+             Amplitude, Expected);
+      exit(1);
+    }
+    if ((OnBin != IR_GOERTZEL_NONE) && (Beacon != OnBin) && (Amplitude > MaxLeakage))
+    {
+      printf("FAIL %s, %.0fHz: %u leaked from %.0fHz\n", pName, BeaconHz[Beacon],
+             Amplitude, BeaconHz[OnBin]);
+      exit(1);
+    }
+  }
+}
+
+int main(void)
+{
+  static const double Amplitudes[] = { 30, 200, 1000, 2040 };
+  static const double Phases[] = { 0, 0.7, 2.1 };
+  char Name[64];
+  clock_t Start;
+  uint32_t Frames = 0;
+  uint32_t n;
+  uint8_t Beacon, a, p;
+
+  for (Beacon = 0; Beacon < NUM_IR_BEACONS; Beacon++)
+  {
+    for (a = 0; a < sizeof(Amplitudes)/sizeof(Amplitudes[0]); a++)
+    {
+      for (p = 0; p < sizeof(Phases)/sizeof(Phases[0]); p++)
+      {
+        sprintf(Name, "%.0fHz at %.0f, phase %.1f", BeaconHz[Beacon], Amplitudes[a], Phases[p]);
+        MakeFrame(BeaconHz[Beacon], Amplitudes[a], 0, 0, Phases[p]);
+        CheckFrame(Name, Beacon, Amplitudes[a]);
+        if ((IRGoertzel_GetStrongest() != ((Amplitudes[a] > DetectAmplitude) ? Beacon : IR_GOERTZEL_NONE)))
+        {
+          printf("FAIL %s: strongest is %u\n", Name, IRGoertzel_GetStrongest());
+          exit(1);
+        }
+        Frames++;
+      }
+    }
+  }
+
+  // two beacons in view, 1250Hz the stronger
+  MakeFrame(BeaconHz[0], 600, BeaconHz[3], 250, 0.3);
+  CheckFrame("1250Hz and 1950Hz", IR_GOERTZEL_NONE, 0);
+  if ((IRGoertzel_GetDetected() != ((1 << 0) | (1 << 3))) || (IRGoertzel_GetStrongest() != 0))
+  {
+    printf("FAIL 1250Hz and 1950Hz: detected %02x, strongest %u\n",
+           IRGoertzel_GetDetected(), IRGoertzel_GetStrongest());
+    exit(1);
+  }
+
+  // halfway between two beacons, and nothing at all
+  MakeFrame(1575, 800, 0, 0, 1.0);
+  CheckFrame("1575Hz", IR_GOERTZEL_NONE, 0);
+  MakeFrame(0, 0, 0, 0, 0);
+  CheckFrame("silence", IR_GOERTZEL_NONE, 0);
+  if (IRGoertzel_GetDetected() != 0)
+  {
+    printf("FAIL silence: detected %02x\n", IRGoertzel_GetDetected());
+    exit(1);
+  }
+  Frames += 3;
+
+  printf("%lu frames within %u count of double precision (the high word shifted "
+         "up was off by up to %.1f)\n", (unsigned long)Frames, MaxCountError, LegacyMaxError);
+
+  MakeFrame(BeaconHz[2], 1000, BeaconHz[4], 300, 0.5);
+  Start = clock();
+  for (Frames = 0; Frames < NumBenchFrames; Frames++)
+  {
+    for (n = 0; n < FrameSize; n++)
+    {
+      FilterSample(Frame[n] - AdcMidScale);
+    }
+  }
+  printf("%.1f ns per sample, all five filters\n",
+         (double)(clock() - Start)*1e9/CLOCKS_PER_SEC/((double)NumBenchFrames*FrameSize));
+  printf("PASS\n");
+  return 0;
+}
+#endif /* TEST */
@@ -0,0 +1,612 @@
+/****************************************************************************
+InputRecorder
+	Logs every nondeterministic input to the framework so that a run seen on
+	the field can be reproduced on a host build with virtual time.
+
+	Recorded (RECORD_INPUTS):
+		input capture edges   StagingAreaISR, InputCaptureForFront/BackIRDetection
+		ADC samples           ADC_MultiRead
+		SSI0 receive bytes    SPIService EOT handling
+		interrupt arrivals    SSI EOT, game timer, get away timer, station lost,
+		                      FLYWHEEL_AT_SPEED, SERVO_MOVE_DONE,
+		                      IR_PULSES_DONE
+		wheel encoder counts  OdometryISR
+		keystrokes            GetNewKey
+		framework ticks       _HW_Process_Pending_Ints
+	Replayed (REPLAY_INPUTS): the same hooks take their values from the log
+	and _HW_Process_Pending_Ints steps the log one tick at a time, calling the
+	recorded ISRs in order (ReplayIRQ in Host/ReplayMain.c for the IRQ
+	records). Replay is exact at the granularity of one pass of
+	ES_Run: an ISR that landed in the middle of a run function on the target
+	is delivered before the next pass on the host.
+
+ Log format
+	4 byte header 'R' 'L' version channels, then records that start with one
+	byte: bits 7-5 record type, bits 4-0 type specific
+		TICK     bits 4-0 = ticks-1 (consecutive ticks share a record)
+		CAPTURE  bits 4-3 = encoding, bits 2-0 = channel, then
+		         DD8: int8 change of period from the last period
+		         D16: uint16 period in timer ticks
+		         ABS: uint32 raw capture value
+		ADC      bits 2-0 = samples, then uint16 per sample
+		SSI      one byte received
+		KEY      one byte
+		IRQ      bits 4-0 = source
+		QEI      bits 4-0 = encoding, then per wheel (index 0 first)
+		         SAME: nothing, neither count changed since the last record
+		         D8:   int8 change of count
+		         ABS:  int32 count
+	All multi-byte values are little endian. A steady capture stream costs two
+	bytes per edge. The encoders cost a record per OdometryISR tick (100 Hz),
+	one byte standing and three driving, and each one splits the tick run, so
+	a standing robot logs about 200 bytes a second where it used to log a
+	few.
+	The speeds are not logged: OdometryISR works them out from the counts,
+	so replaying the counts replays the speeds, the wheel speed loop and the
+	align sweep that run on them.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "ES_Port.h"
+
+#include "InputRecorder.h"
+
+#if defined(REPLAY_INPUTS)
+#include "HallEffectModule.h"
+#include "IRBeaconModule.h"
+#include "OdometryModule.h"
+#endif
+
+#if defined(RECORD_INPUTS) || defined(REPLAY_INPUTS)
+
+/*----------------------------- Module Defines ----------------------------*/
+#define RecLogSize 16384
+#define RecVersion 2
+
+#define REC_T_TICK    0
+#define REC_T_CAPTURE 1
+#define REC_T_ADC     2
+#define REC_T_SSI     3
+#define REC_T_KEY     4
+#define REC_T_IRQ     5
+#define REC_T_QEI     6
+
+#define REC_FMT_DD8   0
+#define REC_FMT_D16   1
+#define REC_FMT_ABS   2
+
+#define REC_QEI_SAME  0
+#define REC_QEI_D8    1
+#define REC_QEI_ABS   2
+
+#define RecType(h)    ((h) >> 5)
+#define RecAux(h)     ((h) & 0x1f)
+#define RecHeader(t, a) ((uint8_t)(((t) << 5) | ((a) & 0x1f)))
+#define MaxTicksPerRecord 32
+#define HeaderSize 4
+
+// passes through ES_Run that a synchronous record may wait to be read
+// before the replay is declared to have diverged
+#define StallPasses 100000
+
+/*---------------------------- Module Functions ---------------------------*/
+#if defined(RECORD_INPUTS)
+static bool Append( const uint8_t *pBytes, uint8_t Count );
+#endif
+#if defined(REPLAY_INPUTS)
+static bool ExpectRecord( uint8_t Type );
+static uint32_t ReadLE( uint8_t Count );
+static void DeliverCapture( uint8_t Header );
+static void DeliverQEI( uint8_t Header );
+static void Diverge( const char *pWhat );
+#endif
+
+/*---------------------------- Module Variables ---------------------------*/
+static uint32_t LastCapture[REC_NUM_CHANNELS];
+static uint32_t LastPeriod[REC_NUM_CHANNELS];
+static bool HaveCapture[REC_NUM_CHANNELS];
+static int32_t LastQEI[2];
+
+#if defined(RECORD_INPUTS)
+static uint8_t Log[RecLogSize] = { 'R', 'L', RecVersion, REC_NUM_CHANNELS };
+static uint32_t LogLength = HeaderSize;
+static uint32_t LastTickRecord;        // index of a TICK record that can still grow
+static bool LogFull;
+static uint32_t DroppedRecords;
+#endif
+
+#if defined(REPLAY_INPUTS)
+static const uint8_t *pReplayLog;
+static uint32_t ReplayLength;
+static uint32_t ReplayPos;
+static uint8_t PendingTicks;
+static uint32_t ReplayTicks;
+static uint32_t StalledPasses;
+static uint32_t CaptureValue[REC_NUM_CHANNELS];
+static int32_t QEIValue[2];
+static bool Diverged;
+
+typedef void ReplayISR_t( void );
+static ReplayISR_t * const CaptureISRs[REC_NUM_CHANNELS] =
+  { StagingAreaISR, InputCaptureForFrontIRDetection, InputCaptureForBackIRDetection };
+
+// supplied by the replay harness: runs what an IRQ record stands for, and is
+// called once the log is used up
+void ReplayIRQ( uint8_t Source );
+void ReplayFinished( bool DidDiverge );
+#endif
+
+/*------------------------------ Module Code ------------------------------*/
+#if defined(RECORD_INPUTS)
+/****************************************************************************
+ Function
+    InputRec_RecordCapture
+
+ Description
+    Logs a raw capture value from one of the input capture ISRs and hands it
+    back so it can wrap the register read
+****************************************************************************/
+uint32_t InputRec_RecordCapture( uint8_t Channel, uint32_t Value )
+{
+  uint8_t Record[5];
+  uint32_t Period = Value - LastCapture[Channel];
+  int32_t Change = (int32_t)(Period - LastPeriod[Channel]);
+
+  if (HaveCapture[Channel] && (Change >= -128) && (Change <= 127))
+  {
+    Record[0] = RecHeader(REC_T_CAPTURE, (REC_FMT_DD8 << 3) | Channel);
+    Record[1] = (uint8_t)Change;
+    Append(Record, 2);
+  }
+  else if (HaveCapture[Channel] && (Period <= 0xffff))
+  {
+    Record[0] = RecHeader(REC_T_CAPTURE, (REC_FMT_D16 << 3) | Channel);
+    Record[1] = (uint8_t)Period;
+    Record[2] = (uint8_t)(Period >> 8);
+    Append(Record, 3);
+  }
+  else
+  {
+    Record[0] = RecHeader(REC_T_CAPTURE, (REC_FMT_ABS << 3) | Channel);
+    Record[1] = (uint8_t)Value;
+    Record[2] = (uint8_t)(Value >> 8);
+    Record[3] = (uint8_t)(Value >> 16);
+    Record[4] = (uint8_t)(Value >> 24);
+    Append(Record, 5);
+    if (!HaveCapture[Channel])
+    {
+      Period = 0;
+    }
+  }
+  LastPeriod[Channel] = Period;
+  LastCapture[Channel] = Value;
+  HaveCapture[Channel] = true;
+  return Value;
+}
+
+uint8_t InputRec_RecordSSIByte( uint8_t Value )
+{
+  uint8_t Record[2];
+
+  Record[0] = RecHeader(REC_T_SSI, 0);
+  Record[1] = Value;
+  Append(Record, 2);
+  return Value;
+}
+
+void InputRec_RecordIRQ( uint8_t Source )
+{
+  uint8_t Record = RecHeader(REC_T_IRQ, Source);
+  Append(&Record, 1);
+}
+
+/****************************************************************************
+ Function
+    InputRec_RecordQEI
+
+ Description
+    Logs both encoder counts from one OdometryISR tick; they start at 0, so
+    the first record is a change like the rest unless a wheel was spun before
+    the first tick
+****************************************************************************/
+void InputRec_RecordQEI( const int32_t Counts[2] )
+{
+  uint8_t Record[1 + 2*4];
+  int32_t Change[2];
+  uint8_t i;
+
+  Change[0] = Counts[0] - LastQEI[0];
+  Change[1] = Counts[1] - LastQEI[1];
+  if ((Change[0] == 0) && (Change[1] == 0))
+  {
+    Record[0] = RecHeader(REC_T_QEI, REC_QEI_SAME);
+    Append(Record, 1);
+  }
+  else if ((Change[0] >= -128) && (Change[0] <= 127) &&
+           (Change[1] >= -128) && (Change[1] <= 127))
+  {
+    Record[0] = RecHeader(REC_T_QEI, REC_QEI_D8);
+    Record[1] = (uint8_t)Change[0];
+    Record[2] = (uint8_t)Change[1];
+    Append(Record, 3);
+  }
+  else
+  {
+    Record[0] = RecHeader(REC_T_QEI, REC_QEI_ABS);
+    for (i = 0; i < 2; i++)
+    {
+      Record[1 + 4*i] = (uint8_t)Counts[i];
+      Record[2 + 4*i] = (uint8_t)(Counts[i] >> 8);
+      Record[3 + 4*i] = (uint8_t)(Counts[i] >> 16);
+      Record[4 + 4*i] = (uint8_t)(Counts[i] >> 24);
+    }
+    Append(Record, 1 + 2*4);
+  }
+  LastQEI[0] = Counts[0];
+  LastQEI[1] = Counts[1];
+}
+
+void InputRec_RecordADC( const uint32_t Data[], uint8_t HowMany )
+{
+  uint8_t Record[1 + 2*4];
+  uint8_t i;
+
+  Record[0] = RecHeader(REC_T_ADC, HowMany);
+  for (i = 0; i < HowMany; i++)
+  {
+    Record[1 + 2*i] = (uint8_t)Data[i];
+    Record[2 + 2*i] = (uint8_t)(Data[i] >> 8);
+  }
+  Append(Record, 1 + 2*HowMany);
+}
+
+int InputRec_RecordKey( int Key )
+{
+  uint8_t Record[2];
+
+  Record[0] = RecHeader(REC_T_KEY, 0);
+  Record[1] = (uint8_t)Key;
+  Append(Record, 2);
+  return Key;
+}
+
+/****************************************************************************
+ Function
+    InputRec_RecordTick
+
+ Description
+    Called for every framework tick; runs of ticks with no other input in
+    between share one record
+****************************************************************************/
+void InputRec_RecordTick( void )
+{
+  EnterCritical();
+  if ((LastTickRecord != 0) && (RecAux(Log[LastTickRecord]) < (MaxTicksPerRecord - 1)))
+  {
+    Log[LastTickRecord]++;
+  }
+  else if (!LogFull && (LogLength < RecLogSize))
+  {
+    LastTickRecord = LogLength;
+    Log[LogLength++] = RecHeader(REC_T_TICK, 0);
+  }
+  else
+  {
+    LogFull = true;
+    DroppedRecords++;
+  }
+  ExitCritical();
+}
+
+/****************************************************************************
+ Function
+    InputRec_Dump
+
+ Description
+    Prints the log as hex between REC BEGIN / REC END lines so it can be
+    captured from the terminal and fed to Host/ReplayMain.c
+****************************************************************************/
+void InputRec_Dump( void )
+{
+  uint32_t i;
+
+  printf("\r\nREC BEGIN %lu\r\n", (unsigned long)LogLength);
+  for (i = 0; i < LogLength; i++)
+  {
+    printf("%02x", Log[i]);
+    if ((i % 32) == 31)
+    {
+      printf("\r\n");
+    }
+  }
+  printf("\r\nREC END\r\n");
+  if (LogFull)
+  {
+    printf("log filled at tick %u, %lu records dropped\r\n", ES_Timer_GetTime(),
+           (unsigned long)DroppedRecords);
+  }
+}
+#endif /* RECORD_INPUTS */
+
+#if defined(REPLAY_INPUTS)
+/****************************************************************************
+ Function
+    InputRec_LoadLog
+
+ Description
+    Points the replay at a log captured with InputRec_Dump
+****************************************************************************/
+bool InputRec_LoadLog( const uint8_t *pLog, uint32_t Length )
+{
+  if ((Length < HeaderSize) || (pLog[0] != 'R') || (pLog[1] != 'L') ||
+      (pLog[2] != RecVersion) || (pLog[3] != REC_NUM_CHANNELS))
+  {
+    return false;
+  }
+  pReplayLog = pLog;
+  ReplayLength = Length;
+  ReplayPos = HeaderSize;
+  return true;
+}
+
+/****************************************************************************
+ Function
+    InputRec_ReplayTick
+
+ Description
+    Called from _HW_Process_Pending_Ints in place of the SysTick interrupt.
+    Runs the recorded ISRs up to the next tick and returns true if a tick is
+    due. Stops at synchronous records (ADC, SSI, key) until the code that
+    reads them has done so.
+****************************************************************************/
+bool InputRec_ReplayTick( void )
+{
+  uint8_t Header;
+
+  while (!Diverged)
+  {
+    if (PendingTicks != 0)
+    {
+      PendingTicks--;
+      ReplayTicks++;
+      StalledPasses = 0;
+      return true;
+    }
+    if (ReplayPos >= ReplayLength)
+    {
+      ReplayFinished(false);
+      return false;
+    }
+    Header = pReplayLog[ReplayPos];
+    switch (RecType(Header))
+    {
+      case REC_T_TICK:
+        ReplayPos++;
+        PendingTicks = RecAux(Header) + 1;
+        break;
+
+      case REC_T_CAPTURE:
+        ReplayPos++;
+        DeliverCapture(Header);
+        break;
+
+      case REC_T_IRQ:
+        ReplayPos++;
+        if (RecAux(Header) < REC_NUM_IRQS)
+        {
+          ReplayIRQ(RecAux(Header));
+        }
+        break;
+
+      case REC_T_QEI:
+        ReplayPos++;
+        DeliverQEI(Header);
+        break;
+
+      default:
+        // synchronous record: wait for the code to read it
+        if (++StalledPasses > StallPasses)
+        {
+          Diverge("recorded input was never read");
+        }
+        return false;
+    }
+  }
+  return false;
+}
+
+uint32_t InputRec_ReplayCapture( uint8_t Channel )
+{
+  return CaptureValue[Channel];
+}
+
+void InputRec_ReplayQEI( int32_t Counts[2] )
+{
+  Counts[0] = QEIValue[0];
+  Counts[1] = QEIValue[1];
+}
+
+uint8_t InputRec_ReplaySSIByte( void )
+{
+  if (!ExpectRecord(REC_T_SSI))
+  {
+    return 0;
+  }
+  return (uint8_t)ReadLE(1);
+}
+
+void InputRec_ReplayADC( uint32_t Data[], uint8_t HowMany )
+{
+  uint8_t i;
+
+  if (!ExpectRecord(REC_T_ADC) || (RecAux(pReplayLog[ReplayPos - 1]) != HowMany))
+  {
+    Diverge("ADC read");
+    for (i = 0; i < HowMany; i++)
+    {
+      Data[i] = 0;
+    }
+    return;
+  }
+  for (i = 0; i < HowMany; i++)
+  {
+    Data[i] = ReadLE(2);
+  }
+}
+
+bool InputRec_ReplayKeyReady( void )
+{
+  return ((PendingTicks == 0) && (ReplayPos < ReplayLength) &&
+          (RecType(pReplayLog[ReplayPos]) == REC_T_KEY));
+}
+
+int InputRec_ReplayKey( void )
+{
+  if (!ExpectRecord(REC_T_KEY))
+  {
+    return 0;
+  }
+  return (int)ReadLE(1);
+}
+
+uint32_t InputRec_ReplayedTicks( void )
+{
+  return ReplayTicks;
+}
+#endif /* REPLAY_INPUTS */
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+#if defined(RECORD_INPUTS)
+static bool Append( const uint8_t *pBytes, uint8_t Count )
+{
+  uint8_t i;
+  bool Added = false;
+
+  EnterCritical();
+  if (!LogFull && ((LogLength + Count) <= RecLogSize))
+  {
+    for (i = 0; i < Count; i++)
+    {
+      Log[LogLength++] = pBytes[i];
+    }
+    LastTickRecord = 0;
+    Added = true;
+  }
+  else
+  {
+    // stop at the first record that does not fit so the log stays replayable
+    LogFull = true;
+    DroppedRecords++;
+  }
+  ExitCritical();
+  return Added;
+}
+#endif
+
+#if defined(REPLAY_INPUTS)
+static bool ExpectRecord( uint8_t Type )
+{
+  if (Diverged || (PendingTicks != 0) || (ReplayPos >= ReplayLength) ||
+      (RecType(pReplayLog[ReplayPos]) != Type))
+  {
+    Diverge("unexpected read");
+    return false;
+  }
+  ReplayPos++;
+  StalledPasses = 0;
+  return true;
+}
+
+static uint32_t ReadLE( uint8_t Count )
+{
+  uint32_t Value = 0;
+  uint8_t i;
+
+  for (i = 0; i < Count; i++)
+  {
+    Value |= (uint32_t)pReplayLog[ReplayPos++] << (8*i);
+  }
+  return Value;
+}
+
+static void DeliverCapture( uint8_t Header )
+{
+  uint8_t Channel = RecAux(Header) & 0x07;
+  uint8_t Format = RecAux(Header) >> 3;
+  uint32_t Period;
+
+  if (Channel >= REC_NUM_CHANNELS)
+  {
+    Diverge("bad capture channel");
+    return;
+  }
+  if (Format == REC_FMT_DD8)
+  {
+    Period = LastPeriod[Channel] + (int8_t)ReadLE(1);
+  }
+  else if (Format == REC_FMT_D16)
+  {
+    Period = ReadLE(2);
+  }
+  else
+  {
+    CaptureValue[Channel] = ReadLE(4);
+    Period = HaveCapture[Channel] ? (CaptureValue[Channel] - LastCapture[Channel]) : 0;
+    LastCapture[Channel] = CaptureValue[Channel] - Period;
+  }
+  CaptureValue[Channel] = LastCapture[Channel] + Period;
+  LastPeriod[Channel] = Period;
+  LastCapture[Channel] = CaptureValue[Channel];
+  HaveCapture[Channel] = true;
+
+  CaptureISRs[Channel]();
+}
+
+static void DeliverQEI( uint8_t Header )
+{
+  uint8_t i;
+
+  for (i = 0; i < 2; i++)
+  {
+    if (RecAux(Header) == REC_QEI_D8)
+    {
+      QEIValue[i] = LastQEI[i] + (int8_t)ReadLE(1);
+    }
+    else if (RecAux(Header) == REC_QEI_ABS)
+    {
+      QEIValue[i] = (int32_t)ReadLE(4);
+    }
+    else if (RecAux(Header) == REC_QEI_SAME)
+    {
+      QEIValue[i] = LastQEI[i];
+    }
+    else
+    {
+      Diverge("bad encoder record");
+      return;
+    }
+  }
+  LastQEI[0] = QEIValue[0];
+  LastQEI[1] = QEIValue[1];
+
+  OdometryISR();
+}
+
+static void Diverge( const char *pWhat )
+{
+  if (!Diverged)
+  {
+    Diverged = true;
+    printf("\r\nreplay diverged at log offset %lu, tick %lu: %s\r\n",
+           (unsigned long)ReplayPos, (unsigned long)ReplayTicks, pWhat);
+    ReplayFinished(true);
+  }
+}
+#endif
+
+#endif /* RECORD_INPUTS || REPLAY_INPUTS */
@@ -49,10 +49,18 @@
 #define LEDS_OFF 0x00
 
 
-/*----------------------------- Module Functions ----------------------------*/
-static void InitializeLEDHardware(void);
-
 /*----------------------------- Public Functions ----------------------------*/
+/****************************************************************************************
+	InitLEDs
+		Initialize hardware needed for LEDs to be turned on, once at start up;
+		the TurnOnOff functions after it only queue a shift register write
+*******************************************************************************************/
+void InitLEDs(void)
+{
+	// Init shift register
+	SR_Init();
+}
+
 /****************************************************************************************
 	TurnOnOffYellowLEDs
 		Turn on or off construction LEDs, while maintaining TeamColor LEDs
@@ -60,9 +68,6 @@ static void InitializeLEDHardware(void);
 
 void TurnOnOffYellowLEDs(bool ONorOFF, bool TeamColor) 
 {
-	// Initialize hardware
-  InitializeLEDHardware();
-	
 	// If ONorOFF is true
 	if(ONorOFF == ON)
 	{
@@ -93,9 +98,6 @@ void TurnOnOffYellowLEDs(bool ONorOFF, bool TeamColor)
 *******************************************************************************************/
 void TurnOnOffBlueLEDs(bool ONorOFF, bool TeamColor)
 {
-	// Initialize hardware
-	InitializeLEDHardware();
-	
 	// If ONorOFF is true
 	if(ONorOFF == ON)
 	{
@@ -127,9 +129,6 @@ void TurnOnOffBlueLEDs(bool ONorOFF, bool TeamColor)
 *******************************************************************************************/
 void TurnOnOFFTeamColorLEDs(bool ONorOFF, bool TeamColor)
 {
-	// Initialize hardware
-	InitializeLEDHardware();
-
 	// If ONorOFF is true
 	if(ONorOFF == ON)
 	{
@@ -147,13 +146,3 @@ void TurnOnOFFTeamColorLEDs(bool ONorOFF, bool TeamColor)
 		// Turn off red and gree LEDS
 		SR_Write(LEDS_OFF);
 }
-/****************************************************************************************
-	InitializeLEDHardware
-		Initialize hardware needed for LEDs to be turned on
-*******************************************************************************************/
-/*----------------------------- Module Functions ----------------------------*/
-static void InitializeLEDHardware(void)
-{
-	// Init shift register
-	SR_Init();
-}
@@ -4,6 +4,35 @@
 
  Description
 	Stablish what the pins connected to the motor should do
+
+ Notes
+	All the wheel commands go through here. A wheel command is a signed duty
+	cycle (positive forward), and a pair that is already on the wheels is
+	not written again; MotorActions_PrintStats ('m' on the console) shows
+	how many writes that saved.
+	stop() and driveSeperate() take effect at once (the wire follow loop
+	slews its own commands), and so does driveDecay(), which picks what the
+	H-bridges do between pulses: coast (fast decay, what the others use) or
+	brake (slow decay). brakeStop() shorts both motors for a while and then
+	lets them coast, which stops the robot in a fraction of the coasting
+	distance. start2rotate() and the driveStraight,
+	driveArc and rotateInPlace primitives ramp the wheels from a
+	MOTOR_PROFILE_RATE_HZ Timer1A tick instead: up at the profile's
+	acceleration, for TimeMS at speed, and down at its deceleration, a
+	trapezoid. MOTION_COMPLETE goes to RobotTopSM when the wheels stop at
+	the end of it, or when they reach speed if TimeMS is 0 (keep going),
+	and when a timed brakeStop() lets go.
+	driveSpeed() holds the wheels at speeds in mm/s instead of duty cycles:
+	every odometry tick (MotorActions_SpeedTick) runs a PI per wheel on the
+	speeds the encoders just measured, so the speed stays put as the
+	battery runs down or the floor changes. Any other command lets go of it.
+	stop() and brakeStop() from a moving robot have OdometryModule time the
+	stop ('o' on the console).
+	Any immediate command cancels a ramp in progress. Only one of the
+	state machines, the ramp tick, the speed loop or the wire follow loop
+	drives at a time, but a thread level command can still land in the
+	middle of one of the ISRs' ticks, so ApplyDuties checks, records and
+	writes a pair with interrupts off.
 ****************************************************************************/
 /*----------------------------- Include Files -----------------------------*/
 /* include header files for this state machine as well as any machines at the
@@ -13,6 +42,9 @@
 #include "ES_Framework.h"
 #include "MotorActionsModule.h"
 #include "PWMModule.h"
+#include "RobotTopSM.h"
+#include "OdometryModule.h"
+#include "WheelSpeedModule.h"
 
 #include <stdio.h>
 #include <termio.h>
@@ -27,6 +59,8 @@
 #include "inc/hw_gpio.h"
 #include "inc/hw_sysctl.h"
 #include "inc/hw_pwm.h"
+#include "inc/hw_timer.h"
+#include "inc/hw_nvic.h"
 
 // the headers to access the TivaWare Library
 #include "driverlib/sysctl.h"
@@ -47,63 +81,183 @@
 #define LEFT 1
 #define RIGHT 0
 
+#define TicksPerSecond 40000000
+#define TicksPerProfileTick (TicksPerSecond/MOTOR_PROFILE_RATE_HZ)
+// Timer 1A is interrupt 21
+#define Timer1AIntBit BIT21HI
+
+// ramped commands are kept in 1/256ths of a percent duty
+#define RampShift 8
+#define DutyToRamp(Duty) ((int32_t)(Duty) << RampShift)
+// default profile, 0 to BeaconRotationDutyCycle (80%) in 200mS
+#define DefaultAccel 400
+#define DefaultDecel 800
+
+typedef enum { MotionIdle, MotionRamping, MotionCruising, MotionStopping, MotionBraking } MotionPhase_t;
+
 /*---------------------------- Module Functions ---------------------------*/
 /* prototypes for private functions for this service.They should be functions
    relevant to the behavior of this service*/
+static void ApplyDuties(int16_t LeftDuty, int16_t RightDuty, DriveMode_t Mode);
+static void StartMotion(int16_t LeftDuty, int16_t RightDuty, uint16_t TimeMS);
+static void StartTick(void);
+static void FinishMotion(void);
+static void CancelMotion(void);
+static uint32_t MSToTicks(uint16_t TimeMS);
+static int32_t RampTo(int32_t Current, int32_t Target);
+static int16_t RampToDuty(int32_t Ramp);
+static int16_t Signed(uint8_t DutyCycle, bool direction);
+static void MarkStop(bool Braking);
 
 /*---------------------------- Module Variables ---------------------------*/
 // with the introduction of Gen2, we need a module level Priority variable
-static bool wheelSide;
-static bool direction;
+
+// signed duty cycles on the wheels now, by wheelSide
+static int16_t Applied[2];
+static DriveMode_t AppliedMode;
+static volatile uint32_t Writes;
+static volatile uint32_t SkippedWrites;
+
+// ramp in progress
+static volatile MotionPhase_t Phase = MotionIdle;
+static int32_t Current[2];
+static int32_t Target[2];
+static uint32_t CruiseTicksLeft;
+static int32_t AccelStep = DutyToRamp(DefaultAccel)/MOTOR_PROFILE_RATE_HZ;
+static int32_t DecelStep = DutyToRamp(DefaultDecel)/MOTOR_PROFILE_RATE_HZ;
+
+// speed loop, by wheelSide
+static volatile bool SpeedLoopOn;
+static int16_t TargetSpeed[2];
+static WheelPI_t WheelPI[2];
 
 /*------------------------------ Module Code ------------------------------*/
+/***************************************************************************
+  InitMotorActions
+		Sets Timer1A up as the periodic MOTOR_PROFILE_RATE_HZ ramp tick, left
+		stopped until a ramp starts. Call after InitializePWM.
+ ***************************************************************************/
+void InitMotorActions(void)
+{
+	// the wheels start stopped
+	Applied[LEFT] = Applied[RIGHT] = 0;
+	AppliedMode = DRIVE_FAST_DECAY;
+	
+	// enable the clock to Timer1 and wait for it to be ready
+	HWREG(SYSCTL_RCGCTIMER) |= SYSCTL_RCGCTIMER_R1;
+	while ((HWREG(SYSCTL_PRTIMER) & SYSCTL_PRTIMER_R1) != SYSCTL_PRTIMER_R1)
+		;
+	
+	// 32 bit periodic timer A, interrupt on timeout
+	HWREG(TIMER1_BASE + TIMER_O_CTL) &= ~TIMER_CTL_TAEN;
+	HWREG(TIMER1_BASE + TIMER_O_CFG) = TIMER_CFG_32_BIT_TIMER;
+	HWREG(TIMER1_BASE + TIMER_O_TAMR) =
+		(HWREG(TIMER1_BASE + TIMER_O_TAMR) & ~TIMER_TAMR_TAMR_M) | TIMER_TAMR_TAMR_PERIOD;
+	HWREG(TIMER1_BASE + TIMER_O_TAILR) = TicksPerProfileTick - 1;
+	HWREG(TIMER1_BASE + TIMER_O_IMR) |= TIMER_IMR_TATOIM;
+	
+	// enable Timer1A's interrupt in the NVIC
+	HWREG(NVIC_EN0) |= Timer1AIntBit;
+	
+	// make sure interrupts are enabled globally
+	__enable_irq();
+}
+
+/***************************************************************************
+  SetMotorProfile
+		Acceleration and deceleration of the ramps started from now on, in
+		percent duty per second
+ ***************************************************************************/
+void SetMotorProfile(uint16_t AccelPercentPerS, uint16_t DecelPercentPerS)
+{
+	EnterCritical();
+	AccelStep = DutyToRamp(AccelPercentPerS)/MOTOR_PROFILE_RATE_HZ;
+	DecelStep = DutyToRamp(DecelPercentPerS)/MOTOR_PROFILE_RATE_HZ;
+	// at least a step a tick, or a ramp never gets there
+	if (AccelStep == 0)
+	{
+		AccelStep = 1;
+	}
+	if (DecelStep == 0)
+	{
+		DecelStep = 1;
+	}
+	ExitCritical();
+}
+
 /***************************************************************************
   start2rotate
 		rotates the wheels so that the robot is spinning clockwise or counter clockwise at a specific duty cycle
  ***************************************************************************/
 void start2rotate(bool rotationDirection, uint8_t DutyCycle)
+{
+	// ramp up and keep spinning
+	rotateInPlace(rotationDirection, DutyCycle, 0);
+}
+
+/***************************************************************************
+  rotateInPlace
+		ramps the wheels up to spinning the robot clockwise or counter
+		clockwise at DutyCycle, for TimeMS and back down (0 keeps spinning)
+ ***************************************************************************/
+void rotateInPlace(bool rotationDirection, uint8_t DutyCycle, uint16_t TimeMS)
 {
 	// If rotationDirection is clockwise
 	if (rotationDirection == CW)
 	{
-		// pick the left wheel and rotate it forward to make robot spin CW
-		wheelSide = LEFT;
-		direction = FORWARD;
-		SetPWMDutyCycle(DutyCycle, direction, wheelSide);
-		
-		// pick the right wheel and rotate it backward to make robot spin CW
-		wheelSide = RIGHT;
-		direction = BACKWARD;
-		SetPWMDutyCycle(DutyCycle, direction, wheelSide);
+		// left wheel forward and right wheel backward to make robot spin CW
+		StartMotion(Signed(DutyCycle, FORWARD), Signed(DutyCycle, BACKWARD), TimeMS);
 	}
 	// If rotationDirection is counterclockwise
 	else 
 	{
-		// pick the left wheel and rotate it backward to make robot spin CCW
-		wheelSide = LEFT;
-		direction = BACKWARD;
-		SetPWMDutyCycle(DutyCycle, direction, wheelSide);
-		
-		// pick the right wheel and rotate it forward to make robot spin CCW
-		wheelSide = RIGHT;
-		direction = FORWARD;
-		SetPWMDutyCycle(DutyCycle, direction, wheelSide);		
+		// left wheel backward and right wheel forward to make robot spin CCW
+		StartMotion(Signed(DutyCycle, BACKWARD), Signed(DutyCycle, FORWARD), TimeMS);
 	}
 }
 
+/***************************************************************************
+  driveStraight
+		ramps both wheels up to DutyCycle in direction, for TimeMS and back
+		down (0 keeps driving)
+ ***************************************************************************/
+void driveStraight(uint8_t DutyCycle, bool direction, uint16_t TimeMS)
+{
+	StartMotion(Signed(DutyCycle, direction), Signed(DutyCycle, direction), TimeMS);
+}
+
+/***************************************************************************
+  driveArc
+		ramps the wheels up to separate duty cycles in direction, for TimeMS
+		and back down (0 keeps driving)
+ ***************************************************************************/
+void driveArc(uint8_t LeftDutyCycle, uint8_t RightDutyCycle, bool direction, uint16_t TimeMS)
+{
+	StartMotion(Signed(LeftDutyCycle, direction), Signed(RightDutyCycle, direction), TimeMS);
+}
+
 /***************************************************************************
   driveSeperate
 		rotates the wheels so that the robot drives in direction, "direction," with separate duty cycles for left/right wheels
  ***************************************************************************/
 void driveSeperate(uint8_t LeftDutyCycle, uint8_t RightDutyCycle, bool direction)
 {
-	// drive left motor at specified LeftDutyCycle and direction
-	wheelSide = LEFT;
-	SetPWMDutyCycle(LeftDutyCycle, direction, wheelSide);
-	
-	// drive right motor at specified RightDutyCycle and direction
-	wheelSide = RIGHT;
-	SetPWMDutyCycle(RightDutyCycle, direction, wheelSide);
+	// drive both motors at their duty cycles in direction, updated in the
+	// same PWM period
+	CancelMotion();
+	ApplyDuties(Signed(LeftDutyCycle, direction), Signed(RightDutyCycle, direction), DRIVE_FAST_DECAY);
+}
+
+/***************************************************************************
+  driveDecay
+		driveSeperate with the H-bridges coasting (DRIVE_FAST_DECAY) or
+		braking (DRIVE_SLOW_DECAY) between pulses, or braking outright
+		(DRIVE_BRAKE)
+ ***************************************************************************/
+void driveDecay(uint8_t LeftDutyCycle, uint8_t RightDutyCycle, bool direction, DriveMode_t Mode)
+{
+	CancelMotion();
+	ApplyDuties(Signed(LeftDutyCycle, direction), Signed(RightDutyCycle, direction), Mode);
 }
 
 /***************************************************************************
@@ -113,13 +267,308 @@ void driveSeperate(uint8_t LeftDutyCycle, uint8_t RightDutyCycle, bool direction
 void stop(void)
 {
 	uint8_t DutyCycle = 0; // to stop motor
-	direction = FORWARD; 
 	
-	// stop the left motor
-	wheelSide = LEFT;
-	SetPWMDutyCycle(DutyCycle, direction, wheelSide);
+	// stop the left and right motors together
+	CancelMotion();
+	MarkStop(false);
+	ApplyDuties(DutyCycle, DutyCycle, DRIVE_FAST_DECAY);
+}
+
+/***************************************************************************
+  brakeStop
+		brake both motors, then after BrakeMS let them coast (0 keeps
+		braking)
+ ***************************************************************************/
+void brakeStop(uint16_t BrakeMS)
+{
+	CancelMotion();
+	MarkStop(true);
+	ApplyDuties(0, 0, DRIVE_BRAKE);
+	
+	if (BrakeMS != 0)
+	{
+		EnterCritical();
+		CruiseTicksLeft = MSToTicks(BrakeMS);
+		StartTick();
+		Phase = MotionBraking;
+		ExitCritical();
+	}
+}
+
+/***************************************************************************
+  driveSpeed
+		hold the wheels at signed speeds in mm/s (positive forward) from the
+		odometry tick, until another command
+ ***************************************************************************/
+void driveSpeed(int16_t LeftMMPerS, int16_t RightMMPerS)
+{
+	CancelMotion();
+	
+	EnterCritical();
+	if (!SpeedLoopOn)
+	{
+		WheelPI_Init(&WheelPI[LEFT], &WheelDefaultGains);
+		WheelPI_Init(&WheelPI[RIGHT], &WheelDefaultGains);
+	}
+	TargetSpeed[LEFT] = LeftMMPerS;
+	TargetSpeed[RIGHT] = RightMMPerS;
+	SpeedLoopOn = true;
+	ExitCritical();
+}
+
+/***************************************************************************
+  MotorActions_SpeedTick
+		From the odometry tick: one step of the speed loop on the wheel
+		speeds just measured, if driveSpeed() has the wheels
+ ***************************************************************************/
+void MotorActions_SpeedTick(int16_t LeftMMPerS, int16_t RightMMPerS)
+{
+	int32_t Left, Right;
+	
+	if (!SpeedLoopOn)
+	{
+		return;
+	}
+	Left = WheelPI_Step(&WheelPI[LEFT], TargetSpeed[LEFT], LeftMMPerS);
+	Right = WheelPI_Step(&WheelPI[RIGHT], TargetSpeed[RIGHT], RightMMPerS);
+	// Q15 duty to a signed percent, rounded
+	ApplyDuties((int16_t)((Left*100 + (WHEEL_FULL_DUTY >> 1)) >> 15),
+	            (int16_t)((Right*100 + (WHEEL_FULL_DUTY >> 1)) >> 15), DRIVE_FAST_DECAY);
+}
+
+/***************************************************************************
+  MotorProfileISR
+		Timer1A timeout: moves the wheels one step along the ramp
+ ***************************************************************************/
+void MotorProfileISR(void)
+{
+	// clear the source of the interrupt
+	HWREG(TIMER1_BASE + TIMER_O_ICR) = TIMER_ICR_TATOCINT;
+	
+	if (Phase == MotionIdle)
+	{
+		return;
+	}
+	if (Phase == MotionBraking)
+	{
+		// braked long enough, let the wheels coast
+		if (--CruiseTicksLeft == 0)
+		{
+			ApplyDuties(0, 0, DRIVE_FAST_DECAY);
+			FinishMotion();
+		}
+		return;
+	}
+	if (Phase == MotionCruising)
+	{
+		// at speed, start down when the time is up
+		if (--CruiseTicksLeft == 0)
+		{
+			Target[LEFT] = Target[RIGHT] = 0;
+			Phase = MotionStopping;
+		}
+		return;
+	}
 	
-	// stop the right motor
-	wheelSide = RIGHT;
-	SetPWMDutyCycle(DutyCycle, direction, wheelSide);	
+	Current[LEFT] = RampTo(Current[LEFT], Target[LEFT]);
+	Current[RIGHT] = RampTo(Current[RIGHT], Target[RIGHT]);
+	ApplyDuties(RampToDuty(Current[LEFT]), RampToDuty(Current[RIGHT]), DRIVE_FAST_DECAY);
+	
+	if ((Current[LEFT] == Target[LEFT]) && (Current[RIGHT] == Target[RIGHT]))
+	{
+		if ((Phase == MotionRamping) && (CruiseTicksLeft != 0))
+		{
+			Phase = MotionCruising;
+		}
+		else
+		{
+			// stopped at the end, or at speed with no time limit
+			FinishMotion();
+		}
+	}
+}
+
+/***************************************************************************
+  MotorActions_PrintStats
+		Console dump of the wheel writes made and skipped since the last dump
+ ***************************************************************************/
+void MotorActions_PrintStats(void)
+{
+	static const char * const ModeNames[] = { "coasting", "slow decay", "braking" };
+	uint32_t Made, Skipped;
+	int16_t Left, Right;
+	DriveMode_t Mode;
+	
+	EnterCritical();
+	Made = Writes;
+	Skipped = SkippedWrites;
+	Writes = 0;
+	SkippedWrites = 0;
+	Left = Applied[LEFT];
+	Right = Applied[RIGHT];
+	Mode = AppliedMode;
+	ExitCritical();
+	
+	printf("\r\nMotors L %d R %d %s, %s, %lu writes, %lu skipped as repeats\r\n",
+	       Left, Right, ModeNames[Mode],
+	       SpeedLoopOn ? "holding speed" : ((Phase == MotionIdle) ? "holding" : "ramping"),
+	       (unsigned long)Made, (unsigned long)Skipped);
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+
+/***************************************************************************
+  ApplyDuties
+		Puts signed duty cycles on the wheels, unless they are already there.
+		Called from thread level and from the ramp, speed loop and wire
+		follow ISRs: the check, the record and the write go together with
+		interrupts off, so Applied is always what was last written.
+ ***************************************************************************/
+static void ApplyDuties(int16_t LeftDuty, int16_t RightDuty, DriveMode_t Mode)
+{
+	EnterCritical();
+	if ((LeftDuty == Applied[LEFT]) && (RightDuty == Applied[RIGHT]) && (Mode == AppliedMode))
+	{
+		SkippedWrites++;
+	}
+	else
+	{
+		Applied[LEFT] = LeftDuty;
+		Applied[RIGHT] = RightDuty;
+		AppliedMode = Mode;
+		Writes++;
+		StageDriveDutyCycles((LeftDuty < 0) ? -LeftDuty : LeftDuty, LeftDuty >= 0,
+		                     (RightDuty < 0) ? -RightDuty : RightDuty, RightDuty >= 0, Mode);
+	}
+	ExitCritical();
+}
+
+/***************************************************************************
+  StartMotion
+		Starts a ramp from what the wheels are doing now to the signed duty
+		cycles, held for TimeMS before ramping down to stopped (0 holds)
+ ***************************************************************************/
+static void StartMotion(int16_t LeftDuty, int16_t RightDuty, uint16_t TimeMS)
+{
+	EnterCritical();
+	SpeedLoopOn = false;
+	Current[LEFT] = DutyToRamp(Applied[LEFT]);
+	Current[RIGHT] = DutyToRamp(Applied[RIGHT]);
+	Target[LEFT] = DutyToRamp(LeftDuty);
+	Target[RIGHT] = DutyToRamp(RightDuty);
+	CruiseTicksLeft = (TimeMS != 0) ? MSToTicks(TimeMS) : 0;
+	
+	// the first step goes out on the next tick
+	if (Phase == MotionIdle)
+	{
+		StartTick();
+	}
+	Phase = MotionRamping;
+	ExitCritical();
+}
+
+/***************************************************************************
+  StartTick
+		Starts the ramp tick a whole tick from now, with interrupts off
+ ***************************************************************************/
+static void StartTick(void)
+{
+	HWREG(TIMER1_BASE + TIMER_O_CTL) &= ~TIMER_CTL_TAEN;
+	HWREG(TIMER1_BASE + TIMER_O_TAV) = TicksPerProfileTick - 1;
+	HWREG(TIMER1_BASE + TIMER_O_ICR) = TIMER_ICR_TATOCINT;
+	HWREG(TIMER1_BASE + TIMER_O_CTL) |= (TIMER_CTL_TAEN | TIMER_CTL_TASTALL);
+}
+
+/***************************************************************************
+  FinishMotion
+		From the ramp tick: the motion is over, stop the tick and say so
+ ***************************************************************************/
+static void FinishMotion(void)
+{
+	ES_Event ThisEvent;
+	
+	Phase = MotionIdle;
+	HWREG(TIMER1_BASE + TIMER_O_CTL) &= ~TIMER_CTL_TAEN;
+	ThisEvent.EventType = MOTION_COMPLETE;
+	ThisEvent.EventParam = 0;
+	PostRobotTopSM(ThisEvent);
+}
+
+/***************************************************************************
+  CancelMotion
+		Stops a ramp or the speed loop, the wheels stay where it left them
+ ***************************************************************************/
+static void CancelMotion(void)
+{
+	SpeedLoopOn = false;
+	if (Phase != MotionIdle)
+	{
+		EnterCritical();
+		Phase = MotionIdle;
+		HWREG(TIMER1_BASE + TIMER_O_CTL) &= ~TIMER_CTL_TAEN;
+		HWREG(TIMER1_BASE + TIMER_O_ICR) = TIMER_ICR_TATOCINT;
+		ExitCritical();
+	}
+}
+
+/***************************************************************************
+  RampTo
+		Current moved one tick toward Target: at the acceleration going away
+		from stopped, at the deceleration going toward it
+ ***************************************************************************/
+static int32_t RampTo(int32_t Current, int32_t Target)
+{
+	int32_t Step;
+	
+	if (((Current >= 0) && (Target > Current)) || ((Current <= 0) && (Target < Current)))
+	{
+		Step = AccelStep;
+	}
+	else
+	{
+		Step = DecelStep;
+	}
+	
+	if (Target > Current)
+	{
+		return ((Target - Current) > Step) ? (Current + Step) : Target;
+	}
+	return ((Current - Target) > Step) ? (Current - Step) : Target;
+}
+
+static uint32_t MSToTicks(uint16_t TimeMS)
+{
+	uint32_t Ticks = (uint32_t)TimeMS*MOTOR_PROFILE_RATE_HZ/1000;
+	
+	return (Ticks != 0) ? Ticks : 1;
+}
+
+static int16_t RampToDuty(int32_t Ramp)
+{
+	int32_t Half = 1 << (RampShift - 1);
+	
+	return (Ramp < 0) ? -(int16_t)((-Ramp + Half) >> RampShift) : (int16_t)((Ramp + Half) >> RampShift);
+}
+
+static int16_t Signed(uint8_t DutyCycle, bool direction)
+{
+	if (DutyCycle > 100)
+	{
+		DutyCycle = 100;
+	}
+	return (direction == FORWARD) ? DutyCycle : -(int16_t)DutyCycle;
+}
+
+/***************************************************************************
+  MarkStop
+		Has the odometry time a stop, if the wheels are being driven
+ ***************************************************************************/
+static void MarkStop(bool Braking)
+{
+	if ((Applied[LEFT] != 0) || (Applied[RIGHT] != 0))
+	{
+		Odo_MarkStop(Braking);
+	}
 }
@@ -0,0 +1,338 @@
+/****************************************************************************
+OdometryModule
+	Wheel positions and speeds from the quadrature encoders, and the robot's
+	pose dead reckoned from them. QEI0 counts the left wheel (PhA0 on D6,
+	PhB0 on D7) and QEI1 the right (PhA1 on C5, PhB1 on C6), on every edge
+	of both phases. QEI0's velocity timer interrupts at ODO_RATE_HZ; every
+	tick reads both positions at once, turns the change into wheel speeds,
+	moves the pose along and runs the wheel speed loop on the new speeds
+	(MotorActions_SpeedTick).
+
+ Notes
+	The positions are the free running 32 bit counts; they go negative
+	backward and wrap after a few hundred km. The right motor is mirrored,
+	so its phases are swapped to count up forward like the left.
+	A speed is the counts of one tick, so it comes in steps of one count per
+	tick (about 15mm/s).
+	Both counts of a tick go through REC_QEI, so an input log replays the
+	ticks, and everything worked out from them, with the recorded counts.
+	The pose is float, which the M4F does in hardware and is cheap at
+	ODO_RATE_HZ: each tick moves it half the turn, along the distance, then
+	the other half. Its accuracy hasn't been checked: it is only as good as
+	the drive train configuration (CountsPerRev, WheelDiameterMM and
+	ODO_TRACK_MM) and the wheels' grip.
+	Odo_MarkStop (from stop() and brakeStop()) starts timing a stop; the
+	first tick both wheels read stopped ends it. 'o' on the console prints
+	the last coast and brake stops beside the pose, so the stops can be
+	compared.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+#include <math.h>
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "inc/hw_sysctl.h"
+#include "inc/hw_gpio.h"
+#include "inc/hw_qei.h"
+#include "inc/hw_nvic.h"
+
+#include "ES_Port.h"
+#include "BITDEFS.H"
+#include "InputRecorder.h"
+
+#include "OdometryModule.h"
+#include "MotorActionsModule.h"
+#include "WheelSpeedModule.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define TicksPerSecond 40000000
+#define TicksPerOdoTick (TicksPerSecond/ODO_RATE_HZ)
+// QEI0 is interrupt 13
+#define QEI0IntBit BIT13HI
+#define PhaseFunction 6
+#define BitsPerNibble 4
+
+#define LeftPhaseA BIT6HI                      // D6
+#define LeftPhaseB BIT7HI                      // D7, locked as NMI out of reset
+#define RightPhaseA BIT5HI                     // C5
+#define RightPhaseB BIT6HI                     // C6
+
+#define LEFT 1
+#define RIGHT 0
+
+// drive train configuration, not yet measured on the robot: 12 line
+// encoders on the motor shafts, 30:1 gearboxes, 70mm wheels ODO_TRACK_MM
+// apart. Every mm, mm/s and pose figure scales with these.
+#define CountsPerRev (4*12*30)
+#define WheelDiameterMM 70.0f
+#define Pi 3.14159265f
+#define MMPerCount (Pi*WheelDiameterMM/CountsPerRev)
+// the same in Q16, for the integer distance and speed
+#define MMPerCountQ16 ((int32_t)(MMPerCount*65536.0f + 0.5f))
+
+typedef char OdoRateIsWheelSpeedRate[(ODO_RATE_HZ == WHEEL_SPEED_RATE_HZ) ? 1 : -1];
+
+typedef struct
+{
+  int32_t Count;
+  int16_t Speed;                       // mm/s
+} Wheel_t;
+
+typedef struct
+{
+  bool Timing;
+  bool Braking;
+  int32_t StartCount[2];
+  uint32_t StartTick;
+} StopTimer_t;
+
+typedef struct
+{
+  uint32_t DistanceMM;
+  uint32_t TimeMS;
+} StopResult_t;
+
+/*---------------------------- Module Functions ---------------------------*/
+static void InitQEI( uint32_t Base, uint32_t Swap );
+static int32_t Magnitude( int32_t Value );
+
+/*---------------------------- Module Variables ---------------------------*/
+static volatile Wheel_t Wheels[2];
+static Pose_t Pose;
+static volatile uint32_t Ticks;
+static StopTimer_t Stop;
+static StopResult_t LastStop[2];       // coast, brake
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+    InitOdometry
+
+ Description
+    Sets both QEIs up counting from 0 and starts QEI0's velocity timer as
+    the ODO_RATE_HZ tick
+****************************************************************************/
+void InitOdometry( void )
+{
+  // enable the clocks to the QEIs and ports C and D
+  HWREG(SYSCTL_RCGCQEI) |= (SYSCTL_RCGCQEI_R0 | SYSCTL_RCGCQEI_R1);
+  HWREG(SYSCTL_RCGCGPIO) |= (SYSCTL_RCGCGPIO_R2 | SYSCTL_RCGCGPIO_R3);
+  while ((HWREG(SYSCTL_PRQEI) & (SYSCTL_PRQEI_R0 | SYSCTL_PRQEI_R1)) !=
+         (SYSCTL_PRQEI_R0 | SYSCTL_PRQEI_R1))
+    ;
+
+  // D7 has to be unlocked before it can be anything but GPIO
+  HWREG(GPIO_PORTD_BASE + GPIO_O_LOCK) = GPIO_LOCK_KEY;
+  HWREG(GPIO_PORTD_BASE + GPIO_O_CR) |= LeftPhaseB;
+  HWREG(GPIO_PORTD_BASE + GPIO_O_LOCK) = 0;
+
+  // D6 and D7 to PhA0 and PhB0, C5 and C6 to PhA1 and PhB1, as inputs
+  HWREG(GPIO_PORTD_BASE + GPIO_O_AFSEL) |= (LeftPhaseA | LeftPhaseB);
+  HWREG(GPIO_PORTD_BASE + GPIO_O_PCTL) =
+    (HWREG(GPIO_PORTD_BASE + GPIO_O_PCTL) & 0x00ffffff) +
+    (PhaseFunction << (6*BitsPerNibble)) + (PhaseFunction << (7*BitsPerNibble));
+  HWREG(GPIO_PORTD_BASE + GPIO_O_DEN) |= (LeftPhaseA | LeftPhaseB);
+  HWREG(GPIO_PORTD_BASE + GPIO_O_DIR) &= ~(LeftPhaseA | LeftPhaseB);
+  HWREG(GPIO_PORTC_BASE + GPIO_O_AFSEL) |= (RightPhaseA | RightPhaseB);
+  HWREG(GPIO_PORTC_BASE + GPIO_O_PCTL) =
+    (HWREG(GPIO_PORTC_BASE + GPIO_O_PCTL) & 0xf00fffff) +
+    (PhaseFunction << (5*BitsPerNibble)) + (PhaseFunction << (6*BitsPerNibble));
+  HWREG(GPIO_PORTC_BASE + GPIO_O_DEN) |= (RightPhaseA | RightPhaseB);
+  HWREG(GPIO_PORTC_BASE + GPIO_O_DIR) &= ~(RightPhaseA | RightPhaseB);
+
+  InitQEI(QEI0_BASE, 0);
+  InitQEI(QEI1_BASE, QEI_CTL_SWAP);
+  Odo_ResetPose();
+
+  // QEI0's velocity timer is the tick
+  HWREG(QEI0_BASE + QEI_O_ISC) = QEI_ISC_TIMER;
+  HWREG(QEI0_BASE + QEI_O_INTEN) = QEI_INTEN_TIMER;
+  HWREG(NVIC_EN0) |= QEI0IntBit;
+
+  // make sure interrupts are enabled globally
+  __enable_irq();
+}
+
+/****************************************************************************
+ Function
+    Odo_GetCount, Odo_GetDistanceMM, Odo_GetSpeed
+
+ Description
+    A wheel's encoder count, how far it has gone forward in mm (both as of
+    the last tick) and its speed over the last tick in mm/s
+****************************************************************************/
+int32_t Odo_GetCount( bool wheelSide )
+{
+  return Wheels[wheelSide].Count;
+}
+
+int32_t Odo_GetDistanceMM( bool wheelSide )
+{
+  return (int32_t)(((int64_t)Wheels[wheelSide].Count*MMPerCountQ16) >> 16);
+}
+
+int16_t Odo_GetSpeed( bool wheelSide )
+{
+  return Wheels[wheelSide].Speed;
+}
+
+/****************************************************************************
+ Function
+    Odo_GetPose
+
+ Description
+    Copies out the pose as of the last tick
+****************************************************************************/
+void Odo_GetPose( Pose_t *pPose )
+{
+  EnterCritical();
+  *pPose = Pose;
+  ExitCritical();
+}
+
+/****************************************************************************
+ Function
+    Odo_ResetPose
+
+ Description
+    Makes where the robot is now the origin, facing along X
+****************************************************************************/
+void Odo_ResetPose( void )
+{
+  EnterCritical();
+  Pose.X = 0.0f;
+  Pose.Y = 0.0f;
+  Pose.Heading = 0.0f;
+  ExitCritical();
+}
+
+/****************************************************************************
+ Function
+    Odo_MarkStop
+
+ Parameters
+    bool : true for a brake stop, false for a coast
+
+ Description
+    Starts timing a stop from the wheels' positions now
+****************************************************************************/
+void Odo_MarkStop( bool Braking )
+{
+  EnterCritical();
+  Stop.Timing = true;
+  Stop.Braking = Braking;
+  Stop.StartCount[LEFT] = Wheels[LEFT].Count;
+  Stop.StartCount[RIGHT] = Wheels[RIGHT].Count;
+  Stop.StartTick = Ticks;
+  ExitCritical();
+}
+
+/****************************************************************************
+ Function
+    OdometryISR
+
+ Description
+    QEI0 velocity timer: new wheel counts and speeds, the pose moved by
+    them, the timing of a stop and a step of the wheel speed loop
+****************************************************************************/
+void OdometryISR( void )
+{
+  int32_t Count[2], Delta[2];
+  float Distance, Turn;
+  uint8_t Side;
+
+  // clear the source of the interrupt
+  HWREG(QEI0_BASE + QEI_O_ISC) = QEI_ISC_TIMER;
+
+  Count[LEFT] = (int32_t)HWREG(QEI0_BASE + QEI_O_POS);
+  Count[RIGHT] = (int32_t)HWREG(QEI1_BASE + QEI_O_POS);
+  REC_QEI(Count);
+  for (Side = 0; Side < 2; Side++)
+  {
+    Delta[Side] = Count[Side] - Wheels[Side].Count;
+    Wheels[Side].Count = Count[Side];
+    Wheels[Side].Speed = (int16_t)((Delta[Side]*MMPerCountQ16*ODO_RATE_HZ) >> 16);
+  }
+  Ticks++;
+
+  // half the turn, the distance, then the other half
+  Distance = (Delta[LEFT] + Delta[RIGHT])*(MMPerCount/2.0f);
+  Turn = (Delta[RIGHT] - Delta[LEFT])*(MMPerCount/ODO_TRACK_MM);
+  Pose.Heading += Turn/2.0f;
+  Pose.X += Distance*cosf(Pose.Heading);
+  Pose.Y += Distance*sinf(Pose.Heading);
+  Pose.Heading += Turn/2.0f;
+  if (Pose.Heading > Pi)
+  {
+    Pose.Heading -= 2.0f*Pi;
+  }
+  else if (Pose.Heading < -Pi)
+  {
+    Pose.Heading += 2.0f*Pi;
+  }
+
+  if (Stop.Timing && (Delta[LEFT] == 0) && (Delta[RIGHT] == 0))
+  {
+    StopResult_t *pResult = &LastStop[Stop.Braking];
+
+    Stop.Timing = false;
+    pResult->DistanceMM = (uint32_t)(((int64_t)(Magnitude(Count[LEFT] - Stop.StartCount[LEFT]) +
+                                                Magnitude(Count[RIGHT] - Stop.StartCount[RIGHT]))*
+                                      MMPerCountQ16) >> 17);
+    pResult->TimeMS = (Ticks - Stop.StartTick)*1000/ODO_RATE_HZ;
+  }
+
+  MotorActions_SpeedTick(Wheels[LEFT].Speed, Wheels[RIGHT].Speed);
+}
+
+/****************************************************************************
+ Function
+    Odo_PrintStatus
+
+ Description
+    Console dump of the wheels, the pose and the last coast and brake stops
+    (how far the wheels went on average and how long it took, to within a
+    tick)
+****************************************************************************/
+void Odo_PrintStatus( void )
+{
+  Pose_t Now;
+  int32_t Degrees10;
+
+  Odo_GetPose(&Now);
+  Degrees10 = (int32_t)(Now.Heading*(1800.0f/Pi));
+  printf("\r\nWheels L %ld mm %d mm/s, R %ld mm %d mm/s\r\n",
+         (long)Odo_GetDistanceMM(LEFT), Wheels[LEFT].Speed,
+         (long)Odo_GetDistanceMM(RIGHT), Wheels[RIGHT].Speed);
+  printf("Pose X %ld mm, Y %ld mm, heading %ld.%ld deg\r\n",
+         (long)Now.X, (long)Now.Y, (long)(Degrees10/10), (long)Magnitude(Degrees10 % 10));
+  printf("Last coast stop %lu mm in %lu ms, last brake stop %lu mm in %lu ms\r\n",
+         (unsigned long)LastStop[false].DistanceMM, (unsigned long)LastStop[false].TimeMS,
+         (unsigned long)LastStop[true].DistanceMM, (unsigned long)LastStop[true].TimeMS);
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+/***************************************************************************
+  InitQEI
+    A QEI counting both edges of both phases over the full 32 bits, with
+    its velocity timer running at ODO_RATE_HZ
+ ***************************************************************************/
+static void InitQEI( uint32_t Base, uint32_t Swap )
+{
+  HWREG(Base + QEI_O_CTL) = 0;
+  HWREG(Base + QEI_O_MAXPOS) = 0xffffffff;
+  HWREG(Base + QEI_O_POS) = 0;
+  HWREG(Base + QEI_O_LOAD) = TicksPerOdoTick - 1;
+  HWREG(Base + QEI_O_CTL) = (Swap | QEI_CTL_CAPMODE | QEI_CTL_VELEN | QEI_CTL_VELDIV_1 |
+                             QEI_CTL_FILTEN | QEI_CTL_ENABLE);
+}
+
+static int32_t Magnitude( int32_t Value )
+{
+  return (Value < 0) ? -Value : Value;
+}
@@ -4,6 +4,28 @@
 
  Description
 	 Generate PWM waveforms
+
+ Notes
+	 Duty cycles turn into compare values through tables worked out once per
+	 generator period, and the generator action registers of the drive
+	 wheels are shadowed so only the ones that change get written.
+	 The two drive wheel generators (PWM0 generators 0 and 1) run in lock
+	 step and update globally synchronized: new compare and action values
+	 for both wheels are staged and then committed together with
+	 GLOBALSYNC, so a left/right pair always lands in the same PWM period.
+	 SetDriveDutyCycles never waits, so the ramp, wire follow and speed
+	 loop ISRs can call it: while the last commit is still pending the new
+	 pair is parked, and generator 0's zero count interrupt (DrivePeriodISR)
+	 commits it at the boundary where the last one lands, to go out the
+	 period after. A later pair replaces a parked one.
+	 EmitIRPulses sends an exact number of IR pulses from PWM1 generator 2.
+	 Its zero count interrupt marks the period boundaries, where the
+	 locally synchronized updates land, so the ISR switches the pulses on
+	 and off there for whole periods only and counts them as they go out.
+	 An input log records IR_PULSES_DONE going out; the host replay never
+	 runs the ISR, so ReplayIRPulsesDone ends the train there instead.
+	 The drive and flywheel duty cycles are scaled by SetPWMSupplyScale's
+	 factor (BatteryModule's nominal over actual battery) on the way in.
 ****************************************************************************/
 /*----------------------------- Include Files -----------------------------*/
 /* include header files for this state machine as well as any machines at the
@@ -15,6 +37,8 @@
 #include "ES_Configure.h"
 #include "ES_Framework.h"
 #include "PWMmodule.h"
+#include "RobotTopSM.h"
+#include "InputRecorder.h"
 
 #include <stdio.h>
 #include <termio.h>
@@ -29,6 +53,7 @@
 #include "inc/hw_gpio.h"
 #include "inc/hw_sysctl.h"
 #include "inc/hw_pwm.h"
+#include "inc/hw_nvic.h"
 
 // the headers to access the TivaWare Library
 #include "driverlib/sysctl.h"
@@ -45,10 +70,54 @@
 #define PeriodInUS 500
 #define MotorPeriodInUS 2000 // to get 500Hz
 #define IRPeriodInUS 40000
-#define PWMTicksPerUS 40000/(1000*32) //System clock (40MHz) / 32
-#define PWMTickPerMS 40000/32 //System clock divided by 32
+#define PWMTickPerMS (40000/32) //System clock divided by 32
 #define DutyCycle25 25
+// PWM clocks a second for the IR pulse train, the slowest train a 16 bit
+// up/down LOAD can time and PWM1 generator 2's interrupt (number 136)
+#define IRTicksPerSecond (1000UL*PWMTickPerMS)
+#define IRMinFrequencyHz 10
+#define PWM1Gen2IntBit BIT8HI
+// the supply scale is Q12
+#define SupplyScaleShift 12
 #define BitsPerNibble 4
+#define MaxDutyCycle 100
+// PWM clocks (40MHz/32) in a period, multiplied out before the divide:
+// 1.25 ticks a uS doesn't fit a whole number
+#define PeriodTicks(US) (((uint32_t)(US)*40000)/(1000*32))
+// PWM0 generators 0 (right wheel) and 1 (left wheel), the wheelSide values
+#define DriveGenOffset(Side) ((Side) ? PWM_O_1_CTL : PWM_O_0_CTL)
+#define DriveSyncBits (PWM_CTL_GLOBALSYNC0 | PWM_CTL_GLOBALSYNC1)
+// update mode of both drive generators: everything waits for GLOBALSYNC
+#define DriveGenCTL (PWM_X_CTL_MODE | PWM_X_CTL_ENABLE | PWM_X_CTL_GENAUPD_GS | \
+                     PWM_X_CTL_GENBUPD_GS | PWM_X_CTL_CMPAUPD | PWM_X_CTL_CMPBUPD | \
+                     PWM_X_CTL_LOADUPD)
+// PWM0 generator 0 is interrupt 10
+#define PWM0Gen0IntBit BIT10HI
+// passes of the wait for the last commit, more than one 500uS PWM period
+#define SyncWaitPasses 5000
+#define NotWritten 0xffffffff
+// the two outputs of a generator, one per H-bridge input
+#define PinA 0
+#define PinB 1
+
+// the last values written to a drive generator, by pin
+typedef struct {
+	uint32_t Gen[2];
+	uint32_t Cmp[2];
+} GenShadow_t;
+
+// where an IR pulse train is, moved along at each zero count
+typedef enum { IRTrainIdle, IRTrainArming, IRTrainPulsing, IRTrainStopping } IRTrain_t;
+
+// a drive wheel pair waiting for the last commit to land
+typedef struct {
+	uint8_t DutyCycle[2];
+	bool Direction[2];
+	DriveMode_t Mode;
+} DrivePair_t;
+
+// what one H-bridge input does for a period
+typedef enum { PinLow, PinHigh, PinPWM } PinAction_t;
 
 #define PWM0_GenA_Normal (PWM_0_GENA_ACTCMPAU_ONE | PWM_0_GENA_ACTCMPAD_ZERO )
 #define PWM0_GenB_Normal (PWM_0_GENB_ACTCMPBU_ONE | PWM_0_GENB_ACTCMPBD_ZERO )
@@ -62,11 +131,10 @@
 #define L_CW_MOTOR_PIN BIT5HI
 #define R_CW_MOTOR_PIN BIT6HI
 #define R_CCW_MOTOR_PIN BIT7HI
-#define ServoMotorPin BIT4HI //PE4, alt function 5
 #define FlyWheelMotorPin BIT5HI //PE5
 #define IRPin BIT1HI //PF1
 #define ExtraPWMPin BIT0HI //PF0
-#define FlyWheelEnablePin BIT7HI //PD7
+#define FlyWheelEnablePin BIT2HI //PB2, was PD7 (now the left encoder), see README.md
 
 #define FORWARD 1
 #define BACKWARD 0
@@ -77,15 +145,48 @@
 /*---------------------------- Module Functions ---------------------------*/
 /* prototypes for private functions for this service.They should be functions
    relevant to the behavior of this service*/
-static void Set100DC(uint8_t SelectedPin);
-static void Set0DC(uint8_t SelectedPin);
-static void RestoreDC(uint8_t SelectedPin);
 static void EnableFlyWheel( bool );
+static void BuildCompareTable( uint16_t Table[], uint32_t Ticks );
+static bool StageWheel( uint8_t DutyCycle, bool direction, bool wheelSide, DriveMode_t Mode );
+static void Wait4DriveSync( void );
+static void CommitPair( const DrivePair_t *pPair );
+static bool StagePin( uint32_t GenBase, GenShadow_t *pShadow, uint8_t Pin, PinAction_t Action, uint8_t DutyCycle );
+static void CancelIRPulses( void );
+static uint8_t Compensate( uint16_t DutyCycle );
 
 /*---------------------------- Module Variables ---------------------------*/
 // with the introduction of Gen2, we need a module level Priority variable
 //static uint16_t PeriodInUSVal = PeriodInUS;
 
+// compare value for every duty cycle, per generator period
+static uint16_t DriveCompare[MaxDutyCycle+1];
+static uint16_t MotorCompare[MaxDutyCycle+1];
+static uint16_t IRCompare;
+static uint16_t IRLoad;
+
+// IR pulse train in progress
+static volatile IRTrain_t IRTrain = IRTrainIdle;
+static uint8_t IRTrainCount;
+static uint8_t IRPulsesLeft;
+static uint16_t IRTrainLoad;
+static uint16_t IRTrainCompare;
+
+// duty cycle scale for the battery, Q12
+static volatile uint16_t SupplyScale = (1 << SupplyScaleShift);
+
+// last values written to each drive generator, by wheelSide
+static GenShadow_t DriveShadow[2];
+
+// pair for DrivePeriodISR to commit, by wheelSide
+static DrivePair_t ParkedPair;
+static volatile bool PairParked;
+
+static const uint32_t GenOffset[2] = { PWM_O_X_GENA, PWM_O_X_GENB };
+static const uint32_t CmpOffset[2] = { PWM_O_X_CMPA, PWM_O_X_CMPB };
+static const uint32_t PinLowAction[2] = { PWM_X_GENA_ACTZERO_ZERO, PWM_X_GENB_ACTZERO_ZERO };
+static const uint32_t PinHighAction[2] = { PWM_X_GENA_ACTZERO_ONE, PWM_X_GENB_ACTZERO_ONE };
+static const uint32_t PinPWMAction[2] = { PWM0_GenA_Normal, PWM0_GenB_Normal };
+
 /*------------------------------ Module Code ------------------------------*/
 
 /***************************************************************************
@@ -118,14 +219,19 @@ void InitializePWM(void)
 	
 	
 	// Set the PWM period
-	HWREG(PWM0_BASE + PWM_O_0_LOAD) = ((PeriodInUS * PWMTicksPerUS))>>1;
-	HWREG(PWM0_BASE + PWM_O_1_LOAD) = ((PeriodInUS * PWMTicksPerUS))>>1;
+	HWREG(PWM0_BASE + PWM_O_0_LOAD) = PeriodTicks(PeriodInUS)>>1;
+	HWREG(PWM0_BASE + PWM_O_1_LOAD) = PeriodTicks(PeriodInUS)>>1;
+	BuildCompareTable(DriveCompare, PeriodTicks(PeriodInUS));
 	
 	// Set the initial Duty cycle on A and B to 0 
 	HWREG(PWM0_BASE + PWM_O_0_GENA) = PWM_0_GENA_ACTZERO_ZERO;
 	HWREG(PWM0_BASE + PWM_O_0_GENB) = PWM_0_GENB_ACTZERO_ZERO;
 	HWREG(PWM0_BASE + PWM_O_1_GENA) = PWM_1_GENA_ACTZERO_ZERO;
 	HWREG(PWM0_BASE + PWM_O_1_GENB) = PWM_1_GENB_ACTZERO_ZERO;
+	DriveShadow[LEFT].Gen[PinA] = DriveShadow[RIGHT].Gen[PinA] = PWM_X_GENA_ACTZERO_ZERO;
+	DriveShadow[LEFT].Gen[PinB] = DriveShadow[RIGHT].Gen[PinB] = PWM_X_GENB_ACTZERO_ZERO;
+	DriveShadow[LEFT].Cmp[PinA] = DriveShadow[RIGHT].Cmp[PinA] = NotWritten;
+	DriveShadow[LEFT].Cmp[PinB] = DriveShadow[RIGHT].Cmp[PinB] = NotWritten;
 	
 	// Enable the PWM outputs 0, 1, 2, 3
 	HWREG(PWM0_BASE + PWM_O_ENABLE) |= (PWM_ENABLE_PWM1EN | PWM_ENABLE_PWM0EN | PWM_ENABLE_PWM2EN | PWM_ENABLE_PWM3EN);
@@ -141,10 +247,20 @@ void InitializePWM(void)
 	// make pins 4,5,6,7 on Port B into outputs
 	HWREG(GPIO_PORTB_BASE+GPIO_O_DIR) |= (L_CCW_MOTOR_PIN | L_CW_MOTOR_PIN | R_CCW_MOTOR_PIN | R_CW_MOTOR_PIN);
 	
-	// set the up/down count mode, enable the PWM generator and make
-	// both generator updates locally synchronized to zero count
-	HWREG(PWM0_BASE+ PWM_O_0_CTL) = (PWM_0_CTL_MODE | PWM_0_CTL_ENABLE | PWM_0_CTL_GENAUPD_LS | PWM_0_CTL_GENBUPD_LS);
-	HWREG(PWM0_BASE+ PWM_O_1_CTL) = (PWM_1_CTL_MODE | PWM_1_CTL_ENABLE | PWM_1_CTL_GENAUPD_LS | PWM_1_CTL_GENBUPD_LS);
+	// set the up/down count mode, enable the PWM generators and make all
+	// their updates wait for a global synchronization at zero count
+	HWREG(PWM0_BASE+ PWM_O_0_CTL) = DriveGenCTL;
+	HWREG(PWM0_BASE+ PWM_O_1_CTL) = DriveGenCTL;
+	
+	// restart both counters together so their zero counts line up
+	HWREG(PWM0_BASE + PWM_O_SYNC) = (PWM_SYNC_SYNC0 | PWM_SYNC_SYNC1);
+	
+	// generator 0's zero count commits a parked pair, switched on at the
+	// generator only while there is one
+	PairParked = false;
+	HWREG(PWM0_BASE + PWM_O_0_INTEN) = 0;
+	HWREG(PWM0_BASE + PWM_O_INTEN) |= PWM_INTEN_INTPWM0;
+	HWREG(NVIC_EN0) |= PWM0Gen0IntBit;
 }
 
 void InitializeAltPWM(void){
@@ -172,8 +288,11 @@ void InitializeAltPWM(void){
 	HWREG(PWM1_BASE + PWM_O_2_GENB) = PWM2_GenB_Normal;
 	
 	// Set the PWM period
-	HWREG(PWM1_BASE + PWM_O_1_LOAD) = ((MotorPeriodInUS * PWMTicksPerUS))>>1;
-	HWREG(PWM1_BASE + PWM_O_2_LOAD) = ((IRPeriodInUS * PWMTicksPerUS))>>1;
+	HWREG(PWM1_BASE + PWM_O_1_LOAD) = PeriodTicks(MotorPeriodInUS)>>1;
+	IRLoad = PeriodTicks(IRPeriodInUS)>>1;
+	HWREG(PWM1_BASE + PWM_O_2_LOAD) = IRLoad;
+	BuildCompareTable(MotorCompare, PeriodTicks(MotorPeriodInUS));
+	IRCompare = (PeriodTicks(IRPeriodInUS)>>1) - ((DutyCycle25*PeriodTicks(IRPeriodInUS)/100)>>1);
 	
 	// Set the initial Duty cycle on A and B to 0 
 	HWREG(PWM1_BASE + PWM_O_1_GENA) = PWM_1_GENA_ACTZERO_ZERO;
@@ -181,25 +300,25 @@ void InitializeAltPWM(void){
 	HWREG(PWM1_BASE + PWM_O_2_GENA) = PWM_2_GENA_ACTZERO_ZERO;
 	HWREG(PWM1_BASE + PWM_O_2_GENB) = PWM_2_GENB_ACTZERO_ZERO;
 	
-	// Enable the PWM outputs  2, 3, 4, 5
-	HWREG(PWM1_BASE + PWM_O_ENABLE) |= (PWM_ENABLE_PWM2EN | PWM_ENABLE_PWM3EN | PWM_ENABLE_PWM4EN | PWM_ENABLE_PWM5EN);
+	// Enable the PWM outputs 3, 4, 5 (the servo is on ServoModule's PWM0 generator)
+	HWREG(PWM1_BASE + PWM_O_ENABLE) |= (PWM_ENABLE_PWM3EN | PWM_ENABLE_PWM4EN | PWM_ENABLE_PWM5EN);
 
-	// Configure the Port E pins 4,5 to be PWM outputs -- alternate function 5
-	HWREG(GPIO_PORTE_BASE + GPIO_O_AFSEL) |= (ServoMotorPin|FlyWheelMotorPin);
-	HWREG(GPIO_PORTE_BASE + GPIO_O_PCTL) = (HWREG(GPIO_PORTE_BASE+GPIO_O_PCTL) & 0xff00ffff) + (5<<(4*BitsPerNibble)) + (5<<(5*BitsPerNibble));
+	// Configure the Port E pin 5 to be a PWM output -- alternate function 5
+	HWREG(GPIO_PORTE_BASE + GPIO_O_AFSEL) |= FlyWheelMotorPin;
+	HWREG(GPIO_PORTE_BASE + GPIO_O_PCTL) = (HWREG(GPIO_PORTE_BASE+GPIO_O_PCTL) & 0xff0fffff) + (5<<(5*BitsPerNibble));
 	
 	// Configure the Port F pins 0,1 to be PWM outputs -- alternate function 5
 	HWREG(GPIO_PORTF_BASE + GPIO_O_AFSEL) |= (IRPin | ExtraPWMPin);
 	HWREG(GPIO_PORTF_BASE + GPIO_O_PCTL) = (HWREG(GPIO_PORTF_BASE+GPIO_O_PCTL) & 0xffffff00) + (5) + (5<<(BitsPerNibble));
 	
-	// Enable pins 4,5 on Port E for digital I/O
-	HWREG(GPIO_PORTE_BASE+GPIO_O_DEN) |= (ServoMotorPin|FlyWheelMotorPin);
+	// Enable pin 5 on Port E for digital I/O
+	HWREG(GPIO_PORTE_BASE+GPIO_O_DEN) |= FlyWheelMotorPin;
 	
 	// Enable pins 0,1 on Port F for digital I/O
 	HWREG(GPIO_PORTF_BASE+GPIO_O_DEN) |= (IRPin | ExtraPWMPin);
 	
-	// make pins 4,5 on Port E into outputs
-	HWREG(GPIO_PORTE_BASE+GPIO_O_DIR) |= (ServoMotorPin|FlyWheelMotorPin);
+	// make pin 5 on Port E into an output
+	HWREG(GPIO_PORTE_BASE+GPIO_O_DIR) |= FlyWheelMotorPin;
 	
 		// make pins 0,1 on Port F into outputs
 	HWREG(GPIO_PORTF_BASE+GPIO_O_DIR) |= (IRPin | ExtraPWMPin);
@@ -209,159 +328,113 @@ void InitializeAltPWM(void){
 	HWREG(PWM1_BASE+ PWM_O_1_CTL) = (PWM_1_CTL_MODE | PWM_1_CTL_ENABLE | PWM_1_CTL_GENAUPD_LS | PWM_1_CTL_GENBUPD_LS);
 	HWREG(PWM1_BASE+ PWM_O_2_CTL) = (PWM_2_CTL_MODE | PWM_2_CTL_ENABLE | PWM_2_CTL_GENAUPD_LS | PWM_2_CTL_GENBUPD_LS);
 	
+	// the IR pulse train counts on generator 2's zero count interrupt,
+	// switched on at the generator only while a train is going out
+	HWREG(PWM1_BASE + PWM_O_2_INTEN) = 0;
+	HWREG(PWM1_BASE + PWM_O_INTEN) |= PWM_INTEN_INTPWM2;
+	HWREG(NVIC_EN4) |= PWM1Gen2IntBit;
+	
 	// initialize Fly Wheel Enable Pin
-		//Initialize Port D
-		HWREG(SYSCTL_RCGCGPIO) |= SYSCTL_RCGCGPIO_R3;
+		//Initialize Port B
+		HWREG(SYSCTL_RCGCGPIO) |= SYSCTL_RCGCGPIO_R1;
 		
 		// Wait for Port to be ready
-		while ((HWREG(SYSCTL_PRGPIO) & SYSCTL_PRGPIO_R3) != SYSCTL_PRGPIO_R3);
+		while ((HWREG(SYSCTL_PRGPIO) & SYSCTL_PRGPIO_R1) != SYSCTL_PRGPIO_R1);
 		
-		//Enable pin 2 on Port D for digital I/O
-		HWREG(GPIO_PORTD_BASE + GPIO_O_DEN) |= FlyWheelEnablePin;
+		//Enable pin 2 on Port B for digital I/O
+		HWREG(GPIO_PORTB_BASE + GPIO_O_DEN) |= FlyWheelEnablePin;
 		
-		//make pin 2 on Port D into an output
-		HWREG(GPIO_PORTD_BASE + GPIO_O_DIR) |= FlyWheelEnablePin;
+		//make pin 2 on Port B into an output
+		HWREG(GPIO_PORTB_BASE + GPIO_O_DIR) |= FlyWheelEnablePin;
 }
 
 /***************************************************************************
-  SetPWMDutyCycle
-		Set the duty cycle of one of the driving wheel motors corresponding to inputs: DutyCycle, direction (0=backwards,1=forward), and wheelSide (0=right,1=left)
+  SetDriveDutyCycles
+		Set both driving wheel motors, the new duty cycles, directions and
+		drive mode take effect together at the start of the same PWM period.
+		Never waits, so it is safe from an ISR: with the last commit still
+		pending the pair is parked for DrivePeriodISR, a period later.
  ***************************************************************************/
+void SetDriveDutyCycles(uint8_t LeftDutyCycle, bool LeftDirection,
+                        uint8_t RightDutyCycle, bool RightDirection, DriveMode_t Mode)
+{
+	EnterCritical();
+	StageDriveDutyCycles(LeftDutyCycle, LeftDirection, RightDutyCycle, RightDirection, Mode);
+	ExitCritical();
+}
 
-void SetPWMDutyCycle(uint8_t DutyCycle, bool direction, bool wheelSide)
+/***************************************************************************
+  StageDriveDutyCycles
+		SetDriveDutyCycles for a caller that is already between EnterCritical
+		and ExitCritical, which don't nest
+ ***************************************************************************/
+void StageDriveDutyCycles(uint8_t LeftDutyCycle, bool LeftDirection,
+                          uint8_t RightDutyCycle, bool RightDirection, DriveMode_t Mode)
 {
-	// If wheelSide is left and the direction is forward
-	if (wheelSide == LEFT && direction == FORWARD)
+	DrivePair_t Pair;
+	
+	Pair.DutyCycle[LEFT] = LeftDutyCycle;
+	Pair.Direction[LEFT] = LeftDirection;
+	Pair.DutyCycle[RIGHT] = RightDutyCycle;
+	Pair.Direction[RIGHT] = RightDirection;
+	Pair.Mode = Mode;
+	
+	if ((HWREG(PWM0_BASE + PWM_O_CTL) & DriveSyncBits) != 0)
 	{
-		// If the DutyCycle is 0
-		if (DutyCycle == 0)
-		{
-			// Set output of both left pins to 0
-			Set0DC(L_CCW_MOTOR_PIN); //PB4 to 0
-			Set0DC(L_CW_MOTOR_PIN);  //PB5 to 0
-		}
-		
-		//Else If the DutyCycle is 100
-		else if (DutyCycle == 100)
-		{
-			// Set output of left, counterclockwise pin to 100 and left clockwise pin to 0
-			Set100DC(L_CCW_MOTOR_PIN);//PB4 to 100
-			Set0DC(L_CW_MOTOR_PIN);		//PB5 to 0
-		}
-		// Else 
-		else
-		{
-			// Restore pwm to left, counterclockwise pin 
-			RestoreDC(L_CCW_MOTOR_PIN);
-			
-			// Set left, counterclockwise pin to DutyCycle
-			HWREG( PWM0_BASE + PWM_O_1_CMPA) = (HWREG( PWM0_BASE + PWM_O_1_LOAD)) - ((DutyCycle*(PeriodInUS * PWMTicksPerUS)/100)>>1);
-			
-			// Set left, clockwise pin to 0
-			Set0DC(L_CW_MOTOR_PIN);
-		}
+		// staging now could ride along with the pending commit
+		ParkedPair = Pair;
+		PairParked = true;
+		HWREG(PWM0_BASE + PWM_O_0_INTEN) = PWM_X_INTEN_INTCNTZERO;
 	}
-	
-	// Else If wheelSide is left and direction is backwards
-	else if (wheelSide == LEFT && direction == BACKWARD)
+	else
 	{
-		// If the DutyCycle is 0
-		if (DutyCycle == 0)
-		{
-			// Set the left, counterclockwise and clockwise pins to 0
-			Set0DC(L_CCW_MOTOR_PIN); //PB4 to 0
-			Set0DC(L_CW_MOTOR_PIN);  //PB5 to 0
-		}
-		// Else If the DutyCycle is 100
-		else if (DutyCycle == 100)
-		{
-			// Set the left, counterclockwise pin to 0 and the left, clockwise pin to 100
-			Set0DC(L_CCW_MOTOR_PIN); //PB4 to 0
-			Set100DC(L_CW_MOTOR_PIN);//PB5 to 100
-		}
-		// Else 
-		else
-		{
-			// Restore pwm to the left, clockwise pin 
-			RestoreDC(L_CW_MOTOR_PIN);
-			
-			//Set the duty cycle of the left counterclockwise pin to 0
-			Set0DC(L_CCW_MOTOR_PIN);
-			
-			//Set the duty cycle of the left clockwise pin to the DutyCycle
-			HWREG( PWM0_BASE + PWM_O_1_CMPB) = (HWREG( PWM0_BASE + PWM_O_1_LOAD)) - ((DutyCycle*(PeriodInUS * PWMTicksPerUS)/100)>>1);	
-		}
+		// this one supersedes a parked pair
+		PairParked = false;
+		HWREG(PWM0_BASE + PWM_O_0_INTEN) = 0;
+		CommitPair(&Pair);
 	}
+}
+
+/***************************************************************************
+  DrivePeriodISR
+		PWM0 generator 0 at zero count, where a pending commit lands: the
+		parked pair is staged and committed for the next period
+ ***************************************************************************/
+void DrivePeriodISR( void )
+{
+	// clear the source of the interrupt
+	HWREG(PWM0_BASE + PWM_O_0_ISC) = PWM_X_ISC_INTCNTZERO;
 	
-	// Else If wheelSide is right and direction is forward 
-	else if (wheelSide == RIGHT && direction == FORWARD)
+	// a flag left from before the pair was parked, try the next boundary
+	if ((HWREG(PWM0_BASE + PWM_O_CTL) & DriveSyncBits) != 0)
 	{
-		// If the DutyCycle is 0
-		if (DutyCycle == 0)
-		{
-			// Set the right, clockwise and counterclockwise pins to 0
-			Set0DC(R_CW_MOTOR_PIN); //PB6 to 0
-			Set0DC(R_CCW_MOTOR_PIN);//PB7 to 0
-		}
-		// Else If the DutyCycle is 100
-		else if (DutyCycle == 100)
-		{
-			// Set the right cw pin to 100 and the right ccw pin to 0
-			Set100DC(R_CW_MOTOR_PIN);//PB6 to 100
-			Set0DC(R_CCW_MOTOR_PIN); //PB7 to 0
-		}
-		// Else 
-		else
-		{
-			// Restore pwm to the right cw pin 
-			RestoreDC(R_CW_MOTOR_PIN);
-			
-			// Set the duty cycle of the right cw pin to DutyCycle 
-			HWREG( PWM0_BASE + PWM_O_0_CMPA) = (HWREG( PWM0_BASE + PWM_O_0_LOAD)) - ((DutyCycle*(PeriodInUS * PWMTicksPerUS)/100)>>1);
-			
-			// Set the duty cycle of the right ccw pin to 0
-			Set0DC(R_CCW_MOTOR_PIN);
-		}
+		return;
 	}
-	
-	else // right wheel selected, backward direction selected
+	HWREG(PWM0_BASE + PWM_O_0_INTEN) = 0;
+	if (PairParked)
 	{
-		// If the DutyCycle is 0
-		if (DutyCycle == 0)
-		{
-			// Set the right cw and ccw pins to 0
-			Set0DC(R_CW_MOTOR_PIN); //PB6 to 0
-			Set0DC(R_CCW_MOTOR_PIN);//PB7 to 0
-		}
-		// Else If the DutyCycle is 100
-		else if (DutyCycle == 100)
-		{
-			// Set the right cw pin to 0 and the right ccw pin to 100
-			Set0DC(R_CW_MOTOR_PIN);   //PB6 to 0
-			Set100DC(R_CCW_MOTOR_PIN);//PB7 to 100
-		}
-		// Else 
-		else
-		{
-			// Restore pwm to the right ccw pin
-			RestoreDC(R_CCW_MOTOR_PIN);
-			
-			// Set the output of the right cw pin to 0
-			Set0DC(R_CW_MOTOR_PIN);
-			
-			// Set the duty cycle of the right ccw pin to DutyCycle 
-			HWREG( PWM0_BASE + PWM_O_0_CMPB) = (HWREG( PWM0_BASE + PWM_O_0_LOAD)) - ((DutyCycle*(PeriodInUS * PWMTicksPerUS)/100)>>1);
-		}
+		PairParked = false;
+		CommitPair(&ParkedPair);
 	}
 }
+
 /***************************************************************************
   SetPWMPeriodUS
 		Set the loads to the period/2 that is the input of this function (in us)
 ***************************************************************************/	
 void SetPWMPeriodUS(uint16_t Period)
 {
-		HWREG( PWM0_BASE + PWM_O_0_LOAD) = ((Period * PWMTicksPerUS))>>1;
-	  HWREG( PWM0_BASE + PWM_O_1_LOAD) = ((Period * PWMTicksPerUS))>>1;
+	// returns with interrupts off and no commit pending
+	Wait4DriveSync();
+	HWREG( PWM0_BASE + PWM_O_0_LOAD) = PeriodTicks(Period)>>1;
+	HWREG( PWM0_BASE + PWM_O_1_LOAD) = PeriodTicks(Period)>>1;
+	HWREG(PWM0_BASE + PWM_O_CTL) = DriveSyncBits;
+	
+	// the compares go with the period, rewrite them on the next duty cycle
+	BuildCompareTable(DriveCompare, PeriodTicks(Period));
+	DriveShadow[LEFT].Cmp[PinA] = DriveShadow[RIGHT].Cmp[PinA] = NotWritten;
+	DriveShadow[LEFT].Cmp[PinB] = DriveShadow[RIGHT].Cmp[PinB] = NotWritten;
+	ExitCritical();
 }
 
 /***************************************************************************
@@ -369,13 +442,16 @@ void SetPWMPeriodUS(uint16_t Period)
 		Enable/Disable PWM at 25% duty cycle to IR LED based on input boolean OnOrOff
 ***************************************************************************/	
 void EmitIR( bool OnOrOff ){
+	// either way a pulse train in progress stops here
+	CancelIRPulses();
+	
 	// If OnOrOff is true
 	if(OnOrOff == 1){
 		// Restore PWM to IR LED Pin
 		HWREG( PWM1_BASE + PWM_O_2_GENB) = PWM2_GenB_Normal;
 		 
 		// Set duty cycle to 25%
-		HWREG( PWM1_BASE + PWM_O_2_CMPB) = (HWREG(PWM1_BASE + PWM_O_2_LOAD)) - ((DutyCycle25*(IRPeriodInUS * PWMTicksPerUS)/100)>>1);
+		HWREG( PWM1_BASE + PWM_O_2_CMPB) = IRCompare;
 	
 	// Else If OnOrOff is false
 	} else {
@@ -384,39 +460,135 @@ void EmitIR( bool OnOrOff ){
 	}
 }
 /***************************************************************************
-  SetServoDuty
-		Set the duty cycle, which is the input of function (TheDooty), of the pin associated with the servo 
+  EmitIRPulses
+		Send exactly Count IR pulses at FrequencyHz and DutyCycle (percent),
+		then IR_PULSES_DONE to RobotTopSM with Count as the param. The train
+		starts at the next period boundary and replaces one in progress.
 ***************************************************************************/	
-void SetServoDuty( uint16_t TheDooty ){
-	// If TheDooty is 0% duty cycle
-	if (TheDooty == 0)
-		{
-			// Set duty cycle to 0V or 0% duty cycle
-			HWREG(PWM1_BASE + PWM_O_1_GENA) = PWM_1_GENA_ACTZERO_ZERO;
+void EmitIRPulses( uint8_t Count, uint16_t FrequencyHz, uint8_t DutyCycle ){
+	uint32_t Ticks;
+	
+	if (FrequencyHz < IRMinFrequencyHz)
+	{
+		FrequencyHz = IRMinFrequencyHz;
+	}
+	if (DutyCycle > MaxDutyCycle)
+	{
+		DutyCycle = MaxDutyCycle;
+	}
+	Ticks = IRTicksPerSecond/FrequencyHz;
+	
+	EnterCritical();
+	// nothing out of the period under way, the ISR starts the train at the
+	// next zero count and it goes out from the one after
+	HWREG(PWM1_BASE + PWM_O_2_GENB) = PWM_2_GENB_ACTZERO_ZERO;
+	IRTrainLoad = Ticks>>1;
+	IRTrainCompare = (Ticks>>1) - ((DutyCycle*Ticks/100)>>1);
+	IRTrainCount = Count;
+	IRTrain = IRTrainArming;
+	HWREG(PWM1_BASE + PWM_O_2_ISC) = PWM_X_ISC_INTCNTZERO;
+	HWREG(PWM1_BASE + PWM_O_2_INTEN) = PWM_X_INTEN_INTCNTZERO;
+	ExitCritical();
+}
 
-		}
-		// Else If TheDooty is 100% duty cycle
-		else if (TheDooty == 100)
-		{
-			// Set output of Servo Pin to 3.3V (duty cycle to 100)
-			HWREG( PWM1_BASE+PWM_O_1_GENA) = PWM_1_GENA_ACTZERO_ONE;
-		}
-		// Else If TheDooty is between 0% and 100% duty cycle
-		else if ((TheDooty > 0) && (TheDooty < 100))
-		{
-			// Restore PWM function to the Servo Pin
-			HWREG( PWM1_BASE + PWM_O_1_GENA) = PWM1_GenA_Normal;
-		 
-			// Set duty cycle to TheDooty
-			HWREG( PWM1_BASE + PWM_O_1_CMPA) = (HWREG(PWM1_BASE + PWM_O_1_LOAD)) - ((TheDooty*(MotorPeriodInUS * PWMTicksPerUS)/100)>>1);
-		}
+/***************************************************************************
+  IRPulsesBusy
+		True while a pulse train is going out
+***************************************************************************/	
+bool IRPulsesBusy( void ){
+	return (IRTrain != IRTrainIdle);
+}
+
+/***************************************************************************
+  IRPulseISR
+		PWM1 generator 2 at zero count, a period boundary: what is written
+		here lands at the next one, so each step sets up the period after
+***************************************************************************/	
+void IRPulseISR( void ){
+	ES_Event ThisEvent;
 	
+	// clear the source of the interrupt
+	HWREG(PWM1_BASE + PWM_O_2_ISC) = PWM_X_ISC_INTCNTZERO;
+	
+	switch (IRTrain)
+	{
+		case IRTrainArming:
+			// the train's period, and pulses from the next boundary on
+			HWREG(PWM1_BASE + PWM_O_2_LOAD) = IRTrainLoad;
+			HWREG(PWM1_BASE + PWM_O_2_CMPB) = IRTrainCompare;
+			if (IRTrainCount != 0)
+			{
+				HWREG(PWM1_BASE + PWM_O_2_GENB) = PWM2_GenB_Normal;
+			}
+			IRPulsesLeft = IRTrainCount;
+			IRTrain = IRTrainPulsing;
+			break;
+		
+		case IRTrainPulsing:
+			// a pulse goes out in the period starting now, none if empty
+			if (IRPulsesLeft != 0)
+			{
+				IRPulsesLeft--;
+			}
+			if (IRPulsesLeft == 0)
+			{
+				// the last one: nothing after it, and the IR period back
+				HWREG(PWM1_BASE + PWM_O_2_GENB) = PWM_2_GENB_ACTZERO_ZERO;
+				HWREG(PWM1_BASE + PWM_O_2_LOAD) = IRLoad;
+				HWREG(PWM1_BASE + PWM_O_2_CMPB) = IRCompare;
+				IRTrain = IRTrainStopping;
+			}
+			break;
+		
+		case IRTrainStopping:
+			// the last pulse is out
+			HWREG(PWM1_BASE + PWM_O_2_INTEN) = 0;
+			IRTrain = IRTrainIdle;
+			REC_IRQ(REC_IRQ_IR_PULSES_DONE);
+			ThisEvent.EventType = IR_PULSES_DONE;
+			ThisEvent.EventParam = IRTrainCount;
+			PostRobotTopSM(ThisEvent);
+			break;
+		
+		default:
+			HWREG(PWM1_BASE + PWM_O_2_INTEN) = 0;
+			break;
+	}
+}
+
+#if defined(REPLAY_INPUTS)
+/***************************************************************************
+  ReplayIRPulsesDone
+		Stands in for the end of a pulse train on a host replay
+***************************************************************************/	
+void ReplayIRPulsesDone( void ){
+	ES_Event ThisEvent;
+	
+	HWREG(PWM1_BASE + PWM_O_2_INTEN) = 0;
+	IRTrain = IRTrainIdle;
+	ThisEvent.EventType = IR_PULSES_DONE;
+	ThisEvent.EventParam = IRTrainCount;
+	PostRobotTopSM(ThisEvent);
 }
+#endif
+
+/***************************************************************************
+  SetPWMSupplyScale
+		Factor (Q12) on every drive and flywheel duty cycle from now on, the
+		nominal battery over the battery now; 1<<12 for none
+ ***************************************************************************/
+void SetPWMSupplyScale( uint16_t Scale ){
+	SupplyScale = Scale;
+}
+
 /***************************************************************************
   SetFlyWheel
 		Set the duty cycle, which is the input of function (DatDooty), of the pin associated with the flywheel 
  ***************************************************************************/
 void SetFlyDuty( uint16_t DatDooty ){
+	// the duty cycle the nominal battery would need
+	DatDooty = Compensate(DatDooty);
+	
 	// If DatDooty is 0% duty cycle
 	if (DatDooty == 0)
 		{
@@ -446,7 +618,7 @@ void SetFlyDuty( uint16_t DatDooty ){
 			HWREG( PWM1_BASE + PWM_O_1_GENB) = PWM1_GenB_Normal;
 		 
 			// set duty cycle to DatDooty
-			HWREG( PWM1_BASE + PWM_O_1_CMPB) = (HWREG(PWM1_BASE + PWM_O_1_LOAD)) - ((DatDooty*(MotorPeriodInUS * PWMTicksPerUS)/100)>>1);
+			HWREG( PWM1_BASE + PWM_O_1_CMPB) = MotorCompare[DatDooty];
 		}
 	
 }
@@ -464,116 +636,199 @@ static void EnableFlyWheel( bool OnOrOff ){
 	// If input boolean is true
 	if(OnOrOff){
 		// enable H-bridge by setting enable pin Hi
-		HWREG(GPIO_PORTD_BASE+(GPIO_O_DATA + ALL_BITS)) |= FlyWheelEnablePin;
+		HWREG(GPIO_PORTB_BASE+(GPIO_O_DATA + ALL_BITS)) |= FlyWheelEnablePin;
 	
 		// Else If input boolean is false
 	} else {
 		// disable H-bridge by setting enable pin Lo
-		HWREG(GPIO_PORTD_BASE+(GPIO_O_DATA + ALL_BITS)) &= (~FlyWheelEnablePin);
+		HWREG(GPIO_PORTB_BASE+(GPIO_O_DATA + ALL_BITS)) &= (~FlyWheelEnablePin);
 		
 	}
 }
 
 /***************************************************************************
-  Set100DC
-		Program 100% duty cycle (3.3V output) on selected pin, input of function
+  CancelIRPulses
+		Stop a pulse train without IR_PULSES_DONE and put the IR period back
  ***************************************************************************/
-static void Set100DC(uint8_t SelectedPin){
-	
-	// If the SelectedPin is the left, counterclockwise motor pin
-	if (SelectedPin == L_CCW_MOTOR_PIN)
+static void CancelIRPulses( void ){
+	EnterCritical();
+	if (IRTrain != IRTrainIdle)
 	{
-		// PB4 to 100%
-		HWREG( PWM0_BASE+PWM_O_1_GENA) = PWM_1_GENA_ACTZERO_ONE;
+		HWREG(PWM1_BASE + PWM_O_2_INTEN) = 0;
+		HWREG(PWM1_BASE + PWM_O_2_GENB) = PWM_2_GENB_ACTZERO_ZERO;
+		HWREG(PWM1_BASE + PWM_O_2_LOAD) = IRLoad;
+		HWREG(PWM1_BASE + PWM_O_2_CMPB) = IRCompare;
+		IRTrain = IRTrainIdle;
 	}
+	ExitCritical();
+}
+
+/***************************************************************************
+  Compensate
+		A duty cycle times the supply scale, rounded and kept to 100
+ ***************************************************************************/
+static uint8_t Compensate( uint16_t DutyCycle ){
+	uint32_t Scaled = ((uint32_t)DutyCycle*SupplyScale + (1 << (SupplyScaleShift - 1))) >> SupplyScaleShift;
 	
-	// Else If the SelectedPin is the left, clockwise motor pin
-	else if (SelectedPin == L_CW_MOTOR_PIN)
+	return (Scaled > MaxDutyCycle) ? MaxDutyCycle : (uint8_t)Scaled;
+}
+
+/***************************************************************************
+  BuildCompareTable
+		Compare value for each duty cycle 0-100 of a generator counting up/down
+		over Ticks PWM clocks a period (LOAD is Ticks/2)
+ ***************************************************************************/
+static void BuildCompareTable( uint16_t Table[], uint32_t Ticks )
+{
+	uint8_t DutyCycle;
+	
+	for (DutyCycle = 0; DutyCycle <= MaxDutyCycle; DutyCycle++)
 	{
-		// PB5 to 100%
-		HWREG( PWM0_BASE+PWM_O_1_GENB) = PWM_1_GENB_ACTZERO_ONE;
+		Table[DutyCycle] = (Ticks>>1) - ((DutyCycle*Ticks/100)>>1);
 	}
+}
+
+/***************************************************************************
+  StageWheel
+		Write whatever changed of one drive generator for DutyCycle, direction
+		and Mode, to take effect at the next commit. Forward drives the A
+		output of the wheel's generator (PB4 left, PB6 right) and backward
+		the B output (PB5 left, PB7 right).
+		Fast decay holds the other input low, so the bridge coasts between
+		pulses. Slow decay holds the driven input high and pulses the other
+		one for the rest of the period, so the bridge brakes between pulses.
+		Brake holds both high whatever the duty cycle.
+		Returns true if any register was written.
+ ***************************************************************************/
+static bool StageWheel( uint8_t DutyCycle, bool direction, bool wheelSide, DriveMode_t Mode )
+{
+	GenShadow_t *pShadow = &DriveShadow[wheelSide];
+	uint32_t GenBase = PWM0_BASE + DriveGenOffset(wheelSide);
+	uint8_t Drive = (direction == FORWARD) ? PinA : PinB;
+	uint8_t Other = (direction == FORWARD) ? PinB : PinA;
+	bool Changed;
+	
+	// the duty cycle the nominal battery would need, kept to 100
+	DutyCycle = Compensate(DutyCycle);
 	
-	// Else If the SelectedPin is the right, clockwise motor pin
-	else if (SelectedPin == R_CW_MOTOR_PIN)
+	if (Mode == DRIVE_BRAKE)
 	{
-		// PB6 to 100%
-		HWREG( PWM0_BASE+PWM_O_0_GENA) = PWM_0_GENA_ACTZERO_ONE;
+		Changed = StagePin(GenBase, pShadow, Drive, PinHigh, 0);
+		Changed |= StagePin(GenBase, pShadow, Other, PinHigh, 0);
 	}
-	
-	else // Else If the SelectedPin is the right, counterclockwise motor pin
+	else if (Mode == DRIVE_SLOW_DECAY)
+	{
+		// 0% is a brake, 100% the same as fast decay
+		Changed = StagePin(GenBase, pShadow, Drive, PinHigh, 0);
+		if (DutyCycle == MaxDutyCycle)
+		{
+			Changed |= StagePin(GenBase, pShadow, Other, PinLow, 0);
+		}
+		else if (DutyCycle == 0)
+		{
+			Changed |= StagePin(GenBase, pShadow, Other, PinHigh, 0);
+		}
+		else
+		{
+			Changed |= StagePin(GenBase, pShadow, Other, PinPWM, MaxDutyCycle - DutyCycle);
+		}
+	}
+	else
 	{
-		// PB7 to 100%
-		HWREG( PWM0_BASE+PWM_O_0_GENB) = PWM_0_GENB_ACTZERO_ONE;
+		// 0% both outputs low (coast), 100% the driven output high
+		Changed = StagePin(GenBase, pShadow, Other, PinLow, 0);
+		if (DutyCycle == MaxDutyCycle)
+		{
+			Changed |= StagePin(GenBase, pShadow, Drive, PinHigh, 0);
+		}
+		else if (DutyCycle == 0)
+		{
+			Changed |= StagePin(GenBase, pShadow, Drive, PinLow, 0);
+		}
+		else
+		{
+			Changed |= StagePin(GenBase, pShadow, Drive, PinPWM, DutyCycle);
+		}
 	}
+	return Changed;
 }
 
 /***************************************************************************
-Set0DC
-	Set the output on the respective pin, input of function to zero
+  StagePin
+		Write the action (and for PinPWM the compare for DutyCycle) of one
+		output of a drive generator, if they aren't what it has already.
+		Returns true if any register was written.
  ***************************************************************************/
-
-static void Set0DC(uint8_t SelectedPin){
+static bool StagePin( uint32_t GenBase, GenShadow_t *pShadow, uint8_t Pin, PinAction_t Action, uint8_t DutyCycle )
+{
+	uint32_t Gen;
+	bool Changed = false;
 	
-	// If the SelectedPin is the left, counterclockwise motor pin
-	if (SelectedPin == L_CCW_MOTOR_PIN)
+	if (Action == PinHigh)
 	{
-		// PB4 to 0%
-		HWREG( PWM0_BASE+PWM_O_1_GENA) = PWM_1_GENA_ACTZERO_ZERO;
+		Gen = PinHighAction[Pin];
 	}
-	
-	// Else if the SelectedPin is the left, clockwise motor pin
-	else if (SelectedPin == L_CW_MOTOR_PIN)
+	else if (Action == PinLow)
 	{
-		// PB5 to 0%
-		HWREG( PWM0_BASE+PWM_O_1_GENB) = PWM_1_GENB_ACTZERO_ZERO;
+		Gen = PinLowAction[Pin];
 	}
-	
-	// Else If the SelectedPin is the right, clockwise motor pin
-	else if (SelectedPin == R_CW_MOTOR_PIN)
+	else
 	{
-		// PB6 to 0%
-		HWREG( PWM0_BASE+PWM_O_0_GENA) = PWM_0_GENA_ACTZERO_ZERO;
+		Gen = PinPWMAction[Pin];
+		if (pShadow->Cmp[Pin] != DriveCompare[DutyCycle])
+		{
+			pShadow->Cmp[Pin] = DriveCompare[DutyCycle];
+			HWREG(GenBase + CmpOffset[Pin]) = pShadow->Cmp[Pin];
+			Changed = true;
+		}
 	}
 	
-	else // Else If the SelectedPin in the right, counterclockwise motor pin
+	if (pShadow->Gen[Pin] != Gen)
 	{
-		// PB7 to 0%
-		HWREG( PWM0_BASE+PWM_O_0_GENB) = PWM_0_GENB_ACTZERO_ZERO;
+		pShadow->Gen[Pin] = Gen;
+		HWREG(GenBase + GenOffset[Pin]) = Gen;
+		Changed = true;
 	}
+	return Changed;
 }
 
 /***************************************************************************
-  RestoreDC
-		Reprogram generators to go to 1 at rising compare A/B, 0 on falling compare A/B
+  CommitPair
+		Stages both wheels and commits them, if a register changed. Call
+		with the last commit landed and interrupts off.
  ***************************************************************************/
-static void RestoreDC(uint8_t SelectedPin){
-		
-	// If the SelectedPin is the left, counterclockwise motor pin
-	if (SelectedPin == L_CCW_MOTOR_PIN)
-	{
-		// Restore PB4
-		HWREG( PWM0_BASE+PWM_O_1_GENA) = PWM1_GenA_Normal;
-	}
-	
-	// Else If the SelectedPin is the left, clockwise motor pin
-	else if (SelectedPin == L_CW_MOTOR_PIN)
-	{
-		// Restore PB5
-		HWREG( PWM0_BASE+PWM_O_1_GENB) = PWM1_GenB_Normal;
-	}
+static void CommitPair( const DrivePair_t *pPair )
+{
+	bool Changed;
 	
-	// Else If the SelectedPin is the right, clockwise motor pin
-	else if (SelectedPin == R_CW_MOTOR_PIN)
+	Changed = StageWheel(pPair->DutyCycle[LEFT], pPair->Direction[LEFT], LEFT, pPair->Mode);
+	Changed |= StageWheel(pPair->DutyCycle[RIGHT], pPair->Direction[RIGHT], RIGHT, pPair->Mode);
+	if (Changed)
 	{
-		// Restore PB6
-		HWREG( PWM0_BASE+PWM_O_0_GENA) = PWM0_GenA_Normal;
+		HWREG(PWM0_BASE + PWM_O_CTL) = DriveSyncBits;
 	}
+}
+
+/***************************************************************************
+  Wait4DriveSync
+		Wait for the last commit to land and enter a critical section with
+		none pending, so nothing staged next can ride along with a commit an
+		ISR made. The check is repeated with interrupts off since an ISR can
+		commit between the wait and EnterCritical. Only waits when two
+		updates come within a PWM period, and gives up after about one, so
+		it is for thread level callers only; the caller ends the critical
+		section.
+ ***************************************************************************/
+static void Wait4DriveSync( void )
+{
+	uint16_t Passes = SyncWaitPasses;
 	
-	else // Else If the SelectedPin is the right, counterclockwise motor pin
+	EnterCritical();
+	while (((HWREG(PWM0_BASE + PWM_O_CTL) & DriveSyncBits) != 0) && (Passes != 0))
 	{
-		// Restore PB7
-		HWREG( PWM0_BASE+PWM_O_0_GENB) = PWM0_GenB_Normal;
+		ExitCritical();
+		while (((HWREG(PWM0_BASE + PWM_O_CTL) & DriveSyncBits) != 0) && (--Passes != 0))
+			;
+		EnterCritical();
 	}
 }
-
@@ -6,7 +6,8 @@
    2.0.1
 
  Description
-   Loading a new ball
+   Loading a new ball. The transitions for this machine live in
+   Tools/Statecharts/ReloadingSubSM.yaml; this file holds the During functions.
 
  Notes
 
@@ -47,6 +48,7 @@
 // Basic includes for a program using the Events and Services Framework
 #include "ES_Configure.h"
 #include "ES_Framework.h"
+#include "ES_Statechart.h"
 
 /* include header files for this state machine as well as any machines at the
    next lower level in the hierarchy that are sub-machines to this machine
@@ -87,8 +89,10 @@
 #define ALL_BITS (0xff<<2)
 #define TimeWaiting4Ball 3000 //3sec must wait between ball requests
 #define STOP_PWM 0
-#define START_PWM 1
-#define PulseDuration 600 // time needed to get 15 complete pulses of the PWM with f=25Hz and d.c. = 75%
+// a ball request: 15 pulses at 25Hz, 10ms ON + 30ms OFF
+#define BallRequestPulses 15
+#define BallRequestHz 25
+#define BallRequestDuty 25
 
 /*---------------------------- Module Functions ---------------------------*/
 /* prototypes for private functions for this machine, things like during
@@ -99,136 +103,14 @@ static ES_Event DuringRequestingBall( ES_Event Event);
 static ES_Event DuringWaiting4Ball( ES_Event Event);
 
 /*---------------------------- Module Variables ---------------------------*/
-// everybody needs a state variable, you may need others as well
-static ReloadingState_t CurrentState;
-
-/*------------------------------ Module Code ------------------------------*/
-/****************************************************************************
- Function
-    RunReloadingSM
-
- Parameters
-   ES_Event: the event to process
-
- Returns
-   ES_Event: an event to return
-
- Description
-   Uses nested switch/case to implement a statemachine to reload the robot from the supply depots
- Author
-   J. Edward Carryer, 2/11/05, 10:45AM
-****************************************************************************/
-ES_Event RunReloadingSM( ES_Event CurrentEvent )
-{
-   bool MakeTransition = false;/* are we making a state transition? */
-   ReloadingState_t NextState = CurrentState;
-   ES_Event EntryEventKind = { ES_ENTRY, 0 };// default to normal entry to new state
-   ES_Event ReturnEvent = CurrentEvent; // assume we are not consuming event
-
-   switch ( CurrentState )
-   {
-			 // CASE 1/2
-       case REQUESTING_BALL :       
-         // Execute During function 
-         CurrentEvent = DuringRequestingBall(CurrentEvent);
-         //If event type is not ES_NO_EVENT or ES_TIMEOUT, process the event
-         if (( CurrentEvent.EventType != ES_NO_EVENT ) && ( CurrentEvent.EventType == ES_TIMEOUT ) && (CurrentEvent.EventParam == SendingIRPulses_TIMER)) //If an event is active and it's the correct one
-         {       
-                  NextState = WAITING4BALL;//Decide what the next state will be
-                  MakeTransition = true; //mark that we are taking a transition
-                  // if transitioning to a state with history change kind of entry
-                  //EntryEventKind.EventType = ES_ENTRY_HISTORY;
-                  ReturnEvent.EventType = ES_NO_EVENT; // consume for the upper level state machine
-                  break;
-          }
-				 else if ( CurrentEvent.EventType == ES_NO_EVENT )// Current Event is now ES_NO_EVENT. Correction 2/20/17 
-         {     																						//Probably means that CurrentEvent was consumed by lower level
-            ReturnEvent = CurrentEvent; // in that case update ReturnEvent too
-         }
-       break;
-      
-				 // CASE 2/2				 
-			 case WAITING4BALL:
-			 // During function
-       CurrentEvent = DuringWaiting4Ball(CurrentEvent);
-			 // Process events	
-			 if(CurrentEvent.EventType == RELOAD_BALLS)
-			 {
-					 NextState = REQUESTING_BALL;
-					 MakeTransition = true;
-					 ReturnEvent.EventType = ES_NO_EVENT;						 
-			 }
-    }
-    //   If we are making a state transition
-    if (MakeTransition == true)
-    {
-       //   Execute exit function for current state
-       CurrentEvent.EventType = ES_EXIT;
-       RunShootingSM(CurrentEvent);
-
-       CurrentState = NextState; //Modify state variable
-
-       //   Execute entry function for new state
-       // this defaults to ES_ENTRY
-       RunShootingSM(EntryEventKind);
-     }
-     // Return the return event
-     return(ReturnEvent);
-}
-/****************************************************************************
- Function
-     StartReloadingSM
-
- Parameters
-     ES_Event CurrentEvent
-
- Returns
-     None
-
- Description
-     Initializes this state machine
- Notes
-
- Author
-     J. Edward Carryer, 2/18/99, 10:38AM
-****************************************************************************/
-void StartReloadingSM ( ES_Event CurrentEvent )
+// The transition table, state variable and the Run/Start/Query functions are
+// generated into ReloadingSubSM_Gen.c from Tools/Statecharts/ReloadingSubSM.yaml.
+// The generated dispatcher finds the During function for each state here.
+const ES_SCDuring_t ReloadingDuringFuncs[NUM_RELOADING_STATES] =
 {
-   // to implement entry to a history state or directly to a substate
-   // you can modify the initialization of the CurrentState variable
-   // otherwise just start in the entry state every time the state machine
-   // is started
-   if ( ES_ENTRY_HISTORY != CurrentEvent.EventType )
-   {
-        CurrentState = REQUESTING_BALL;
-   }
-	 
-   // call the entry function (if any) for the ENTRY_STATE
-   RunReloadingSM(CurrentEvent);
-}
-
-/****************************************************************************
- Function
-     QueryReloadingSM
-
- Parameters
-     None
-
- Returns
-     The current state of this state machine
-
- Description
-     Returns the current state of this state machine
- Notes
-
- Author
-     J. Edward Carryer, 2/11/05, 10:38AM
-****************************************************************************/
-ReloadingState_t QueryReloadingSM ( void )
-{
-  // Return the current state of this state machine
-   return(CurrentState);
-}
+  DuringRequestingBall, // REQUESTING_BALL
+  DuringWaiting4Ball    // WAITING4BALL
+};
 
 /***************************************************************************
  private functions
@@ -258,11 +140,16 @@ static ES_Event DuringRequestingBall( ES_Event Event)
     // IF event is ES_ENTRY or ES_ENTRY_HISTORY
     if ( (Event.EventType == ES_ENTRY) || (Event.EventType == ES_ENTRY_HISTORY) )
     {
-        // do nothing
+				// Turn on communication LEDs
+				TurnOnOffBlueLEDs(LEDS_ON, GetTeamColor());	
+        // Send the 15 pulses, IR_PULSES_DONE when the last is out
+				EmitIRPulses(BallRequestPulses, BallRequestHz, BallRequestDuty);
     }
     // Else If event is ES_EXIT
     else if ( Event.EventType == ES_EXIT )
     {
+      // cut a request short if leaving before it is out
+        EmitIR(STOP_PWM);
       // turn off communication LEDS
         TurnOnOffBlueLEDs(LEDS_OFF, GetTeamColor());
     }
@@ -270,12 +157,7 @@ static ES_Event DuringRequestingBall( ES_Event Event)
 		// Else do the 'during' function for this state
 		else 
     {
-				// Turn off communication LEDs
-				TurnOnOffBlueLEDs(LEDS_ON, GetTeamColor());	
-        // Kick off SendingIRPulses_TIMER		
-				ES_Timer_InitTimer(SendingIRPulses_TIMER, PulseDuration);
-        // Send 15 pulses (10ms ON + 30ms OFF)
-				EmitIR(START_PWM);	
+				// the pulses go out by themselves
     }
     // return either Event, if you don't want to allow the lower level machine
     // to remap the current event, or ReturnEvent if you do want to allow it.
@@ -306,9 +188,6 @@ static ES_Event DuringWaiting4Ball( ES_Event Event)
     // If Event is ES_ENTRY or ES_ENTRY_HISTORY 
     if ( (Event.EventType == ES_ENTRY) || (Event.EventType == ES_ENTRY_HISTORY) )
     {
-      // Stop sending IR pulses
-			EmitIR(STOP_PWM);	
-
 			// Start 3 second timer
 			ES_Timer_InitTimer(Waitin4Ball_TIMER, TimeWaiting4Ball);
     }
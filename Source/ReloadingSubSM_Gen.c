@@ -0,0 +1,111 @@
+/****************************************************************************
+ Module
+   ReloadingSubSM_Gen.c
+
+ Description
+   Transition table and Run/Start/Query functions for the Reloading state
+   machine. GENERATED by Tools/StatechartGen.py from
+   Tools/Statecharts/ReloadingSubSM.yaml -- edit the spec and regenerate.
+****************************************************************************/
+/*----------------------------- Include Files -----------------------------*/
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "ES_Statechart.h"
+#include "ReloadingSubSM.h"
+#include "SMProfiler.h"
+
+/*---------------------------- Module Functions ---------------------------*/
+// During functions in ReloadingState_t order, supplied by ReloadingSubSM.c
+extern const ES_SCDuring_t ReloadingDuringFuncs[NUM_RELOADING_STATES];
+
+/*---------------------------- Module Variables ---------------------------*/
+static ReloadingState_t CurrentState;
+
+// entries left out are SC_NO_TRANSITION
+static const ES_SCTransition_t TransitionTable[NUM_RELOADING_STATES][NUM_ES_EVENTS] =
+{
+  [REQUESTING_BALL][IR_PULSES_DONE] = { WAITING4BALL, SC_TAKEN, 0 },
+  [WAITING4BALL][RELOAD_BALLS] = { REQUESTING_BALL, SC_TAKEN, 0 }
+};
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+    RunReloadingSM
+
+ Description
+   Runs the During function for the current state, then looks up
+   (CurrentState, EventType) in the transition table
+****************************************************************************/
+ES_Event RunReloadingSM( ES_Event CurrentEvent )
+{
+   const ES_SCTransition_t *pTransition;
+   ES_Event EntryEventKind = { ES_ENTRY, 0 };// default to normal entry to new state
+   ES_Event ReturnEvent = CurrentEvent; // assume we are not consuming event
+
+   CurrentEvent = ReloadingDuringFuncs[CurrentState](CurrentEvent);
+   if ( CurrentEvent.EventType == ES_NO_EVENT )
+   {  // consumed by a lower level machine
+      return(CurrentEvent);
+   }
+
+   pTransition = &TransitionTable[CurrentState][CurrentEvent.EventType];
+   if ( ((pTransition->Flags & SC_TAKEN) == 0) ||
+        (((pTransition->Flags & SC_GUARDED) != 0) &&
+         (pTransition->Param != CurrentEvent.EventParam)) )
+   {
+      return(ReturnEvent);
+   }
+
+   if ( (pTransition->Flags & SC_PASS) == 0 )
+   {
+      ReturnEvent.EventType = ES_NO_EVENT; // consume for the upper level state machine
+   }
+   if ( (pTransition->Flags & SC_INTERNAL) == 0 )
+   {
+      SMProf_Transition(PROF_RELOADING, CurrentState, pTransition->NextState, CurrentEvent.EventType);
+      //   Execute exit function for current state
+      CurrentEvent.EventType = ES_EXIT;
+      RunReloadingSM(CurrentEvent);
+
+      CurrentState = (ReloadingState_t)pTransition->NextState; //Modify state variable
+
+      //   Execute entry function for new state
+      if ( (pTransition->Flags & SC_HISTORY) != 0 )
+      {
+         EntryEventKind.EventType = ES_ENTRY_HISTORY;
+      }
+      RunReloadingSM(EntryEventKind);
+   }
+   return(ReturnEvent);
+}
+
+/****************************************************************************
+ Function
+     StartReloadingSM
+
+ Description
+     Enters REQUESTING_BALL unless asked for a history entry
+****************************************************************************/
+void StartReloadingSM ( ES_Event CurrentEvent )
+{
+   if ( ES_ENTRY_HISTORY != CurrentEvent.EventType )
+   {
+      CurrentState = REQUESTING_BALL;
+   }
+   SMProf_Enter(PROF_RELOADING, CurrentState);
+   // call the entry function (if any) for the ENTRY_STATE
+   RunReloadingSM(CurrentEvent);
+}
+
+/****************************************************************************
+ Function
+     QueryReloadingSM
+
+ Description
+     Returns the current state of this state machine
+****************************************************************************/
+ReloadingState_t QueryReloadingSM ( void )
+{
+   return(CurrentState);
+}
@@ -42,13 +42,21 @@
 #include "SPIService.h"
 #include "HallEffectModule.h"
 #include "WireSensingModule.h"
+#include "WireFollowModule.h"
 #include "IRBeaconModule.h"
+#include "IRGoertzelModule.h"
 #include "LEDModule.h"
 #include "ReloadingSubSM.h"
 #include "MotorActionsModule.h"
+#include "OdometryModule.h"
+#include "FlywheelModule.h"
+#include "ServoModule.h"
+#include "BatteryModule.h"
 #include "PWMModule.h"
 #include "EventCheckers.h"
 #include "CheckingInSubSM.h"
+#include "SMProfiler.h"
+#include "InputRecorder.h"
 
 // the common headers for C99 types 
 #include <stdint.h>
@@ -146,10 +154,8 @@
 #define ONE_SEC 976
 #define WireFollow_TIME ONE_SEC/50
 #define PWMOffset 70
-#define PWMProportionalGain 0.15 //0.10
-#define PWMDerivativeGain 0.1
 #define NoWireDetectedReading 2000
-// Good try: Timer=1/50s, offset=70, Proportional=0.15, Derivative=0.1
+// the PID itself runs at 1kHz in WireFollowModule.c
 
 // MotorActionDefines
 #define FORWARD 1
@@ -176,8 +182,6 @@ static void InitGameTimer(void);
 static void SetTimeoutAndStartGameTimer( uint32_t GameTimerTimeoutMS );
 static void InitGetAwayTimer(void);
 
-static void Drivin( void );
-
 
 /*---------------------------- Module Variables ---------------------------*/
 // everybody needs a state variable, though if the top level state machine
@@ -188,13 +192,6 @@ static bool TeamColor;
 
 static RobotState_t CurrentState;
 static uint8_t MyPriority;
-static uint16_t PeriodCode;
-static int RLCReading[2]; //RLCReading[0] = Left Sensor Reading; RLCReading[1] = Right Sensor Reading
-static int RLCReading_Left;
-static int RLCReading_Right;
-static int PositionDifference;
-static int LastPositionDifference = 0;
-static int PositionDifference_dt;
 static bool CheckOnWireFlag_Left;
 static bool CheckOnWireFlag_Right;
 static bool FirstTimeDriving = 1;
@@ -206,14 +203,12 @@ static uint16_t LastButtonState;
 static uint8_t BallCount = 3; //We will start with 3 balls
 static uint8_t CurrentStagingArea;
 static uint8_t NextStagingArea;
-static uint16_t LastPeriodCode = 0xff;
 static uint16_t PeriodCodeCounter = 0;
 static uint16_t MaxPeriodCodeCount = 5;
 static uint8_t NumberOfCorrectReports = 0;
 static uint8_t newRead;
 static bool ValidSecondCode = 1;
 static uint32_t OneShotTimeoutMS;
-static uint16_t LastPeriodCode;
 static uint16_t GetAwayTimeoutMS = 3000;
 static bool HallEffectFlag = 0;
 
@@ -257,16 +252,35 @@ bool InitRobotTopSM ( uint8_t Priority )
 	
   InitializeTeamButtonsHardware();   
 	
+	// LED shift register on SSI1, once; LED calls after this only queue a byte
+	InitLEDs();
+	
 	// Initialize PWM hardware to drive the motors
 	InitializePWM();
 	
+	// Wheel commands and their ramps
+	InitMotorActions();
+	
+	// Wheel encoders, pose and the wheel speed loop's tick
+	InitOdometry();
+	
 	// Initialize RLC hardware 
 	InitRLCSensor();
 	
+	// Battery voltage on the third ADC channel, for the duty cycle feed-forward
+	InitBattery();
+	
+	// Wire following control loop, off until a driving state turns it on
+	InitWireFollow();
+	
 	// Initialize hardware for IR but not kicking the timer off 
 	InitInputCaptureForFrontIRDetection();
 	InitInputCaptureForBackIRDetection();
 	
+	// Goertzel beacon detector on the front IR phototransistor, off until
+	// something needs it
+	InitIRGoertzel();
+	
 	// Initialize stage area frequency reading
 	InitStagingAreaISR();
 	
@@ -276,8 +290,15 @@ bool InitRobotTopSM ( uint8_t Priority )
 	// Initialize game timer,  one-shot
 	InitGameTimer();
 
-	// Initialize Fly wheel, IR emitter, and servo pwm
+	// Initialize Fly wheel and IR emitter pwm
 	InitializeAltPWM();
+	
+	// Ball separator servo, holding the gate closed
+	InitServo();
+	Servo_SetPulseUS(SEPARATOR_CLOSED_US);
+	
+	// Flywheel tach and speed loop, the flywheel stays off
+	InitFlywheel();
 
 	// Start the Master State machine
   StartRobotTopSM( ThisEvent );
@@ -354,17 +375,17 @@ ES_Event RunRobotTopSM( ES_Event CurrentEvent )
 			 // Process events				
 			 if (CurrentEvent.EventType == STATION_REACHED)
 				{
-					 printf("\r\nReceived STATION_REACHED event at DRIVING2STAGING state \r\n");
+					 // stop on the station before anything else, then see how long
+					 // it took from the edge that confirmed it
+					 EnableWireFollow(false);
+					 brakeStop(MOTOR_STOP_BRAKE_MS);
+					 MarkStagingAreaStop();
+					 CurrentStagingCode = CurrentEvent.EventParam;
+					 printf("\r\nReceived STATION_REACHED event at DRIVING2STAGING state, pcode %x \r\n", CurrentStagingCode);
 					 NextState = CHECKING_IN;
 					 MakeTransition = true;
 					 ReturnEvent.EventType = ES_NO_EVENT;
 				}
-				else if (CurrentEvent.EventType == ES_TIMEOUT && (CurrentEvent.EventParam == WireFollow_TIMER))
-				{		
-					 // Internal self transition
-					 NextState = DRIVING2STAGING;
-					 ReturnEvent.EventType = ES_NO_EVENT;
-				}
 
 				break;
 				
@@ -376,10 +397,16 @@ ES_Event RunRobotTopSM( ES_Event CurrentEvent )
 			 if (CurrentEvent.EventType == CHECK_IN_SUCCESS) 
        {
 				  printf("\r\nReceive CHECK_IN_SUCCESS event\r\n");
+					// where we shoot from sets the flywheel speed
+					CurrentStagingArea = CurrentEvent.EventParam;
 					NextState = SHOOTING;
 					MakeTransition = true; 
 				 stop();
 			 }
+			 if(CurrentEvent.EventType == STATION_LOST)
+			 {
+				 printf("\r\nLost the staging area field while checking in\r\n");
+			 }
 			 if(CurrentEvent.EventType == KEEP_DRIVING)
 			 {
 				 	NextState = DRIVING2STAGING;
@@ -411,11 +438,25 @@ ES_Event RunRobotTopSM( ES_Event CurrentEvent )
 				{
 					NextState = DRIVING2STAGING;
 					MakeTransition = true;
+				}
+				else if (CurrentEvent.EventType == BATTERY_LOW)
+				{
+					// the flywheel can't hold the targets any more: bring them down
+					// to what the pack gives and shoot on
+					Fly_LimitForSupply(CurrentEvent.EventParam);
+					printf("\r\nBattery low: %u mV, flywheel targets lowered\r\n", (unsigned)CurrentEvent.EventParam);
+				}
+				else if (CurrentEvent.EventType == ALIGN_FAILED)
+				{
+					// the goal wasn't found both ways, try from another staging area
+					NextState = DRIVING2STAGING;
+					MakeTransition = true;
 				}			 			
 				else if (CurrentEvent.EventType == MISSED_SHOT )
 				{
-					NextState = SHOOTING; // EXTERNAL Self transition
-					MakeTransition = true; 
+					// INTERNAL Self transition: the sub SM shoots the next ball
+					// with the flywheel still spinning
+					NextState = SHOOTING;
 					break;
 				}
 				else if (CurrentEvent.EventType ==  NO_BALLS)
@@ -475,6 +516,7 @@ ES_Event RunRobotTopSM( ES_Event CurrentEvent )
     if (MakeTransition == true)
     {
 			 printf("\r\n Transition: current %i,next %i\r\n",CurrentState,NextState);
+       SMProf_Transition(PROF_ROBOT_TOP, CurrentState, NextState, CurrentEvent.EventType);
        //   Execute exit function for current state
        CurrentEvent.EventType = ES_EXIT;
        RunRobotTopSM(CurrentEvent);
@@ -514,6 +556,7 @@ void StartRobotTopSM ( ES_Event CurrentEvent )
 	//CurrentState = DRIVING2STAGING;
 	CurrentState = WAITING2START;
 	//CurrentState = DRIVING2RELOAD;
+	SMProf_Enter(PROF_ROBOT_TOP, CurrentState);
 	
   // now we need to let the Run function init the lower level state machines
   // use LocalEvent to keep the compiler from complaining about unused var
@@ -617,73 +660,19 @@ static ES_Event DuringDriving2Staging( ES_Event Event)
 			// Look for staging area (hall effect)
 			EnableStagingAreaISR(1);
 			
-			// When getting into this state from other states,
-			// Start the timer to periodically read the sensor values
-			ES_Timer_InitTimer(WireFollow_TIMER,WireFollow_TIME);
+			// Follow the wire, the control loop reads the RLC sensors and
+			// drives the wheels on its own from here
+			SetWireFollowSpeed(PWMOffset);
+			EnableWireFollow(true);
 
     }
     else if ( Event.EventType == ES_EXIT )
     {	
+			EnableWireFollow(false);
     }
 		
 		// ----- DURING
-		else if ((Event.EventType == ES_TIMEOUT) && (Event.EventParam == WireFollow_TIMER))
-    {
-			// Read the RLC sensor values
-			ReadRLCSensor(RLCReading);
-			RLCReading_Right = RLCReading[1];
-			RLCReading_Left = RLCReading[0];
-			
-			// Positive when too left (right at higher voltage)
-			// Negative when too right (left at higher voltage)
-			PositionDifference = RLCReading_Right - RLCReading_Left;
-			PositionDifference_dt = (PositionDifference - LastPositionDifference);
-			LastPositionDifference = PositionDifference;
-			
-			// PD Control
-			int PWMLeft = (float)PWMOffset + (float)PWMProportionalGain * PositionDifference + (float)PWMDerivativeGain * PositionDifference_dt;
-			int PWMRight = (float)PWMOffset - (float)PWMProportionalGain * PositionDifference - (float)PWMDerivativeGain * PositionDifference_dt;
-				
-			//Clamp the value to 0-100
-			if(PWMLeft < 0){
-				PWMLeft = 0;
-			}else if(PWMLeft > 100){
-				PWMLeft = 100;
-			}
-				
-			if(PWMRight < 0){
-				PWMRight = 0;
-			}else if(PWMRight > 100){
-				PWMRight = 100;
-			}
-			
-			// Drive the motors using new PWM duty cycles
-			driveSeperate(PWMLeft,PWMRight,FORWARD);		
-			printf("\r\nLeft=%d,Right=%d,PWM Left=%d,PWM Right=%d\r\n",RLCReading_Left,RLCReading_Right,PWMLeft,PWMRight);
-			
-			// Restart the timer
-			ES_Timer_InitTimer(WireFollow_TIMER,WireFollow_TIME);
-			
-			// Check if a staging area has been reached
-			PeriodCode = GetStagingAreaCodeArray();
-			
-			if((PeriodCode != codeInvalidStagingArea) && (PeriodCode != LastPeriodCode))//&&(PeriodCode != CurrentStagingCode4Redriving))
-			{ 
-				CurrentStagingCode = PeriodCode;
-				
-				// save last period code 
-				LastPeriodCode = PeriodCode;
-				
-				// post to Top SM
-				ES_Event Event2Post;
-				Event2Post.EventType = STATION_REACHED;
-				Event2Post.EventParam = PeriodCode;
-				printf("\r\n ------------STATION_REACHED posted, pcode-----------   %x",PeriodCode);
-				PostRobotTopSM(Event2Post);
-			}
-    }
-		
-		LastPeriodCode = PeriodCode;
+		// staging areas come in as STATION_REACHED from StagingAreaISR
 
     // return either Event, if you don't want to allow the lower level machine
     // to remap the current event, or ReturnEvent if you do want to allow it.
@@ -743,6 +732,9 @@ static ES_Event DuringShooting( ES_Event Event)
 			  //Yellow LEDs ON to signal shooting is going to start
 				TurnOnOffYellowLEDs(LEDS_ON, TeamColor);
 			
+				// a battery that went low on the way shoots at what it can hold
+				Fly_LimitForSupply(Battery_IsLow() ? Battery_GetMV() : 0);
+			
         // start any lower level machines that run in this state
         StartShootingSM(Event);  	
     }
@@ -750,6 +742,9 @@ static ES_Event DuringShooting( ES_Event Event)
     {
         // on exit, give the lower levels a chance to clean up first
         RunShootingSM(Event);   
+				
+				// the flywheel spins from the first ball to the last
+				Fly_SetTargetRPM(0);
     }
 		
 		// do the 'during' function for this state
@@ -816,13 +811,14 @@ static ES_Event DuringDriving2Reload( ES_Event Event)
     }
     else if ( Event.EventType == ES_EXIT )
     {
+			EnableWireFollow(false);
 			// disable BackIRInterrupt (SEE ME: finish)
     }
 		
 		// do the 'during' function for this state
 		else 
 		{
-			if (Event.EventType == ES_TIMEOUT && (Event.EventParam == WireFollow_TIME))
+			if (Event.EventType == ES_TIMEOUT && (Event.EventParam == WireFollow_TIMER))
 			{
 				
 				// Read the detected IR frequency
@@ -854,15 +850,19 @@ static ES_Event DuringDriving2Reload( ES_Event Event)
 							OrientedWithWire_Driving2Reload = 1;
 						}
 					}
-					}else if (OrientedWithWire_Driving2Reload == 1) 
-					{
-						// Drive
-						printf("\r\n drivin");
-						Drivin();
 					}
 				
-				// Reinitialize timer
-				ES_Timer_InitTimer(WireFollow_TIMER,WireFollow_TIME);
+				if (OrientedWithWire_Driving2Reload == 1)
+				{
+					// lined up, the control loop follows the wire from here
+					SetWireFollowSpeed(PWMOffset);
+					EnableWireFollow(true);
+				}
+				else
+				{
+					// Reinitialize timer
+					ES_Timer_InitTimer(WireFollow_TIMER,WireFollow_TIME);
+				}
 			}
 		}
 
@@ -1050,7 +1050,7 @@ GAME TIMER
 		2 min timeout to move onto strategy state
 ****************************************************************************/
 
-static void InitGameTimer() //Wide Timer 1 subtimer B
+static void InitGameTimer() //Wide Timer 1 subtimer A, B is the front IR capture
 {	
 	// start by enabling the clock to the timer (Wide Timer 1)
 	HWREG(SYSCTL_RCGCWTIMER) |= SYSCTL_RCGCWTIMER_R1;
@@ -1058,27 +1058,27 @@ static void InitGameTimer() //Wide Timer 1 subtimer B
 	// kill a few cycles to let the clock get going
 	while((HWREG(SYSCTL_PRWTIMER) & SYSCTL_PRWTIMER_R1) != SYSCTL_PRWTIMER_R1){}
 
-	// make sure that timer (Timer B) is disabled before configuring
-	HWREG(WTIMER1_BASE+TIMER_O_CTL) &= ~TIMER_CTL_TBEN; //TAEN = Bit1
+	// make sure that timer (Timer A) is disabled before configuring
+	HWREG(WTIMER1_BASE+TIMER_O_CTL) &= ~TIMER_CTL_TAEN; //TAEN = Bit0
 
 	// set it up in 32bit wide (individual, not concatenated) mode
 	// the constant name derives from the 16/32 bit timer, but this is a 32/64
 	// bit timer so we are setting the 32bit mode
 	HWREG(WTIMER1_BASE+TIMER_O_CFG) = TIMER_CFG_16_BIT; //bits 0-2 = 0x04
 
-	// set up timer B in 1-shot mode so that it disables timer on timeouts
+	// set up timer A in 1-shot mode so that it disables timer on timeouts
 	// first mask off the TAMR field (bits 0:1) then set the value for
 	// 1-shot mode = 0x01
-	HWREG(WTIMER1_BASE+TIMER_O_TBMR) = (HWREG(WTIMER1_BASE+TIMER_O_TBMR)& ~TIMER_TBMR_TBMR_M)| TIMER_TBMR_TBMR_1_SHOT;
+	HWREG(WTIMER1_BASE+TIMER_O_TAMR) = (HWREG(WTIMER1_BASE+TIMER_O_TAMR)& ~TIMER_TAMR_TAMR_M)| TIMER_TAMR_TAMR_1_SHOT;
 	
 	// set timeout
 	OneShotTimeoutMS = 1000; //arbitrary initialization value
-	HWREG(WTIMER1_BASE+TIMER_O_TBILR) = TicksPerMS*OneShotTimeoutMS;
+	HWREG(WTIMER1_BASE+TIMER_O_TAILR) = TicksPerMS*OneShotTimeoutMS;
 	
-	// enable a local timeout interrupt. TBTOIM = bit 1
-	HWREG(WTIMER1_BASE+TIMER_O_IMR) |= TIMER_IMR_TBTOIM; // bit1
+	// enable a local timeout interrupt. TATOIM = bit 0
+	HWREG(WTIMER1_BASE+TIMER_O_IMR) |= TIMER_IMR_TATOIM; // bit0
 
-	// enable the Timer B in Wide Timer 1 interrupt in the NVIC
+	// enable the Timer A in Wide Timer 1 interrupt in the NVIC
 	// it is interrupt number 96 so appears in EN3 at bit 0
 	HWREG(NVIC_EN3) |= BIT0HI;
 	
@@ -1094,16 +1094,18 @@ static void InitGameTimer() //Wide Timer 1 subtimer B
 static void SetTimeoutAndStartGameTimer( uint32_t GameTimerTimeoutMS )
 {
 	// set timeout
-	HWREG(WTIMER1_BASE+TIMER_O_TBILR) = TicksPerMS*GameTimerTimeoutMS;
+	HWREG(WTIMER1_BASE+TIMER_O_TAILR) = TicksPerMS*GameTimerTimeoutMS;
 	
 	// now kick the timer off by enabling it and enabling the timer to stall while stopped by the debugger
-	HWREG(WTIMER1_BASE+TIMER_O_CTL) |= (TIMER_CTL_TBEN | TIMER_CTL_TBSTALL);
+	HWREG(WTIMER1_BASE+TIMER_O_CTL) |= (TIMER_CTL_TAEN | TIMER_CTL_TASTALL);
 }
 
 void GameTimerISR(void) 
 {	
+	REC_IRQ(REC_IRQ_GAME_TIMER);
+
 	// clear interrupt
-	HWREG(WTIMER1_BASE+TIMER_O_ICR) = TIMER_ICR_TBTOCINT; 
+	HWREG(WTIMER1_BASE+TIMER_O_ICR) = TIMER_ICR_TATOCINT; 
 	
 	// post event to go into ENDING_STRATEGY state
 	ES_Event PostEvent;
@@ -1169,6 +1171,8 @@ void EnableGetAwayTimer( uint16_t GetAwayTimeoutMS )
 
 void GetAwayISR()
 {
+	REC_IRQ(REC_IRQ_GET_AWAY);
+
 	if(ShootingFlag)
 	{
 		// clear interrupt
@@ -1179,53 +1183,14 @@ void GetAwayISR()
 	}
 	else
 	{
-		//stop ball separator
-		SetServoDuty(0);
+		//stop the ball separator
+		Servo_Off();
 	}
 }
 
 uint8_t returnCurrentStageCode(){
 	return CurrentStagingCode;
 }
-static void Drivin( void ){
-
-			// Read the RLC sensor values
-			ReadRLCSensor(RLCReading);
-			RLCReading_Right = RLCReading[1];
-			RLCReading_Left = RLCReading[0];
-			
-			// Positive when too left (right at higher voltage)
-			// Negative when too right (left at higher ovltage)
-			PositionDifference = RLCReading_Right - RLCReading_Left;
-			PositionDifference_dt = (PositionDifference - LastPositionDifference);
-			LastPositionDifference = PositionDifference;
-			
-			// PD Control
-			int PWMLeft = (float)PWMOffset + (float)PWMProportionalGain * PositionDifference + (float)PWMDerivativeGain * PositionDifference_dt;
-			int PWMRight = (float)PWMOffset - (float)PWMProportionalGain * PositionDifference - (float)PWMDerivativeGain * PositionDifference_dt;
-				
-			//Clamp the value to 0-100
-			if(PWMLeft < 0){
-				PWMLeft = 0;
-			}else if(PWMLeft > 100){
-				PWMLeft = 100;
-			}
-				
-			if(PWMRight < 0){
-				PWMRight = 0;
-			}else if(PWMRight > 100){
-				PWMRight = 100;
-			}
-			
-			// Drive the motors using new PWM duty cycles
-			driveSeperate(PWMLeft,PWMRight,FORWARD);		
-			
-			// Restart the timer
-			ES_Timer_InitTimer(WireFollow_TIMER,WireFollow_TIME);
-			
-			// Check if a staging area has been reached
-			PeriodCode = GetStagingAreaCodeArray();
-}
 /****************************************************************************
 TESTS
 ****************************************************************************/
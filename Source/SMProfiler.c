@@ -0,0 +1,267 @@
+/****************************************************************************
+SMProfiler
+	Records how long the robot spends in each state of RobotTopSM and its
+	sub-machines, and how often each (from, to, event) transition is taken.
+	The machines call in at their MakeTransition points; 'p' on the console
+	dumps the tables and 'P' clears them.
+
+ Notes
+	Times are in framework ticks (mS) from _HW_GetLongTickCount.
+	A sub-machine is closed out when its parent leaves the state that owns it,
+	so its residency does not keep running after e.g. SHOOTING is exited.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "ES_Port.h"
+
+#include "SMProfiler.h"
+#include "RobotTopSM.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define MaxProfStates 8
+#define MaxProfTransitions 48
+#define NotActive 0xff
+
+/*---------------------------- Module Types -------------------------------*/
+typedef struct
+{
+  uint16_t Entries;
+  uint32_t TotalMS;
+  uint32_t MaxMS;
+} StateStats_t;
+
+typedef struct
+{
+  uint8_t Machine;
+  uint8_t From;
+  uint8_t To;
+  uint8_t Event;
+  uint16_t Count;
+} TransitionStats_t;
+
+typedef struct
+{
+  uint8_t Machine;
+  uint8_t State;
+} ParentState_t;
+
+/*---------------------------- Module Functions ---------------------------*/
+static void CloseState( ProfMachine_t Machine, uint32_t Now );
+static void CountTransition( ProfMachine_t Machine, uint8_t From, uint8_t To,
+                             ES_EventTyp_t Event );
+
+/*---------------------------- Module Variables ---------------------------*/
+static StateStats_t StateStats[NUM_PROF_MACHINES][MaxProfStates];
+static TransitionStats_t Transitions[MaxProfTransitions];
+static uint8_t NumTransitions;
+static uint16_t DroppedTransitions;
+static uint8_t ActiveState[NUM_PROF_MACHINES] = { NotActive, NotActive, NotActive, NotActive };
+static uint32_t EnteredAt[NUM_PROF_MACHINES];
+
+// which top level state each machine runs inside of
+static const ParentState_t ParentState[NUM_PROF_MACHINES] =
+{
+  { NotActive, NotActive },          // PROF_ROBOT_TOP
+  { PROF_ROBOT_TOP, CHECKING_IN },   // PROF_CHECKING_IN
+  { PROF_ROBOT_TOP, SHOOTING },      // PROF_SHOOTING
+  { PROF_ROBOT_TOP, RELOADING }      // PROF_RELOADING
+};
+
+// names for the dump, in the order of the state enums of each machine
+static const char * const MachineNames[NUM_PROF_MACHINES] =
+  { "RobotTop", "CheckingIn", "Shooting", "Reloading" };
+static const char * const StateNames[NUM_PROF_MACHINES][MaxProfStates] =
+{
+  { "WAITING2START", "DRIVING2STAGING", "CHECKING_IN", "SHOOTING",
+    "DRIVING2RELOAD", "RELOADING", "ENDING_STRATEGY", "STOP" },
+  { "FirstReportDone", "Waiting4FirstResponseReady", "SecondReportDone" },
+  { "PREPARING_SHOT", "FEEDING_BALL", "WATING4SHOT_COMPLETE" },
+  { "REQUESTING_BALL", "WAITING4BALL" }
+};
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+    SMProf_Enter
+
+ Description
+    Marks the entry of Machine into State without counting a transition,
+    called from the Start function of each machine
+****************************************************************************/
+void SMProf_Enter( ProfMachine_t Machine, uint8_t State )
+{
+  uint32_t Now = _HW_GetLongTickCount();
+
+  if (State >= MaxProfStates)
+  {
+    return;
+  }
+  CloseState(Machine, Now);
+  ActiveState[Machine] = State;
+  EnteredAt[Machine] = Now;
+  StateStats[Machine][State].Entries++;
+}
+
+/****************************************************************************
+ Function
+    SMProf_Transition
+
+ Description
+    Called at the MakeTransition point of a machine, before the exit function
+    runs. Closes the residency of From (and of any sub-machine running inside
+    From), counts the transition and opens the residency of To.
+****************************************************************************/
+void SMProf_Transition( ProfMachine_t Machine, uint8_t From, uint8_t To,
+                        ES_EventTyp_t Event )
+{
+  uint8_t Child;
+  uint32_t Now = _HW_GetLongTickCount();
+
+  for (Child = 0; Child < NUM_PROF_MACHINES; Child++)
+  {
+    if ((ParentState[Child].Machine == Machine) && (ParentState[Child].State == From))
+    {
+      CloseState((ProfMachine_t)Child, Now);
+    }
+  }
+  CountTransition(Machine, From, To, Event);
+  SMProf_Enter(Machine, To);
+}
+
+/****************************************************************************
+ Function
+    SMProf_Dump
+
+ Description
+    Prints the residency table and the transition table to the console.
+    The state each machine is in right now is marked with '*' and its open
+    interval is included in the totals.
+****************************************************************************/
+void SMProf_Dump( void )
+{
+  uint8_t Machine;
+  uint8_t State;
+  uint8_t i;
+  uint32_t Now = _HW_GetLongTickCount();
+
+  printf("\r\n%-11s %-27s %7s %10s %8s\r\n", "Machine", "State", "Entries", "Total ms", "Max ms");
+  for (Machine = 0; Machine < NUM_PROF_MACHINES; Machine++)
+  {
+    for (State = 0; State < MaxProfStates; State++)
+    {
+      StateStats_t Stats = StateStats[Machine][State];
+      bool IsActive = (ActiveState[Machine] == State);
+
+      if ((Stats.Entries == 0) || (StateNames[Machine][State] == NULL))
+      {
+        continue;
+      }
+      if (IsActive)
+      {
+        uint32_t Open = Now - EnteredAt[Machine];
+        Stats.TotalMS += Open;
+        if (Open > Stats.MaxMS)
+        {
+          Stats.MaxMS = Open;
+        }
+      }
+      printf("%-11s %-27s %7u %10lu %8lu%s\r\n", MachineNames[Machine],
+             StateNames[Machine][State], Stats.Entries,
+             (unsigned long)Stats.TotalMS, (unsigned long)Stats.MaxMS,
+             IsActive ? " *" : "");
+    }
+  }
+
+  printf("\r\n%-11s %-27s %-27s %5s %6s\r\n", "Machine", "From", "To", "Event", "Count");
+  for (i = 0; i < NumTransitions; i++)
+  {
+    printf("%-11s %-27s %-27s %5u %6u\r\n", MachineNames[Transitions[i].Machine],
+           StateNames[Transitions[i].Machine][Transitions[i].From],
+           StateNames[Transitions[i].Machine][Transitions[i].To],
+           Transitions[i].Event, Transitions[i].Count);
+  }
+  if (DroppedTransitions != 0)
+  {
+    printf("%u transitions not recorded, raise MaxProfTransitions\r\n", DroppedTransitions);
+  }
+}
+
+/****************************************************************************
+ Function
+    SMProf_Reset
+
+ Description
+    Clears all counters; machines that are running restart their residency now
+****************************************************************************/
+void SMProf_Reset( void )
+{
+  uint8_t Machine;
+  uint8_t State;
+  uint32_t Now = _HW_GetLongTickCount();
+
+  for (Machine = 0; Machine < NUM_PROF_MACHINES; Machine++)
+  {
+    for (State = 0; State < MaxProfStates; State++)
+    {
+      StateStats[Machine][State].Entries = 0;
+      StateStats[Machine][State].TotalMS = 0;
+      StateStats[Machine][State].MaxMS = 0;
+    }
+    EnteredAt[Machine] = Now;
+  }
+  NumTransitions = 0;
+  DroppedTransitions = 0;
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+static void CloseState( ProfMachine_t Machine, uint32_t Now )
+{
+  uint8_t State = ActiveState[Machine];
+  uint32_t Elapsed;
+
+  if (State == NotActive)
+  {
+    return;
+  }
+  Elapsed = Now - EnteredAt[Machine];
+  StateStats[Machine][State].TotalMS += Elapsed;
+  if (Elapsed > StateStats[Machine][State].MaxMS)
+  {
+    StateStats[Machine][State].MaxMS = Elapsed;
+  }
+  ActiveState[Machine] = NotActive;
+}
+
+static void CountTransition( ProfMachine_t Machine, uint8_t From, uint8_t To,
+                             ES_EventTyp_t Event )
+{
+  uint8_t i;
+
+  for (i = 0; i < NumTransitions; i++)
+  {
+    if ((Transitions[i].Machine == Machine) && (Transitions[i].From == From) &&
+        (Transitions[i].To == To) && (Transitions[i].Event == Event))
+    {
+      Transitions[i].Count++;
+      return;
+    }
+  }
+  if (NumTransitions < MaxProfTransitions)
+  {
+    Transitions[NumTransitions].Machine = Machine;
+    Transitions[NumTransitions].From = From;
+    Transitions[NumTransitions].To = To;
+    Transitions[NumTransitions].Event = Event;
+    Transitions[NumTransitions].Count = 1;
+    NumTransitions++;
+  }
+  else
+  {
+    DroppedTransitions++;
+  }
+}
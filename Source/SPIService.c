@@ -35,6 +35,7 @@
 #include "inc/hw_ssi.h"
 #include "SPIService.h"
 #include "RobotTopSM.h"
+#include "InputRecorder.h"
 
 // to print comments to the terminal
 #include <stdio.h>
@@ -240,7 +241,7 @@ ES_Event RunSPIService ( ES_Event CurrentEvent )
 				// SEE ME: put this in the isr
 				// Read lines of last received data	
 				for(int i=0; i<ReceivedLines;i++){
-					ReceivedLOCData[i] = HWREG(SSI0_BASE+SSI_O_DR);
+					ReceivedLOCData[i] = REC_SSI_BYTE(HWREG(SSI0_BASE+SSI_O_DR));
 					//printf("\r\n byte %i = %x",i,ReceivedLOCData[i]);
 				}
 				
@@ -304,6 +305,8 @@ bool PostSPIService( ES_Event ThisEvent )
 ****************************************************************************/
 void SPI_InterruptResponse( void )
 {	
+	REC_IRQ(REC_IRQ_SSI_EOT);
+
 	// clear interrupt
 	HWREG(SSI0_BASE + SSI_O_IM) &= (~SSI_IM_TXIM);
 	
@@ -371,7 +374,7 @@ static void InitSerialHardware(void)
 	HWREG(SYSCTL_RCGCGPIO)|= SYSCTL_RCGCGPIO_R0;		
 	
 	// Enable the clock to SSI module
-	HWREG(SYSCTL_RCGCSSI) = SSIModule;	
+	HWREG(SYSCTL_RCGCSSI) |= SSIModule;	
 	
 	// Wait for the GPIO port to be ready
 	while((HWREG(SYSCTL_RCGCGPIO) & SYSCTL_PRGPIO_R0) != SYSCTL_PRGPIO_R0){};
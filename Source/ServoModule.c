@@ -0,0 +1,365 @@
+/****************************************************************************
+ServoModule
+	Drives the ball separator servo on E4 from PWM0 generator 2 (M0PWM4) at
+	SERVO_RATE_HZ, with the pulse width in uS between endpoints that can be
+	set. Moves are timed: Servo_Run takes up to SERVO_MAX_SEGMENTS legs,
+	each to a pulse width in a time (a hold if it is already there), and the
+	generator's period interrupt steps the pulse along them, one step a
+	period. SERVO_MOVE_DONE goes to RobotTopSM at the end of the last leg.
+
+ Notes
+	The generator counts down at the PWM clock (40MHz/32, 0.8uS a tick):
+	the output goes high at the load and low at compare A on the way down,
+	so a new width always starts with a period.
+	Each leg eases in and out (smoothstep), so the arm starts and stops
+	without a jolt and the ball doesn't bounce out early.
+	Servo_Off stops the pulses and leaves the servo limp, where it no longer
+	holds its position; only the end of the game does that.
+	An input log records SERVO_MOVE_DONE going out. The host replay doesn't
+	run the period interrupt, so Servo_ReplayMoveDone ends the move there.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "inc/hw_sysctl.h"
+#include "inc/hw_gpio.h"
+#include "inc/hw_pwm.h"
+#include "inc/hw_nvic.h"
+
+#include "ES_Port.h"
+#include "BITDEFS.H"
+
+#include "ServoModule.h"
+#include "RobotTopSM.h"
+#include "InputRecorder.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+// PWM clock, set up by InitializePWM: 40MHz/32 is 5 ticks every 4uS
+#define PWMTicksPerSecond (40000000/32)
+#define USToTicks(US) (((uint32_t)(US)*5) >> 2)
+#define ServoLoad (PWMTicksPerSecond/SERVO_RATE_HZ - 1)
+// PWM0 generator 2 is interrupt 12
+#define PWM0Gen2IntBit BIT12HI
+#define ServoPin BIT4HI                        // E4
+#define ServoPinNumber 4
+#define M0PWM4Function 4
+#define BitsPerNibble 4
+
+#define ServoGenPulse (PWM_X_GENA_ACTLOAD_ONE | PWM_X_GENA_ACTCMPAD_ZERO)
+#define ServoGenOff PWM_X_GENA_ACTZERO_ZERO
+
+// standard hobby servo travel until set otherwise
+#define DefaultMinUS 1000
+#define DefaultMaxUS 2000
+
+// smoothstep works in Q15
+#define Q15One 32768
+
+/*---------------------------- Module Functions ---------------------------*/
+static void WritePulse( uint16_t PulseUS );
+static void StartSegment( uint8_t Index );
+static uint16_t Clamp( uint16_t PulseUS );
+static uint16_t Ease( uint16_t Start, uint16_t End, uint32_t Step, uint32_t Steps );
+
+/*---------------------------- Module Variables ---------------------------*/
+static uint16_t MinUS = DefaultMinUS;
+static uint16_t MaxUS = DefaultMaxUS;
+// width on the pin, 0 while off
+static uint16_t Pulse;
+
+// move in progress
+static ServoSegment_t Segments[SERVO_MAX_SEGMENTS];
+static uint8_t NumSegments;
+static uint8_t Segment;
+static uint16_t From;
+static uint32_t Elapsed;
+static uint32_t Periods;
+static volatile bool Moving;
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+    InitServo
+
+ Description
+    Sets PWM0 generator 2 up at SERVO_RATE_HZ on E4, with no pulses until
+    the first command. Call after InitializePWM, which starts the PWM0
+    clock and divider.
+****************************************************************************/
+void InitServo( void )
+{
+  // enable the clocks to PWM0 and port E
+  HWREG(SYSCTL_RCGCPWM) |= SYSCTL_RCGCPWM_R0;
+  HWREG(SYSCTL_RCGCGPIO) |= SYSCTL_RCGCGPIO_R4;
+  while ((HWREG(SYSCTL_PRPWM) & SYSCTL_PRPWM_R0) != SYSCTL_PRPWM_R0)
+    ;
+
+  // down count, compare and action updates at the end of a period
+  HWREG(PWM0_BASE + PWM_O_2_CTL) = 0;
+  HWREG(PWM0_BASE + PWM_O_2_LOAD) = ServoLoad;
+  HWREG(PWM0_BASE + PWM_O_2_CMPA) = ServoLoad - USToTicks(DefaultMinUS);
+  HWREG(PWM0_BASE + PWM_O_2_GENA) = ServoGenOff;
+  Pulse = 0;
+  Moving = false;
+
+  // an interrupt at every load, the start of a period
+  HWREG(PWM0_BASE + PWM_O_2_ISC) = PWM_X_ISC_INTCNTLOAD;
+  HWREG(PWM0_BASE + PWM_O_2_INTEN) = PWM_X_INTEN_INTCNTLOAD;
+  HWREG(PWM0_BASE + PWM_O_INTEN) |= PWM_INTEN_INTPWM2;
+  HWREG(NVIC_EN0) |= PWM0Gen2IntBit;
+
+  HWREG(PWM0_BASE + PWM_O_ENABLE) |= PWM_ENABLE_PWM4EN;
+
+  // route E4 to M0PWM4
+  HWREG(GPIO_PORTE_BASE + GPIO_O_AFSEL) |= ServoPin;
+  HWREG(GPIO_PORTE_BASE + GPIO_O_PCTL) =
+    (HWREG(GPIO_PORTE_BASE + GPIO_O_PCTL) & ~(0xf << (BitsPerNibble*ServoPinNumber))) +
+    (M0PWM4Function << (BitsPerNibble*ServoPinNumber));
+  HWREG(GPIO_PORTE_BASE + GPIO_O_DEN) |= ServoPin;
+  HWREG(GPIO_PORTE_BASE + GPIO_O_DIR) |= ServoPin;
+
+  HWREG(PWM0_BASE + PWM_O_2_CTL) = PWM_X_CTL_ENABLE;
+
+  // make sure interrupts are enabled globally
+  __enable_irq();
+}
+
+/****************************************************************************
+ Function
+    Servo_SetEndpoints
+
+ Description
+    The narrowest and widest pulses the servo may be given; every command
+    is clamped to them
+****************************************************************************/
+void Servo_SetEndpoints( uint16_t NewMinUS, uint16_t NewMaxUS )
+{
+  EnterCritical();
+  MinUS = NewMinUS;
+  MaxUS = NewMaxUS;
+  ExitCritical();
+}
+
+/****************************************************************************
+ Function
+    Servo_SetPulseUS, Servo_Off
+
+ Description
+    Goes straight to a pulse width, or stops the pulses; either cancels a
+    move without SERVO_MOVE_DONE
+****************************************************************************/
+void Servo_SetPulseUS( uint16_t PulseUS )
+{
+  EnterCritical();
+  Moving = false;
+  WritePulse(Clamp(PulseUS));
+  ExitCritical();
+}
+
+void Servo_Off( void )
+{
+  EnterCritical();
+  Moving = false;
+  WritePulse(0);
+  ExitCritical();
+}
+
+/****************************************************************************
+ Function
+    Servo_MoveTo
+
+ Description
+    A move of one leg, to PulseUS in TimeMS
+****************************************************************************/
+void Servo_MoveTo( uint16_t PulseUS, uint16_t TimeMS )
+{
+  ServoSegment_t Leg;
+
+  Leg.PulseUS = PulseUS;
+  Leg.TimeMS = TimeMS;
+  Servo_Run(&Leg, 1);
+}
+
+/****************************************************************************
+ Function
+    Servo_Run
+
+ Parameters
+    const ServoSegment_t * : the legs of the move, copied
+    uint8_t : how many, up to SERVO_MAX_SEGMENTS
+
+ Description
+    Starts a move from where the servo is now, replacing one in progress.
+    From off the servo's position isn't known, so the first leg starts
+    at its own end.
+****************************************************************************/
+void Servo_Run( const ServoSegment_t *pSegments, uint8_t Count )
+{
+  uint8_t i;
+
+  if (Count > SERVO_MAX_SEGMENTS)
+  {
+    Count = SERVO_MAX_SEGMENTS;
+  }
+  if (Count == 0)
+  {
+    return;
+  }
+
+  EnterCritical();
+  for (i = 0; i < Count; i++)
+  {
+    Segments[i].PulseUS = Clamp(pSegments[i].PulseUS);
+    Segments[i].TimeMS = pSegments[i].TimeMS;
+  }
+  NumSegments = Count;
+  if (Pulse == 0)
+  {
+    WritePulse(Segments[0].PulseUS);
+  }
+  StartSegment(0);
+  Moving = true;
+  ExitCritical();
+}
+
+/****************************************************************************
+ Function
+    Servo_IsMoving, Servo_GetPulseUS
+
+ Description
+    Whether a move is in progress, and the width going out now (0 if off)
+****************************************************************************/
+bool Servo_IsMoving( void )
+{
+  return Moving;
+}
+
+uint16_t Servo_GetPulseUS( void )
+{
+  return Pulse;
+}
+
+/****************************************************************************
+ Function
+    ServoPeriodISR
+
+ Description
+    PWM0 generator 2 load: one step of a move, the width for the next
+    period
+****************************************************************************/
+void ServoPeriodISR( void )
+{
+  ES_Event ThisEvent;
+
+  // clear the source of the interrupt
+  HWREG(PWM0_BASE + PWM_O_2_ISC) = PWM_X_ISC_INTCNTLOAD;
+
+  if (!Moving)
+  {
+    return;
+  }
+
+  Elapsed++;
+  WritePulse(Ease(From, Segments[Segment].PulseUS, Elapsed, Periods));
+  if (Elapsed < Periods)
+  {
+    return;
+  }
+
+  // on to the next leg, or done
+  if (Segment + 1 < NumSegments)
+  {
+    StartSegment(Segment + 1);
+    return;
+  }
+  Moving = false;
+  REC_IRQ(REC_IRQ_SERVO_DONE);
+  ThisEvent.EventType = SERVO_MOVE_DONE;
+  ThisEvent.EventParam = Pulse;
+  PostRobotTopSM(ThisEvent);
+}
+
+#if defined(REPLAY_INPUTS)
+/****************************************************************************
+ Function
+    Servo_ReplayMoveDone
+
+ Description
+    Stands in for the end of a move on a host replay: the servo is at the
+    last leg's width
+****************************************************************************/
+void Servo_ReplayMoveDone( void )
+{
+  ES_Event ThisEvent;
+
+  if (Moving)
+  {
+    WritePulse(Segments[NumSegments - 1].PulseUS);
+  }
+  Moving = false;
+  ThisEvent.EventType = SERVO_MOVE_DONE;
+  ThisEvent.EventParam = Pulse;
+  PostRobotTopSM(ThisEvent);
+}
+#endif
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+/***************************************************************************
+  WritePulse
+    Puts a width on the pin from the next period on, 0 for no pulses
+ ***************************************************************************/
+static void WritePulse( uint16_t PulseUS )
+{
+  if (PulseUS == 0)
+  {
+    HWREG(PWM0_BASE + PWM_O_2_GENA) = ServoGenOff;
+  }
+  else
+  {
+    HWREG(PWM0_BASE + PWM_O_2_CMPA) = ServoLoad - USToTicks(PulseUS);
+    if (Pulse == 0)
+    {
+      HWREG(PWM0_BASE + PWM_O_2_GENA) = ServoGenPulse;
+    }
+  }
+  Pulse = PulseUS;
+}
+
+/***************************************************************************
+  StartSegment
+    Starts a leg from the width now
+ ***************************************************************************/
+static void StartSegment( uint8_t Index )
+{
+  Segment = Index;
+  From = Pulse;
+  Elapsed = 0;
+  Periods = ((uint32_t)Segments[Index].TimeMS*SERVO_RATE_HZ + 999)/1000;
+  if (Periods == 0)
+  {
+    Periods = 1;
+  }
+}
+
+static uint16_t Clamp( uint16_t PulseUS )
+{
+  return (PulseUS < MinUS) ? MinUS : ((PulseUS > MaxUS) ? MaxUS : PulseUS);
+}
+
+/***************************************************************************
+  Ease
+    The width Step periods into a leg of Steps from Start to End, on
+    3t^2 - 2t^3
+ ***************************************************************************/
+static uint16_t Ease( uint16_t Start, uint16_t End, uint32_t Step, uint32_t Steps )
+{
+  uint32_t t = (Step >= Steps) ? Q15One : (Step*Q15One/Steps);
+  uint32_t s = (((t*t) >> 15)*(3*Q15One - 2*t)) >> 15;
+
+  return (uint16_t)((int32_t)Start + ((((int32_t)End - Start)*(int32_t)s) >> 15));
+}
@@ -3,29 +3,41 @@
    ShiftRegisterWrite.c
 
  Revision
-   1.0.1
+   2.0.0
 
  Description
    This module acts as the low level interface to a write only shift register.
 
  Notes
+   SSI1 shifts the bits out, so SR_Write only puts the byte in the transmit
+   FIFO and returns: 8 bits at 1MHz go out on their own while the caller
+   carries on. In Freescale SPI mode 0 the frame select drops for the frame
+   and rises after the 8th bit, which is the register clock's latch edge.
+     PD0  SSI1Clk  to SRCLK
+     PD1  SSI1Fss  to RCLK
+     PD3  SSI1Tx   to SER
+   All three wires differ from the old bit-banged harness (see the pin map
+   in README.md).
+   A write of the value already in the register is skipped, so the LEDs
+   can be set from entry code every time without costing a frame.
 
  History
  When           Who     What/Why
  -------------- ---     --------
  10/11/15 19:55 jec     first pass
  10/22/15 20:36 Elena   second pass
- 
+
 ****************************************************************************/
-// the common headers for C99 types 
+// the common headers for C99 types
 #include <stdint.h>
 #include <stdbool.h>
 
-// the headers to access the GPIO subsystem
+// the headers to access the GPIO and SSI subsystems
 #include "inc/hw_memmap.h"
 #include "inc/hw_types.h"
 #include "inc/hw_gpio.h"
 #include "inc/hw_sysctl.h"
+#include "inc/hw_ssi.h"
 
 // the headers to access the TivaWare Library
 #include "driverlib/sysctl.h"
@@ -35,23 +47,25 @@
 #include "driverlib/interrupt.h"
 
 #include "BITDEFS.H"
+#include "ShiftRegisterWrite.h"
 
 // readability defines
-#define DATA GPIO_PIN_0
-
-#define SCLK GPIO_PIN_1
-#define SCLK_HI BIT1HI
-#define SCLK_LO BIT1LO
-
-#define RCLK GPIO_PIN_3
-#define RCLK_LO BIT3LO
-#define RCLK_HI BIT3HI
-
-#define GET_MSB_IN_LSB(x) ((x & 0x80)>>7)
-#define ALL_BITS (0xff<<2)
+#define SCLK GPIO_PIN_0
+#define RCLK GPIO_PIN_1
+#define DATA GPIO_PIN_3
+#define SSI1Function 2
+#define BitsPerNibble 4
+// PD0, PD1 and PD3 to SSI1, PD2 left alone
+#define SSI1PinsMask 0xffff0f00
+#define SSI1PinsPCTL ((SSI1Function<<(3*BitsPerNibble)) + (SSI1Function<<(1*BitsPerNibble)) + SSI1Function)
+
+// 40MHz/(CPSDVSR*(1+SCR)) = 1MHz
+#define CPSDVSR 4
+#define SCR 9
 
 // an image of the last 8 bits written to the shift register
 static uint8_t LocalRegisterImage=0;
+static bool Initialized = false;
 
 /********************** SR_Init ********************************************
  Function
@@ -64,25 +78,45 @@ static uint8_t LocalRegisterImage=0;
    nothing
 
  Description
-   Initializes the shift register
-   
+   Initializes SSI1 and its pins and clears the shift register, the first
+   time only; later calls return straight away
+
  Author
    Elena Galbally
 ****************************************************************************/
 void SR_Init(void)
 {
-  // set up port D by enabling the peripheral clock
-	HWREG(SYSCTL_RCGCGPIO) |= BIT3HI;
+	if (Initialized)
+		return;
+
+  // set up port D and SSI1 by enabling the peripheral clocks
+	HWREG(SYSCTL_RCGCGPIO) |= SYSCTL_RCGCGPIO_R3;
+	HWREG(SYSCTL_RCGCSSI) |= SYSCTL_RCGCSSI_R1;
 	while ((HWREG(SYSCTL_PRGPIO) & SYSCTL_PRGPIO_R3) != SYSCTL_PRGPIO_R3);
-	
-	// Set the direction of PD0, PD1 & PD2 to output and digital pins
-	HWREG(GPIO_PORTD_BASE+GPIO_O_DEN) |= (DATA | SCLK | RCLK);	
+
+	// PD0, PD1 & PD3 to their SSI1 alternate functions, digital outputs
+	HWREG(GPIO_PORTD_BASE+GPIO_O_AFSEL) |= (DATA | SCLK | RCLK);
+	HWREG(GPIO_PORTD_BASE+GPIO_O_PCTL) =
+		(HWREG(GPIO_PORTD_BASE+GPIO_O_PCTL) & SSI1PinsMask) + SSI1PinsPCTL;
+	HWREG(GPIO_PORTD_BASE+GPIO_O_DEN) |= (DATA | SCLK | RCLK);
 	HWREG(GPIO_PORTD_BASE+GPIO_O_DIR) |= (DATA | SCLK | RCLK);
-  
-  // Start with the data & sclk lines low and the RCLK line high
-	HWREG(GPIO_PORTD_BASE+(GPIO_O_DATA + ALL_BITS)) &= SCLK_LO;
-	HWREG(GPIO_PORTD_BASE+(GPIO_O_DATA + ALL_BITS)) &= BIT0LO;
-	HWREG(GPIO_PORTD_BASE+(GPIO_O_DATA + ALL_BITS)) |= RCLK_HI;	
+
+	while ((HWREG(SYSCTL_PRSSI) & SYSCTL_PRSSI_R1) != SYSCTL_PRSSI_R1);
+
+	// disabled while programming: master, system clock, 1MHz
+	HWREG(SSI1_BASE + SSI_O_CR1) = 0;
+	HWREG(SSI1_BASE + SSI_O_CC) = SSI_CC_CS_SYSPLL;
+	HWREG(SSI1_BASE + SSI_O_CPSR) = CPSDVSR;
+
+	// Freescale SPI, mode 0 (data out before the rising clock, the edge the
+	// register shifts on), 8 bit frames
+	HWREG(SSI1_BASE + SSI_O_CR0) = (SCR<<SSI_CR0_SCR_S) | SSI_CR0_FRF_MOTO | SSI_CR0_DSS_8;
+
+	HWREG(SSI1_BASE + SSI_O_CR1) = SSI_CR1_SSE;
+	Initialized = true;
+
+	// start from a known register, all off
+	HWREG(SSI1_BASE + SSI_O_DR) = LocalRegisterImage;
 }
 
 /********************* SR_GetCurrentRegister ***************************************
@@ -97,7 +131,7 @@ void SR_Init(void)
 
  Description
    Returns the current shift register value
-   
+
  Author
    Elena Galbally
 ****************************************************************************/
@@ -118,36 +152,26 @@ uint8_t SR_GetCurrentRegister(void)
    nothing
 
  Description
-   Writes a new 8 bit value to the shift register
-   
+   Queues a new 8 bit value for the shift register, unless it is already
+   there; the SSI sends and latches it after SR_Write has returned
+
  Author
    Elena Galbally
 ****************************************************************************/
 void SR_Write(uint8_t NewValue)
 {
-// Create a local variable to count bits
-  uint8_t BitCounter;
+	// nothing to do if the register already holds it
+	if (Initialized && (NewValue == LocalRegisterImage))
+		return;
+
   // save a local copy of NewValue
-  LocalRegisterImage = NewValue; 
-	
-	// For 0 through 8 
-	for(BitCounter = 0; BitCounter < 8; BitCounter++)
-	{
-		// Isolate the MSB of NewValue, put it into the LSB position and output
-		if((NewValue & BIT7HI) == BIT7HI) 
-			HWREG(GPIO_PORTD_BASE+(GPIO_O_DATA + ALL_BITS)) |= DATA; 
-		else
-			HWREG(GPIO_PORTD_BASE+(GPIO_O_DATA + ALL_BITS)) &= (~DATA); 
-		
-		// Pulse SCLK
-		HWREG(GPIO_PORTD_BASE+(GPIO_O_DATA + ALL_BITS)) |= SCLK_HI; 
-		HWREG(GPIO_PORTD_BASE+(GPIO_O_DATA + ALL_BITS)) &= SCLK_LO; 
-		
-		// Shift data
-		NewValue = (NewValue << 1);
-	}
-		
-	// Pulse the register clock to latch the new data
-	HWREG(GPIO_PORTD_BASE+(GPIO_O_DATA + ALL_BITS)) &= RCLK_LO;
-	HWREG(GPIO_PORTD_BASE+(GPIO_O_DATA + ALL_BITS)) |= RCLK_HI;  
+  LocalRegisterImage = NewValue;
+
+	// before SR_Init the image is all there is, SR_Init sends it
+	if (!Initialized)
+		return;
+
+	// the FIFO holds 8 frames, 8uS each: only a burst of writes waits here
+	while ((HWREG(SSI1_BASE + SSI_O_SR) & SSI_SR_TNF) == 0);
+	HWREG(SSI1_BASE + SSI_O_DR) = NewValue;
 }
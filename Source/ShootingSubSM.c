@@ -9,6 +9,12 @@
    This is a template file for implementing state machines.
 
  Notes
+   Aiming at the goal and spinning the flywheel up don't depend on each
+   other, so PREPARING_SHOT runs them as two orthogonal regions (the aim
+   and the spin, each with its own state) and the shot goes as soon as
+   both are done. Balls after the first keep the aim and the flywheel
+   speed, only the dip a ball makes in the flywheel is waited out. Every
+   ball out prints its cycle time.
 
  History
  When           Who     What/Why
@@ -44,6 +50,8 @@
  02/14/99 10:34 jec      Began Coding
 ****************************************************************************/
 /*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+
 // Basic includes for a program using the Events and Services Framework
 #include "ES_Configure.h"
 #include "ES_Framework.h"
@@ -57,7 +65,11 @@
 #include "MotorActionsModule.h"
 #include "IRBeaconModule.h"
 #include "PWMmodule.h"
+#include "FlywheelModule.h"
+#include "ServoModule.h"
+#include "BeaconAlignModule.h"
 #include "LEDModule.h"
+#include "SMProfiler.h"
 
 /*----------------------------- Module Defines ----------------------------*/
 // define constants for the states for this machine
@@ -66,11 +78,10 @@
 // these times assume a 1.000mS/tick timing
 #define ONE_SEC 976
 #define Looking4Beacon_TIME ONE_SEC/100 
-#define IRAligning_TIME 100//ONE_SEC/20
+#define IRAligning_TIME ALIGN_SAMPLE_MS
+// only if the tach never says the flywheel is at speed
 #define FlyWheel_TIME ONE_SEC*4
 
-#define AligningSpeed 40
-
 #define RED 0
 #define GREEN 1
 
@@ -84,9 +95,15 @@
 #define GOAL_BYTE_MASK 0x00ff
 #define LEDS_OFF 0
 
-#define FlyWheelDuty 80
-#define SeparatorDuty 50
-#define SeparatorONTime 1000 //ms
+#define BallsPerLoad 3
+// separator gate: eased open, held while the ball rolls out, eased shut
+#define FeedOpenMS 150
+#define FeedHoldMS 250
+#define FeedCloseMS 150
+
+// states of the regions of PREPARING_SHOT
+typedef enum { AIMING, AIMED } AimState_t;
+typedef enum { SPINNING_UP, AT_SPEED } SpinState_t;
 
 // IR frequency codes
 #define code800us 0x00 // 1250Hz (Green supply depot)
@@ -101,15 +118,23 @@
    functions, entry & exit functions.They should be functions relevant to the
    behavior of this state machine
 */
-static ES_Event DuringLooking4Bucket( ES_Event Event);
-static ES_Event DuringSettingBallSpeed( ES_Event Event);
+static ES_Event DuringPreparingShot( ES_Event Event);
+static bool RunAimRegion( ES_Event Event);
+static bool RunSpinRegion( ES_Event Event);
+static ES_Event DuringFeedingBall( ES_Event Event);
 static ES_Event DuringWaiting4ShotComplete( ES_Event Event);
 static bool DetectAGoal();
 
 /*---------------------------- Module Variables ---------------------------*/
 // everybody needs a state variable, you may need others as well
 static ShootingState_t CurrentState;
-static uint8_t BallCount;
+// states of the two regions of PREPARING_SHOT
+static AimState_t AimState;
+static SpinState_t SpinState;
+static uint8_t BallCount = BallsPerLoad;
+// ES_Timer_GetTime() of the start of shooting and of the last ball out
+static uint16_t ShootingStart;
+static uint16_t LastCycleStart;
 static uint8_t MyScore;
 static uint8_t Back_MeasuredIRPeriodCode;
 static bool setSpeedReady = 0;
@@ -131,6 +156,15 @@ static bool TeamColor = GREEN;
 static uint8_t GoalCode;
 static uint8_t Front_MeasuredIRPeriodCode;
 static bool rotationDirection;
+// the sweep has been tried the other way after an ALIGN_FAILED
+static bool AimRetried;
+
+static const ServoSegment_t FeedMove[] =
+{
+  { SEPARATOR_OPEN_US, FeedOpenMS },
+  { SEPARATOR_OPEN_US, FeedHoldMS },
+  { SEPARATOR_CLOSED_US, FeedCloseMS }
+};
 
 /*------------------------------ Module Code ------------------------------*/
 /****************************************************************************
@@ -158,61 +192,55 @@ ES_Event RunShootingSM( ES_Event CurrentEvent )
    ES_Event ReturnEvent = CurrentEvent; // assume we are not consuming event
 
 	 /*	 
-	 LOOKING4BUCKET
-		- Rotate and find an active goal, then stop
-		- It has to be the correct goal because only one is active at a time
-		- Query status and exit
+	 PREPARING_SHOT, two orthogonal regions run side by side
+		- Aim: rotate until the front IR sees our goal, then brake on it
+		- Spin: bring the flywheel to the RPM for our staging area
+		- The shot goes when the aim is AIMED and the spin is AT_SPEED
 	 
-	 SETTING_BALL_SPEED
-	  - When we get a status response, we start SETTING_BALL_SPEED
-		- Set fly wheel and separator speed as a function of current 
-		  active goal and location
+	 FEEDING_BALL
+		- Pulse the separator to let one ball into the flywheel
 	 
 	 WATING4SHOT_COMPLETE
-	 - Wait for a timeout and then check if you have scored or not 
-		 in order to do one thing or another	 
+	 - Wait for the LOC to count the shot, then let RobotTopSM ask for the
+		 score. A miss comes back as MISSED_SHOT and the next ball goes with
+		 the flywheel still spinning and the aim kept.
 	 */
 	
 	// Switch the CurrentState
    switch ( CurrentState )
    {
 			
-			 // CASE 1/3, LOOKING4BUCKET			 
-			 case LOOKING4BUCKET :
-				 // Execute During function 
-         		CurrentEvent = DuringLooking4Bucket(CurrentEvent);				 
-				 // If current event is BucketAligned
-				 if (CurrentEvent.EventType == BucketAligned)
+			 // CASE 1/3, PREPARING_SHOT
+			 case PREPARING_SHOT :
+				 // Execute During function, which runs both regions
+				 CurrentEvent = DuringPreparingShot(CurrentEvent);
+				 // If both regions are done (the join), on an event either used
+				 if ((CurrentEvent.EventType == ES_NO_EVENT) &&
+				     (AimState == AIMED) && (SpinState == AT_SPEED))
 				 {
-				 	// Change NextState to SETTING_BALL_SPEED
-					 NextState = SETTING_BALL_SPEED;
+					 // Change NextState to FEEDING_BALL
+					 NextState = FEEDING_BALL;
 					 // Set MakeTransition to true
 					 MakeTransition = true;
 					 // Set ReturnEvent to ES_NO_EVENT
 					 ReturnEvent.EventType = ES_NO_EVENT;
 				 }
-				 // If CurrentEvent is ES_TIMEOUT and the param IRAligning_TIMER
-				 else if (CurrentEvent.EventType == ES_TIMEOUT && (CurrentEvent.EventParam == IRAligning_TIMER))
+				 // Else the regions used it, consume it for the upper level
+				 else if (CurrentEvent.EventType == ES_NO_EVENT)
 				 {
-					// Internal Transition
-					NextState = LOOKING4BUCKET;
-					// Set MakeTransition to false
-					MakeTransition = false;
-					// Set ReturnEvent to ES_NO_EVENT, consume for the upper level state machine
-					ReturnEvent.EventType = ES_NO_EVENT; 
+					 ReturnEvent.EventType = ES_NO_EVENT;
 				 }
 				 break;
 				 
-		// CASE 2/3, SETTING_BALL_SPEED
-       case SETTING_BALL_SPEED : 				 
+		// CASE 2/3, FEEDING_BALL
+       case FEEDING_BALL : 				 
          // Execute During function 
-         CurrentEvent = DuringSettingBallSpeed(CurrentEvent);
+         CurrentEvent = DuringFeedingBall(CurrentEvent);
 			 
-		// Wait for the flywheel to rotate for a while to reach desired speed
-         // If CurrentEvent is ES_TIMEOUT and the param is IRAligning_TIMER
-         if (CurrentEvent.EventType == ES_TIMEOUT && (CurrentEvent.EventParam == IRAligning_TIMER))
+         // If CurrentEvent is SERVO_MOVE_DONE, the gate has let a ball out and closed
+         if (CurrentEvent.EventType == SERVO_MOVE_DONE)
          {       
-         	// Change the state to WAITING4SHOT_COMPLETE
+         	// Change the state to WATING4SHOT_COMPLETE
             NextState = WATING4SHOT_COMPLETE;
             // Set MakeTransition to true
             MakeTransition = true; 
@@ -225,20 +253,19 @@ ES_Event RunShootingSM( ES_Event CurrentEvent )
 		 case WATING4SHOT_COMPLETE :  			 		 
 			// During function
 			CurrentEvent = DuringWaiting4ShotComplete(CurrentEvent);
-			// If CurrentEvent is ShotComplete		 
-			if (CurrentEvent.EventType == ShotComplete)
+			// If CurrentEvent is MISSED_SHOT, shoot the next ball
+			if (CurrentEvent.EventType == MISSED_SHOT)
          {  
-         	// Consume for the upper level state machine
+			// Back to PREPARING_SHOT, with history so the aim is kept
+            NextState = PREPARING_SHOT;
+            MakeTransition = true; 
+            EntryEventKind.EventType = ES_ENTRY_HISTORY;
+            // consume for the upper level state machine
             ReturnEvent.EventType = ES_NO_EVENT; 
          }
-         // Else If CurrentEvent is ES_TIMEOUT and param is IRAligning_TIMER
-         else if (CurrentEvent.EventType == ES_TIMEOUT && (CurrentEvent.EventParam == IRAligning_TIMER))
+         // Else If CurrentEvent is ES_TIMEOUT and param is Waiting4Shot_TIMER
+         else if (CurrentEvent.EventType == ES_TIMEOUT && (CurrentEvent.EventParam == Waiting4Shot_TIMER))
          {  
-			// Internal Transition
-			// Set state to WATING4SHOT_COMPLETE
-            NextState = WATING4SHOT_COMPLETE;
-            // Set MakeTransition to false
-            MakeTransition = false; 
             // consume for the upper level state machine
             ReturnEvent.EventType = ES_NO_EVENT; 
          }							
@@ -249,6 +276,7 @@ ES_Event RunShootingSM( ES_Event CurrentEvent )
     // If we are making a state transition
     if (MakeTransition == true)
     {
+       SMProf_Transition(PROF_SHOOTING, CurrentState, NextState, CurrentEvent.EventType);
        // Execute exit function for current state
        CurrentEvent.EventType = ES_EXIT;
        RunShootingSM(CurrentEvent);
@@ -285,9 +313,11 @@ void StartShootingSM ( ES_Event CurrentEvent )
    // If current event is ES_ENTRY_HISTORY
    if ( ES_ENTRY_HISTORY != CurrentEvent.EventType )
    {
-   		// change current state to LOOKING4BUCKET
-        CurrentState = LOOKING4BUCKET;
+   		// change current state to PREPARING_SHOT
+        CurrentState = PREPARING_SHOT;
    }
+   ShootingStart = LastCycleStart = ES_Timer_GetTime();
+   SMProf_Enter(PROF_SHOOTING, CurrentState);
    // Call the entry function (if any) for the ENTRY_STATE
    RunShootingSM(CurrentEvent);
 }
@@ -317,31 +347,69 @@ ShootingState_t QueryShootingSM ( void )
 
 /***************************************************************************
  Function
-     DuringLooking4Bucket
+     DuringPreparingShot
 
  Parameters
      ES_Event Event
 
  Returns
-     ES_Event Return Event, event to return to the rest of the state machine
+     ES_Event Return Event, ES_NO_EVENT if one of the regions used it
 
  Description
-     During function for the Looking4Bucket
+     During function for PreparingShot: runs the aim and the spin regions
+     on every event, each with its own entry and exit
  Notes
 
- Author
-     J. Edward Carryer, 2/11/05, 10:38AM
 ****************************************************************************/
-
-static ES_Event DuringLooking4Bucket( ES_Event Event)  
+static ES_Event DuringPreparingShot( ES_Event Event)
 {
-	// Create variable for ReturnEvent
-	ES_Event ReturnEvent = Event; 
-	ES_Event Event2Post;
+	ES_Event ReturnEvent = Event;
 	
-	// If Event is ES_ENTRY or ES_ENTRY_HISTORY
+	// If Event is ES_ENTRY or ES_ENTRY_HISTORY, enter both regions
 	if ( (Event.EventType == ES_ENTRY) || (Event.EventType == ES_ENTRY_HISTORY) )
-  {
+	{
+		// with history an aim that is done stays done
+		if ( (Event.EventType == ES_ENTRY) || (AimState != AIMED) )
+		{
+			AimState = AIMING;
+			RunAimRegion(Event);
+		}
+		SpinState = SPINNING_UP;
+		RunSpinRegion(Event);
+	}
+	// Else If ES_EXIT, exit both regions
+	else if ( Event.EventType == ES_EXIT )
+	{
+		RunAimRegion(Event);
+		RunSpinRegion(Event);
+	}
+	// Else, give the event to both regions
+	else
+	{
+		// not ||, both regions see every event
+		if ( RunAimRegion(Event) | RunSpinRegion(Event) )
+		{
+			ReturnEvent.EventType = ES_NO_EVENT;
+		}
+	}
+	// Return ReturnEvent
+	return ReturnEvent;
+}
+
+/***************************************************************************
+ RunAimRegion
+	Aim region of PreparingShot. AIMING sweeps for our goal's frequency and
+	turns back onto the middle of where it was seen (BeaconAlignModule),
+	feeding it the front IR code every IRAligning_TIME; when the robot
+	brakes on it the region is AIMED. The first ALIGN_FAILED sweeps again
+	the other way, a second is left for RobotTopSM. Returns true if it
+	used the event.
+ ***************************************************************************/
+static bool RunAimRegion( ES_Event Event)
+{
+	// If Event is ES_ENTRY or ES_ENTRY_HISTORY (only while AIMING)
+	if ( (Event.EventType == ES_ENTRY) || (Event.EventType == ES_ENTRY_HISTORY) )
+	{
 		// Get team color
 		TeamColor = GetTeamColor();
 		// If TeamColor is Green
@@ -361,50 +429,104 @@ static ES_Event DuringLooking4Bucket( ES_Event Event)
 		//Enable ISR for front IR (Initialized in TopSM Initialization)
 		EnableFrontIRInterrupt();
 		
-		//Start rotating slowly
-		start2rotate(rotationDirection, AligningSpeed);
+		//Start sweeping fast
+		AimRetried = false;
+		Align_Start(GoalCode, rotationDirection == CW);
 		
 		// Start the timer to periodically check the IR frequency   
 		ES_Timer_InitTimer(IRAligning_TIMER,IRAligning_TIME);
-
+		return true;
 	}
-	// Else If ES_EXIT	
+	// Else If ES_EXIT while still AIMING
 	else if ( Event.EventType == ES_EXIT )
-  {
-		// Stop Rotating
-		stop(); 		
+	{
+		if (AimState == AIMING)
+		{
+			// Stop Rotating
+			ES_Timer_StopTimer(IRAligning_TIMER);
+			Align_Stop();
+		}
+		return false;
 	}
 	
-	// Else, do the during function
-	else
+	// If AIMING and Event is ES_TIMEOUT and param is IRAligning_TIMER
+	if ( (AimState == AIMING) && (Event.EventType == ES_TIMEOUT) && (Event.EventParam == IRAligning_TIMER) )
 	{
-		// If Event is ES_TIMEOUT and param is IRAligning_TIMER
-		if (Event.EventType == ES_TIMEOUT && (Event.EventParam == IRAligning_TIMER))
-		{
-			// Read the detected IR frequency
-			Front_MeasuredIRPeriodCode = Front_GetIRCode();		
-
-			// If Goal Freq detected, post event; Otherwise restart timer
-			if(Front_MeasuredIRPeriodCode == GoalCode){
-				// Post GoalAligned to Robot Top SM
-				Event2Post.EventType = GoalAligned;
-				Event2Post.EventParam = Front_MeasuredIRPeriodCode;
-				PostRobotTopSM(Event2Post);
+		// Read the detected IR frequency
+		Front_MeasuredIRPeriodCode = Front_GetIRCode();		
+
+		// If on the centre of the goal's window (and braking), done; Otherwise restart timer
+		if(Align_Step(Front_MeasuredIRPeriodCode)){
+			AimState = AIMED;
 		// Else 
-      }else{
-      			// Kick off IRAligning_TIMER
-				ES_Timer_InitTimer(IRAligning_TIMER,IRAligning_TIME);
-			}				
+		}else{
+			// Kick off IRAligning_TIMER
+			ES_Timer_InitTimer(IRAligning_TIMER,IRAligning_TIME);
 		}
-	}	
-	// Return ReturnEvent
-	return ReturnEvent;
+		return true;
+	}
+	
+	// If AIMING and Event is ALIGN_FAILED, the goal wasn't found
+	if ( (AimState == AIMING) && (Event.EventType == ALIGN_FAILED) )
+	{
+		ES_Timer_StopTimer(IRAligning_TIMER);
+		// the first time, sweep the other way
+		if (!AimRetried)
+		{
+			AimRetried = true;
+			rotationDirection = !rotationDirection;
+			Align_Start(GoalCode, rotationDirection == CW);
+			ES_Timer_InitTimer(IRAligning_TIMER,IRAligning_TIME);
+			return true;
+		}
+		// then RobotTopSM moves on
+		return false;
+	}
+	return false;
 }
 
 /***************************************************************************
+ RunSpinRegion
+	Spin region of PreparingShot. SPINNING_UP sets the flywheel target for
+	our staging area (again after a shot, which waits out the dip a ball
+	makes) and is AT_SPEED on FLYWHEEL_AT_SPEED, or when FlyWheel_TIMER runs
+	out on a silent tach. The flywheel keeps spinning on exit, RobotTopSM
+	turns it off when it leaves SHOOTING. Returns true if it used the event.
+ ***************************************************************************/
+static bool RunSpinRegion( ES_Event Event)
+{
+	// If Event is ES_ENTRY or ES_ENTRY_HISTORY
+	if ( (Event.EventType == ES_ENTRY) || (Event.EventType == ES_ENTRY_HISTORY) )
+	{
+		// spin the fly wheel up to the speed for where we shoot from
+		Fly_SetTargetRPM(Fly_TargetRPMForStage(GetCurrentStagingAreaPosition()));
+		
+		// Start the fallback timer in case FLYWHEEL_AT_SPEED never comes
+		ES_Timer_InitTimer(FlyWheel_TIMER,FlyWheel_TIME);
+		return true;
+	}
+	// Else If ES_EXIT
+	else if ( Event.EventType == ES_EXIT )
+	{
+		ES_Timer_StopTimer(FlyWheel_TIMER);
+		return false;
+	}
+	
+	// If SPINNING_UP and Event is FLYWHEEL_AT_SPEED, or ES_TIMEOUT and param is FlyWheel_TIMER
+	if ( (SpinState == SPINNING_UP) && ((Event.EventType == FLYWHEEL_AT_SPEED) ||
+	     (Event.EventType == ES_TIMEOUT && (Event.EventParam == FlyWheel_TIMER))) )
+	{
+		// whichever comes first
+		ES_Timer_StopTimer(FlyWheel_TIMER);
+		SpinState = AT_SPEED;
+		return true;
+	}
+	return false;
+}
 
+/***************************************************************************
  Function
-     DuringSettingBallSpeed
+     DuringFeedingBall
 
  Parameters
      ES_Event Event
@@ -413,50 +535,41 @@ static ES_Event DuringLooking4Bucket( ES_Event Event)
      ES_Event Return Event, event to return to the rest of the state machine
 
  Description
-     During function for the SettingBallSpeed
+     During function for FeedingBall: one pulse of the separator lets a
+     ball into the flywheel
  Notes
 
- Author
-     J. Edward Carryer, 2/11/05, 10:38AM
 ****************************************************************************/
-static ES_Event DuringSettingBallSpeed( ES_Event Event)
+static ES_Event DuringFeedingBall( ES_Event Event)
 {
     ES_Event ReturnEvent = Event; // assume no re-mapping or consumption
+		uint16_t Now;
 
     // process ES_ENTRY, ES_ENTRY_HISTORY & ES_EXIT events
     if ( (Event.EventType == ES_ENTRY) ||(Event.EventType == ES_ENTRY_HISTORY) )
 		{
-			// turn on fly wheel 
-			SetFlyDuty(FlyWheelDuty);	
+			// cycle time: from the start of shooting for the first ball,
+			// from the ball before for the others
+			Now = ES_Timer_GetTime();
+			printf("\r\nBall %u out at %u RPM, %u ms after %s\r\n", (unsigned)(BallsPerLoad - BallCount + 1),
+			       (unsigned)Fly_GetRPM(), (unsigned)(uint16_t)(Now - LastCycleStart),
+			       (LastCycleStart == ShootingStart) ? "shooting started" : "the last ball");
+			LastCycleStart = Now;
+			Fly_MarkShot();
 			
-			// Start timer to allow the flywheel to reach desired speed
-			ES_Timer_InitTimer(FlyWheel_TIMER,FlyWheel_TIME);
+			// open the gate, let one ball through and close it again
+			Servo_Run(FeedMove, sizeof(FeedMove)/sizeof(FeedMove[0]));
 		}
 	// Else If Event is ES_EXIT
     else if ( Event.EventType == ES_EXIT )
     {
-    	// Do nothing		
-			
-    }
-		//Else do during function
-		else 
-		{
-			// If Event is ES_TIMEOUT and param is FlyWheel_TIMER
-			if (Event.EventType == ES_TIMEOUT && (Event.EventParam == FlyWheel_TIMER))
-			{
-					//start servo motor 
-					SetServoDuty(SeparatorDuty);
-				
-					// start timer to turn off servo
-					ES_Timer_InitTimer(Servo_TIMER,SeparatorONTime);
-				
-			// Else If Event is ES_TIMEOUT and param is Servo_TIMER	
-			} else if (Event.EventType == ES_TIMEOUT && (Event.EventParam == Servo_TIMER)) 
+			// the gate rests closed between feeds: a feed cut short eases
+			// shut from wherever it got to
+			if (Servo_IsMoving())
 			{
-				// stop servo motor
-				SetServoDuty(0);
+				Servo_MoveTo(SEPARATOR_CLOSED_US, FeedCloseMS);
 			}
-		}
+    }
 		
     // Return ReturnEvent
     return(ReturnEvent);
@@ -474,27 +587,15 @@ static ES_Event DuringWaiting4ShotComplete( ES_Event Event)
     // process ES_ENTRY, ES_ENTRY_HISTORY & ES_EXIT events
     if ( (Event.EventType == ES_ENTRY) || (Event.EventType == ES_ENTRY_HISTORY) )
     {
-				// Start to rotate the seperator very slowly
-				SetServoDuty(SeparatorDuty);
-			
-			  // start timer to load balls and shoot
-				ES_Timer_InitTimer(IRAligning_TIMER, Wait4ShotTime);				
+			  // give the ball time to reach the goal and the LOC to count it
+				ES_Timer_InitTimer(Waiting4Shot_TIMER, Wait4ShotTime);				
     }
     else if ( Event.EventType == ES_EXIT )
     {    
-				// Turn off both the pushing flywheel and the separation servo
-				SetServoDuty(0);
-				SetFlyDuty(0);	
+				ES_Timer_StopTimer(Waiting4Shot_TIMER);
     }
 		else //DURING - Scored, Missed, or No Balls?
     {  
-			// Post Event to indicate shooting complete when timer expires
-			if (Event.EventType == ES_TIMEOUT && (Event.EventParam == IRAligning_TIMER))
-			{
-					Event2Post.EventType = ShotComplete;
-					PostRobotTopSM(Event2Post);
-			}
-			
 			// If shot is done				
 			if((Event.EventType == ES_TIMEOUT) && (Event.EventParam == Waiting4Shot_TIMER))
 			{
@@ -503,6 +604,8 @@ static ES_Event DuringWaiting4ShotComplete( ES_Event Event)
 					
 					if (BallCount == 0) // go to RELOADING
 					{
+						// and come back with a full load
+						BallCount = BallsPerLoad;
 						Event2Post.EventType = NO_BALLS;
 						PostRobotTopSM(Event2Post);
 					}
@@ -512,13 +615,6 @@ static ES_Event DuringWaiting4ShotComplete( ES_Event Event)
 						PostRobotTopSM(Event2Post);
 					}
 				}
-			
-			// If shot is NOT done - keep waiting
-			{
-				//internal self transition
-				Event2Post.EventType = KEEP_WAITING4SHOT;
-				PostRobotTopSM(Event2Post);
-			}			
     }
     return(ReturnEvent);
 }
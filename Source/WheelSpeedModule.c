@@ -0,0 +1,261 @@
+//#define TEST
+/****************************************************************************
+WheelSpeedModule
+	Fixed-point PI controller that holds a wheel at a speed in mm/s, one
+	instance per wheel. MotorActionsModule runs it from the odometry tick on
+	the speeds the encoders just measured (see OdometryModule.c).
+
+ Notes
+	As in the wire follow loop the command is a Q15 fraction of 100% duty,
+	the gains are Q16 (duty per mm/s) and every product goes through a 64
+	bit SMLAL (DSP_MulAcc64). WHEEL_GAIN() converts from duty percent per
+	mm/s.
+	The command is a feed forward on the target, the duty that gives the
+	speed on a nominal battery with no drag, plus P and I on the speed
+	error; the integral takes up the battery and the floor. While the
+	command is clamped the integral may only shrink (conditional
+	integration), and it always stays inside the gains' IntegralLimit.
+	A target of 0 lets go: the command is 0 and the integral starts over,
+	so a stopped wheel isn't held against the floor.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include "WheelSpeedModule.h"
+#include "DSP_Intrinsics.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define GainShift 16
+#define PERCENT_Q15(Percent) ((int32_t)(Percent)*WHEEL_FULL_DUTY/100)
+
+/*---------------------------- Module Functions ---------------------------*/
+static int32_t Clamp( int32_t Value, int32_t Min, int32_t Max );
+static int32_t Magnitude( int32_t Value );
+static int32_t Product( int32_t Gain, int32_t Value );
+
+/*---------------------------- Module Variables ---------------------------*/
+// feed forward for 600mm/s at 100%, I per second turned into per step
+const WheelGains_t WheelDefaultGains =
+{
+  WHEEL_GAIN(100.0/600.0), WHEEL_GAIN(0.05), WHEEL_GAIN(0.5/WHEEL_SPEED_RATE_HZ), PERCENT_Q15(40)
+};
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+    WheelPI_Init
+
+ Description
+    Starts a controller on a set of gains with nothing integrated
+****************************************************************************/
+void WheelPI_Init( WheelPI_t *pPI, const WheelGains_t *pGains )
+{
+  pPI->pGains = pGains;
+  pPI->Integral = 0;
+}
+
+/****************************************************************************
+ Function
+    WheelPI_Step
+
+ Parameters
+    int32_t : target speed, mm/s, negative backward
+    int32_t : speed measured since the last step, mm/s
+
+ Returns
+    int32_t : the wheel command, Q15 duty from -WHEEL_FULL_DUTY (full
+    backward) to WHEEL_FULL_DUTY (full forward)
+****************************************************************************/
+int32_t WheelPI_Step( WheelPI_t *pPI, int32_t TargetMMPerS, int32_t MeasuredMMPerS )
+{
+  const WheelGains_t *pGains = pPI->pGains;
+  int32_t Error = TargetMMPerS - MeasuredMMPerS;
+  int32_t NewIntegral, Command;
+  bool Clamped;
+
+  if (TargetMMPerS == 0)
+  {
+    pPI->Integral = 0;
+    return 0;
+  }
+
+  NewIntegral = Clamp(pPI->Integral + Product(pGains->Ki, Error),
+                      -pGains->IntegralLimit, pGains->IntegralLimit);
+  Command = Product(pGains->Kff, TargetMMPerS) + Product(pGains->Kp, Error) + NewIntegral;
+
+  // anti-windup: with the command pinned the integral can only unwind
+  Clamped = (Command > WHEEL_FULL_DUTY) || (Command < -WHEEL_FULL_DUTY);
+  if (!Clamped || (Magnitude(NewIntegral) < Magnitude(pPI->Integral)))
+  {
+    pPI->Integral = NewIntegral;
+  }
+  return Clamp(Command, -WHEEL_FULL_DUTY, WHEEL_FULL_DUTY);
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+static int32_t Clamp( int32_t Value, int32_t Min, int32_t Max )
+{
+  return (Value < Min) ? Min : ((Value > Max) ? Max : Value);
+}
+
+static int32_t Magnitude( int32_t Value )
+{
+  return (Value < 0) ? -Value : Value;
+}
+
+static int32_t Product( int32_t Gain, int32_t Value )
+{
+  return (int32_t)(DSP_MulAcc64(0, Gain, Value) >> GainShift);
+}
+
+#ifdef TEST
+/* Test harness: the controller against a model of a drive wheel.
+
+   Host (from the repo root):
+      gcc -std=gnu99 -O2 -DTEST -IHeaders -o wheelspeed Source/WheelSpeedModule.c -lm
+      ./wheelspeed
+   The wheel is a DC gearmotor, first order from duty to speed, with a top
+   speed that goes with the battery voltage and a floor that takes a
+   Coulomb drag off it. The model runs at 10kHz, the encoder is quantized
+   to whole counts and the controller steps at WHEEL_SPEED_RATE_HZ on the
+   counts of the last step, as on the robot. For every battery and floor it
+   runs a set of targets with the feed forward alone (what the open loop
+   duty used to do) and with the whole loop, and prints the speed each
+   settles at, the time to 90% and the overshoot. A closed loop speed off
+   by more than SpeedTolerance, or an overshoot over MaxOvershoot percent,
+   fails the run and the program exits 1.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define ModelRateHz 10000
+#define RunSeconds 2
+// the last half second is the settled speed
+#define SettledSeconds 0.5
+#define SpeedTolerance 0.03
+#define MaxOvershoot 15
+
+// drive train, as OdometryModule.c
+#define MMPerCount (3.14159265*70.0/(4*12*30))
+
+// wheel speed at 100% on a nominal battery with no drag, and how fast it
+// gets there
+#define NominalVolts 7.8
+#define TopSpeedMMPerS 600.0
+#define MotorTauS 0.08
+
+typedef struct
+{
+  const char *pName;
+  double Volts;
+  double DragMMPerS;                   // Coulomb drag, in speed lost
+} Condition_t;
+
+static const Condition_t Conditions[] =
+{
+  { "fresh battery, lab floor",  8.4, 20.0 },
+  { "nominal, lab floor",        7.8, 20.0 },
+  { "low battery, lab floor",    6.8, 20.0 },
+  { "fresh battery, field",      8.4, 70.0 },
+  { "low battery, field",        6.8, 70.0 },
+};
+
+static const int32_t Targets[] = { 150, 300, 450, -300 };
+
+typedef struct
+{
+  double Settled;
+  double RiseS;
+  double OvershootPercent;
+} Response_t;
+
+static Response_t RunWheel( const WheelGains_t *pGains, const Condition_t *pCond,
+                            int32_t Target )
+{
+  WheelPI_t PI;
+  Response_t Result = { 0.0, -1.0, 0.0 };
+  double Speed = 0.0, Position = 0.0, Peak = 0.0, SettledSum = 0.0;
+  double Duty = 0.0;
+  long LastCount = 0, Count;
+  long SettledSteps = 0;
+  long n, Steps = (long)RunSeconds*ModelRateHz;
+  long StepEvery = ModelRateHz/WHEEL_SPEED_RATE_HZ;
+  double Sign = (Target < 0) ? -1.0 : 1.0;
+  int32_t Measured;
+
+  WheelPI_Init(&PI, pGains);
+  for (n = 0; n < Steps; n++)
+  {
+    double Drive, Drag;
+
+    if ((n % StepEvery) == 0)
+    {
+      Count = (long)floor(Position/MMPerCount);
+      Measured = (int32_t)lround((Count - LastCount)*MMPerCount*WHEEL_SPEED_RATE_HZ);
+      LastCount = Count;
+      Duty = (double)WheelPI_Step(&PI, Target, Measured)/WHEEL_FULL_DUTY;
+      if (n >= Steps - (long)(SettledSeconds*ModelRateHz))
+      {
+        SettledSum += Measured;
+        SettledSteps++;
+      }
+    }
+
+    // first order toward the speed the duty and battery give, less the drag
+    Drive = Duty*TopSpeedMMPerS*pCond->Volts/NominalVolts;
+    Drag = (Speed > 0.0) ? pCond->DragMMPerS : ((Speed < 0.0) ? -pCond->DragMMPerS : 0.0);
+    if ((Speed == 0.0) && (fabs(Drive) <= pCond->DragMMPerS))
+    {
+      Drag = Drive;
+    }
+    Speed += (Drive - Drag - Speed)/(MotorTauS*ModelRateHz);
+    Position += Speed/ModelRateHz;
+
+    if ((Result.RiseS < 0.0) && (Sign*Speed >= 0.9*Sign*Target))
+    {
+      Result.RiseS = (double)n/ModelRateHz;
+    }
+    if (Sign*Speed > Peak)
+    {
+      Peak = Sign*Speed;
+    }
+  }
+  Result.Settled = SettledSum/SettledSteps;
+  Result.OvershootPercent = (Peak > Sign*Target) ? 100.0*(Peak - Sign*Target)/(Sign*Target) : 0.0;
+  return Result;
+}
+
+int main( void )
+{
+  WheelGains_t OpenLoop = WheelDefaultGains;
+  unsigned Cond, Run;
+  int Failures = 0;
+
+  // the feed forward alone is the open loop duty for the speed
+  OpenLoop.Kp = 0;
+  OpenLoop.Ki = 0;
+  OpenLoop.IntegralLimit = 0;
+
+  printf("%-28s %6s | %8s | %8s %7s %6s\n", "", "target", "open", "closed", "90% in", "over");
+  for (Cond = 0; Cond < sizeof(Conditions)/sizeof(Conditions[0]); Cond++)
+  {
+    for (Run = 0; Run < sizeof(Targets)/sizeof(Targets[0]); Run++)
+    {
+      Response_t Open = RunWheel(&OpenLoop, &Conditions[Cond], Targets[Run]);
+      Response_t Closed = RunWheel(&WheelDefaultGains, &Conditions[Cond], Targets[Run]);
+      bool Pass = (fabs(Closed.Settled - Targets[Run]) <= SpeedTolerance*abs(Targets[Run])) &&
+                  (Closed.OvershootPercent <= MaxOvershoot) && (Closed.RiseS >= 0.0);
+
+      printf("%-28s %6ld | %8.1f | %8.1f %5.0fmS %5.1f%%%s\n",
+             (Run == 0) ? Conditions[Cond].pName : "", (long)Targets[Run],
+             Open.Settled, Closed.Settled, Closed.RiseS*1000.0, Closed.OvershootPercent,
+             Pass ? "" : "  FAIL");
+      Failures += !Pass;
+    }
+  }
+  printf("%s\n", Failures ? "FAILED" : "passed");
+  return Failures ? 1 : 0;
+}
+#endif /* TEST */
@@ -0,0 +1,349 @@
+/****************************************************************************
+WireFollowModule
+	Follows the wire from Timer2A at WIRE_FOLLOW_RATE_HZ. Every tick reads
+	the filtered left and right RLC sensors and runs a fixed-point PID on
+	their difference, which steers the two wheels around the target speed.
+	The state machines only set the speed and turn the loop on and off.
+
+ Notes
+	Error and outputs are Q15 fractions of full scale: the error of a whole
+	ADC range, the command of 100% duty. Gains are Q16, in full scale out per
+	full scale in, and each product goes through a 64 bit SMLAL
+	(DSP_MulAcc64). GAIN() converts from the duty percent per ADC count the
+	old 50Hz PD loop was tuned in.
+	While a wheel command is clamped the integral may only shrink
+	(conditional integration), and it always stays inside IntegralLimit.
+	Each wheel's command moves at most MaxDutyStep a tick, so a step in the
+	error or the speed becomes a ramp instead of a jolt on the gearbox.
+	The gains are scheduled on the target speed: faster means less P and
+	more D. At 70% they give the tuned PD (P 0.15, D 0.1 per 20mS, so 2.0
+	per mS) plus a little I for the offset between the two sensors.
+	The readings are fresh every 0.8mS, see ADMulti.c, and don't go to the
+	input recorder: the wheel commands are no input to the state machines.
+	Timing: every tick keeps how late after the timeout the ISR started
+	(Timer2A's count) and the cycles it took; WireFollow_PrintStats ('w' on
+	the console) prints the spread of the start, which is the loop's jitter,
+	and its CPU load.
+****************************************************************************/
+
+/*----------------------------- Include Files -----------------------------*/
+#include <stdio.h>
+#include "ES_Configure.h"
+#include "ES_Framework.h"
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "inc/hw_sysctl.h"
+#include "inc/hw_timer.h"
+#include "inc/hw_nvic.h"
+
+#include "ES_Port.h"
+#include "BITDEFS.H"
+
+#include "WireFollowModule.h"
+#include "WireSensingModule.h"
+#include "MotorActionsModule.h"
+#include "DSP_Intrinsics.h"
+
+/*----------------------------- Module Defines ----------------------------*/
+#define TicksPerSecond 40000000
+#define TicksPerUS 40
+#define TicksPerControlTick (TicksPerSecond/WIRE_FOLLOW_RATE_HZ)
+// Timer 2A is interrupt 23
+#define Timer2AIntBit BIT23HI
+
+#define FORWARD 1
+#define FullScaleReading 4095
+#define ReadingToQ15Shift 3
+#define Q15One 32768
+#define GainShift 16
+// from duty % per ADC count
+#define GAIN(PercentPerCount) ((int32_t)((PercentPerCount)*FullScaleReading/100.0*(1 << GainShift)))
+#define PERCENT_Q15(Percent) ((int32_t)(Percent)*Q15One/100)
+
+#define IntegralLimit PERCENT_Q15(20)
+#define MaxDutyStep PERCENT_Q15(2)
+
+typedef struct
+{
+  uint8_t MaxSpeed;                    // duty %, the set is for speeds up to this
+  int32_t Kp, Ki, Kd;
+} GainSet_t;
+
+typedef struct
+{
+  uint32_t Count;
+  uint32_t TotalCycles;
+  uint32_t MaxCycles;
+  uint32_t MinLatency;
+  uint32_t MaxLatency;
+} LoopStats_t;
+
+/*---------------------------- Module Functions ---------------------------*/
+static int32_t Clamp( int32_t Value, int32_t Min, int32_t Max );
+static int32_t SlewTo( int32_t Last, int32_t Target );
+static int32_t Magnitude( int32_t Value );
+static uint8_t Q15ToPercent( int32_t Value );
+
+/*---------------------------- Module Variables ---------------------------*/
+static const GainSet_t GainSchedule[] =
+{
+  {  50, GAIN(0.18), GAIN(0.0005), GAIN(1.5) },
+  {  75, GAIN(0.15), GAIN(0.0005), GAIN(2.0) },
+  { 100, GAIN(0.12), GAIN(0.0003), GAIN(2.5) },
+};
+
+static volatile bool Running;
+static const GainSet_t *pGains = &GainSchedule[1];
+static int32_t BaseCommand;
+static int32_t Integral;
+static int32_t LastError;
+static bool FirstTick;
+static int32_t LeftCommand, RightCommand;
+static uint8_t LeftDuty, RightDuty;
+static volatile LoopStats_t Stats;
+
+/*------------------------------ Module Code ------------------------------*/
+/****************************************************************************
+ Function
+    InitWireFollow
+
+ Description
+    Sets Timer2A up as a periodic WIRE_FOLLOW_RATE_HZ interrupt, left
+    stopped until EnableWireFollow
+****************************************************************************/
+void InitWireFollow( void )
+{
+  _HW_CycleCounterInit();
+
+  // enable the clock to Timer2 and wait for it to be ready
+  HWREG(SYSCTL_RCGCTIMER) |= SYSCTL_RCGCTIMER_R2;
+  while ((HWREG(SYSCTL_PRTIMER) & SYSCTL_PRTIMER_R2) != SYSCTL_PRTIMER_R2)
+    ;
+
+  // 32 bit periodic timer A, interrupt on timeout
+  HWREG(TIMER2_BASE + TIMER_O_CTL) &= ~TIMER_CTL_TAEN;
+  HWREG(TIMER2_BASE + TIMER_O_CFG) = TIMER_CFG_32_BIT_TIMER;
+  HWREG(TIMER2_BASE + TIMER_O_TAMR) =
+    (HWREG(TIMER2_BASE + TIMER_O_TAMR) & ~TIMER_TAMR_TAMR_M) | TIMER_TAMR_TAMR_PERIOD;
+  HWREG(TIMER2_BASE + TIMER_O_TAILR) = TicksPerControlTick - 1;
+  HWREG(TIMER2_BASE + TIMER_O_IMR) |= TIMER_IMR_TATOIM;
+
+  // enable Timer2A's interrupt in the NVIC
+  HWREG(NVIC_EN0) |= Timer2AIntBit;
+
+  // make sure interrupts are enabled globally
+  __enable_irq();
+}
+
+/****************************************************************************
+ Function
+    EnableWireFollow
+
+ Description
+    Starts the loop from a clean state, wheels ramping up from stopped, or
+    stops it. Stopping leaves the wheels on the last command; no tick runs
+    after this returns, so a stop() or other drive call right after sticks.
+****************************************************************************/
+void EnableWireFollow( bool Enable )
+{
+  if (Enable)
+  {
+    HWREG(TIMER2_BASE + TIMER_O_CTL) &= ~TIMER_CTL_TAEN;
+    Integral = 0;
+    FirstTick = true;
+    LeftCommand = 0;
+    RightCommand = 0;
+    LeftDuty = 0;
+    RightDuty = 0;
+    Running = true;
+    HWREG(TIMER2_BASE + TIMER_O_TAV) = TicksPerControlTick - 1;
+    HWREG(TIMER2_BASE + TIMER_O_ICR) = TIMER_ICR_TATOCINT;
+    HWREG(TIMER2_BASE + TIMER_O_CTL) |= (TIMER_CTL_TAEN | TIMER_CTL_TASTALL);
+  }
+  else
+  {
+    // a tick already pending sees Running false and does nothing
+    Running = false;
+    HWREG(TIMER2_BASE + TIMER_O_CTL) &= ~TIMER_CTL_TAEN;
+    HWREG(TIMER2_BASE + TIMER_O_ICR) = TIMER_ICR_TATOCINT;
+  }
+}
+
+/****************************************************************************
+ Function
+    SetWireFollowSpeed
+
+ Parameters
+    uint8_t : duty cycle both wheels run at when centered on the wire
+
+ Description
+    Takes effect on the next tick, through the wheels' slew limit, and
+    picks the gains for the speed
+****************************************************************************/
+void SetWireFollowSpeed( uint8_t DutyCycle )
+{
+  const GainSet_t *pSet = &GainSchedule[0];
+
+  if (DutyCycle > 100)
+  {
+    DutyCycle = 100;
+  }
+  while (pSet->MaxSpeed < DutyCycle)
+  {
+    pSet++;
+  }
+
+  EnterCritical();
+  BaseCommand = PERCENT_Q15(DutyCycle);
+  pGains = pSet;
+  ExitCritical();
+}
+
+/****************************************************************************
+ Function
+    WireFollowControlISR
+
+ Description
+    Timer2A timeout: one PID step and the wheel commands that follow
+****************************************************************************/
+void WireFollowControlISR( void )
+{
+  uint32_t Start = _HW_GetCycleCount();
+  uint32_t Latency = TicksPerControlTick - 1 - HWREG(TIMER2_BASE + TIMER_O_TAV);
+  int RLCReading[2];
+  int32_t Error, Proportional, Derivative, NewIntegral;
+  int32_t Steer, Left, Right;
+  bool Clamped;
+  uint8_t NewLeftDuty, NewRightDuty;
+  uint32_t Cycles;
+
+  // clear the source of the interrupt
+  HWREG(TIMER2_BASE + TIMER_O_ICR) = TIMER_ICR_TATOCINT;
+  if (!Running)
+  {
+    return;
+  }
+
+  // positive when too far left (right sensor higher)
+  PeekRLCSensor(RLCReading);
+  Error = (RLCReading[1] - RLCReading[0]) << ReadingToQ15Shift;
+  if (FirstTick)
+  {
+    LastError = Error;
+    FirstTick = false;
+  }
+
+  Proportional = (int32_t)(DSP_MulAcc64(0, pGains->Kp, Error) >> GainShift);
+  Derivative = (int32_t)(DSP_MulAcc64(0, pGains->Kd, Error - LastError) >> GainShift);
+  NewIntegral = Clamp(Integral + (int32_t)(DSP_MulAcc64(0, pGains->Ki, Error) >> GainShift),
+                      -IntegralLimit, IntegralLimit);
+  LastError = Error;
+
+  Steer = Clamp(Proportional + Derivative + NewIntegral, -Q15One, Q15One);
+  Left = BaseCommand + Steer;
+  Right = BaseCommand - Steer;
+
+  // anti-windup: with a wheel pinned the integral can only unwind
+  Clamped = (Left > Q15One) || (Left < 0) || (Right > Q15One) || (Right < 0);
+  if (!Clamped || (Magnitude(NewIntegral) < Magnitude(Integral)))
+  {
+    Integral = NewIntegral;
+  }
+
+  LeftCommand = SlewTo(LeftCommand, Clamp(Left, 0, Q15One));
+  RightCommand = SlewTo(RightCommand, Clamp(Right, 0, Q15One));
+
+  // the PWM only gets written when a duty actually changes
+  NewLeftDuty = Q15ToPercent(LeftCommand);
+  NewRightDuty = Q15ToPercent(RightCommand);
+  if ((NewLeftDuty != LeftDuty) || (NewRightDuty != RightDuty))
+  {
+    LeftDuty = NewLeftDuty;
+    RightDuty = NewRightDuty;
+    driveSeperate(LeftDuty, RightDuty, FORWARD);
+  }
+
+  Cycles = _HW_GetCycleCount() - Start;
+  if (Stats.Count == 0)
+  {
+    Stats.MinLatency = Latency;
+    Stats.MaxLatency = Latency;
+  }
+  else if (Latency < Stats.MinLatency)
+  {
+    Stats.MinLatency = Latency;
+  }
+  else if (Latency > Stats.MaxLatency)
+  {
+    Stats.MaxLatency = Latency;
+  }
+  Stats.Count++;
+  Stats.TotalCycles += Cycles;
+  if (Cycles > Stats.MaxCycles)
+  {
+    Stats.MaxCycles = Cycles;
+  }
+}
+
+/****************************************************************************
+ Function
+    WireFollow_PrintStats
+
+ Description
+    Console dump of the loop timing since the last dump, then starts it
+    over: ticks, cycles per tick, the CPU load in hundredths of a percent
+    and how late after the timeout the ticks started, in uS. The spread of
+    the start (Max-Min) is the loop's jitter.
+****************************************************************************/
+void WireFollow_PrintStats( void )
+{
+  LoopStats_t Last;
+  uint32_t Load;
+
+  EnterCritical();
+  Last = Stats;
+  Stats.Count = 0;
+  Stats.TotalCycles = 0;
+  Stats.MaxCycles = 0;
+  ExitCritical();
+
+  // a tick is TicksPerControlTick cycles long, load in 0.01%
+  Load = Last.Count ? (uint32_t)((uint64_t)Last.TotalCycles*10000/((uint64_t)Last.Count*TicksPerControlTick)) : 0;
+  printf("\r\nWire follow %s, speed %lu%%, duty L %u R %u, error %ld\r\n",
+         Running ? "on" : "off", (unsigned long)Q15ToPercent(BaseCommand),
+         LeftDuty, RightDuty, (long)(LastError >> ReadingToQ15Shift));
+  printf("%lu ticks, cycles avg %lu max %lu, load %lu.%02lu%%, start %lu.%02lu-%lu.%02luuS late\r\n",
+         (unsigned long)Last.Count,
+         (unsigned long)(Last.Count ? Last.TotalCycles/Last.Count : 0),
+         (unsigned long)Last.MaxCycles,
+         (unsigned long)(Load/100), (unsigned long)(Load%100),
+         (unsigned long)(Last.MinLatency/TicksPerUS), (unsigned long)(Last.MinLatency%TicksPerUS*100/TicksPerUS),
+         (unsigned long)(Last.MaxLatency/TicksPerUS), (unsigned long)(Last.MaxLatency%TicksPerUS*100/TicksPerUS));
+}
+
+/***************************************************************************
+ private functions
+ ***************************************************************************/
+static int32_t Clamp( int32_t Value, int32_t Min, int32_t Max )
+{
+  return (Value < Min) ? Min : ((Value > Max) ? Max : Value);
+}
+
+static int32_t Magnitude( int32_t Value )
+{
+  return (Value < 0) ? -Value : Value;
+}
+
+/***************************************************************************
+  SlewTo
+    Last moved toward Target by no more than MaxDutyStep
+ ***************************************************************************/
+static int32_t SlewTo( int32_t Last, int32_t Target )
+{
+  return Clamp(Target, Last - MaxDutyStep, Last + MaxDutyStep);
+}
+
+static uint8_t Q15ToPercent( int32_t Value )
+{
+  return (uint8_t)((Value*100 + Q15One/2) >> 15);
+}
@@ -1,6 +1,10 @@
 /****************************************************************************
 WireSensingModule
 	Define functions for Wire Sensing from 2 RLC circuit
+	Both sensors are filtered at the 10kHz ADC sample rate: a median of 3
+	takes out single sample spikes, an average of 8 the ripple of the tank,
+	then a 200Hz Butterworth lowpass, so the readings are smooth enough to
+	take the PD derivative from.
  
 Events to receive:
 					None
@@ -21,6 +25,7 @@ Events to post:
 #include "inc/hw_timer.h"
 #include "inc/hw_nvic.h"
 #include "ADMulti.h"
+#include "DSPFilters.h"
 
 #include "MotorActionsModule.h"
 #include "HallEffectModule.h"
@@ -30,7 +35,17 @@ Events to post:
 #define ALL_BITS (0xff<<2)
 #define TicksPerMS 40000
 #define BitsPerNibble 4
+#define SpikeMedianLength 3
+#define RippleAverageShift 3     // 8 samples
+#define MaxReading 4095
+/*---------------------------- Module Functions ---------------------------*/
+static void FilterRLCRun(uint32_t Run[ADC_STEPS_PER_RUN]);
 /*---------------------------- Module Variables ---------------------------*/
+// Butterworth, 200Hz at 10kHz, Q14: DC gain is exactly 1
+static const BiquadCoeffs_t RLCLowpass = { 59, 119, 59, -29863, 13716 };
+static Median2_t RLCMedian;
+static MovingAverage2_t RLCAverage;
+static Biquad2_t RLCBiquad;
 
 
 /*------------------------------ Module Code ------------------------------*/
@@ -54,8 +69,13 @@ Events to post:
 void InitRLCSensor( void )
 {
 	
-	//Enable PE0 and PE1 for analog input
-	ADC_MultiInit(2);
+	Median2_Init(&RLCMedian, SpikeMedianLength);
+	MovingAverage2_Init(&RLCAverage, RippleAverageShift);
+	Biquad2_Init(&RLCBiquad, &RLCLowpass);
+	ADC_MultiSetRunFilter(FilterRLCRun);
+
+	//Enable PE0 and PE1 for analog input, and PE2 for the battery
+	ADC_MultiInit(ADC_NUM_CHANNELS);
 
 }
 
@@ -77,3 +97,47 @@ void ReadRLCSensor(int RLCReading[2])
 	RLCReading[0] = CurrentADRead[0];
 	RLCReading[1] = CurrentADRead[1];
 }
+
+/****************************************************************************
+ Function
+     PeekRLCSensor
+
+ Description
+     ReadRLCSensor for the wire follow control interrupt, the readings
+     don't go to the input recorder
+
+****************************************************************************/
+void PeekRLCSensor(int RLCReading[2])
+{
+	uint32_t CurrentADRead[4];
+
+	ADC_MultiPeek(CurrentADRead);
+
+	RLCReading[0] = CurrentADRead[0];
+	RLCReading[1] = CurrentADRead[1];
+}
+
+/****************************************************************************
+ Function
+     FilterRLCRun
+
+ Description
+     ADC run filter, one sample of both sensors through the filter chain;
+     leaves the filtered readings, back in ADC counts, in the run
+
+****************************************************************************/
+static void FilterRLCRun(uint32_t Run[ADC_STEPS_PER_RUN])
+{
+	uint32_t Pair = FILTER_PAIR(Run[0] << FILTER_ADC_SHIFT, Run[1] << FILTER_ADC_SHIFT);
+	int32_t Left, Right;
+
+	Pair = Median2_Step(&RLCMedian, Pair);
+	Pair = MovingAverage2_Step(&RLCAverage, Pair);
+	Pair = Biquad2_Step(&RLCBiquad, Pair);
+
+	// the lowpass can overshoot a little past either end
+	Left = (FILTER_CH0(Pair) + (1 << (FILTER_ADC_SHIFT - 1))) >> FILTER_ADC_SHIFT;
+	Right = (FILTER_CH1(Pair) + (1 << (FILTER_ADC_SHIFT - 1))) >> FILTER_ADC_SHIFT;
+	Run[0] = (Left < 0) ? 0 : ((Left > MaxReading) ? MaxReading : Left);
+	Run[1] = (Right < 0) ? 0 : ((Right > MaxReading) ? MaxReading : Right);
+}
@@ -38,3 +38,28 @@ void _sys_exit(int return_code) {
 	label: goto label; /* Forever loop */
 }
 #endif
+
+#if defined(gcc)
+/* newlib (QEMU build) ends up in these for stdin/stdout */
+extern void TERMIO_PutChar(unsigned char ch);
+extern unsigned char TERMIO_GetChar(void);
+
+int _write(int file, char *ptr, int len) {
+	int i;
+	for (i = 0; i < len; i++)
+		TERMIO_PutChar(ptr[i]);
+	return len;
+}
+
+int _read(int file, char *ptr, int len) {
+	if (len == 0)
+		return 0;
+	*ptr = (char)TERMIO_GetChar();
+	return 1;
+}
+
+/* keeps stdout line buffered instead of held until the buffer fills */
+int _isatty(int file) {
+	return 1;
+}
+#endif
@@ -0,0 +1,396 @@
+#!/usr/bin/env python3
+"""
+ Module
+   StatechartGen.py
+
+ Description
+   Statechart compiler for the Events and Services Framework Gen2.
+   Reads a compact YAML description of one level of a hierarchical state
+   machine and emits:
+     Headers/<Module>_States.h   state enum used by the Query function
+     Source/<Module>_Gen.c       const transition table plus the Run, Start
+                                 and Query functions (RunFunc interface)
+     Tools/Statecharts/<Module>.dot   Graphviz diagram of the machine
+
+   The transition table is sized [NUM_<MACHINE>_STATES][NUM_ES_EVENTS] so
+   that dispatch is a single indexed load on (CurrentState, EventType). Only
+   the transitions are written out, as designated initializers by state and
+   event name; every other entry is zero, SC_NO_TRANSITION. Adding an event
+   to Headers/ES_Configure.h therefore needs no regeneration; the event list
+   is only read to check the spec's event names.
+
+   The During functions stay hand written in <Module>.c, which exports them
+   in state order through <Machine>DuringFuncs[].
+
+ Spec format (a small subset of YAML, see Tools/Statecharts/*.yaml)
+   machine: Reloading            prefix used for Run/Start/Query<machine>SM
+   module: ReloadingSubSM        file name stem of the hand written module
+   initial: REQUESTING_BALL
+   states:
+     - REQUESTING_BALL: DuringRequestingBall
+     - WAITING4BALL: DuringWaiting4Ball
+   transitions:
+     - {from: REQUESTING_BALL, event: IR_PULSES_DONE, to: WAITING4BALL}
+     - {from: WAITING4BALL, event: RELOAD_BALLS, to: REQUESTING_BALL}
+   Optional transition keys:
+     param: X           taken only when EventParam is X (timer number)
+     internal: true     consume the event but do not exit/enter
+     history: true      enter the target with ES_ENTRY_HISTORY
+     consume: false     pass the event up to the calling machine
+   Optional top level key:
+     profile: PROF_RELOADING   report transitions to SMProfiler
+
+ Usage
+   python3 Tools/StatechartGen.py Tools/Statecharts/ReloadingSubSM.yaml
+"""
+
+import os
+import re
+import sys
+
+ROOT = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+CONFIGURE_H = os.path.join(ROOT, 'Headers', 'ES_Configure.h')
+
+
+class SpecError(Exception):
+    pass
+
+
+def parse_scalar(text):
+    text = text.strip()
+    if len(text) >= 2 and text[0] == text[-1] and text[0] in '"\'':
+        return text[1:-1]
+    if text in ('true', 'True', 'yes'):
+        return True
+    if text in ('false', 'False', 'no'):
+        return False
+    return text
+
+
+def parse_flow_map(text, lineno):
+    body = text.strip()
+    if not (body.startswith('{') and body.endswith('}')):
+        raise SpecError('line %d: expected {key: value, ...}' % lineno)
+    result = {}
+    for item in body[1:-1].split(','):
+        if not item.strip():
+            continue
+        if ':' not in item:
+            raise SpecError('line %d: bad entry "%s"' % (lineno, item.strip()))
+        key, value = item.split(':', 1)
+        result[key.strip()] = parse_scalar(value)
+    return result
+
+
+def parse_spec(path):
+    """Parse the YAML subset used by the statechart specs."""
+    spec = {}
+    current_list = None
+    with open(path) as f:
+        for lineno, raw in enumerate(f, 1):
+            line = raw.split('#', 1)[0].rstrip()
+            if not line.strip():
+                continue
+            if not line[0].isspace():
+                if ':' not in line:
+                    raise SpecError('line %d: expected "key: value"' % lineno)
+                key, value = line.split(':', 1)
+                key = key.strip()
+                if value.strip():
+                    spec[key] = parse_scalar(value)
+                    current_list = None
+                else:
+                    spec[key] = []
+                    current_list = spec[key]
+                continue
+            item = line.strip()
+            if not item.startswith('-') or current_list is None:
+                raise SpecError('line %d: unexpected indented text' % lineno)
+            item = item[1:].strip()
+            if item.startswith('{'):
+                current_list.append(parse_flow_map(item, lineno))
+            elif ':' in item:
+                key, value = item.split(':', 1)
+                current_list.append({key.strip(): parse_scalar(value)})
+            else:
+                current_list.append(parse_scalar(item))
+    return spec
+
+
+def read_event_list(path):
+    """Return the ES_EventTyp_t enumerators in declaration order."""
+    with open(path) as f:
+        text = f.read()
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    text = re.sub(r'//[^\n]*', '', text)
+    m = re.search(r'typedef\s+enum\s*\{(.*?)\}\s*ES_EventTyp_t\s*;', text, re.S)
+    if not m:
+        raise SpecError('could not find ES_EventTyp_t in %s' % path)
+    events = []
+    for name in m.group(1).split(','):
+        name = name.split('=', 1)[0].strip()
+        if name:
+            events.append(name)
+    if not events or events[-1] != 'NUM_ES_EVENTS':
+        raise SpecError('ES_EventTyp_t must end with NUM_ES_EVENTS')
+    return events[:-1]
+
+
+def build_machine(spec, events):
+    for key in ('machine', 'module', 'initial', 'states', 'transitions'):
+        if key not in spec:
+            raise SpecError('spec is missing "%s"' % key)
+    states = []
+    during = {}
+    for entry in spec['states']:
+        if not isinstance(entry, dict) or len(entry) != 1:
+            raise SpecError('states must be "- STATE: DuringFunction"')
+        (name, func), = entry.items()
+        states.append(name)
+        during[name] = func
+    if spec['initial'] not in states:
+        raise SpecError('initial state %s is not in states' % spec['initial'])
+
+    table = {}
+    for t in spec['transitions']:
+        for key in ('from', 'event', 'to'):
+            if key not in t:
+                raise SpecError('transition %r is missing "%s"' % (t, key))
+        if t['from'] not in states or t['to'] not in states:
+            raise SpecError('transition %r names an unknown state' % t)
+        if t['event'] not in events:
+            raise SpecError('transition %r names an unknown event' % t)
+        cell = (t['from'], t['event'])
+        if cell in table:
+            raise SpecError('two transitions leave %s on %s; fold the second into a '
+                            'During function or split the event' % cell)
+        table[cell] = t
+    return states, during, table
+
+
+def flags_for(t):
+    flags = ['SC_TAKEN']
+    if t.get('internal'):
+        flags.append('SC_INTERNAL')
+    if t.get('history'):
+        flags.append('SC_HISTORY')
+    if t.get('consume', True) is False:
+        flags.append('SC_PASS')
+    if 'param' in t:
+        flags.append('SC_GUARDED')
+    return '|'.join(flags)
+
+
+def emit_states_header(spec, states):
+    machine = spec['machine']
+    guard = '%s_States_H' % spec['module']
+    lines = [
+        '/****************************************************************************',
+        ' %s_States.h' % spec['module'],
+        ' GENERATED by Tools/StatechartGen.py from %s.yaml -- do not edit' % spec['module'],
+        ' ****************************************************************************/',
+        '',
+        '#ifndef %s' % guard,
+        '#define %s' % guard,
+        '',
+        '// State definitions for use with the query function',
+        'typedef enum { %s } %sState_t;' % (', '.join(states), machine),
+        '',
+        '#define NUM_%s_STATES %d' % (machine.upper(), len(states)),
+        '',
+        '#endif /* %s */' % guard,
+        '',
+    ]
+    return '\n'.join(lines)
+
+
+def emit_source(spec, states, table, events):
+    machine = spec['machine']
+    module = spec['module']
+    num_states = 'NUM_%s_STATES' % machine.upper()
+    out = []
+    w = out.append
+    w('/****************************************************************************')
+    w(' Module')
+    w('   %s_Gen.c' % module)
+    w('')
+    w(' Description')
+    w('   Transition table and Run/Start/Query functions for the %s state' % machine)
+    w('   machine. GENERATED by Tools/StatechartGen.py from')
+    w('   Tools/Statecharts/%s.yaml -- edit the spec and regenerate.' % module)
+    w('****************************************************************************/')
+    w('/*----------------------------- Include Files -----------------------------*/')
+    w('#include "ES_Configure.h"')
+    w('#include "ES_Framework.h"')
+    w('#include "ES_Statechart.h"')
+    w('#include "%s.h"' % module)
+    if 'profile' in spec:
+        w('#include "SMProfiler.h"')
+    w('')
+    w('/*---------------------------- Module Functions ---------------------------*/')
+    w('// During functions in %sState_t order, supplied by %s.c' % (machine, module))
+    w('extern const ES_SCDuring_t %sDuringFuncs[%s];' % (machine, num_states))
+    w('')
+    w('/*---------------------------- Module Variables ---------------------------*/')
+    w('static %sState_t CurrentState;' % machine)
+    w('')
+    w('// entries left out are SC_NO_TRANSITION')
+    w('static const ES_SCTransition_t TransitionTable[%s][NUM_ES_EVENTS] =' % num_states)
+    w('{')
+    cells = [(state, event) for state in states for event in events
+             if (state, event) in table]
+    for index, (state, event) in enumerate(cells):
+        t = table[(state, event)]
+        param = t.get('param', '0')
+        sep = ',' if index < len(cells) - 1 else ''
+        w('  [%s][%s] = { %s, %s, %s }%s' % (state, event, t['to'], flags_for(t), param, sep))
+    w('};')
+    w('')
+    w('/*------------------------------ Module Code ------------------------------*/')
+    w('/****************************************************************************')
+    w(' Function')
+    w('    Run%sSM' % machine)
+    w('')
+    w(' Description')
+    w('   Runs the During function for the current state, then looks up')
+    w('   (CurrentState, EventType) in the transition table')
+    w('****************************************************************************/')
+    w('ES_Event Run%sSM( ES_Event CurrentEvent )' % machine)
+    w('{')
+    w('   const ES_SCTransition_t *pTransition;')
+    w('   ES_Event EntryEventKind = { ES_ENTRY, 0 };// default to normal entry to new state')
+    w('   ES_Event ReturnEvent = CurrentEvent; // assume we are not consuming event')
+    w('')
+    w('   CurrentEvent = %sDuringFuncs[CurrentState](CurrentEvent);' % machine)
+    w('   if ( CurrentEvent.EventType == ES_NO_EVENT )')
+    w('   {  // consumed by a lower level machine')
+    w('      return(CurrentEvent);')
+    w('   }')
+    w('')
+    w('   pTransition = &TransitionTable[CurrentState][CurrentEvent.EventType];')
+    w('   if ( ((pTransition->Flags & SC_TAKEN) == 0) ||')
+    w('        (((pTransition->Flags & SC_GUARDED) != 0) &&')
+    w('         (pTransition->Param != CurrentEvent.EventParam)) )')
+    w('   {')
+    w('      return(ReturnEvent);')
+    w('   }')
+    w('')
+    w('   if ( (pTransition->Flags & SC_PASS) == 0 )')
+    w('   {')
+    w('      ReturnEvent.EventType = ES_NO_EVENT; // consume for the upper level state machine')
+    w('   }')
+    w('   if ( (pTransition->Flags & SC_INTERNAL) == 0 )')
+    w('   {')
+    if 'profile' in spec:
+        w('      SMProf_Transition(%s, CurrentState, pTransition->NextState, CurrentEvent.EventType);'
+          % spec['profile'])
+    w('      //   Execute exit function for current state')
+    w('      CurrentEvent.EventType = ES_EXIT;')
+    w('      Run%sSM(CurrentEvent);' % machine)
+    w('')
+    w('      CurrentState = (%sState_t)pTransition->NextState; //Modify state variable' % machine)
+    w('')
+    w('      //   Execute entry function for new state')
+    w('      if ( (pTransition->Flags & SC_HISTORY) != 0 )')
+    w('      {')
+    w('         EntryEventKind.EventType = ES_ENTRY_HISTORY;')
+    w('      }')
+    w('      Run%sSM(EntryEventKind);' % machine)
+    w('   }')
+    w('   return(ReturnEvent);')
+    w('}')
+    w('')
+    w('/****************************************************************************')
+    w(' Function')
+    w('     Start%sSM' % machine)
+    w('')
+    w(' Description')
+    w('     Enters %s unless asked for a history entry' % spec['initial'])
+    w('****************************************************************************/')
+    w('void Start%sSM ( ES_Event CurrentEvent )' % machine)
+    w('{')
+    w('   if ( ES_ENTRY_HISTORY != CurrentEvent.EventType )')
+    w('   {')
+    w('      CurrentState = %s;' % spec['initial'])
+    w('   }')
+    if 'profile' in spec:
+        w('   SMProf_Enter(%s, CurrentState);' % spec['profile'])
+    w('   // call the entry function (if any) for the ENTRY_STATE')
+    w('   Run%sSM(CurrentEvent);' % machine)
+    w('}')
+    w('')
+    w('/****************************************************************************')
+    w(' Function')
+    w('     Query%sSM' % machine)
+    w('')
+    w(' Description')
+    w('     Returns the current state of this state machine')
+    w('****************************************************************************/')
+    w('%sState_t Query%sSM ( void )' % (machine, machine))
+    w('{')
+    w('   return(CurrentState);')
+    w('}')
+    w('')
+    return '\n'.join(out)
+
+
+def emit_dot(spec, states, table):
+    out = ['// GENERATED by Tools/StatechartGen.py from %s.yaml' % spec['module'],
+           'digraph %s {' % spec['machine'],
+           '  rankdir=LR;',
+           '  node [shape=box, style=rounded];',
+           '  __initial [shape=point, label=""];',
+           '  __initial -> %s;' % spec['initial']]
+    for state in states:
+        out.append('  %s;' % state)
+    for (state, event), t in sorted(table.items(), key=lambda kv: states.index(kv[0][0])):
+        label = event if 'param' not in t else '%s(%s)' % (event, t['param'])
+        attrs = ['label="%s"' % label]
+        if t.get('internal'):
+            attrs.append('style=dashed')
+        if t.get('history'):
+            attrs.append('arrowhead=odiamond')
+        out.append('  %s -> %s [%s];' % (t['from'], t['to'], ', '.join(attrs)))
+    out.append('}')
+    out.append('')
+    return '\n'.join(out)
+
+
+def write_if_changed(path, text, newline):
+    text = text.replace('\n', newline)
+    try:
+        with open(path, 'rb') as f:
+            if f.read() == text.encode():
+                return
+    except IOError:
+        pass
+    with open(path, 'wb') as f:
+        f.write(text.encode())
+    print('wrote %s' % os.path.relpath(path, ROOT))
+
+
+def main(argv):
+    if len(argv) < 2:
+        print('usage: %s spec.yaml [spec.yaml ...]' % argv[0])
+        return 2
+    try:
+        events = read_event_list(CONFIGURE_H)
+        for spec_path in argv[1:]:
+            spec = parse_spec(spec_path)
+            states, _, table = build_machine(spec, events)
+            module = spec['module']
+            write_if_changed(os.path.join(ROOT, 'Headers', '%s_States.h' % module),
+                             emit_states_header(spec, states), '\n')
+            write_if_changed(os.path.join(ROOT, 'Source', '%s_Gen.c' % module),
+                             emit_source(spec, states, table, events), '\n')
+            write_if_changed(os.path.join(os.path.dirname(os.path.abspath(spec_path)),
+                                          '%s.dot' % module),
+                             emit_dot(spec, states, table), '\n')
+    except SpecError as e:
+        print('%s: %s' % (argv[0], e))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))